@@ -0,0 +1,119 @@
+#include "AAQualityProbe.h"
+#include "CommandStats.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace jhb {
+	AAQualityProbe::AAQualityProbe(Device& device) : device{ device }
+	{
+	}
+
+	void AAQualityProbe::start(VkExtent2D _extent)
+	{
+		if (readbackBuffer == nullptr || extent.width != _extent.width || extent.height != _extent.height)
+		{
+			// nothing is in flight, previous capture waited queue
+			extent = _extent;
+			readbackBuffer = std::make_unique<Buffer>(device, 4, extent.width * extent.height, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			readbackBuffer->map();
+		}
+		reference.assign(static_cast<size_t>(extent.width) * extent.height * 3, 0.f);
+		phase = Phase::Reference;
+		phaseFrame = 0;
+		captured = false;
+		resultValid = false;
+	}
+
+	void AAQualityProbe::cancel()
+	{
+		phase = Phase::Idle;
+		captured = false;
+		resultValid = false;
+	}
+
+	void AAQualityProbe::recordCapture(VkCommandBuffer cmd, VkImage image)
+	{
+		VkBufferImageCopy region{};
+		region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		region.imageExtent = { extent.width, extent.height, 1 };
+		vkCmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer->getBuffer(), 1, &region);
+
+		VkBufferMemoryBarrier bufferBarrier{};
+		bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.buffer = readbackBuffer->getBuffer();
+		bufferBarrier.size = VK_WHOLE_SIZE;
+		cmd::pipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+
+		captured = true;
+	}
+
+	void AAQualityProbe::endFrame()
+	{
+		if (phase == Phase::Idle)
+		{
+			return;
+		}
+
+		if (captured)
+		{
+			vkQueueWaitIdle(device.getGraphicsQueue());
+			captured = false;
+			auto pixels = static_cast<const uint8_t*>(readbackBuffer->getMappedMemory());
+			if (phase == Phase::Reference)
+			{
+				accumulateReference(pixels);
+			}
+			else
+			{
+				compareWithReference(pixels);
+				phase = Phase::Idle;
+				return;
+			}
+		}
+
+		phaseFrame++;
+		if (phase == Phase::Reference && phaseFrame == REFERENCE_FRAMES)
+		{
+			phase = Phase::Settle;
+			phaseFrame = 0;
+		}
+	}
+
+	void AAQualityProbe::accumulateReference(const uint8_t* pixels)
+	{
+		// 4 bytes per texel, bgra or rgba order doesn't matter for the difference, alpha is skipped
+		size_t texelCount = static_cast<size_t>(extent.width) * extent.height;
+		for (size_t i = 0; i < texelCount; i++)
+		{
+			reference[i * 3 + 0] += pixels[i * 4 + 0];
+			reference[i * 3 + 1] += pixels[i * 4 + 1];
+			reference[i * 3 + 2] += pixels[i * 4 + 2];
+		}
+	}
+
+	void AAQualityProbe::compareWithReference(const uint8_t* pixels)
+	{
+		size_t texelCount = static_cast<size_t>(extent.width) * extent.height;
+		double scale = 1.0 / (255.0 * REFERENCE_FRAMES);
+		double squaredError = 0.0;
+		for (size_t i = 0; i < texelCount; i++)
+		{
+			for (size_t c = 0; c < 3; c++)
+			{
+				double diff = pixels[i * 4 + c] / 255.0 - reference[i * 3 + c] * scale;
+				squaredError += diff * diff;
+			}
+		}
+
+		result.rmse = std::sqrt(squaredError / (texelCount * 3));
+		// identical images would be infinite, clamp to 8 bit quantization
+		result.psnr = 20.0 * std::log10(1.0 / std::max(result.rmse, 1.0 / 255.0));
+		resultValid = true;
+	}
+}
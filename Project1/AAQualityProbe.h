@@ -0,0 +1,72 @@
+#pragma once
+#include "Buffer.h"
+
+#include <memory>
+#include <vector>
+
+namespace jhb {
+	// objective quality of current anti aliasing mode. reference is the average of many jittered frames of a still camera,
+	// a box filtered supersample of that view. then the mode renders same view normally and its swapchain image is compared by rmse and psnr.
+	// every captured frame waits queue idle, it's a measurement and camera input is frozen while it runs
+	class AAQualityProbe
+	{
+	public:
+		// distinct jitter offsets, so samples per pixel of reference
+		static constexpr uint32_t REFERENCE_FRAMES = 64;
+		// taa history converges before measured frame
+		static constexpr uint32_t SETTLE_FRAMES = 32;
+
+		struct Result {
+			double rmse = 0.0; // 0 ~ 1 of 8 bit color
+			double psnr = 0.0; // db
+		};
+
+	public:
+		AAQualityProbe(Device& device);
+
+		AAQualityProbe(const AAQualityProbe&) = delete;
+		AAQualityProbe& operator=(const AAQualityProbe&) = delete;
+
+		void start(VkExtent2D extent);
+		// window resized or mode changed, result is not comparable anymore
+		void cancel();
+
+		bool isActive() const { return phase != Phase::Idle; }
+		// reference frames are rendered with jitter of getReferenceIndex and without taa history
+		bool isReferenceFrame() const { return phase == Phase::Reference; }
+		uint32_t getReferenceIndex() const { return phaseFrame; }
+		bool capturesFrame() const { return phase == Phase::Reference || (phase == Phase::Settle && phaseFrame == SETTLE_FRAMES); }
+
+		// swapchain image must be in transfer src layout
+		void recordCapture(VkCommandBuffer cmd, VkImage image);
+		// after submit, reads back captured frame and advances
+		void endFrame();
+
+		bool hasResult() const { return resultValid; }
+		const Result& getResult() const { return result; }
+
+	private:
+		enum class Phase {
+			Idle,
+			Reference,
+			Settle, // last settle frame is the measured one
+		};
+
+		void accumulateReference(const uint8_t* pixels);
+		void compareWithReference(const uint8_t* pixels);
+
+	private:
+		Device& device;
+		std::unique_ptr<Buffer> readbackBuffer;
+		VkExtent2D extent{};
+
+		Phase phase = Phase::Idle;
+		uint32_t phaseFrame = 0;
+		bool captured = false;
+
+		// rgb sum of reference frames, 0 ~ 255 per frame
+		std::vector<float> reference;
+		Result result{};
+		bool resultValid = false;
+	};
+}
@@ -0,0 +1,374 @@
+#include "AsyncComputeScheduler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+
+namespace jhb {
+	AsyncComputeScheduler::AsyncComputeScheduler(Device& device) : device{ device }
+	{
+		sharedFamily = device.getComputeQueueFamily() == device.getGraphicsQueueFamily();
+
+		commandBuffers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = device.getComputeCommandPool();
+		allocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+		if (vkAllocateCommandBuffers(device.getLogicalDevice(), &allocInfo, commandBuffers.data()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate compute command buffers!");
+		}
+
+		createSyncObjects();
+		createQueryPool();
+	}
+
+	AsyncComputeScheduler::~AsyncComputeScheduler()
+	{
+		vkFreeCommandBuffers(device.getLogicalDevice(), device.getComputeCommandPool(), static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+		vkDestroySemaphore(device.getLogicalDevice(), computeTimeline, nullptr);
+		vkDestroySemaphore(device.getLogicalDevice(), graphicsTimeline, nullptr);
+		if (queryPool != VK_NULL_HANDLE)
+		{
+			vkDestroyQueryPool(device.getLogicalDevice(), queryPool, nullptr);
+		}
+	}
+
+	void AsyncComputeScheduler::createSyncObjects()
+	{
+		VkSemaphoreTypeCreateInfo typeInfo{};
+		typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		typeInfo.initialValue = 0;
+
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphoreInfo.pNext = &typeInfo;
+
+		if (vkCreateSemaphore(device.getLogicalDevice(), &semaphoreInfo, nullptr, &computeTimeline) != VK_SUCCESS ||
+			vkCreateSemaphore(device.getLogicalDevice(), &semaphoreInfo, nullptr, &graphicsTimeline) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create timeline semaphore!");
+		}
+	}
+
+	void AsyncComputeScheduler::createQueryPool()
+	{
+		uint32_t queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(device.getPhysicalDevice(), &queueFamilyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(device.getPhysicalDevice(), &queueFamilyCount, queueFamilies.data());
+
+		// both queues need timestamps, values of different queues on same device share one clock
+		timestampsSupported = device.properties.limits.timestampPeriod > 0.f &&
+			queueFamilies[device.getGraphicsQueueFamily()].timestampValidBits > 0 &&
+			queueFamilies[device.getComputeQueueFamily()].timestampValidBits > 0;
+		if (!timestampsSupported)
+		{
+			return;
+		}
+
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = SwapChain::MAX_FRAMES_IN_FLIGHT * 4;
+		if (vkCreateQueryPool(device.getLogicalDevice(), &queryPoolInfo, nullptr, &queryPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create query pool!");
+		}
+		vkResetQueryPool(device.getLogicalDevice(), queryPool, 0, queryPoolInfo.queryCount);
+	}
+
+	void AsyncComputeScheduler::addBackgroundJob(const std::string& name, std::vector<StepFunc> steps, CompleteFunc onComplete, std::vector<ImageInput> inputs, uint32_t stepsPerFrame)
+	{
+		BackgroundJob job{};
+		job.name = name;
+		job.steps = std::move(steps);
+		job.onComplete = std::move(onComplete);
+		job.inputs = std::move(inputs);
+		job.stepsPerFrame = std::max(stepsPerFrame, 1u);
+		backgroundJobs.push_back(std::move(job));
+	}
+
+	void AsyncComputeScheduler::releaseBuffer(VkBuffer buffer, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+	{
+		assert(recordingCmd != VK_NULL_HANDLE && "Can't release buffer outside of compute job!");
+		if (sharedFamily)
+		{
+			return;
+		}
+
+		VkBufferMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstAccessMask = 0;
+		barrier.srcQueueFamilyIndex = device.getComputeQueueFamily();
+		barrier.dstQueueFamilyIndex = device.getGraphicsQueueFamily();
+		barrier.buffer = buffer;
+		barrier.offset = 0;
+		barrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(recordingCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+		// acquire half, same families and range
+		Handoff handoff{};
+		handoff.bufferBarrier = barrier;
+		handoff.bufferBarrier.srcAccessMask = 0;
+		handoff.bufferBarrier.dstAccessMask = dstAccess;
+		handoff.isImage = false;
+		handoff.dstStage = dstStage;
+		recordingHandoffs.push_back(handoff);
+	}
+
+	void AsyncComputeScheduler::releaseImage(VkImage image, const VkImageSubresourceRange& range, VkImageLayout oldLayout, VkImageLayout newLayout,
+		VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+	{
+		assert(recordingCmd != VK_NULL_HANDLE && "Can't release image outside of compute job!");
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstAccessMask = 0;
+		barrier.oldLayout = oldLayout;
+		barrier.newLayout = newLayout;
+		barrier.srcQueueFamilyIndex = sharedFamily ? VK_QUEUE_FAMILY_IGNORED : device.getComputeQueueFamily();
+		barrier.dstQueueFamilyIndex = sharedFamily ? VK_QUEUE_FAMILY_IGNORED : device.getGraphicsQueueFamily();
+		barrier.image = image;
+		barrier.subresourceRange = range;
+		if (sharedFamily && oldLayout == newLayout)
+		{
+			return;
+		}
+		vkCmdPipelineBarrier(recordingCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		if (sharedFamily)
+		{
+			return;
+		}
+
+		// acquire has to repeat layout transition of release
+		Handoff handoff{};
+		handoff.imageBarrier = barrier;
+		handoff.imageBarrier.srcAccessMask = 0;
+		handoff.imageBarrier.dstAccessMask = dstAccess;
+		handoff.isImage = true;
+		handoff.dstStage = dstStage;
+		recordingHandoffs.push_back(handoff);
+	}
+
+	void AsyncComputeScheduler::recordInputOwnership(VkCommandBuffer cmd, const BackgroundJob& job, bool release)
+	{
+		// graphics -> compute, release is recorded on graphics queue and acquire on compute queue
+		FrameVector<VkImageMemoryBarrier> barriers(device.getFrameArena());
+		for (auto& input : job.inputs)
+		{
+			VkImageMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = release ? 0 : VK_ACCESS_SHADER_READ_BIT;
+			barrier.oldLayout = input.layout;
+			barrier.newLayout = input.layout;
+			barrier.srcQueueFamilyIndex = device.getGraphicsQueueFamily();
+			barrier.dstQueueFamilyIndex = device.getComputeQueueFamily();
+			barrier.image = input.image;
+			barrier.subresourceRange = input.range;
+			barriers.push_back(barrier);
+		}
+		vkCmdPipelineBarrier(cmd, release ? VK_PIPELINE_STAGE_ALL_COMMANDS_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+			release ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr,
+			static_cast<uint32_t>(barriers.size()), barriers.data());
+	}
+
+	void AsyncComputeScheduler::beginGraphics(VkCommandBuffer cmd, int frameIndex)
+	{
+		// compute that used this slot is three frames old, so this practically never blocks
+		VkSemaphoreWaitInfo waitInfo{};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &computeTimeline;
+		waitInfo.pValues = &frameComputeValues[frameIndex];
+		vkWaitSemaphores(device.getLogicalDevice(), &waitInfo, UINT64_MAX);
+
+		if (timestampsSupported)
+		{
+			readTimestamps(frameIndex);
+			vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, frameIndex * 4 + 2);
+		}
+
+		graphicsSync.waitSemaphore = computeValue > 0 ? computeTimeline : VK_NULL_HANDLE;
+		graphicsSync.waitValue = computeValue;
+		graphicsSync.waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		graphicsSync.signalSemaphore = graphicsTimeline;
+		graphicsSync.signalValue = graphicsValue + 1;
+
+		// everything released so far was submitted in previous frames, and this submission waits on last of them
+		for (auto& handoff : pendingHandoffs)
+		{
+			vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, handoff.dstStage, 0, 0, nullptr,
+				handoff.isImage ? 0 : 1, &handoff.bufferBarrier, handoff.isImage ? 1 : 0, &handoff.imageBarrier);
+		}
+		pendingHandoffs.clear();
+
+		uint64_t completedValue = 0;
+		vkGetSemaphoreCounterValue(device.getLogicalDevice(), computeTimeline, &completedValue);
+		while (!backgroundJobs.empty() && backgroundJobs.front().state == BackgroundJob::State::Finished && backgroundJobs.front().finishValue <= completedValue)
+		{
+			backgroundJobs.front().onComplete(cmd);
+			backgroundJobs.pop_front();
+		}
+
+		if (!backgroundJobs.empty() && backgroundJobs.front().state == BackgroundJob::State::Queued)
+		{
+			BackgroundJob& job = backgroundJobs.front();
+			if (sharedFamily || job.inputs.empty())
+			{
+				job.state = BackgroundJob::State::Running;
+			}
+			else
+			{
+				recordInputOwnership(cmd, job, true);
+				job.state = BackgroundJob::State::InputsReleased;
+				job.inputsReleaseValue = graphicsSync.signalValue;
+			}
+		}
+	}
+
+	void AsyncComputeScheduler::submit(VkCommandBuffer graphicsCmd, int frameIndex)
+	{
+		if (timestampsSupported)
+		{
+			vkCmdWriteTimestamp(graphicsCmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, frameIndex * 4 + 3);
+		}
+
+		// compute of this frame can only wait graphics already submitted
+		BackgroundJob* job = backgroundJobs.empty() ? nullptr : &backgroundJobs.front();
+		if (job && job->state == BackgroundJob::State::InputsReleased && job->inputsReleaseValue <= graphicsValue)
+		{
+			job->state = BackgroundJob::State::Running;
+			job->nextStep = 0;
+		}
+		bool runBackground = job && job->state == BackgroundJob::State::Running;
+
+		if (!runBackground)
+		{
+			frameQueriesWritten[frameIndex] = false;
+			graphicsValue = graphicsSync.signalValue;
+			return;
+		}
+
+		VkCommandBuffer cmd = commandBuffers[frameIndex];
+		vkResetCommandBuffer(cmd, 0);
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		if (vkBeginCommandBuffer(cmd, &beginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to begin compute command buffer!");
+		}
+		if (timestampsSupported)
+		{
+			vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, frameIndex * 4);
+		}
+
+		recordingCmd = cmd;
+		if (job->nextStep == 0 && !sharedFamily && !job->inputs.empty())
+		{
+			recordInputOwnership(cmd, *job, false);
+		}
+
+		uint32_t lastStep = std::min(job->nextStep + job->stepsPerFrame, static_cast<uint32_t>(job->steps.size()));
+		for (; job->nextStep < lastStep; job->nextStep++)
+		{
+			job->steps[job->nextStep](cmd);
+		}
+
+		if (job->nextStep == job->steps.size())
+		{
+			// inputs go back to graphics as they were
+			for (auto& input : job->inputs)
+			{
+				releaseImage(input.image, input.range, input.layout, input.layout, 0, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_SHADER_READ_BIT);
+			}
+			job->state = BackgroundJob::State::Finished;
+			job->finishValue = computeValue + 1;
+		}
+		recordingCmd = VK_NULL_HANDLE;
+
+		if (timestampsSupported)
+		{
+			vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, frameIndex * 4 + 1);
+		}
+		if (vkEndCommandBuffer(cmd) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to record compute command buffer!");
+		}
+
+		uint64_t waitValue = graphicsValue;
+		uint64_t signalValue = ++computeValue;
+		VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+		VkTimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.waitSemaphoreValueCount = waitValue > 0 ? 1 : 0;
+		timelineInfo.pWaitSemaphoreValues = &waitValue;
+		timelineInfo.signalSemaphoreValueCount = 1;
+		timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = &timelineInfo;
+		submitInfo.waitSemaphoreCount = waitValue > 0 ? 1 : 0;
+		submitInfo.pWaitSemaphores = &graphicsTimeline;
+		submitInfo.pWaitDstStageMask = &waitStage;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &cmd;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &computeTimeline;
+		if (vkQueueSubmit(device.getComputeQueue(), 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to submit compute command buffer!");
+		}
+
+		frameComputeValues[frameIndex] = signalValue;
+		frameQueriesWritten[frameIndex] = true;
+		pendingHandoffs.insert(pendingHandoffs.end(), recordingHandoffs.begin(), recordingHandoffs.end());
+		recordingHandoffs.clear();
+
+		// graphics of this frame is submitted right after by renderer.endFrame
+		graphicsValue = graphicsSync.signalValue;
+	}
+
+	void AsyncComputeScheduler::readTimestamps(int frameIndex)
+	{
+		// graphics of this slot finished with its frame fence, compute with wait in beginGraphics
+		if (frameQueriesWritten[frameIndex])
+		{
+			uint64_t timestamps[4];
+			if (vkGetQueryPoolResults(device.getLogicalDevice(), queryPool, frameIndex * 4, 4, sizeof(timestamps), timestamps, sizeof(uint64_t),
+				VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+			{
+				double period = device.properties.limits.timestampPeriod * 1e-6;
+				uint64_t overlapBegin = std::max(timestamps[0], timestamps[2]);
+				uint64_t overlapEnd = std::min(timestamps[1], timestamps[3]);
+				totalComputeMs += (timestamps[1] - timestamps[0]) * period;
+				totalGraphicsMs += (timestamps[3] - timestamps[2]) * period;
+				totalOverlapMs += overlapEnd > overlapBegin ? (overlapEnd - overlapBegin) * period : 0.0;
+				measuredFrames++;
+			}
+			frameQueriesWritten[frameIndex] = false;
+		}
+		vkResetQueryPool(device.getLogicalDevice(), queryPool, frameIndex * 4, 4);
+	}
+
+	void AsyncComputeScheduler::printReport() const
+	{
+		const char* queueName = sharedFamily ? (device.hasAsyncComputeQueue() ? "second graphics family queue" : "graphics queue, no overlap possible") : "dedicated compute family";
+		if (measuredFrames == 0)
+		{
+			std::cout << "[async compute] " << queueName << ", no compute frames measured" << std::endl;
+			return;
+		}
+		std::cout << "[async compute] " << queueName << " : " << measuredFrames << " frames, compute avg " << totalComputeMs / measuredFrames
+			<< " ms, graphics avg " << totalGraphicsMs / measuredFrames << " ms, overlapped " << totalOverlapMs / measuredFrames << " ms ("
+			<< (totalComputeMs > 0.0 ? totalOverlapMs / totalComputeMs * 100.0 : 0.0) << "% of compute hidden behind graphics)" << std::endl;
+	}
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include "Device.h"
+#include "SwapChain.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <deque>
+
+namespace jhb {
+	// records background compute work into one submission per frame on async compute queue.
+	// compute submitted in frame N runs next to graphics of frame N, and its results are consumed by graphics of frame N+1.
+	// work graphics needs in the same frame, like meshlet culling, stays on graphics queue as render graph pass
+	// two timeline semaphores order them, compute of frame N waits graphics of frame N-1 and graphics of frame N waits compute of frame N-1
+	class AsyncComputeScheduler
+	{
+	public:
+		using StepFunc = std::function<void(VkCommandBuffer cmd)>;
+		using CompleteFunc = std::function<void(VkCommandBuffer graphicsCmd)>;
+
+		// image owned by graphics queue that background job reads, handed to compute queue and back
+		struct ImageInput {
+			VkImage image;
+			VkImageSubresourceRange range;
+			VkImageLayout layout;
+		};
+
+	public:
+		AsyncComputeScheduler(Device& device);
+		~AsyncComputeScheduler();
+
+		AsyncComputeScheduler(const AsyncComputeScheduler&) = delete;
+		AsyncComputeScheduler& operator=(const AsyncComputeScheduler&) = delete;
+
+		// long work split in steps, stepsPerFrame steps go into each frame's submission so graphics never waits for whole job.
+		// onComplete is called once cpu sees last step finished, with graphics command buffer of that frame
+		void addBackgroundJob(const std::string& name, std::vector<StepFunc> steps, CompleteFunc onComplete, std::vector<ImageInput> inputs = {}, uint32_t stepsPerFrame = 1);
+		bool isBackgroundJobPending() const { return !backgroundJobs.empty(); }
+
+		// only inside record/step callbacks. ownership goes to graphics family at end of submission and graphics of next frame acquires it,
+		// with shared family only layout transition is recorded because semaphore already makes memory visible
+		void releaseBuffer(VkBuffer buffer, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+		void releaseImage(VkImage image, const VkImageSubresourceRange& range, VkImageLayout oldLayout, VkImageLayout newLayout,
+			VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+		// start of graphics command buffer, acquires what previous compute submissions released and runs finished background callbacks
+		void beginGraphics(VkCommandBuffer cmd, int frameIndex);
+		// end of graphics command buffer, right before renderer.endFrame. compute is not submitted when there is no job
+		void submit(VkCommandBuffer graphicsCmd, int frameIndex);
+		// wait and signal of this frame's graphics submission
+		const SwapChain::TimelineSync* getGraphicsSync() const { return &graphicsSync; }
+
+		void printReport() const;
+
+	private:
+		struct BackgroundJob {
+			enum class State { Queued, InputsReleased, Running, Finished };
+			std::string name;
+			std::vector<StepFunc> steps;
+			CompleteFunc onComplete;
+			std::vector<ImageInput> inputs;
+			uint32_t stepsPerFrame;
+			uint32_t nextStep = 0;
+			State state = State::Queued;
+			uint64_t inputsReleaseValue = 0; // graphics timeline value of submission that released inputs
+			uint64_t finishValue = 0; // compute timeline value of submission with last step
+		};
+
+		// recorded on graphics queue after compute submission that released it
+		struct Handoff {
+			VkBufferMemoryBarrier bufferBarrier;
+			VkImageMemoryBarrier imageBarrier;
+			bool isImage;
+			VkPipelineStageFlags dstStage;
+		};
+
+		void createSyncObjects();
+		void createQueryPool();
+		void readTimestamps(int frameIndex);
+		void recordInputOwnership(VkCommandBuffer cmd, const BackgroundJob& job, bool release);
+
+	private:
+		Device& device;
+		bool sharedFamily;
+
+		std::deque<BackgroundJob> backgroundJobs;
+		std::vector<Handoff> pendingHandoffs;
+		std::vector<Handoff> recordingHandoffs;
+		VkCommandBuffer recordingCmd = VK_NULL_HANDLE;
+
+		std::vector<VkCommandBuffer> commandBuffers;
+		VkSemaphore computeTimeline = VK_NULL_HANDLE;
+		VkSemaphore graphicsTimeline = VK_NULL_HANDLE;
+		uint64_t computeValue = 0;
+		uint64_t graphicsValue = 0;
+		// compute value of last submission of each frame slot, command buffer and queries are reused after it
+		std::vector<uint64_t> frameComputeValues = std::vector<uint64_t>(SwapChain::MAX_FRAMES_IN_FLIGHT, 0);
+		SwapChain::TimelineSync graphicsSync{};
+
+		// per frame slot: compute begin, compute end, graphics begin, graphics end
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		bool timestampsSupported = false;
+		std::vector<bool> frameQueriesWritten = std::vector<bool>(SwapChain::MAX_FRAMES_IN_FLIGHT, false);
+		uint32_t measuredFrames = 0;
+		double totalComputeMs = 0.0;
+		double totalOverlapMs = 0.0;
+		double totalGraphicsMs = 0.0;
+	};
+}
@@ -1,4 +1,5 @@
 #include "BaseRenderSystem.h"
+#include "CommandStats.h"
 #include "JHBApplication.h"
 #include "Model.h"
 #include <memory>
@@ -38,13 +39,13 @@ namespace jhb {
 
 	void BaseRenderSystem::renderGameObjects(FrameInfo& frameInfo)
 	{
-		vkCmdBindDescriptorSets(
+		cmd::bindDescriptorSets(
 			frameInfo.commandBuffer,
 			VK_PIPELINE_BIND_POINT_GRAPHICS,
 			pipelineLayout,
 			0, 1
 			, &frameInfo.globaldDescriptorSet,
-			0, nullptr
+			1, &frameInfo.globalUboOffset
 		);
 	}
 }
\ No newline at end of file
@@ -0,0 +1,329 @@
+#include "Benchmark.h"
+#include "Device.h"
+#include "RenderGraph.h"
+#include "CommandStats.h"
+
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace jhb {
+	bool BenchmarkSettings::parseOption(int argc, char** argv, int& i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--headless")
+		{
+			headless = true;
+		}
+		else if (arg == "--camera-path" && hasValue)
+		{
+			cameraPath = argv[++i];
+		}
+		else if (arg == "--warmup" && hasValue)
+		{
+			warmupFrames = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--frames" && hasValue)
+		{
+			measuredFrames = static_cast<uint32_t>(std::stoul(argv[++i]));
+			if (measuredFrames == 0)
+			{
+				throw std::runtime_error("benchmark needs at least one measured frame!");
+			}
+		}
+		else if (arg == "--output" && hasValue)
+		{
+			output = argv[++i];
+		}
+		else
+		{
+			return false;
+		}
+		return true;
+	}
+
+	CameraPath CameraPath::load(const std::string& filepath)
+	{
+		std::ifstream file{ filepath };
+		if (!file.is_open())
+		{
+			throw std::runtime_error("failed to open camera path " + filepath + "!");
+		}
+
+		CameraPath path{};
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::istringstream stream{ line };
+			std::string type;
+			if (!(stream >> type) || type[0] == '#')
+			{
+				continue;
+			}
+
+			if (type == "camera")
+			{
+				Key key{};
+				if (!(stream >> key.time >> key.translation.x >> key.translation.y >> key.translation.z >> key.pitch >> key.yaw))
+				{
+					throw std::runtime_error("failed to parse camera path line " + line + "!");
+				}
+				path.keys.push_back(key);
+			}
+			else if (type == "mouse")
+			{
+				MouseEvent event{};
+				int pressed = 0;
+				if (!(stream >> event.time >> event.x >> event.y >> pressed))
+				{
+					throw std::runtime_error("failed to parse camera path line " + line + "!");
+				}
+				event.pressed = pressed != 0;
+				path.mouseEvents.push_back(event);
+			}
+			else
+			{
+				throw std::runtime_error("unknown camera path entry " + type + "!");
+			}
+		}
+
+		if (path.keys.empty())
+		{
+			throw std::runtime_error("camera path has no camera keys!");
+		}
+		auto byTime = [](const auto& a, const auto& b) { return a.time < b.time; };
+		std::stable_sort(path.keys.begin(), path.keys.end(), byTime);
+		std::stable_sort(path.mouseEvents.begin(), path.mouseEvents.end(), byTime);
+		return path;
+	}
+
+	CameraPath CameraPath::orbit()
+	{
+		// y is down in world, same start as interactive camera
+		const float pi = glm::pi<float>();
+		CameraPath path{};
+		path.keys = {
+			{ 0.f, { 0.f, -5.5f, -2.5f }, 0.f, 0.f },
+			{ 5.f, { 9.f, -5.5f, -2.5f }, 0.2f, 0.5f * pi },
+			{ 10.f, { 9.f, -3.f, 2.5f }, -0.2f, pi },
+			{ 15.f, { -9.f, -3.f, 2.5f }, 0.f, 1.5f * pi },
+			{ 20.f, { -9.f, -5.5f, -2.5f }, 0.2f, 2.f * pi },
+			{ 25.f, { 0.f, -5.5f, -2.5f }, 0.f, 2.f * pi },
+		};
+		// one pick in the middle of window each loop
+		path.mouseEvents = {
+			{ 2.f, 0.5f, 0.5f, true, true },
+			{ 2.1f, 0.5f, 0.5f, false, true },
+		};
+		return path;
+	}
+
+	void CameraPath::sample(float time, glm::vec3& translation, glm::vec3& rotation) const
+	{
+		auto next = std::upper_bound(keys.begin(), keys.end(), time, [](float t, const Key& key) { return t < key.time; });
+		if (next == keys.begin() || next == keys.end())
+		{
+			const Key& key = next == keys.begin() ? keys.front() : keys.back();
+			translation = key.translation;
+			rotation = { key.pitch, key.yaw, 0.f };
+			return;
+		}
+
+		const Key& a = *(next - 1);
+		const Key& b = *next;
+		float t = b.time > a.time ? (time - a.time) / (b.time - a.time) : 1.f;
+		translation = glm::mix(a.translation, b.translation, t);
+		rotation = { glm::mix(a.pitch, b.pitch, t), glm::mix(a.yaw, b.yaw, t), 0.f };
+	}
+
+	Benchmark::Benchmark(const BenchmarkSettings& settings, const SceneConfig& scene) : settings{ settings }, scene{ scene }
+	{
+		path = settings.cameraPath.empty() ? CameraPath::orbit() : CameraPath::load(settings.cameraPath);
+		wallMs.reserve(settings.measuredFrames);
+		cpuMs.reserve(settings.measuredFrames);
+		gpuMs.reserve(settings.measuredFrames);
+		std::cout << "[benchmark] scene " << scene.name << ", " << settings.warmupFrames << " warmup and " << settings.measuredFrames
+			<< " measured frames, camera path " << (settings.cameraPath.empty() ? "built in" : settings.cameraPath) << std::endl;
+	}
+
+	float Benchmark::getPathTime() const
+	{
+		float time = frame * getFrameTime();
+		float duration = path.getDuration();
+		return duration > 0.f ? std::fmod(time, duration) : 0.f;
+	}
+
+	void Benchmark::applyMouse(Window& window, double& x, double& y)
+	{
+		float time = getPathTime();
+		if (time < lastMouseTime)
+		{
+			// path looped
+			nextMouseEvent = 0;
+		}
+		lastMouseTime = time;
+
+		// same as InputController::OnButtonPressed
+		for (; nextMouseEvent < path.mouseEvents.size() && path.mouseEvents[nextMouseEvent].time <= time; nextMouseEvent++)
+		{
+			auto& event = path.mouseEvents[nextMouseEvent];
+			cursorX = event.relative ? event.x * window.getExtent().width : event.x;
+			cursorY = event.relative ? event.y * window.getExtent().height : event.y;
+			if (event.pressed)
+			{
+				window.SetMouseCursorPose(cursorX, cursorY);
+				window.SetMouseButtonPress(true);
+			}
+			else
+			{
+				window.SetMouseButtonPress(false);
+				window.objectId = -1;
+			}
+		}
+		x = cursorX;
+		y = cursorY;
+	}
+
+	glm::vec3 Benchmark::applyCamera(GameObject& viewer)
+	{
+		path.sample(getPathTime(), viewer.transform.translation, viewer.transform.rotation);
+
+		float yaw = viewer.transform.rotation.y;
+		float pitch = viewer.transform.rotation.x;
+		glm::vec3 forwardDir(0);
+		forwardDir.x = glm::cos(yaw) * glm::cos(pitch);
+		forwardDir.y = glm::sin(pitch);
+		forwardDir.z = glm::sin(yaw) * glm::cos(pitch);
+		return forwardDir;
+	}
+
+	void Benchmark::endFrame(double frameWallMs, double frameCpuMs, const RenderGraph& graph, const Device& device)
+	{
+		if (frame++ < settings.warmupFrames)
+		{
+			return;
+		}
+
+		wallMs.push_back(frameWallMs);
+		cpuMs.push_back(frameCpuMs);
+		if (graph.getFrameGpuTime() >= 0.0)
+		{
+			gpuMs.push_back(graph.getFrameGpuTime());
+		}
+
+		auto& passTimes = graph.getPassGpuTimes();
+		if (passGpuMs.size() < passTimes.size())
+		{
+			passGpuMs.resize(passTimes.size());
+		}
+		for (size_t i = 0; i < passTimes.size(); i++)
+		{
+			// culled passes don't count as zero
+			if (passTimes[i] >= 0.0)
+			{
+				passGpuMs[i].push_back(passTimes[i]);
+			}
+		}
+
+		VkDeviceSize usage = 0;
+		VkDeviceSize budget = 0;
+		if (device.queryMemoryUsage(usage, budget))
+		{
+			peakMemoryUsage = std::max(peakMemoryUsage, usage);
+			memoryBudget = budget;
+		}
+	}
+
+	Benchmark::Percentiles Benchmark::percentiles(std::vector<double> samples)
+	{
+		Percentiles result{};
+		if (samples.empty())
+		{
+			return result;
+		}
+
+		// nearest rank
+		std::sort(samples.begin(), samples.end());
+		auto rank = [&](double p) {
+			size_t index = static_cast<size_t>(std::ceil(p * samples.size()));
+			return samples[std::min(std::max<size_t>(index, 1), samples.size()) - 1];
+		};
+		result.p50 = rank(0.50);
+		result.p95 = rank(0.95);
+		result.p99 = rank(0.99);
+		return result;
+	}
+
+	void Benchmark::setAntiAliasingQuality(const std::string& mode, double rmse, double psnr)
+	{
+		aaMode = mode;
+		aaRmse = rmse;
+		aaPsnr = psnr;
+	}
+
+	void Benchmark::writeReport(const Device& device, const RenderGraph& graph) const
+	{
+		std::ofstream out{ settings.output };
+		if (!out.is_open())
+		{
+			throw std::runtime_error("failed to open benchmark output " + settings.output + "!");
+		}
+
+		auto writePercentiles = [&](const Percentiles& p) {
+			out << "{ \"p50\": " << p.p50 << ", \"p95\": " << p.p95 << ", \"p99\": " << p.p99 << " }";
+		};
+
+#ifdef NDEBUG
+		const char* configuration = "release";
+#else
+		const char* configuration = "debug";
+#endif
+		out << "{\n";
+		out << "  \"build\": { \"date\": \"" << __DATE__ << " " << __TIME__ << "\", \"configuration\": \"" << configuration << "\" },\n";
+		out << "  \"device\": " << jsonString(device.properties.deviceName) << ",\n";
+		out << "  \"scene\": { \"name\": " << jsonString(scene.name);
+		if (scene.name == "stress")
+		{
+			out << ", \"instances\": " << scene.instanceCount << ", \"models\": " << scene.modelCount << ", \"materials\": " << scene.materialCount
+				<< ", \"lights\": " << scene.lightCount << ", \"seed\": " << scene.seed << ", \"distribution\": \""
+				<< (scene.distribution == SceneConfig::Distribution::Grid ? "grid" : "random") << "\"";
+		}
+		out << " },\n";
+		out << "  \"cameraPath\": " << jsonString(settings.cameraPath.empty() ? "built in" : settings.cameraPath) << ",\n";
+		out << "  \"warmupFrames\": " << settings.warmupFrames << ",\n";
+		out << "  \"measuredFrames\": " << wallMs.size() << ",\n";
+		out << "  \"frameMs\": ";
+		writePercentiles(percentiles(wallMs));
+		out << ",\n  \"cpuMs\": ";
+		writePercentiles(percentiles(cpuMs));
+		out << ",\n  \"gpuMs\": ";
+		writePercentiles(percentiles(gpuMs));
+		out << ",\n  \"passGpuMs\": [";
+		for (size_t i = 0; i < passGpuMs.size() && i < graph.getPassCount(); i++)
+		{
+			out << (i ? ",\n    " : "\n    ") << "{ \"pass\": " << jsonString(graph.getPassName(static_cast<uint32_t>(i))) << ", \"frames\": " << passGpuMs[i].size() << ", \"ms\": ";
+			writePercentiles(percentiles(passGpuMs[i]));
+			out << " }";
+		}
+		out << "\n  ],\n";
+		out << "  \"memory\": { \"deviceLocalPeakMB\": " << peakMemoryUsage / (1024 * 1024) << ", \"deviceLocalBudgetMB\": " << memoryBudget / (1024 * 1024)
+			<< , \"renderGraphOwnedTransientKB\": " << graph.getTransientMemorySize() / 1024 << " },\n";
+		if (aaRmse >= 0.0)
+		{
+			out << "  \"antiAliasingQuality\": { \"mode\": " << jsonString(aaMode) << ", \"rmse\": " << aaRmse << ", \"psnrDb\": " << aaPsnr << " },\n";
+		}
+		out << "  \"lastFrameCommands\": ";
+		CommandStats::GetSingleton().writeJson(out);
+		out << "\n}\n";
+
+		auto frame = percentiles(wallMs);
+		std::cout << "[benchmark] frame p50 " << frame.p50 << " ms, p95 " << frame.p95 << " ms, p99 " << frame.p99 << " ms, report written to "
+			<< settings.output << std::endl;
+	}
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include "Window.h"
+#include "GameObject.h"
+#include "Scene.h"
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <vector>
+
+namespace jhb {
+	class Device;
+	class RenderGraph;
+
+	// Project1.exe --benchmark [scene options] [--camera-path file] [--warmup N] [--frames M] [--output file] [--headless]
+	struct BenchmarkSettings {
+		bool enabled = false;
+		// empty uses built in path through sponza
+		std::string cameraPath;
+		uint32_t warmupFrames = 120;
+		uint32_t measuredFrames = 1000;
+		std::string output = "benchmark.json";
+		// window is created hidden, swapchain and present still run
+		bool headless = false;
+
+		// consumes option at argv[i] and its value, false when it is not a benchmark option
+		bool parseOption(int argc, char** argv, int& i);
+	};
+
+	// recorded camera transforms and mouse timeline, played back in place of user input.
+	// text file, one entry per line, times in seconds, path loops when it's shorter than the run
+	//   camera <time> <x> <y> <z> <pitch> <yaw>
+	//   mouse <time> <x> <y> <pressed 0|1>
+	class CameraPath
+	{
+	public:
+		struct Key {
+			float time;
+			glm::vec3 translation;
+			float pitch;
+			float yaw;
+		};
+
+		struct MouseEvent {
+			float time;
+			float x, y;
+			bool pressed;
+			// x y are fractions of window extent, built in path doesn't know window size
+			bool relative = false;
+		};
+
+		static CameraPath load(const std::string& filepath);
+		// walk around sponza atrium with one pick click
+		static CameraPath orbit();
+
+		float getDuration() const { return keys.back().time; }
+		// linear between keys
+		void sample(float time, glm::vec3& translation, glm::vec3& rotation) const;
+
+		std::vector<Key> keys;
+		std::vector<MouseEvent> mouseEvents;
+	};
+
+	// drives frames with fixed time step so every build renders exactly same frames, collects frame times and writes json report
+	class Benchmark
+	{
+	public:
+		Benchmark(const BenchmarkSettings& settings, const SceneConfig& scene);
+
+		// simulated time step, wall clock time is only measured
+		float getFrameTime() const { return 1.f / 60.f; }
+		bool isFinished() const { return frame >= settings.warmupFrames + settings.measuredFrames; }
+
+		// replaces mouse button callback, x y become cursor position of this frame
+		void applyMouse(Window& window, double& x, double& y);
+		// replaces InputController::move, returns forward direction
+		glm::vec3 applyCamera(GameObject& viewer);
+		// gpu times of graph lag a few frames behind, they still are the same frames over a whole run
+		void endFrame(double frameWallMs, double frameCpuMs, const RenderGraph& graph, const Device& device);
+
+		// measured at last pose of path after the run, see AAQualityProbe
+		void setAntiAliasingQuality(const std::string& mode, double rmse, double psnr);
+
+		void writeReport(const Device& device, const RenderGraph& graph) const;
+
+	private:
+		struct Percentiles {
+			double p50 = 0.0;
+			double p95 = 0.0;
+			double p99 = 0.0;
+		};
+
+		static Percentiles percentiles(std::vector<double> samples);
+		float getPathTime() const;
+
+	private:
+		BenchmarkSettings settings;
+		SceneConfig scene;
+		CameraPath path;
+		uint32_t frame = 0;
+		size_t nextMouseEvent = 0;
+		float lastMouseTime = 0.f;
+		float cursorX = 0.f;
+		float cursorY = 0.f;
+
+		std::vector<double> wallMs;
+		std::vector<double> cpuMs;
+		std::vector<double> gpuMs;
+		std::vector<std::vector<double>> passGpuMs;
+		VkDeviceSize peakMemoryUsage = 0;
+		VkDeviceSize memoryBudget = 0;
+
+		std::string aaMode;
+		double aaRmse = -1.0;
+		double aaPsnr = 0.0;
+	};
+}
@@ -25,6 +25,37 @@ void jhb::Camera::setPerspectiveProjection(float aspect, float near, float far)
     projectionMatrix[2][2] = far / (far - near);
     projectionMatrix[2][3] = 1.f;
     projectionMatrix[3][2] = -(far * near) / (far - near);
+
+    // w is view space z, so offset in third column moves ndc xy by constant amount
+    jitteredProjectionMatrix = projectionMatrix;
+    jitteredProjectionMatrix[2][0] += jitter.x;
+    jitteredProjectionMatrix[2][1] += jitter.y;
+}
+
+static float halton(uint32_t index, uint32_t base)
+{
+    float f = 1.f;
+    float result = 0.f;
+    while (index > 0)
+    {
+        f /= base;
+        result += f * (index % base);
+        index /= base;
+    }
+    return result;
+}
+
+void jhb::Camera::setJitter(uint32_t frameCount, float width, float height, uint32_t sequenceLength)
+{
+    // 8 samples are enough for taa, longer sequence only shows up as shimmering with 0.9 history feedback
+    uint32_t index = (frameCount % sequenceLength) + 1;
+    jitter.x = (halton(index, 2) - 0.5f) * 2.f / width;
+    jitter.y = (halton(index, 3) - 0.5f) * 2.f / height;
+}
+
+void jhb::Camera::clearJitter()
+{
+    jitter = glm::vec2{ 0.f };
 }
 
 void jhb::Camera::setViewDirection(glm::vec3 cameraPosition, glm::vec3 cameraDirection, glm::vec3 up)
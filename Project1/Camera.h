@@ -16,6 +16,10 @@ namespace jhb {
 
 		void setPerspectiveProjection(float aspect, float near, float far);
 
+		// sub pixel jitter for taa, halton(2,3) sequence. applied on every setPerspectiveProjection
+		void setJitter(uint32_t frameCount, float width, float height, uint32_t sequenceLength = 8);
+		void clearJitter();
+
 		void setViewDirection(glm::vec3 cameraPosition, glm::vec3 cameraDirection, glm::vec3 up = glm::vec3{0.f, -1.f, 0.f});
 		void setViewTarget(glm::vec3 cameraPosition, glm::vec3 target, glm::vec3 up = glm::vec3{ 0.f, -1.f, 0.f });
 		void setViewYXZ(glm::vec3 position, glm::vec3 rotation);
@@ -23,11 +27,17 @@ namespace jhb {
 		void setfovy(float _fovy) { fovy = _fovy; }
 
 		const glm::mat4& getProjection() const { return projectionMatrix; }
+		const glm::mat4& getJitteredProjection() const { return jitteredProjectionMatrix; }
+		const glm::vec2& getJitter() const { return jitter; }
 		const glm::mat4& getView() const { return viewMatrix; }
 		const glm::mat4& getInverseView() const { return inverseViewMatrix; }
+		// unjittered, for picking rays
+		glm::mat4 getInverseViewProjection() const { return glm::inverse(projectionMatrix * viewMatrix); }
 	private:
 		glm::mat4 inverseViewMatrix{ 1.f };
 		glm::mat4 projectionMatrix{ 1.f }; // camera space to canonical view volume;
+		glm::mat4 jitteredProjectionMatrix{ 1.f };
+		glm::vec2 jitter{ 0.f }; // ndc offset
 		glm::mat4 viewMatrix{1.f}; // objects in world space move to camera space;
 		float fovy; // radianse
 	};
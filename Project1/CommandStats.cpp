@@ -0,0 +1,96 @@
+#include "CommandStats.h"
+
+#include <cstdio>
+#include <utility>
+
+namespace jhb {
+	PassCommandStats* CommandStats::active = nullptr;
+
+	std::string jsonString(const std::string& text)
+	{
+		std::string result = "\"";
+		for (char c : text)
+		{
+			switch (c)
+			{
+			case '"': result += "\\\""; break;
+			case '\\': result += "\\\\"; break;
+			case '\n': result += "\\n"; break;
+			case '\r': result += "\\r"; break;
+			case '\t': result += "\\t"; break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20)
+				{
+					char escaped[8];
+					std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(c));
+					result += escaped;
+				}
+				else
+				{
+					result += c;
+				}
+			}
+		}
+		result += '"';
+		return result;
+	}
+
+	void PassCommandStats::add(const PassCommandStats& other)
+	{
+		renderPasses += other.renderPasses;
+		draws += other.draws;
+		indirectDraws += other.indirectDraws;
+		triangles += other.triangles;
+		instances += other.instances;
+		dispatches += other.dispatches;
+		pipelineBinds += other.pipelineBinds;
+		descriptorBinds += other.descriptorBinds;
+		vertexBufferBinds += other.vertexBufferBinds;
+		indexBufferBinds += other.indexBufferBinds;
+		pushConstantBytes += other.pushConstantBytes;
+		barriers += other.barriers;
+		copies += other.copies;
+	}
+
+	void CommandStats::beginFrame()
+	{
+		active = nullptr;
+		// swap keeps capacity of both, pass names fit in small string buffer so nothing is allocated per frame
+		std::swap(recording, lastFrame);
+		recording.clear();
+	}
+
+	void CommandStats::beginPass(const std::string& name)
+	{
+#if JHB_COMMAND_STATS
+		recording.push_back(PassEntry{ name, PassCommandStats{} });
+		active = &recording.back().stats;
+#endif
+	}
+
+	PassCommandStats CommandStats::getLastFrameTotal() const
+	{
+		PassCommandStats total{};
+		for (auto& entry : lastFrame)
+		{
+			total.add(entry.stats);
+		}
+		return total;
+	}
+
+	void CommandStats::writeJson(std::ostream& out) const
+	{
+		out << "[";
+		for (size_t i = 0; i < lastFrame.size(); i++)
+		{
+			auto& s = lastFrame[i].stats;
+			out << (i ? ", " : "") << "{ \"pass\": " << jsonString(lastFrame[i].name) << ", \"renderPasses\": " << s.renderPasses
+				<< ", \"draws\": " << s.draws << ", \"indirectDraws\": " << s.indirectDraws << ", \"triangles\": " << s.triangles
+				<< ", \"instances\": " << s.instances << ", \"dispatches\": " << s.dispatches << ", \"pipelineBinds\": " << s.pipelineBinds
+				<< ", \"descriptorBinds\": " << s.descriptorBinds << ", \"vertexBufferBinds\": " << s.vertexBufferBinds
+				<< ", \"indexBufferBinds\": " << s.indexBufferBinds << ", \"pushConstantBytes\": " << s.pushConstantBytes
+				<< ", \"barriers\": " << s.barriers << ", \"copies\": " << s.copies << " }";
+		}
+		out << "]";
+	}
+}
@@ -0,0 +1,192 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// set to 0 to compile counting out, cmd:: wrappers then only forward to vkCmd*
+#ifndef JHB_COMMAND_STATS
+#define JHB_COMMAND_STATS 1
+#endif
+
+namespace jhb {
+	struct PassCommandStats {
+		uint32_t renderPasses = 0;
+		uint32_t draws = 0;
+		// triangle count of indirect draws is only known on gpu, they are counted here instead
+		uint32_t indirectDraws = 0;
+		uint64_t triangles = 0;
+		uint64_t instances = 0;
+		uint32_t dispatches = 0;
+		uint32_t pipelineBinds = 0;
+		uint32_t descriptorBinds = 0;
+		uint32_t vertexBufferBinds = 0;
+		uint32_t indexBufferBinds = 0;
+		uint32_t pushConstantBytes = 0;
+		uint32_t barriers = 0;
+		// buffer to image and image to image, texture streaming records them outside of graph passes
+		uint32_t copies = 0;
+
+		void add(const PassCommandStats& other);
+	};
+
+	// counts what each render graph pass records in a frame, cpu side only
+	class CommandStats
+	{
+	public:
+		struct PassEntry {
+			std::string name;
+			PassCommandStats stats;
+		};
+
+		static CommandStats& GetSingleton()
+		{
+			static CommandStats commandStats;
+			return commandStats;
+		}
+
+		// frame recorded until now becomes last frame
+		void beginFrame();
+		// commands recorded outside of a pass are not counted
+		void beginPass(const std::string& name);
+		void endPass() { active = nullptr; }
+
+		const std::vector<PassEntry>& getLastFrame() const { return lastFrame; }
+		PassCommandStats getLastFrameTotal() const;
+		void writeJson(std::ostream& out) const;
+
+		static PassCommandStats* active;
+
+	private:
+		CommandStats() = default;
+
+		std::vector<PassEntry> recording;
+		std::vector<PassEntry> lastFrame;
+	};
+
+	// quoted json string, backslash, quote and control characters escaped. reports carry windows paths and driver names
+	std::string jsonString(const std::string& text);
+
+	// thin layer over vkCmd* used while recording frames
+	namespace cmd {
+		inline void beginRenderPass(VkCommandBuffer commandBuffer, const VkRenderPassBeginInfo* beginInfo, VkSubpassContents contents)
+		{
+#if JHB_COMMAND_STATS
+			if (CommandStats::active) CommandStats::active->renderPasses++;
+#endif
+			vkCmdBeginRenderPass(commandBuffer, beginInfo, contents);
+		}
+
+		inline void bindPipeline(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipeline pipeline)
+		{
+#if JHB_COMMAND_STATS
+			if (CommandStats::active) CommandStats::active->pipelineBinds++;
+#endif
+			vkCmdBindPipeline(commandBuffer, bindPoint, pipeline);
+		}
+
+		inline void bindDescriptorSets(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t firstSet,
+			uint32_t setCount, const VkDescriptorSet* sets, uint32_t dynamicOffsetCount, const uint32_t* dynamicOffsets)
+		{
+#if JHB_COMMAND_STATS
+			if (CommandStats::active) CommandStats::active->descriptorBinds++;
+#endif
+			vkCmdBindDescriptorSets(commandBuffer, bindPoint, layout, firstSet, setCount, sets, dynamicOffsetCount, dynamicOffsets);
+		}
+
+		inline void bindVertexBuffers(VkCommandBuffer commandBuffer, uint32_t firstBinding, uint32_t bindingCount, const VkBuffer* buffers, const VkDeviceSize* offsets)
+		{
+#if JHB_COMMAND_STATS
+			if (CommandStats::active) CommandStats::active->vertexBufferBinds++;
+#endif
+			vkCmdBindVertexBuffers(commandBuffer, firstBinding, bindingCount, buffers, offsets);
+		}
+
+		inline void bindIndexBuffer(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, VkIndexType indexType)
+		{
+#if JHB_COMMAND_STATS
+			if (CommandStats::active) CommandStats::active->indexBufferBinds++;
+#endif
+			vkCmdBindIndexBuffer(commandBuffer, buffer, offset, indexType);
+		}
+
+		inline void pushConstants(VkCommandBuffer commandBuffer, VkPipelineLayout layout, VkShaderStageFlags stages, uint32_t offset, uint32_t size, const void* values)
+		{
+#if JHB_COMMAND_STATS
+			if (CommandStats::active) CommandStats::active->pushConstantBytes += size;
+#endif
+			vkCmdPushConstants(commandBuffer, layout, stages, offset, size, values);
+		}
+
+		inline void draw(VkCommandBuffer commandBuffer, uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance)
+		{
+#if JHB_COMMAND_STATS
+			if (PassCommandStats* stats = CommandStats::active)
+			{
+				stats->draws++;
+				stats->triangles += static_cast<uint64_t>(vertexCount / 3) * instanceCount;
+				stats->instances += instanceCount;
+			}
+#endif
+			vkCmdDraw(commandBuffer, vertexCount, instanceCount, firstVertex, firstInstance);
+		}
+
+		inline void drawIndexed(VkCommandBuffer commandBuffer, uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance)
+		{
+#if JHB_COMMAND_STATS
+			if (PassCommandStats* stats = CommandStats::active)
+			{
+				stats->draws++;
+				stats->triangles += static_cast<uint64_t>(indexCount / 3) * instanceCount;
+				stats->instances += instanceCount;
+			}
+#endif
+			vkCmdDrawIndexed(commandBuffer, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+		}
+
+		inline void drawIndexedIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount, uint32_t stride)
+		{
+#if JHB_COMMAND_STATS
+			if (CommandStats::active) CommandStats::active->indirectDraws += drawCount;
+#endif
+			vkCmdDrawIndexedIndirect(commandBuffer, buffer, offset, drawCount, stride);
+		}
+
+		inline void dispatch(VkCommandBuffer commandBuffer, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ)
+		{
+#if JHB_COMMAND_STATS
+			if (CommandStats::active) CommandStats::active->dispatches++;
+#endif
+			vkCmdDispatch(commandBuffer, groupCountX, groupCountY, groupCountZ);
+		}
+
+		inline void pipelineBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages, VkDependencyFlags dependencyFlags,
+			uint32_t memoryBarrierCount, const VkMemoryBarrier* memoryBarriers, uint32_t bufferBarrierCount, const VkBufferMemoryBarrier* bufferBarriers,
+			uint32_t imageBarrierCount, const VkImageMemoryBarrier* imageBarriers)
+		{
+#if JHB_COMMAND_STATS
+			if (CommandStats::active) CommandStats::active->barriers += memoryBarrierCount + bufferBarrierCount + imageBarrierCount;
+#endif
+			vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, dependencyFlags, memoryBarrierCount, memoryBarriers, bufferBarrierCount, bufferBarriers,
+				imageBarrierCount, imageBarriers);
+		}
+
+		inline void copyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkImage image, VkImageLayout layout, uint32_t regionCount, const VkBufferImageCopy* regions)
+		{
+#if JHB_COMMAND_STATS
+			if (CommandStats::active) CommandStats::active->copies++;
+#endif
+			vkCmdCopyBufferToImage(commandBuffer, buffer, image, layout, regionCount, regions);
+		}
+
+		inline void copyImage(VkCommandBuffer commandBuffer, VkImage srcImage, VkImageLayout srcLayout, VkImage dstImage, VkImageLayout dstLayout, uint32_t regionCount, const VkImageCopy* regions)
+		{
+#if JHB_COMMAND_STATS
+			if (CommandStats::active) CommandStats::active->copies++;
+#endif
+			vkCmdCopyImage(commandBuffer, srcImage, srcLayout, dstImage, dstLayout, regionCount, regions);
+		}
+	}
+}
@@ -107,7 +107,7 @@ namespace jhb {
 		std::array<std::unique_ptr<DescriptorPool>, 3> discriptorPool{};
 
 		std::unique_ptr<DescriptorPool> computeDescriptorPool;
-		std::unique_ptr<DescriptorSetLayout> computeDescriptorSetLayout;
+		std::shared_ptr<DescriptorSetLayout> computeDescriptorSetLayout;
 		
 		VkShaderModule computeShader;
 	public:
@@ -1,16 +1,22 @@
 #include "DeferedPBRRenderSystem.h"
+#include "CommandStats.h"
 #include <memory>
 #include <array>
 #include "SwapChain.h"
 #include "GameObjectManager.h"
+#include "MeshletCullSystem.h"
+#include "OcclusionCuller.h"
 
 namespace jhb {
 	uint32_t DeferedPBRRenderSystem::id = 0;
 	// descriptortsetlayouts =>  { globaluniform, gltfmaterial,pbrresource, shadow } 
-	DeferedPBRRenderSystem::DeferedPBRRenderSystem(Device& device, std::vector<VkDescriptorSetLayout> descSetlayouts, const std::vector<VkImageView>& swapchainImageViews, VkFormat swapchainFormat)
+	DeferedPBRRenderSystem::DeferedPBRRenderSystem(Device& device, std::vector<VkDescriptorSetLayout> descSetlayouts, const std::vector<VkImageView>& swapchainImageViews, VkFormat swapchainFormat,
+		const SceneConfig& scene)
 		: BaseRenderSystem(device)
 	{
 		assert(descSetlayouts.size() == 5 && "descriptor setlayout size in defered render system less than 5!!!!!!!");
+		sampleCount = device.msaaSamples;
+		this->swapchainFormat = swapchainFormat;
 		// ù° subpass gltf ͸ descriptorsetlayout ù subpass pipelinelayout  ־. ׷Ƿ uniform buffer  Բ  2 descriptor set layout ʿ.
 		createRenderPass(swapchainFormat);
 		createFrameBuffers(swapchainImageViews);
@@ -21,8 +27,26 @@ namespace jhb {
 			"shaders/deferedoffscreen.frag.spv");
 		// ι° subpass pbr ؾϱ  pbrresource descriptorsetlayout ι° subpass pipelinelayout  ־.    ۰ ʿϰ(light ġ), pbr ̹ descriptor set layout, 
 		//  descriptor set layout 3 ʿ.
-		createLightingPipelineAndPipelinelayout({descSetlayouts[0], descSetlayouts[2], descSetlayouts[3] }); // second subapss
-		createSkyboxPipelineAndPipelinelayout({ descSetlayouts[0], descSetlayouts[4]});
+		lightingSetLayouts = { descSetlayouts[0], descSetlayouts[2], descSetlayouts[3] };
+		skyboxSetLayouts = { descSetlayouts[0], descSetlayouts[4] };
+		createLightingPipelineAndPipelinelayout(lightingSetLayouts); // second subapss
+		createSkyboxPipelineAndPipelinelayout(skyboxSetLayouts);
+
+		if (scene.name == "stress")
+		{
+			// skybox has to be id 1, id 0 stays empty without sponza
+			if (scene.sponza)
+			{
+				createSponze();
+			}
+			else
+			{
+				id++;
+			}
+			createSkybox();
+			createStressScene(scene);
+			return;
+		}
 
 		createSponze();
 		//createFloor();
@@ -112,32 +136,93 @@ namespace jhb {
 			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
 			&DepthAttachment);
 
-		// create colorresolve for msa
+		if (antiAliasingMode == AntiAliasingMode::TAA)
+		{
+			// lighting result and velocity are sampled by taa resolve pass, so they must be stored
+			createSampledAttachment(jhb::SwapChain::swapChainImageFormat, &ColorResolveAttachment);
+			createSampledAttachment(VK_FORMAT_R16G16_SFLOAT, &VelocityAttachment);
+		}
+		else
+		{
+			// create colorresolve for msa
+			VkImageCreateInfo imageCI{};
+			imageCI.imageType = VK_IMAGE_TYPE_2D;
+			imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			imageCI.format = jhb::SwapChain::swapChainImageFormat;
+			imageCI.extent.width = device.getWindow().getExtent().width;
+			imageCI.extent.height = device.getWindow().getExtent().height;
+			imageCI.extent.depth = 1;
+			imageCI.mipLevels = 1;
+			ColorResolveAttachment.format = jhb::SwapChain::swapChainImageFormat;
+			imageCI.arrayLayers = 1;
+			imageCI.samples = sampleCount;
+			imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+			if (transientAttachments)
+			{
+				imageCI.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+			}
+			VkMemoryPropertyFlags memProps = device.createImageWithInfo(imageCI, getAttachmentMemoryProperties(), ColorResolveAttachment.image, ColorResolveAttachment.memory);
+			VkMemoryRequirements memReqs;
+			vkGetImageMemoryRequirements(device.getLogicalDevice(), ColorResolveAttachment.image, &memReqs);
+			ColorResolveAttachment.size = memReqs.size;
+			ColorResolveAttachment.lazilyAllocated = (memProps & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0;
+			// Image view
+			VkImageViewCreateInfo viewCI{};
+			viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewCI.format = jhb::SwapChain::swapChainImageFormat;
+			viewCI.subresourceRange = {};
+			viewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			viewCI.subresourceRange.levelCount = 1;
+			viewCI.subresourceRange.layerCount = 1;
+			viewCI.image = ColorResolveAttachment.image;
+			if (vkCreateImageView(device.getLogicalDevice(), &viewCI, nullptr, &ColorResolveAttachment.view))
+			{
+				throw std::runtime_error("failed to create ImageView!");
+			}
+		}
+
+		if (attachmentReportPending)
+		{
+			attachmentReportPending = false;
+			printAttachmentMemoryReport();
+		}
+	}
+
+	void DeferedPBRRenderSystem::createSampledAttachment(VkFormat format, Texture* attachment)
+	{
+		attachment->format = format;
+
 		VkImageCreateInfo imageCI{};
-		imageCI.imageType = VK_IMAGE_TYPE_2D;
 		imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-		imageCI.format = jhb::SwapChain::swapChainImageFormat;
+		imageCI.imageType = VK_IMAGE_TYPE_2D;
+		imageCI.format = format;
 		imageCI.extent.width = device.getWindow().getExtent().width;
 		imageCI.extent.height = device.getWindow().getExtent().height;
 		imageCI.extent.depth = 1;
 		imageCI.mipLevels = 1;
-		ColorResolveAttachment.format = jhb::SwapChain::swapChainImageFormat;
 		imageCI.arrayLayers = 1;
-		imageCI.samples = device.msaaSamples;
+		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
 		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
-		device.createImageWithInfo(imageCI, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ColorResolveAttachment.image, ColorResolveAttachment.memory);
-		// Image view
+		imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		device.createImageWithInfo(imageCI, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, attachment->image, attachment->memory);
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device.getLogicalDevice(), attachment->image, &memReqs);
+		attachment->size = memReqs.size;
+		attachment->lazilyAllocated = false;
+
 		VkImageViewCreateInfo viewCI{};
-		viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
 		viewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-		viewCI.format = jhb::SwapChain::swapChainImageFormat;
+		viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewCI.format = format;
 		viewCI.subresourceRange = {};
 		viewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 		viewCI.subresourceRange.levelCount = 1;
 		viewCI.subresourceRange.layerCount = 1;
-		viewCI.image = ColorResolveAttachment.image;
-		if (vkCreateImageView(device.getLogicalDevice(), &viewCI, nullptr, &ColorResolveAttachment.view))
+		viewCI.image = attachment->image;
+		if (vkCreateImageView(device.getLogicalDevice(), &viewCI, nullptr, &attachment->view))
 		{
 			throw std::runtime_error("failed to create ImageView!");
 		}
@@ -174,8 +259,16 @@ namespace jhb {
 		imageCIa.samples = sampleCount;
 		imageCIa.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 		imageCIa.usage = usage | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+		if (transientAttachments)
+		{
+			imageCIa.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+		}
 
-		device.createImageWithInfo(imageCIa, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, attachment->image, attachment->memory);
+		VkMemoryPropertyFlags memProps = device.createImageWithInfo(imageCIa, getAttachmentMemoryProperties(), attachment->image, attachment->memory);
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device.getLogicalDevice(), attachment->image, &memReqs);
+		attachment->size = memReqs.size;
+		attachment->lazilyAllocated = (memProps & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0;
 		// Image view
 		VkImageViewCreateInfo viewCIa{};
 		viewCIa.viewType = VK_IMAGE_VIEW_TYPE_2D;
@@ -202,12 +295,11 @@ namespace jhb {
 			removeVkResources();
 			createGBuffers();
 
-			gbufferDescriptorPool = nullptr;
-			gbufferDescriptorSetLayout = nullptr;
+			device.getDeletionQueue().retire(std::move(gbufferDescriptorPool));
 			initializeOffScreenDescriptor();
 		}
 
-		std::array<VkImageView, 8> attachments;
+		std::vector<VkImageView> attachments(getAttachmentCount());
 		attachments[1] = PositionAttachment.view;
 		attachments[2] = NormalAttachment.view;
 		attachments[3] = AlbedoAttachment.view;
@@ -215,6 +307,10 @@ namespace jhb {
 		attachments[5] = EmmisiveAttachment.view;
 		attachments[6] = DepthAttachment.view;
 		attachments[7] = ColorResolveAttachment.view;
+		if (antiAliasingMode == AntiAliasingMode::TAA)
+		{
+			attachments[8] = VelocityAttachment.view;
+		}
 
 		frameBuffers.resize(swapchainImageViews.size());
 		for (int i = 0; i < swapchainImageViews.size(); i++)
@@ -240,10 +336,12 @@ namespace jhb {
 	{
 		createGBuffers();
 		// Set up separate renderpass with references to the color and depth attachments
-		std::array<VkAttachmentDescription, 8> attachmentDescs = {};
+		// taa adds velocity(8) and stores scene color(7) for resolve pass
+		const bool isTAA = antiAliasingMode == AntiAliasingMode::TAA;
+		std::vector<VkAttachmentDescription> attachmentDescs(getAttachmentCount());
 
 		// Init attachment properties
-		for (uint32_t i = 0; i <8; ++i)
+		for (uint32_t i = 0; i < attachmentDescs.size(); ++i)
 		{
 			if (i<7)
 			{
@@ -252,12 +350,24 @@ namespace jhb {
 			}
 			else
 			{
-				attachmentDescs[i].samples = device.msaaSamples;
+				attachmentDescs[i].samples = sampleCount;
 				attachmentDescs[i].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 			}
 
-			
-			attachmentDescs[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			// only swapchain image(0) is read after render pass. gbuffer is consumed by subpass 1 and msaa color is resolved inside the pass.
+			// clear is kept for gbuffer and depth, it costs nothing on tile memory and sky pixels must not read garbage.
+			if (isTAA && i >= 7)
+			{
+				attachmentDescs[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			}
+			else if (transientAttachments && i != 0)
+			{
+				attachmentDescs[i].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			}
+			else
+			{
+				attachmentDescs[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			}
 			attachmentDescs[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 			attachmentDescs[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 			if (i == 6)
@@ -270,10 +380,10 @@ namespace jhb {
 				attachmentDescs[i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 				attachmentDescs[i].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 			}
-			else if (i == 7)
+			else if (i >= 7)
 			{
 				attachmentDescs[i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-				attachmentDescs[i].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+				attachmentDescs[i].finalLayout = isTAA ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 			}
 			else
 			{
@@ -291,6 +401,10 @@ namespace jhb {
 		attachmentDescs[5].format = EmmisiveAttachment.format;
 		attachmentDescs[6].format = DepthAttachment.format;
 		attachmentDescs[7].format = ColorResolveAttachment.format;
+		if (isTAA)
+		{
+			attachmentDescs[8].format = VelocityAttachment.format;
+		}
 
 		std::vector<VkAttachmentReference> colorReferences;
 		colorReferences.push_back({ 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
@@ -311,7 +425,11 @@ namespace jhb {
 		subpassDescriptions[0].colorAttachmentCount = static_cast<uint32_t>(colorReferences.size());
 		subpassDescriptions[0].pDepthStencilAttachment = &depthReference;
 
-		VkAttachmentReference colorReference{ 7, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+		std::vector<VkAttachmentReference> lightingReferences = { { 7, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL } };
+		if (isTAA)
+		{
+			lightingReferences.push_back({ 8, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
+		}
 
 		std::vector<VkAttachmentReference> colorInputReferences;
 		colorInputReferences.push_back({ 1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL });
@@ -324,9 +442,10 @@ namespace jhb {
 
 		// light subpass will use inputattachemnts
 		subpassDescriptions[1].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-		subpassDescriptions[1].pColorAttachments = &colorReference;
-		subpassDescriptions[1].colorAttachmentCount = 1;
-		subpassDescriptions[1].pResolveAttachments = &colorResolveReference;
+		subpassDescriptions[1].pColorAttachments = lightingReferences.data();
+		subpassDescriptions[1].colorAttachmentCount = static_cast<uint32_t>(lightingReferences.size());
+		// taa resolves in its own pass with neighborhood samples, not here
+		subpassDescriptions[1].pResolveAttachments = isTAA ? nullptr : &colorResolveReference;
 		//subpassDescriptions[1].pDepthStencilAttachment = &depthReference;
 		subpassDescriptions[1].inputAttachmentCount = colorInputReferences.size();
 		subpassDescriptions[1].pInputAttachments = colorInputReferences.data();
@@ -365,6 +484,13 @@ namespace jhb {
 		dependencies[3].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 		dependencies[3].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
 		dependencies[3].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+		if (isTAA)
+		{
+			// resolve pass samples neighbors, so not by region
+			dependencies[3].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+			dependencies[3].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			dependencies[3].dependencyFlags = 0;
+		}
 
 		VkRenderPassCreateInfo renderPassInfo = {};
 		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -382,14 +508,15 @@ namespace jhb {
 	}
 	void DeferedPBRRenderSystem::createSponze()
 	{
-		auto sponzaModel = loadGLTFFile("Models/sponza/Sponza.gltf");
+		// camera is always inside sponza, lods would never be picked. its big primitives are culled per meshlet instead,
+		// and merged per material first so meshlets and draws work on one range per material
+		auto sponzaModel = loadGLTFFile("Models/sponza/Sponza.gltf", VK_SAMPLER_ADDRESS_MODE_REPEAT, false, true, true);
+		// scale and flip are baked into root matrix, object stays at origin as its only instance
+		TransformComponent sponzaTransform{};
+		sponzaTransform.scale = { 2.f, 2.f, 2.f };
+		sponzaTransform.rotation = { glm::radians(180.f),0.f, 0.f };
+		sponzaModel->rootModelMatrix = sponzaTransform.mat4();
 		auto sponza = GameObject::createGameObject();
-		sponza.transform.translation = { 0.f, 0.f, 0.f };
-		sponza.transform.scale = { 2.f, 2.f, 2.f };
-		sponza.transform.rotation = { glm::radians(180.f),0.f, 0.f };
-		sponzaModel->instanceCount += 1;
-		sponzaModel->rootModelMatrix = sponza.transform.mat4();
-		sponzaModel->updateInstanceBuffer(1, { sponza.transform.translation }, { sponza.transform.translation });
 		sponza.setId(id++);
 		sponza.model = sponzaModel;
 
@@ -428,12 +555,13 @@ namespace jhb {
 		return { gbufferDescriptorSetLayout->getDescriptorSetLayout() };
 	}
 
-	std::shared_ptr<Model> DeferedPBRRenderSystem::loadGLTFFile(const std::string& filename, VkSamplerAddressMode samplerMode)
+	std::shared_ptr<Model> DeferedPBRRenderSystem::loadGLTFFile(const std::string& filename, VkSamplerAddressMode samplerMode, bool generateLods, bool buildMeshlets, bool staticBatching)
 	{
 		tinygltf::Model glTFInput;
 		tinygltf::TinyGLTF gltfContext;
 		std::string error, warning;
 
+		gltfContext.SetImageLoader(Model::loadGLTFImageData, nullptr);
 		bool fileLoaded = gltfContext.LoadASCIIFromFile(&glTFInput, &error, &warning, filename);
 
 		size_t pos = filename.find_last_of('/');
@@ -446,7 +574,7 @@ namespace jhb {
 		model->path = filename.substr(0, pos);
 
 		if (fileLoaded) {
-			model->loadImages(glTFInput, samplerMode);
+			model->loadImages(glTFInput, samplerMode, true);
 			model->loadMaterials(glTFInput);
 			model->loadTextures(glTFInput);
 			const tinygltf::Scene& scene = glTFInput.scenes[0];
@@ -473,62 +601,122 @@ namespace jhb {
 			return nullptr;
 		}
 
+		model->computeTexelDensity(vertexBuffer, indexBuffer);
+		if (staticBatching)
+		{
+			model->buildStaticBatches(vertexBuffer, indexBuffer);
+		}
 		model->createVertexBuffer(vertexBuffer);
+		if (generateLods)
+		{
+			model->generateLods(indexBuffer);
+		}
+		if (buildMeshlets)
+		{
+			model->buildMeshlets(indexBuffer);
+		}
 		model->createIndexBuffer(indexBuffer);
+		model->buildDrawBuckets();
 		//model->createObjectSphere(vertexBuffer);
 		//model->updateInstanceBuffer(300, 2.5f, 2.5f);
 		//model->createObjectSphere(vertexBuffer);
 
-		PipelineConfigInfo pipelineConfig{};
-		pipelineConfig.depthStencilInfo.depthTestEnable = true;
-		pipelineConfig.depthStencilInfo.depthWriteEnable = true;
-		pipelineConfig.depthStencilInfo.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-		Pipeline::defaultPipelineConfigInfo(pipelineConfig);
-		createVertexAttributeAndBindingDesc(pipelineConfig);
+		createMaterialPipelines(*model);
+		gltfModels.push_back(model);
+		return model;
+	}
+
+	void DeferedPBRRenderSystem::createMaterialPipelines(Model& model)
+	{
 		std::array<VkPipelineColorBlendAttachmentState, 6> blendAttachmentStates;
+		std::array<VkPipelineColorBlendAttachmentState, 6> depthOnlyBlendStates;
 		for (int i = 0; i < blendAttachmentStates.size(); i++)
 		{
 			VkPipelineColorBlendAttachmentState colorblendState{};
 			colorblendState.blendEnable = VK_FALSE;
 			colorblendState.colorWriteMask = 0xf;
 			blendAttachmentStates[i] = colorblendState;
+			colorblendState.colorWriteMask = 0;
+			depthOnlyBlendStates[i] = colorblendState;
 		}
 
-		pipelineConfig.colorBlendInfo.attachmentCount = blendAttachmentStates.size();
-		pipelineConfig.colorBlendInfo.pAttachments = blendAttachmentStates.data();
+		// same subpass as gbuffer, prepass pipelines only change depth state and color writes
+		auto setupConfig = [&](PipelineConfigInfo& pipelineConfig, bool depthWrite, VkCompareOp depthCompareOp, std::array<VkPipelineColorBlendAttachmentState, 6>& blendStates) {
+			pipelineConfig.depthStencilInfo.depthTestEnable = true;
+			pipelineConfig.depthStencilInfo.depthWriteEnable = depthWrite;
+			Pipeline::defaultPipelineConfigInfo(pipelineConfig);
+			pipelineConfig.depthStencilInfo.depthCompareOp = depthCompareOp;
+			createVertexAttributeAndBindingDesc(pipelineConfig);
+			pipelineConfig.colorBlendInfo.attachmentCount = blendStates.size();
+			pipelineConfig.colorBlendInfo.pAttachments = blendStates.data();
+			pipelineConfig.renderPass = offScreenRenderPass;
+			pipelineConfig.pipelineLayout = pipelineLayout;
+		};
 
-		pipelineConfig.renderPass = offScreenRenderPass;
-		pipelineConfig.pipelineLayout = pipelineLayout;
-		model->createGraphicsPipelinePerMaterial("shaders/deferedoffscreen.vert.spv",
+		PipelineConfigInfo pipelineConfig{};
+		setupConfig(pipelineConfig, true, VK_COMPARE_OP_LESS_OR_EQUAL, blendAttachmentStates);
+		model.createGraphicsPipelinePerMaterial("shaders/deferedoffscreen.vert.spv",
 			"shaders/deferedoffscreen.frag.spv", pipelineConfig);
-		return model;
+
+		PipelineConfigInfo depthConfig{};
+		setupConfig(depthConfig, true, VK_COMPARE_OP_LESS_OR_EQUAL, depthOnlyBlendStates);
+		// depth is final after prepass, masked materials already discarded there
+		PipelineConfigInfo equalConfig{};
+		setupConfig(equalConfig, false, VK_COMPARE_OP_EQUAL, blendAttachmentStates);
+		equalConfig.materialAlphaTest = false;
+		model.createDepthPrepassPipelinesPerMaterial("shaders/deferedoffscreen.vert.spv", "shaders/deferedDepthPrepass.frag.spv", depthConfig,
+			"shaders/deferedoffscreen.frag.spv", equalConfig);
 	}
 
 	void DeferedPBRRenderSystem::createDamagedHelmets()
 	{
 		auto helmetModel = loadGLTFFile("Models/DamagedHelmet/DamagedHelmet.gltf", VK_SAMPLER_ADDRESS_MODE_REPEAT);
-		helmetModel->firstid = id;
-		std::vector<glm::vec3> tmppos;
-		std::vector<glm::vec3> tmprot;
-		uint32_t firstid = id;
+		// objects sharing the model are drawn as one instanced draw by InstanceBatcher
 		for (int i = 0; i< 6; i++)
 		{
 			auto helmet = GameObject::createGameObject();
-			helmet.transform.translation = { 0.f, 0.f, 0.f };
 			helmet.transform.rotation = { 0,0, glm::radians(90.f) };
 			auto rotate = glm::rotate(glm::mat4(1.f), (i * glm::two_pi<float>() / 6), { 0.f, 1.f, 0.f });
 			glm::vec4 tmp{ 2, -1.5, 2, 1};
-			tmppos.push_back(glm::vec3(rotate*tmp));
 			helmet.transform.translation = glm::vec3(rotate * tmp);
-			tmprot.push_back(helmet.transform.rotation);
 
-			helmetModel->instanceCount += 1;
 			helmet.setId(id++);
 			helmet.model = helmetModel;
 			GameObjectManager::GetSingleton().AddGameObject(std::move(helmet));
 		}
-		helmetModel->updateInstanceBuffer(6, tmppos, tmprot);
+	}
+
+	void DeferedPBRRenderSystem::createStressScene(const SceneConfig& scene)
+	{
+		std::vector<SceneInstance> instances = generateSceneInstances(scene);
+		std::vector<std::vector<uint32_t>> modelInstances(scene.modelCount);
+		for (uint32_t i = 0; i < instances.size(); i++)
+		{
+			modelInstances[instances[i].model].push_back(i);
+		}
+
+		for (uint32_t m = 0; m < scene.modelCount; m++)
+		{
+			auto model = loadGLTFFile(scene.modelFiles[m % scene.modelFiles.size()], VK_SAMPLER_ADDRESS_MODE_REPEAT);
+
+			for (uint32_t index : modelInstances[m])
+			{
+				const SceneInstance& instance = instances[index];
+				glm::vec2 material = getSceneMaterial(instance.material);
+
+				auto object = GameObject::createGameObject();
+				object.transform.translation = instance.position;
+				object.transform.rotation = instance.rotation;
+				object.roughness = material.x;
+				object.metallic = material.y;
+				object.setId(id++);
+				object.model = model;
+				GameObjectManager::GetSingleton().AddGameObject(std::move(object));
+			}
+		}
 
+		std::cout << "[scene] stress : " << scene.instanceCount << " instances of " << scene.modelCount << " models, " << scene.materialCount
+			<< " materials, " << scene.lightCount << " lights, seed " << scene.seed << std::endl;
 	}
 
 	void DeferedPBRRenderSystem::createFloor()
@@ -704,9 +892,24 @@ namespace jhb {
 
 		pipelineConfig.attributeDescriptions = attributeDescriptions;
 		pipelineConfig.bindingDescriptions = bindingDescriptions;
-		pipelineConfig.multisampleInfo.rasterizationSamples = device.msaaSamples;
+		pipelineConfig.multisampleInfo.rasterizationSamples = sampleCount;
 		pipelineConfig.renderPass = offScreenRenderPass;
 		pipelineConfig.pipelineLayout = lightingPipelinelayout;
+
+		if (antiAliasingMode == AntiAliasingMode::TAA)
+		{
+			// scene color + velocity
+			std::array<VkPipelineColorBlendAttachmentState, 2> blendAttachmentStates;
+			for (int i = 0; i < blendAttachmentStates.size(); i++)
+			{
+				blendAttachmentStates[i] = pipelineConfig.colorBlendAttachment;
+			}
+			pipelineConfig.colorBlendInfo.attachmentCount = blendAttachmentStates.size();
+			pipelineConfig.colorBlendInfo.pAttachments = blendAttachmentStates.data();
+			lightingPipeline = std::make_unique<Pipeline>(device, "shaders/deferedPBR.vert.spv",
+				"shaders/deferedPBRTAA.frag.spv", pipelineConfig);
+			return;
+		}
 		lightingPipeline = std::make_unique<Pipeline>(device, "shaders/deferedPBR.vert.spv",
 			"shaders/deferedPBR.frag.spv", pipelineConfig); 
 	}
@@ -766,46 +969,247 @@ namespace jhb {
 			"shaders/deferedoffscreenSkybox.frag.spv", pipelineConfig);
 	}
 
-	void DeferedPBRRenderSystem::removeVkResources()
+	void DeferedPBRRenderSystem::destroyAttachment(Texture& attachment)
 	{
-		vkDestroyImage(device.getLogicalDevice(), NormalAttachment.image, nullptr);
-		vkDestroyImageView(device.getLogicalDevice(), NormalAttachment.view, nullptr);
-		vkFreeMemory(device.getLogicalDevice(), NormalAttachment.memory, nullptr);
+		VkDevice logicalDevice = device.getLogicalDevice();
+		VkImageView view = attachment.view;
+		VkImage image = attachment.image;
+		VkDeviceMemory memory = attachment.memory;
+		device.getDeletionQueue().retire([logicalDevice, view, image, memory]() {
+			vkDestroyImageView(logicalDevice, view, nullptr);
+			vkDestroyImage(logicalDevice, image, nullptr);
+			vkFreeMemory(logicalDevice, memory, nullptr);
+		});
+		attachment.view = VK_NULL_HANDLE;
+		attachment.image = VK_NULL_HANDLE;
+		attachment.memory = VK_NULL_HANDLE;
+	}
 
-		vkDestroyImage(device.getLogicalDevice(), AlbedoAttachment.image, nullptr);
-		vkDestroyImageView(device.getLogicalDevice(), AlbedoAttachment.view, nullptr);
-		vkFreeMemory(device.getLogicalDevice(), AlbedoAttachment.memory, nullptr);
+	VkMemoryPropertyFlags DeferedPBRRenderSystem::getAttachmentMemoryProperties()
+	{
+		if (transientAttachments)
+		{
+			// device falls back to device local when there is no lazily allocated memory type
+			return VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+		}
+		return VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	}
 
-		vkDestroyImage(device.getLogicalDevice(), MaterialAttachment.image, nullptr);
-		vkDestroyImageView(device.getLogicalDevice(), MaterialAttachment.view, nullptr);
-		vkFreeMemory(device.getLogicalDevice(), MaterialAttachment.memory, nullptr);
+	void DeferedPBRRenderSystem::printAttachmentMemoryReport()
+	{
+		std::vector<std::pair<const char*, Texture*>> attachments = {
+			{"position", &PositionAttachment},
+			{"normal", &NormalAttachment},
+			{"albedo", &AlbedoAttachment},
+			{"material", &MaterialAttachment},
+			{"emmisive", &EmmisiveAttachment},
+			{"depth", &DepthAttachment},
+		};
+		if (antiAliasingMode == AntiAliasingMode::TAA)
+		{
+			attachments.push_back({ "scene color", &ColorResolveAttachment });
+			attachments.push_back({ "velocity", &VelocityAttachment });
+		}
+		else
+		{
+			attachments.push_back({ "msaa color", &ColorResolveAttachment });
+		}
 
-		vkDestroyImage(device.getLogicalDevice(), EmmisiveAttachment.image, nullptr);
-		vkDestroyImageView(device.getLogicalDevice(), EmmisiveAttachment.view, nullptr);
-		vkFreeMemory(device.getLogicalDevice(), EmmisiveAttachment.memory, nullptr);
+		VkDeviceSize totalRequired = 0;
+		VkDeviceSize totalCommitted = 0;
+		std::cout << "[gbuffer memory] " << device.getWindow().getExtent().width << "x" << device.getWindow().getExtent().height
+			<< (transientAttachments ? " transient" : " non-transient") << std::endl;
+		for (auto& [name, attachment] : attachments)
+		{
+			// committed size can only be queried for lazily allocated memory, the others are fully backed
+			VkDeviceSize committed = attachment->size;
+			if (attachment->lazilyAllocated)
+			{
+				vkGetDeviceMemoryCommitment(device.getLogicalDevice(), attachment->memory, &committed);
+			}
+			totalRequired += attachment->size;
+			totalCommitted += committed;
+			std::cout << "  " << name << " : " << attachment->size / 1024 << " KB, committed " << committed / 1024 << " KB"
+				<< (attachment->lazilyAllocated ? " (lazy)" : "") << std::endl;
+		}
+		std::cout << "  total : " << totalRequired / 1024 << " KB, committed " << totalCommitted / 1024
+			<< " KB, saved " << (totalRequired - totalCommitted) / 1024 << " KB" << std::endl;
+		attachmentMemorySize = totalCommitted;
+	}
+
+	void DeferedPBRRenderSystem::setAntiAliasing(AntiAliasingMode mode, VkSampleCountFlagBits samples, const std::vector<VkImageView>& swapchainImageViews)
+	{
+		VkSampleCountFlagBits newSampleCount = mode == AntiAliasingMode::TAA ? VK_SAMPLE_COUNT_1_BIT : std::min(samples, device.msaaSamples);
+		if (mode == antiAliasingMode && newSampleCount == sampleCount)
+		{
+			return;
+		}
+
+		antiAliasingMode = mode;
+		sampleCount = newSampleCount;
+		recreateOffScreenPass(swapchainImageViews);
+	}
+
+	void DeferedPBRRenderSystem::setTransientAttachments(bool transient, const std::vector<VkImageView>& swapchainImageViews)
+	{
+		if (transient == transientAttachments)
+		{
+			return;
+		}
 
-		vkDestroyImage(device.getLogicalDevice(), DepthAttachment.image, nullptr);
-		vkDestroyImageView(device.getLogicalDevice(), DepthAttachment.view, nullptr);
-		vkFreeMemory(device.getLogicalDevice(), DepthAttachment.memory, nullptr);
+		transientAttachments = transient;
+		recreateOffScreenPass(swapchainImageViews);
+	}
 
-		gbufferDescriptorSetLayout = nullptr;
+	void DeferedPBRRenderSystem::recreateOffScreenPass(const std::vector<VkImageView>& swapchainImageViews)
+	{
+		attachmentReportPending = true;
+
+		// sample count and attachment count are part of render pass compatibility,
+		// so every pipeline built on offScreenRenderPass is created again.
+		// old objects are retired, frames in flight keep using them
+		auto& deletionQueue = device.getDeletionQueue();
+		VkDevice logicalDevice = device.getLogicalDevice();
+		removeVkResources();
+		deletionQueue.retire([logicalDevice, renderPass = offScreenRenderPass, lightingLayout = lightingPipelinelayout, skyboxLayout = skyboxPipelinelayout]() {
+			vkDestroyRenderPass(logicalDevice, renderPass, nullptr);
+			vkDestroyPipelineLayout(logicalDevice, lightingLayout, nullptr);
+			vkDestroyPipelineLayout(logicalDevice, skyboxLayout, nullptr);
+		});
+		deletionQueue.retire(std::move(pipeline));
+		deletionQueue.retire(std::move(lightingPipeline));
+		deletionQueue.retire(std::move(skyboxPipeline));
+		createRenderPass(swapchainFormat);
+		createFrameBuffers(swapchainImageViews);
+		deletionQueue.retire(std::move(gbufferDescriptorPool));
+		initializeOffScreenDescriptor();
 
-		for (int i = 0; i < frameBuffers.size(); i++)
+		createPipeline(nullptr, "shaders/deferedoffscreen.vert.spv", "shaders/deferedoffscreen.frag.spv");
+		createLightingPipelineAndPipelinelayout(lightingSetLayouts);
+		createSkyboxPipelineAndPipelinelayout(skyboxSetLayouts);
+		for (auto& model : gltfModels)
 		{
-			vkDestroyFramebuffer(device.getLogicalDevice(), frameBuffers[i], nullptr);
+			for (auto& material : model->materials)
+			{
+				deletionQueue.retire(std::move(material.pipeline));
+				deletionQueue.retire(std::move(material.depthPipeline));
+				deletionQueue.retire(std::move(material.equalPipeline));
+			}
+			createMaterialPipelines(*model);
+		}
+	}
+
+	void DeferedPBRRenderSystem::removeVkResources()
+	{
+		destroyAttachment(PositionAttachment);
+		destroyAttachment(NormalAttachment);
+		destroyAttachment(AlbedoAttachment);
+		destroyAttachment(MaterialAttachment);
+		destroyAttachment(EmmisiveAttachment);
+		destroyAttachment(DepthAttachment);
+		destroyAttachment(ColorResolveAttachment);
+		destroyAttachment(VelocityAttachment);
+
+		// layout cache keeps it alive for pipelines still in flight
+		gbufferDescriptorSetLayout.reset();
+
+		VkDevice logicalDevice = device.getLogicalDevice();
+		device.getDeletionQueue().retire([logicalDevice, oldFrameBuffers = frameBuffers]() {
+			for (auto framebuffer : oldFrameBuffers)
+			{
+				vkDestroyFramebuffer(logicalDevice, framebuffer, nullptr);
+			}
+		});
+	}
+
+	void DeferedPBRRenderSystem::selectLods(FrameInfo& frameInfo, float viewportHeight, bool enabled, float errorPixels, bool debugView, FrustumCuller* culler, OcclusionCuller* occlusion,
+		TextureStreamer* streamer)
+	{
+		// projection[1][1] is 1 / tan(fovy / 2), so error / distance * pixelScale is size on screen in pixels
+		float pixelScale = std::abs(frameInfo.camera.getProjection()[1][1]) * viewportHeight * 0.5f;
+		glm::vec3 cameraPosition = frameInfo.camera.getInverseView()[3];
+		glm::mat4 viewProjection = frameInfo.camera.getProjection() * frameInfo.camera.getView();
+
+		if (culler && occlusion)
+		{
+			occlusion->render(viewProjection);
+		}
+
+		lodInstanceCounts.fill(0);
+		visibleInstanceCount = 0;
+		totalInstanceCount = 0;
+		for (auto& model : gltfModels)
+		{
+			model->cullStaticBatches(frameInfo.frameIndex, viewProjection, culler);
+			uint32_t instances = static_cast<uint32_t>(model->instanceData.size());
+			totalInstanceCount += instances;
+			if (!culler || instances == 0)
+			{
+				visibleInstanceCount += instances;
+				if (streamer)
+				{
+					model->requestTextureMips(*streamer, frameInfo.frameIndex, cameraPosition, pixelScale);
+				}
+				if (!enabled)
+				{
+					model->clearLods(frameInfo.frameIndex);
+					continue;
+				}
+				model->selectLods(frameInfo.frameIndex, cameraPosition, pixelScale, errorPixels, debugView);
+			}
+			else
+			{
+				culler->cull(viewProjection, model->getInstanceBounds(), visibleInstances);
+				if (occlusion && !occlusion->isOccluder(model.get()))
+				{
+					occlusion->cull(model->getInstanceBounds(), visibleInstances);
+				}
+				visibleInstanceCount += static_cast<uint32_t>(visibleInstances.size());
+				if (streamer)
+				{
+					model->requestTextureMips(*streamer, frameInfo.frameIndex, cameraPosition, pixelScale, &visibleInstances);
+				}
+				model->selectLods(frameInfo.frameIndex, cameraPosition, pixelScale, enabled ? errorPixels : -1.f, debugView, &visibleInstances);
+			}
+			// culled frame is filled even without lods
+			auto& counts = model->getLodInstanceCounts(frameInfo.frameIndex);
+			uint32_t levels = culler && instances > 0 ? std::max(model->getLodCount(), 1u) : model->getLodCount();
+			for (uint32_t level = 0; level < levels; level++)
+			{
+				lodInstanceCounts[level] += counts[level];
+			}
 		}
 	}
 
 	void DeferedPBRRenderSystem::renderGameObjects(FrameInfo& frameInfo)
 	{
+		// depth of every opaque and masked surface first, gbuffer below then shades each pixel once with equal depth test
+		if (depthPrepass)
+		{
+			for (auto& kv : GameObjectManager::GetSingleton().gameObjects)
+			{
+				auto& obj = kv.second;
+				// skybox keeps its own pipeline in gbuffer draw
+				if (obj.model == nullptr || kv.first == 1 || kv.first != obj.model->batchOwner)
+				{
+					continue;
+				}
+				obj.model->bind(frameInfo.commandBuffer);
+				cmd::bindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &frameInfo.globaldDescriptorSet, 1, &frameInfo.globalUboOffset);
+				const CulledGeometry* culled = frameInfo.meshletCulling ? frameInfo.meshletCulling->getCulledGeometry(obj.model.get(), 0) : nullptr;
+				obj.model->draw(frameInfo.commandBuffer, pipelineLayout, frameInfo.frameIndex, culled, MaterialPass::DepthPrepass);
+			}
+		}
+
 		for (auto& kv : GameObjectManager::GetSingleton().gameObjects)
 		{
 			auto& obj = kv.second;
-			if (kv.first > 2) // higer than 2 no need to draw cause of instance drawing
+			if (obj.model == nullptr)
 			{
-				break;
+				continue;
 			}
-			if (obj.model == nullptr)
+			// instanced model is drawn once, by owner of its batch
+			if (kv.first != obj.model->batchOwner)
 			{
 				continue;
 			}
@@ -817,43 +1221,44 @@ namespace jhb {
 
 			if (kv.first == 1)
 			{
-				vkCmdBindDescriptorSets(
+				cmd::bindDescriptorSets(
 					frameInfo.commandBuffer,
 					VK_PIPELINE_BIND_POINT_GRAPHICS,
 					skyboxPipelinelayout,
 					0, 1
 					, &frameInfo.globaldDescriptorSet,
-					0, nullptr
+					1, &frameInfo.globalUboOffset
 				);
 				auto& skyBox = kv.second;
-				vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, skyboxPipelinelayout, 1, 1, &frameInfo.skyBoxImageSamplerDecriptorSet, 0, nullptr);
-				vkCmdBindPipeline(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, skyboxPipeline->getPipeline());
+				cmd::bindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, skyboxPipelinelayout, 1, 1, &frameInfo.skyBoxImageSamplerDecriptorSet, 0, nullptr);
+				cmd::bindPipeline(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, skyboxPipeline->getPipeline());
 
 				SimplePushConstantData push{};
 				push.ModelMatrix = skyBox.transform.mat4();
 				push.normalMatrix = skyBox.transform.normalMatrix();
 
-				vkCmdPushConstants(frameInfo.commandBuffer, skyboxPipelinelayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(SimplePushConstantData), &push);
+				cmd::pushConstants(frameInfo.commandBuffer, skyboxPipelinelayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(SimplePushConstantData), &push);
 
 				obj.model->draw(frameInfo.commandBuffer, skyboxPipelinelayout, frameInfo.frameIndex);
 				continue;
 			}
 			
-			vkCmdBindDescriptorSets(
+			cmd::bindDescriptorSets(
 				frameInfo.commandBuffer,
 				VK_PIPELINE_BIND_POINT_GRAPHICS,
 				pipelineLayout,
 				0, 1
 				, &frameInfo.globaldDescriptorSet,
-				0, nullptr
+				1, &frameInfo.globalUboOffset
 			);
-			obj.model->draw(frameInfo.commandBuffer, pipelineLayout, frameInfo.frameIndex);
+			const CulledGeometry* culled = frameInfo.meshletCulling ? frameInfo.meshletCulling->getCulledGeometry(obj.model.get(), 0) : nullptr;
+			obj.model->draw(frameInfo.commandBuffer, pipelineLayout, frameInfo.frameIndex, culled, depthPrepass ? MaterialPass::GBufferEqual : MaterialPass::GBuffer);
 		}
 
 		vkCmdNextSubpass(frameInfo.commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
 
-		vkCmdBindPipeline(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, lightingPipeline->getPipeline());
-		vkCmdBindDescriptorSets(
+		cmd::bindPipeline(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, lightingPipeline->getPipeline());
+		cmd::bindDescriptorSets(
 			frameInfo.commandBuffer,
 			VK_PIPELINE_BIND_POINT_GRAPHICS,
 			lightingPipelinelayout,
@@ -861,8 +1266,8 @@ namespace jhb {
 			, &gbufferDescriptorSet,
 			0, nullptr
 		);
-		vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, lightingPipelinelayout, 1, 1, &frameInfo.globaldDescriptorSet, 0, NULL);
-		vkCmdBindDescriptorSets(
+		cmd::bindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, lightingPipelinelayout, 1, 1, &frameInfo.globaldDescriptorSet, 1, &frameInfo.globalUboOffset);
+		cmd::bindDescriptorSets(
 			frameInfo.commandBuffer,
 			VK_PIPELINE_BIND_POINT_GRAPHICS,
 			lightingPipelinelayout,
@@ -870,7 +1275,7 @@ namespace jhb {
 			, &frameInfo.pbrImageSamplerDescriptorSet,
 			0, nullptr
 		);
-		vkCmdBindDescriptorSets(
+		cmd::bindDescriptorSets(
 			frameInfo.commandBuffer,
 			VK_PIPELINE_BIND_POINT_GRAPHICS,
 			lightingPipelinelayout,
@@ -878,6 +1283,6 @@ namespace jhb {
 			, &frameInfo.shadowMapDescriptorSet,
 			0, nullptr
 		);
-		vkCmdDraw(frameInfo.commandBuffer, 3, 1, 0, 0);
+		cmd::draw(frameInfo.commandBuffer, 3, 1, 0, 0);
 	}
 };
\ No newline at end of file
@@ -13,17 +13,25 @@
 #include "GameObject.h"
 #include "Camera.h"
 #include "FrameInfo.h"
+#include "Scene.h"
 
 #include <stdint.h>
 
 namespace jhb {
+	enum class AntiAliasingMode {
+		MSAA, // lighting subpass is multisampled and resolved into swapchain
+		TAA, // everything is 1x, jittered scene color and velocity are resolved by TAARenderSystem
+	};
+
 	class DeferedPBRRenderSystem : public BaseRenderSystem {
 		struct Texture {
-			VkImage image;
-			VkDeviceMemory memory;
-			VkImageView view;
+			VkImage image = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
 			VkSampler sampler;
 			VkFormat format;
+			VkDeviceSize size = 0;
+			bool lazilyAllocated = false;
 		};
 
 		struct UniformData {
@@ -39,7 +47,8 @@ namespace jhb {
 		} offscreenBuffer;
 
 	public:
-		DeferedPBRRenderSystem(Device& device, std::vector<VkDescriptorSetLayout> descSetlayouts, const std::vector<VkImageView>& swapchainImageViews, VkFormat swapchainFormat);
+		DeferedPBRRenderSystem(Device& device, std::vector<VkDescriptorSetLayout> descSetlayouts, const std::vector<VkImageView>& swapchainImageViews, VkFormat swapchainFormat,
+			const SceneConfig& scene = {});
 		~DeferedPBRRenderSystem();
 
 		DeferedPBRRenderSystem(const DeferedPBRRenderSystem&) = delete;
@@ -51,6 +60,37 @@ namespace jhb {
 		VkFramebuffer getFrameBuffer(int idx) { return frameBuffers[idx]; }
 		VkRenderPass getRenderPass() { return offScreenRenderPass; }
 		void createFrameBuffers(const std::vector<VkImageView>& swapchainImageViews, bool shouldRecreate = false);
+		void printAttachmentMemoryReport();
+
+		// recreate render pass, attachments and every pipeline on offScreenRenderPass. samples is ignored for taa
+		void setAntiAliasing(AntiAliasingMode mode, VkSampleCountFlagBits samples, const std::vector<VkImageView>& swapchainImageViews);
+		// store ops of render pass and memory of attachments change, so same recreate as setAntiAliasing
+		void setTransientAttachments(bool transient, const std::vector<VkImageView>& swapchainImageViews);
+		bool getTransientAttachments() { return transientAttachments; }
+		AntiAliasingMode getAntiAliasingMode() { return antiAliasingMode; }
+		VkSampleCountFlagBits getSampleCount() { return sampleCount; }
+		uint32_t getAttachmentCount() { return antiAliasingMode == AntiAliasingMode::TAA ? 9 : 8; }
+		VkDeviceSize getAttachmentMemorySize() { return attachmentMemorySize; }
+		// only valid in taa mode
+		VkImageView getSceneColorView() { return ColorResolveAttachment.view; }
+		VkImageView getVelocityView() { return VelocityAttachment.view; }
+		VkImage getSceneColorImage() { return ColorResolveAttachment.image; }
+		VkImage getVelocityImage() { return VelocityAttachment.image; }
+
+		// per instance lod of every gltf model for this frame, must run before pass is recorded. disabled draws full meshes.
+		// with culler, instances outside camera frustum are dropped from gbuffer draws, shadow still draws them.
+		// occlusion also drops instances hidden behind its occluders, it only runs together with culler.
+		// streamer is asked for texture mips of materials with visible geometry
+		void selectLods(FrameInfo& frameInfo, float viewportHeight, bool enabled, float errorPixels, bool debugView, FrustumCuller* culler = nullptr, class OcclusionCuller* occlusion = nullptr,
+			class TextureStreamer* streamer = nullptr);
+		// instances per lod level over all models, last selectLods
+		const std::array<uint32_t, Model::MAX_LOD_LEVEL>& getLodInstanceCounts() const { return lodInstanceCounts; }
+		// instances over all models last selectLods, visible is all of them without culler
+		uint32_t getVisibleInstanceCount() const { return visibleInstanceCount; }
+		uint32_t getTotalInstanceCount() const { return totalInstanceCount; }
+
+		// depth only pass over opaque then masked buckets before gbuffer, gbuffer then tests equal and never discards
+		bool depthPrepass = true;
 	private:
 		// render pass only used to create pipeline
 		// render system doest not store render pass, beacuase render system's life cycle is not tie to render pass
@@ -59,19 +99,27 @@ namespace jhb {
 		void createAttachment(VkFormat format,
 			VkImageUsageFlagBits usage,
 			Texture* attachment, VkSampleCountFlagBits sampleCount = VK_SAMPLE_COUNT_1_BIT);
+		void createSampledAttachment(VkFormat format, Texture* attachment);
 		void createRenderPass(VkFormat);
 		void createSponze();
 		void createDamagedHelmets();
 		void createSkybox();
 		void createFloor();
+		// every model of scene is its own Model, instances of a model get contiguous ids
+		void createStressScene(const SceneConfig& scene);
 
 		void createVertexAttributeAndBindingDesc(PipelineConfigInfo&);
 		void createLightingPipelineAndPipelinelayout(const std::vector<VkDescriptorSetLayout>&);
 		void createSkyboxPipelineAndPipelinelayout(const std::vector<VkDescriptorSetLayout>& externDescsetlayout);
+		void recreateOffScreenPass(const std::vector<VkImageView>& swapchainImageViews);
 		void removeVkResources();
+		void destroyAttachment(Texture& attachment);
+		VkMemoryPropertyFlags getAttachmentMemoryProperties();
 
 		std::vector<VkDescriptorSetLayout> initializeOffScreenDescriptor();
-		std::shared_ptr<Model> loadGLTFFile(const std::string& filename, VkSamplerAddressMode samplerMode = VK_SAMPLER_ADDRESS_MODE_REPEAT);
+		// staticBatching merges primitives of every node per material, for models placed once
+		std::shared_ptr<Model> loadGLTFFile(const std::string& filename, VkSamplerAddressMode samplerMode = VK_SAMPLER_ADDRESS_MODE_REPEAT, bool generateLods = true, bool buildMeshlets = false, bool staticBatching = false);
+		void createMaterialPipelines(Model& model);
 
 	private:
 		std::unique_ptr<Pipeline> lightingPipeline = nullptr; // pipeline for second subpass
@@ -86,18 +134,36 @@ namespace jhb {
 		Texture DepthAttachment;
 		Texture MaterialAttachment;
 		Texture EmmisiveAttachment;
-		Texture ColorResolveAttachment;
+		Texture ColorResolveAttachment; // msaa color, or 1x scene color in taa mode
+		Texture VelocityAttachment; // taa only
 
 		std::vector<VkFramebuffer> frameBuffers;
 
+		// gbuffer, depth and msaa color are only live inside offScreenRenderPass,
+		// so they don't need to be stored and can use lazily allocated memory on tilers
+		bool transientAttachments = true;
+		VkDeviceSize attachmentMemorySize = 0;
+		// report is printed when configuration changes, not on every resize
+		bool attachmentReportPending = true;
+
+		AntiAliasingMode antiAliasingMode = AntiAliasingMode::MSAA;
+		VkSampleCountFlagBits sampleCount = VK_SAMPLE_COUNT_1_BIT;
+		VkFormat swapchainFormat;
+		std::vector<VkDescriptorSetLayout> lightingSetLayouts;
+		std::vector<VkDescriptorSetLayout> skyboxSetLayouts;
+		std::vector<std::shared_ptr<Model>> gltfModels;
+		std::array<uint32_t, Model::MAX_LOD_LEVEL> lodInstanceCounts{};
+		uint32_t visibleInstanceCount = 0;
+		uint32_t totalInstanceCount = 0;
+		std::vector<uint32_t> visibleInstances;
+
 		VkRenderPass offScreenRenderPass;
 		const VkExtent2D offscreenImageSize{ 1024, 1024 };
 
-		std::unique_ptr<Buffer> uboBuffer;
 		VkDescriptorSet gbufferDescriptorSet;
 
 		std::unique_ptr<DescriptorPool> gbufferDescriptorPool;
-		std::unique_ptr<DescriptorSetLayout> gbufferDescriptorSetLayout;
+		std::shared_ptr<DescriptorSetLayout> gbufferDescriptorSetLayout;
 		glm::vec3 _lightpos;
 	public:
 		GameObject::Map pbrObjects;
@@ -0,0 +1,35 @@
+#include "DeletionQueue.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace jhb {
+	void DeletionQueue::retire(std::function<void()> destroy)
+	{
+		entries.push_back(Entry{ submittedFrames, std::move(destroy) });
+		peakPendingCount = std::max(peakPendingCount, entries.size());
+	}
+
+	void DeletionQueue::collect(uint64_t completedFrames)
+	{
+		// entries are in frame order. destroying a retired system can retire more, so ready ones are taken out first
+		std::vector<Entry> ready;
+		while (!entries.empty() && entries.front().frame < completedFrames)
+		{
+			ready.push_back(std::move(entries.front()));
+			entries.pop_front();
+		}
+		for (auto& entry : ready)
+		{
+			entry.destroy();
+		}
+	}
+
+	void DeletionQueue::flush()
+	{
+		while (!entries.empty())
+		{
+			collect(UINT64_MAX);
+		}
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#include <functional>
+#include <memory>
+#include <deque>
+
+namespace jhb {
+	// vulkan objects still referenced by frames in flight are retired here instead of destroyed,
+	// each one is tagged with frame being recorded and destroyed once that frame's fence was waited.
+	// only covers graphics queue submissions made through renderer
+	class DeletionQueue
+	{
+	public:
+		DeletionQueue() = default;
+		~DeletionQueue() = default;
+
+		DeletionQueue(const DeletionQueue&) = delete;
+		DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+		void retire(std::function<void()> destroy);
+		// owner's destructor runs when frame completes, for pipelines and whole render systems
+		template<typename T>
+		void retire(std::unique_ptr<T> object)
+		{
+			if (object)
+			{
+				retire([shared = std::shared_ptr<T>(std::move(object))]() mutable { shared.reset(); });
+			}
+		}
+
+		// renderer calls these, one per graphics submission and one per waited frame fence
+		void frameSubmitted() { submittedFrames++; }
+		void collect(uint64_t completedFrames);
+		// device must be idle
+		void flush();
+
+		uint64_t getSubmittedFrames() const { return submittedFrames; }
+		size_t getPendingCount() const { return entries.size(); }
+		size_t getPeakPendingCount() const { return peakPendingCount; }
+
+	private:
+		struct Entry {
+			uint64_t frame;
+			std::function<void()> destroy;
+		};
+
+		std::deque<Entry> entries;
+		uint64_t submittedFrames = 0;
+		size_t peakPendingCount = 0;
+	};
+}
@@ -1,6 +1,7 @@
 #include "Descriptors.h"
 
 // std
+#include <algorithm>
 #include <cassert>
 #include <stdexcept>
 
@@ -23,8 +24,31 @@ namespace jhb {
         return *this;
     }
 
-    std::unique_ptr<DescriptorSetLayout> DescriptorSetLayout::Builder::build() const {
-        return std::make_unique<DescriptorSetLayout>(device, bindings);
+    std::shared_ptr<DescriptorSetLayout> DescriptorSetLayout::Builder::build() const {
+        return device.getDescriptorLayoutCache().get(bindings);
+    }
+
+    // *************** Descriptor Layout Cache *********************
+
+    std::shared_ptr<DescriptorSetLayout> DescriptorLayoutCache::get(
+        const std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding>& bindings) {
+        Key key;
+        key.reserve(bindings.size());
+        for (auto& kv : bindings) {
+            auto& b = kv.second;
+            key.push_back({ b.binding, static_cast<uint32_t>(b.descriptorType), b.descriptorCount, b.stageFlags });
+        }
+        std::sort(key.begin(), key.end());
+
+        auto it = layouts.find(key);
+        if (it != layouts.end()) {
+            hitCount++;
+            return it->second;
+        }
+
+        auto layout = std::make_shared<DescriptorSetLayout>(device, bindings);
+        layouts.emplace(std::move(key), layout);
+        return layout;
     }
 
     // *************** Descriptor Set Layout *********************
@@ -110,8 +134,7 @@ namespace jhb {
         allocInfo.pSetLayouts = &descriptorSetLayout;
         allocInfo.descriptorSetCount = 1;
 
-        // Might want to create a "DescriptorPoolManager" class that handles this case, and builds
-        // a new pool whenever an old pool fills up. But this is beyond our current scope
+        // DescriptorAllocator chains a new pool when this fails
         if (vkAllocateDescriptorSets(device.getLogicalDevice(), &allocInfo, &descriptor) != VK_SUCCESS) {
             return false;
         }
@@ -130,10 +153,79 @@ namespace jhb {
         vkResetDescriptorPool(device.getLogicalDevice(), descriptorPool, 0);
     }
 
+    // *************** Descriptor Allocator *********************
+
+    DescriptorAllocator::DescriptorAllocator(
+        Device& device, const std::vector<VkDescriptorPoolSize>& poolSizes, uint32_t initialSetsPerPool)
+        : device{ device }, poolSizes{ poolSizes }, setsPerPool{ initialSetsPerPool } {}
+
+    std::unique_ptr<DescriptorPool> DescriptorAllocator::takePool() {
+        if (!readyPools.empty()) {
+            auto pool = std::move(readyPools.back());
+            readyPools.pop_back();
+            return pool;
+        }
+
+        std::vector<VkDescriptorPoolSize> sizes = poolSizes;
+        for (auto& size : sizes) {
+            size.descriptorCount *= setsPerPool;
+        }
+        auto pool = std::make_unique<DescriptorPool>(device, setsPerPool, 0, sizes);
+        setsPerPool = std::min(setsPerPool * 2, 4096u);
+        return pool;
+    }
+
+    bool DescriptorAllocator::allocate(const VkDescriptorSetLayout descriptorSetLayout, VkDescriptorSet& descriptor) {
+        if (!currentPool) {
+            currentPool = takePool();
+            currentPoolSetCount = 0;
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = currentPool->descriptorPool;
+        allocInfo.pSetLayouts = &descriptorSetLayout;
+        allocInfo.descriptorSetCount = 1;
+        VkResult result = vkAllocateDescriptorSets(device.getLogicalDevice(), &allocInfo, &descriptor);
+
+        // only a pool that is really full or fragmented is retired, other errors would fail in next pool too
+        if ((result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) && currentPoolSetCount > 0) {
+            fullPools.push_back(std::move(currentPool));
+            currentPool = takePool();
+            currentPoolSetCount = 0;
+            allocInfo.descriptorPool = currentPool->descriptorPool;
+            result = vkAllocateDescriptorSets(device.getLogicalDevice(), &allocInfo, &descriptor);
+        }
+
+        if (result != VK_SUCCESS) {
+            // layout uses a type this allocator has no pool size for, or device memory ran out. pool stays current
+            return false;
+        }
+        currentPoolSetCount++;
+        allocatedSetCount++;
+        return true;
+    }
+
+    void DescriptorAllocator::resetPools() {
+        if (currentPool) {
+            fullPools.push_back(std::move(currentPool));
+        }
+        currentPoolSetCount = 0;
+        for (auto& pool : fullPools) {
+            pool->resetPool();
+            readyPools.push_back(std::move(pool));
+        }
+        fullPools.clear();
+        allocatedSetCount = 0;
+    }
+
     // *************** Descriptor Writer *********************
 
     DescriptorWriter::DescriptorWriter(DescriptorSetLayout& setLayout, DescriptorPool& pool)
-        : setLayout{ setLayout }, pool{ pool } {}
+        : setLayout{ setLayout }, pool{ &pool }, writes{ setLayout.device.getFrameArena() } {}
+
+    DescriptorWriter::DescriptorWriter(DescriptorSetLayout& setLayout, DescriptorAllocator& allocator)
+        : setLayout{ setLayout }, allocator{ &allocator }, writes{ setLayout.device.getFrameArena() } {}
 
     DescriptorWriter& DescriptorWriter::writeBuffer(
         uint32_t binding, VkDescriptorBufferInfo* bufferInfo) {
@@ -178,7 +270,8 @@ namespace jhb {
     }
 
     bool DescriptorWriter::build(VkDescriptorSet& set) {
-        bool success = pool.allocateDescriptor(setLayout.getDescriptorSetLayout(), set);
+        bool success = allocator ? allocator->allocate(setLayout.getDescriptorSetLayout(), set)
+            : pool->allocateDescriptor(setLayout.getDescriptorSetLayout(), set);
         if (!success) {
             return false;
         }
@@ -190,7 +283,7 @@ namespace jhb {
         for (auto& write : writes) {
             write.dstSet = set;
         }
-        vkUpdateDescriptorSets(pool.device.getLogicalDevice(), writes.size(), writes.data(), 0, nullptr);
+        vkUpdateDescriptorSets(setLayout.device.getLogicalDevice(), writes.size(), writes.data(), 0, nullptr);
     }
 
 }  // namespace lve
\ No newline at end of file
@@ -3,6 +3,8 @@
 #include "Device.h"
 
 // std
+#include <array>
+#include <map>
 #include <memory>
 #include <unordered_map>
 #include <vector>
@@ -20,7 +22,8 @@ namespace jhb {
                 VkDescriptorType descriptorType,
                 VkShaderStageFlags stageFlags,
                 uint32_t count = 1);
-            std::unique_ptr<DescriptorSetLayout> build() const;
+            // identical binding sets share one layout through device's layout cache
+            std::shared_ptr<DescriptorSetLayout> build() const;
 
         private:
             Device& device;
@@ -43,6 +46,27 @@ namespace jhb {
         friend class DescriptorWriter;
     };
 
+    // layouts live until device is destroyed, so retired pipelines never outlive their layouts
+    class DescriptorLayoutCache {
+    public:
+        DescriptorLayoutCache(Device& device) : device{ device } {}
+        DescriptorLayoutCache(const DescriptorLayoutCache&) = delete;
+        DescriptorLayoutCache& operator=(const DescriptorLayoutCache&) = delete;
+
+        std::shared_ptr<DescriptorSetLayout> get(const std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding>& bindings);
+
+        size_t getLayoutCount() const { return layouts.size(); }
+        uint32_t getHitCount() const { return hitCount; }
+
+    private:
+        // binding, type, count, stages sorted by binding
+        using Key = std::vector<std::array<uint32_t, 4>>;
+
+        Device& device;
+        std::map<Key, std::shared_ptr<DescriptorSetLayout>> layouts;
+        uint32_t hitCount = 0;
+    };
+
     class DescriptorPool {
     public:
         class Builder {
@@ -82,11 +106,42 @@ namespace jhb {
         VkDescriptorPool descriptorPool;
 
         friend class DescriptorWriter;
+        friend class DescriptorAllocator;
+    };
+
+    // chains pools, a new one is made when allocation fails because current one is full.
+    // poolSizes are descriptor counts per set, pool sizes scale with sets per pool which doubles every new pool
+    class DescriptorAllocator {
+    public:
+        DescriptorAllocator(Device& device, const std::vector<VkDescriptorPoolSize>& poolSizes, uint32_t initialSetsPerPool = 32);
+        DescriptorAllocator(const DescriptorAllocator&) = delete;
+        DescriptorAllocator& operator=(const DescriptorAllocator&) = delete;
+
+        bool allocate(const VkDescriptorSetLayout descriptorSetLayout, VkDescriptorSet& descriptor);
+        // every set allocated so far is released at once, gpu must be done with them
+        void resetPools();
+
+        size_t getPoolCount() const { return fullPools.size() + readyPools.size() + (currentPool ? 1 : 0); }
+        uint32_t getAllocatedSetCount() const { return allocatedSetCount; }
+
+    private:
+        std::unique_ptr<DescriptorPool> takePool();
+
+        Device& device;
+        std::vector<VkDescriptorPoolSize> poolSizes;
+        uint32_t setsPerPool;
+        uint32_t allocatedSetCount = 0;
+        // an empty pool that fails is not full, retiring it would only chain pools forever
+        uint32_t currentPoolSetCount = 0;
+        std::unique_ptr<DescriptorPool> currentPool;
+        std::vector<std::unique_ptr<DescriptorPool>> readyPools;
+        std::vector<std::unique_ptr<DescriptorPool>> fullPools;
     };
 
     class DescriptorWriter {
     public:
         DescriptorWriter(DescriptorSetLayout& setLayout, DescriptorPool& pool);
+        DescriptorWriter(DescriptorSetLayout& setLayout, DescriptorAllocator& allocator);
 
         DescriptorWriter& writeBuffer(uint32_t binding, VkDescriptorBufferInfo* bufferInfo);
         DescriptorWriter& writeImage(uint32_t binding, VkDescriptorImageInfo* imageInfos);
@@ -96,7 +151,9 @@ namespace jhb {
 
     private:
         DescriptorSetLayout& setLayout;
-        DescriptorPool& pool;
-        std::vector<VkWriteDescriptorSet> writes;
+        DescriptorPool* pool = nullptr;
+        DescriptorAllocator* allocator = nullptr;
+        // temporary, taken from frame arena while a frame is recorded
+        FrameVector<VkWriteDescriptorSet> writes;
     };
 }
@@ -1,5 +1,7 @@
 #include "Device.h"
 #include "SwapChain.h"
+#include "Descriptors.h"
+#include "CommandStats.h"
 #include "External/Imgui/imgui_impl_glfw.h"
 #include "External/Imgui/imgui_impl_vulkan.h"
 
@@ -14,10 +16,14 @@ namespace jhb {
 	{
 		initVulkan();
 		initImgui();
+		descriptorLayoutCache = std::make_unique<DescriptorLayoutCache>(*this);
 	}
 
 	Device::~Device()
 	{
+		vkDeviceWaitIdle(logicalDevice);
+		deletionQueue.flush();
+		descriptorLayoutCache.reset();
 	}
 	
 
@@ -111,6 +117,19 @@ namespace jhb {
 		throw std::runtime_error("failed to find suitable memory type!");
 	}
 
+	bool Device::hasMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+	{
+		VkPhysicalDeviceMemoryProperties memProperties;
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+		for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+			if ((typeFilter & (1 << i)) &&
+				(memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+				return true;
+			}
+		}
+		return false;
+	}
+
 	void Device::createInstance() {
 		// using for optimizatgion my applciation (optional)
 		if (enableValidationLayers && !checkValidationLayerSupport())
@@ -124,7 +143,7 @@ namespace jhb {
 		appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 		appInfo.pEngineName = "No Engine";
 		appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-		appInfo.apiVersion = VK_API_VERSION_1_0;
+		appInfo.apiVersion = VK_API_VERSION_1_2; // timeline semaphore for async compute
 
 		uint32_t glfwExtensionCount = 0;
 		const char** glfwExtensions;
@@ -166,7 +185,7 @@ namespace jhb {
 		}
 	}
 
-	void Device::createImageWithInfo(const VkImageCreateInfo& imageInfo, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory)
+	VkMemoryPropertyFlags Device::createImageWithInfo(const VkImageCreateInfo& imageInfo, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory)
 	{
 		if (vkCreateImage(logicalDevice, &imageInfo, nullptr, &image) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create image!");
@@ -175,6 +194,12 @@ namespace jhb {
 		VkMemoryRequirements memRequirements;
 		vkGetImageMemoryRequirements(logicalDevice, image, &memRequirements);
 
+		// lazily allocated memory only exists on tile based gpus, desktop gpus fall back to plain device local memory
+		if ((properties & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) && !hasMemoryType(memRequirements.memoryTypeBits, properties))
+		{
+			properties &= ~VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+		}
+
 		VkMemoryAllocateInfo allocInfo{};
 		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
 		allocInfo.allocationSize = memRequirements.size;
@@ -187,6 +212,7 @@ namespace jhb {
 		if (vkBindImageMemory(logicalDevice, image, imageMemory, 0) != VK_SUCCESS) {
 			throw std::runtime_error("failed to bind image memory!");
 		}
+		return properties;
 	}
 
 	VkSampleCountFlagBits Device::getMaxUsableSampleCount()
@@ -292,21 +318,42 @@ namespace jhb {
 		QueueFamilyIndexes familyindexs = findQueueFamilies(physicalDevice);
 
 		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-		std::set<std::optional<uint32_t>> uniqueQueueFamiliesIndexs = { familyindexs.graphicsFamily, familyindexs.presentFamily };
-		float priority = 1.0;
+		std::set<std::optional<uint32_t>> uniqueQueueFamiliesIndexs = { familyindexs.graphicsFamily, familyindexs.presentFamily, familyindexs.computeFamily };
+		float priorities[] = { 1.0f, 1.0f };
+
+		// without compute only family, second queue of graphics family still runs concurrently with graphics queue
+		uint32_t computeQueueIndex = 0;
+		if (familyindexs.computeFamily == familyindexs.graphicsFamily)
+		{
+			uint32_t queueFamilyCount = 0;
+			vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+			std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+			vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+			computeQueueIndex = queueFamilies[familyindexs.graphicsFamily.value()].queueCount > 1 ? 1 : 0;
+		}
 
 		for (auto queueFamilyIndex : uniqueQueueFamiliesIndexs)
 		{
 			VkDeviceQueueCreateInfo queueCreateInfo{};
 			queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
 			queueCreateInfo.queueFamilyIndex = queueFamilyIndex.value();
-			queueCreateInfo.queueCount = 1; // number of queues for single queue family
-			queueCreateInfo.pQueuePriorities = &priority; // floating point between 0.0 ~ 1.0
+			queueCreateInfo.queueCount = queueFamilyIndex == familyindexs.computeFamily ? computeQueueIndex + 1 : 1; // number of queues for single queue family
+			queueCreateInfo.pQueuePriorities = priorities; // floating point between 0.0 ~ 1.0
 
 			queueCreateInfos.push_back(queueCreateInfo);
 		}
 
 		VkPhysicalDeviceFeatures deviceFeatures{}; // todo : implementation later
+		// block compressed formats ktx2 textures are transcoded to, Image::loadKTX2Texture picks among supported ones
+		deviceFeatures.textureCompressionBC = features.textureCompressionBC;
+		deviceFeatures.textureCompressionASTC_LDR = features.textureCompressionASTC_LDR;
+		deviceFeatures.textureCompressionETC2 = features.textureCompressionETC2;
+
+		// timeline semaphore orders graphics and compute queue, host query reset lets timestamp queries be reset without command buffer
+		VkPhysicalDeviceVulkan12Features features12{};
+		features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		features12.timelineSemaphore = VK_TRUE;
+		features12.hostQueryReset = VK_TRUE;
 
 		// Create the logical device
 		VkDeviceCreateInfo deviceCreateInfo{};
@@ -315,8 +362,23 @@ namespace jhb {
 		deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 		deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
 		deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
-		deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-		deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
+		deviceCreateInfo.pNext = &features12;
+		// memory budget is optional, only used for reporting usage
+		std::vector<const char*> enabledExtensions = deviceExtensions;
+		uint32_t extensionCount = 0;
+		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+		for (auto& extension : availableExtensions)
+		{
+			if (strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+			{
+				enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+				memoryBudgetSupported = true;
+			}
+		}
+		deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+		deviceCreateInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
 		if (vkCreateDevice(physicalDevice, &deviceCreateInfo, nullptr, &logicalDevice) != VK_SUCCESS)
 		{
@@ -325,6 +387,10 @@ namespace jhb {
 
 		vkGetDeviceQueue(logicalDevice, familyindexs.graphicsFamily.value(), 0, &graphicsQueue);
 		vkGetDeviceQueue(logicalDevice, familyindexs.presentFamily.value(), 0, &presentQueue);
+		vkGetDeviceQueue(logicalDevice, familyindexs.computeFamily.value(), computeQueueIndex, &ComputeQueue);
+		graphicsQueueFamily = familyindexs.graphicsFamily.value();
+		computeQueueFamily = familyindexs.computeFamily.value();
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
 	}
 
 	void Device::createCommandPool()
@@ -340,6 +406,12 @@ namespace jhb {
 		if (vkCreateCommandPool(logicalDevice, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create command pool!");
 		}
+
+		poolInfo.queueFamilyIndex = queueFamilyIndices.computeFamily.value();
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		if (vkCreateCommandPool(logicalDevice, &poolInfo, nullptr, &computeCommandPool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create compute command pool!");
+		}
 	}
 
 	void Device::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
@@ -507,7 +579,7 @@ namespace jhb {
 				break;
 			}
 		}
-		vkCmdPipelineBarrier(
+		cmd::pipelineBarrier(
 			commandBuffer,
 			sourceStage /* TODO */, destinationStage /* TODO */,
 			0,
@@ -772,7 +844,7 @@ namespace jhb {
 
 		if (physicalDevice == VK_NULL_HANDLE)
 		{
-			throw std::runtime_error("failed to find a suitable GPU!");
+			throw std::runtime_error("failed to find a suitable GPU! vulkan 1.2 with timeline semaphore and host query reset is required");
 		}
 	}
 
@@ -805,7 +877,49 @@ namespace jhb {
 			swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
 		}
 
-		return indexes.graphicsFamily.has_value() && indexes.presentFamily.has_value() && extensionsSupported && swapChainAdequate;
+		// createLogicalDevice always enables these, async compute and gpu timestamps need them
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(device, &properties);
+		bool vulkan12Supported = false;
+		if (properties.apiVersion >= VK_API_VERSION_1_2)
+		{
+			VkPhysicalDeviceVulkan12Features supported12{};
+			supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+			VkPhysicalDeviceFeatures2 supportedFeatures{};
+			supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			supportedFeatures.pNext = &supported12;
+			vkGetPhysicalDeviceFeatures2(device, &supportedFeatures);
+			vulkan12Supported = supported12.timelineSemaphore && supported12.hostQueryReset;
+		}
+
+		return indexes.graphicsFamily.has_value() && indexes.presentFamily.has_value() && extensionsSupported && swapChainAdequate && vulkan12Supported;
+	}
+
+	bool Device::queryMemoryUsage(VkDeviceSize& usage, VkDeviceSize& budget) const
+	{
+		usage = 0;
+		budget = 0;
+		if (!memoryBudgetSupported)
+		{
+			return false;
+		}
+
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+		budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+		VkPhysicalDeviceMemoryProperties2 memoryProperties{};
+		memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+		memoryProperties.pNext = &budgetProperties;
+		vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &memoryProperties);
+
+		for (uint32_t i = 0; i < memoryProperties.memoryProperties.memoryHeapCount; i++)
+		{
+			if (memoryProperties.memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+			{
+				usage += budgetProperties.heapUsage[i];
+				budget += budgetProperties.heapBudget[i];
+			}
+		}
+		return true;
 	}
 
 	bool Device::checkDeviceExtensionSupport(VkPhysicalDevice device)
@@ -25,8 +25,12 @@
 #include <algorithm> // Necessary for std::clamp
 
 #include "Window.h"
+#include "DeletionQueue.h"
+#include "FrameArena.h"
 
 namespace jhb {
+	class DescriptorLayoutCache;
+
 	class Device
 	{
 		static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
@@ -64,10 +68,25 @@ namespace jhb {
 		VkQueue getComputeQueue() const { return ComputeQueue;	}
 		VkQueue getPresentQueue() const { return presentQueue; }
 		VkCommandPool getCommnadPool() { return commandPool; }
+		VkCommandPool getComputeCommandPool() { return computeCommandPool; }
+		uint32_t getGraphicsQueueFamily() const { return graphicsQueueFamily; }
+		uint32_t getComputeQueueFamily() const { return computeQueueFamily; }
+		// false when compute work has to share graphics queue, then nothing can overlap
+		bool hasAsyncComputeQueue() const { return ComputeQueue != graphicsQueue; }
+		// destroy objects used by frames in flight through this instead of waiting idle
+		DeletionQueue& getDeletionQueue() { return deletionQueue; }
+		// transient cpu memory of frame being recorded
+		FrameArena& getFrameArena() { return frameArena; }
+		// DescriptorSetLayout::Builder goes through this, identical layouts are shared
+		DescriptorLayoutCache& getDescriptorLayoutCache() { return *descriptorLayoutCache; }
+		// device local heaps, false when VK_EXT_memory_budget is not available
+		bool queryMemoryUsage(VkDeviceSize& usage, VkDeviceSize& budget) const;
 
 		uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+		bool hasMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
 		void createInstance();
-		void createImageWithInfo(
+		// returns memory property flags actually used (lazily allocated bit is dropped when not supported)
+		VkMemoryPropertyFlags createImageWithInfo(
 			const VkImageCreateInfo& imageInfo,
 			VkMemoryPropertyFlags properties,
 			VkImage& image,
@@ -131,6 +150,13 @@ namespace jhb {
 		VkSwapchainKHR swapChain;
 		VkDebugUtilsMessengerEXT debugMessenger;
 		VkCommandPool commandPool;
+		VkCommandPool computeCommandPool;
+		uint32_t graphicsQueueFamily;
+		uint32_t computeQueueFamily;
+		DeletionQueue deletionQueue;
+		FrameArena frameArena{ 256 * 1024 };
+		std::unique_ptr<DescriptorLayoutCache> descriptorLayoutCache;
+		bool memoryBudgetSupported = false;
 
 		const std::vector<const char*> validationLayers = {
 		"VK_LAYER_KHRONOS_validation"
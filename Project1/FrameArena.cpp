@@ -0,0 +1,110 @@
+#include "FrameArena.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#if JHB_HEAP_STATS
+namespace {
+	std::atomic<uint64_t> heapAllocationCount{ 0 };
+}
+
+// replaced for whole program so heap traffic per frame can be counted
+void* operator new(size_t size)
+{
+	heapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(size == 0 ? 1 : size))
+	{
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	std::free(p);
+}
+#endif
+
+namespace jhb {
+	uint64_t getHeapAllocationCount()
+	{
+#if JHB_HEAP_STATS
+		return heapAllocationCount.load(std::memory_order_relaxed);
+#else
+		return 0;
+#endif
+	}
+
+	FrameArena::FrameArena(size_t frameCapacity) : frameCapacity{ frameCapacity }
+	{
+	}
+
+	void FrameArena::beginFrame(int frameIndex)
+	{
+		// blocks are made on first use so arena doesn't have to know how many frames are in flight
+		if (blocks.size() <= static_cast<size_t>(frameIndex))
+		{
+			blocks.resize(frameIndex + 1);
+		}
+
+		Block& block = blocks[frameIndex];
+		if (!block.memory)
+		{
+			block.memory = std::make_unique<char[]>(frameCapacity);
+		}
+		block.head = 0;
+		current = &block;
+	}
+
+	void* FrameArena::allocate(size_t size, size_t alignment)
+	{
+		if (enabled && current)
+		{
+			size_t offset = (current->head + alignment - 1) & ~(alignment - 1);
+			if (offset + size <= frameCapacity)
+			{
+				current->head = offset + size;
+				peakFrameUsage = std::max(peakFrameUsage, current->head);
+				return current->memory.get() + offset;
+			}
+			overflowCount++;
+		}
+		return ::operator new(size);
+	}
+
+	void FrameArena::deallocate(void* p, size_t size)
+	{
+		if (!owns(p))
+		{
+			::operator delete(p);
+			return;
+		}
+
+		// last allocation can be given back, vector growing in place reuses it
+		char* end = static_cast<char*>(p) + size;
+		if (current && end == current->memory.get() + current->head)
+		{
+			current->head -= size;
+		}
+	}
+
+	bool FrameArena::owns(const void* p) const
+	{
+		const char* c = static_cast<const char*>(p);
+		for (auto& block : blocks)
+		{
+			if (block.memory && c >= block.memory.get() && c < block.memory.get() + frameCapacity)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+}
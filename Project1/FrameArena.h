@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// set to 1 to replace global operator new and count heap allocations per frame. off by default, it changes allocation of every linked library too
+#ifndef JHB_HEAP_STATS
+#define JHB_HEAP_STATS 0
+#endif
+
+namespace jhb {
+	// linear allocator for cpu data that only lives while a frame is recorded.
+	// one block per frame in flight, a block is rewound when renderer waited that frame's fence.
+	// nothing is freed one by one, overflow and allocations outside of a frame go to heap.
+	// main thread only, there is no locking
+	class FrameArena
+	{
+	public:
+		FrameArena(size_t frameCapacity);
+		~FrameArena() = default;
+
+		FrameArena(const FrameArena&) = delete;
+		FrameArena& operator=(const FrameArena&) = delete;
+
+		// renderer calls this after fence of frameIndex slot was waited
+		void beginFrame(int frameIndex);
+		// after submit, allocations go to heap until next beginFrame
+		void endFrame() { current = nullptr; }
+
+		void* allocate(size_t size, size_t alignment);
+		void deallocate(void* p, size_t size);
+
+		// off : everything goes to heap, for comparing allocation counts
+		void setEnabled(bool enable) { enabled = enable; }
+		bool isEnabled() const { return enabled; }
+
+		size_t getFrameCapacity() const { return frameCapacity; }
+		size_t getPeakFrameUsage() const { return peakFrameUsage; }
+		uint64_t getOverflowCount() const { return overflowCount; }
+
+	private:
+		struct Block {
+			std::unique_ptr<char[]> memory;
+			size_t head = 0;
+		};
+
+		bool owns(const void* p) const;
+
+		std::vector<Block> blocks;
+		Block* current = nullptr;
+		size_t frameCapacity;
+		size_t peakFrameUsage = 0;
+		uint64_t overflowCount = 0;
+		bool enabled = true;
+	};
+
+	// stl adapter, default constructed one has no arena and uses heap
+	template<typename T>
+	class FrameAllocator
+	{
+	public:
+		using value_type = T;
+
+		FrameAllocator() noexcept = default;
+		FrameAllocator(FrameArena& arena) noexcept : arena{ &arena } {}
+		template<typename U>
+		FrameAllocator(const FrameAllocator<U>& other) noexcept : arena{ other.arena } {}
+
+		T* allocate(size_t n)
+		{
+			if (arena == nullptr)
+			{
+				return static_cast<T*>(::operator new(n * sizeof(T)));
+			}
+			return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+		}
+
+		void deallocate(T* p, size_t n) noexcept
+		{
+			if (arena == nullptr)
+			{
+				::operator delete(p);
+				return;
+			}
+			arena->deallocate(p, n * sizeof(T));
+		}
+
+		template<typename U>
+		bool operator==(const FrameAllocator<U>& other) const noexcept { return arena == other.arena; }
+		template<typename U>
+		bool operator!=(const FrameAllocator<U>& other) const noexcept { return arena != other.arena; }
+
+	private:
+		template<typename U> friend class FrameAllocator;
+		FrameArena* arena = nullptr;
+	};
+
+	template<typename T>
+	using FrameVector = std::vector<T, FrameAllocator<T>>;
+
+	// counted by global operator new for per frame allocation report, always 0 without JHB_HEAP_STATS
+	uint64_t getHeapAllocationCount();
+}
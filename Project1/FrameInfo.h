@@ -4,6 +4,8 @@
 #include <vulkan/vulkan.h>
 
 namespace jhb {
+	class MeshletCullSystem;
+
 	constexpr static int MaxLights = 10;
 	struct PointLight {
 		glm::vec4 position{};
@@ -19,10 +21,11 @@ namespace jhb {
 		int numLights;
 		float exposure = 4.5f;
 		float gamma = 2.2f;
-	};
-
-	struct PickingUbo {
-		int objindex;
+		// for taa velocity, both are not jittered
+		alignas(16) glm::mat4 viewProjection{1.f};
+		glm::mat4 prevViewProjection{1.f};
+		// l2 spherical harmonics of diffuse irradiance, deferred lighting has no irradiance cube fetch
+		glm::vec4 irradianceSH[9]{};
 	};
 
 	struct FrameInfo
@@ -35,6 +38,10 @@ namespace jhb {
 		VkDescriptorSet pbrImageSamplerDescriptorSet;
 		VkDescriptorSet skyBoxImageSamplerDecriptorSet;
 		VkDescriptorSet shadowMapDescriptorSet;
+		// dynamic offset of this frame's GlobalUbo in uniform ring, every bind of global set passes it
+		uint32_t globalUboOffset = 0;
+		// set in frames where meshlet culling pass runs, draws of culled models use its output
+		MeshletCullSystem* meshletCulling = nullptr;
 	};
 }
 
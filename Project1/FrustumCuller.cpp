@@ -0,0 +1,590 @@
+#include "FrustumCuller.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <type_traits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define JHB_CULL_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#else
+#define JHB_CULL_X86 0
+#endif
+
+#if defined(_M_ARM64) || defined(__aarch64__)
+#define JHB_CULL_NEON 1
+#include <arm_neon.h>
+#else
+#define JHB_CULL_NEON 0
+#endif
+
+// msvc emits any intrinsic without /arch, gcc and clang need avx2 enabled per function
+#if JHB_CULL_X86 && (defined(__GNUC__) || defined(__clang__))
+#define JHB_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define JHB_TARGET_AVX2
+#endif
+
+namespace jhb {
+	namespace {
+		// normalized planes split per component, abs is for aabb extents
+		struct Planes {
+			float x[6], y[6], z[6], w[6];
+			float absX[6], absY[6], absZ[6];
+		};
+
+		// extent arrays are null for spheres
+		struct Streams {
+			const float* x;
+			const float* y;
+			const float* z;
+			const float* radius;
+			const float* extentX;
+			const float* extentY;
+			const float* extentZ;
+		};
+
+		// writes visible indices in [begin, end) to out, returns how many
+		using Kernel = size_t(*)(const Planes&, const Streams&, size_t, size_t, uint32_t*);
+
+		Planes extractPlanes(const glm::mat4& m)
+		{
+			// rows of clip matrix, depth is 0 to 1
+			glm::vec4 row0{ m[0][0], m[1][0], m[2][0], m[3][0] };
+			glm::vec4 row1{ m[0][1], m[1][1], m[2][1], m[3][1] };
+			glm::vec4 row2{ m[0][2], m[1][2], m[2][2], m[3][2] };
+			glm::vec4 row3{ m[0][3], m[1][3], m[2][3], m[3][3] };
+			glm::vec4 planes[6] = { row3 + row0, row3 - row0, row3 + row1, row3 - row1, row2, row3 - row2 };
+
+			Planes result;
+			for (int i = 0; i < 6; i++)
+			{
+				glm::vec4 plane = planes[i] / glm::length(glm::vec3(planes[i]));
+				result.x[i] = plane.x;
+				result.y[i] = plane.y;
+				result.z[i] = plane.z;
+				result.w[i] = plane.w;
+				result.absX[i] = std::abs(plane.x);
+				result.absY[i] = std::abs(plane.y);
+				result.absZ[i] = std::abs(plane.z);
+			}
+			return result;
+		}
+
+		Streams makeStreams(const SphereBounds& bounds)
+		{
+			return { bounds.centerX.data(), bounds.centerY.data(), bounds.centerZ.data(), bounds.radius.data(), nullptr, nullptr, nullptr };
+		}
+
+		Streams makeStreams(const AabbBounds& bounds)
+		{
+			return { bounds.centerX.data(), bounds.centerY.data(), bounds.centerZ.data(), nullptr, bounds.extentX.data(), bounds.extentY.data(), bounds.extentZ.data() };
+		}
+
+		inline uint32_t countTrailingZeros(uint32_t bits)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanForward(&index, bits);
+			return index;
+#else
+			return static_cast<uint32_t>(__builtin_ctz(bits));
+#endif
+		}
+
+		// one set bit per visible lane
+		inline size_t appendVisible(uint32_t bits, size_t base, uint32_t* out, size_t count)
+		{
+			while (bits)
+			{
+				out[count++] = static_cast<uint32_t>(base + countTrailingZeros(bits));
+				bits &= bits - 1;
+			}
+			return count;
+		}
+
+		// sphere is outside when it's fully behind one plane, aabb uses its extent projected on plane normal as radius
+		template<bool Aabb>
+		size_t cullScalar(const Planes& p, const Streams& s, size_t begin, size_t end, uint32_t* out)
+		{
+			size_t count = 0;
+			for (size_t i = begin; i < end; i++)
+			{
+				bool inside = true;
+				for (int k = 0; k < 6; k++)
+				{
+					float distance = p.x[k] * s.x[i] + p.y[k] * s.y[i] + p.z[k] * s.z[i] + p.w[k];
+					float radius = Aabb ? p.absX[k] * s.extentX[i] + p.absY[k] * s.extentY[i] + p.absZ[k] * s.extentZ[i] : s.radius[i];
+					inside &= distance + radius >= 0.f;
+				}
+				// branchless, slot is overwritten by next index when not visible
+				out[count] = static_cast<uint32_t>(i);
+				count += inside;
+			}
+			return count;
+		}
+
+#if JHB_CULL_X86
+		struct PlanesSSE {
+			__m128 x[6], y[6], z[6], w[6];
+			__m128 absX[6], absY[6], absZ[6];
+		};
+
+		inline PlanesSSE broadcastSSE(const Planes& p)
+		{
+			PlanesSSE result;
+			for (int k = 0; k < 6; k++)
+			{
+				result.x[k] = _mm_set1_ps(p.x[k]);
+				result.y[k] = _mm_set1_ps(p.y[k]);
+				result.z[k] = _mm_set1_ps(p.z[k]);
+				result.w[k] = _mm_set1_ps(p.w[k]);
+				result.absX[k] = _mm_set1_ps(p.absX[k]);
+				result.absY[k] = _mm_set1_ps(p.absY[k]);
+				result.absZ[k] = _mm_set1_ps(p.absZ[k]);
+			}
+			return result;
+		}
+
+		// 4 bit visible mask of bounds i .. i + 3
+		template<bool Aabb>
+		inline uint32_t testSSE(const PlanesSSE& p, const Streams& s, size_t i)
+		{
+			__m128 x = _mm_loadu_ps(s.x + i);
+			__m128 y = _mm_loadu_ps(s.y + i);
+			__m128 z = _mm_loadu_ps(s.z + i);
+			__m128 radius, ex, ey, ez;
+			if (Aabb)
+			{
+				ex = _mm_loadu_ps(s.extentX + i);
+				ey = _mm_loadu_ps(s.extentY + i);
+				ez = _mm_loadu_ps(s.extentZ + i);
+			}
+			else
+			{
+				radius = _mm_loadu_ps(s.radius + i);
+			}
+
+			__m128 zero = _mm_setzero_ps();
+			__m128 inside = _mm_cmpeq_ps(zero, zero);
+			for (int k = 0; k < 6; k++)
+			{
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p.x[k], x), _mm_mul_ps(p.y[k], y)), _mm_add_ps(_mm_mul_ps(p.z[k], z), p.w[k]));
+				if (Aabb)
+				{
+					radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p.absX[k], ex), _mm_mul_ps(p.absY[k], ey)), _mm_mul_ps(p.absZ[k], ez));
+				}
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), zero));
+			}
+			return static_cast<uint32_t>(_mm_movemask_ps(inside));
+		}
+
+		// two registers per iteration, 8 bounds
+		template<bool Aabb>
+		size_t cullSSE(const Planes& planes, const Streams& s, size_t begin, size_t end, uint32_t* out)
+		{
+			PlanesSSE p = broadcastSSE(planes);
+			size_t count = 0;
+			size_t i = begin;
+			for (; i + 8 <= end; i += 8)
+			{
+				uint32_t bits = testSSE<Aabb>(p, s, i) | testSSE<Aabb>(p, s, i + 4) << 4;
+				count = appendVisible(bits, i, out, count);
+			}
+			return count + cullScalar<Aabb>(planes, s, i, end, out + count);
+		}
+
+		struct PlanesAVX2 {
+			__m256 x[6], y[6], z[6], w[6];
+			__m256 absX[6], absY[6], absZ[6];
+		};
+
+		JHB_TARGET_AVX2 inline PlanesAVX2 broadcastAVX2(const Planes& p)
+		{
+			PlanesAVX2 result;
+			for (int k = 0; k < 6; k++)
+			{
+				result.x[k] = _mm256_set1_ps(p.x[k]);
+				result.y[k] = _mm256_set1_ps(p.y[k]);
+				result.z[k] = _mm256_set1_ps(p.z[k]);
+				result.w[k] = _mm256_set1_ps(p.w[k]);
+				result.absX[k] = _mm256_set1_ps(p.absX[k]);
+				result.absY[k] = _mm256_set1_ps(p.absY[k]);
+				result.absZ[k] = _mm256_set1_ps(p.absZ[k]);
+			}
+			return result;
+		}
+
+		// 8 bit visible mask of bounds i .. i + 7
+		template<bool Aabb>
+		JHB_TARGET_AVX2 inline uint32_t testAVX2(const PlanesAVX2& p, const Streams& s, size_t i)
+		{
+			__m256 x = _mm256_loadu_ps(s.x + i);
+			__m256 y = _mm256_loadu_ps(s.y + i);
+			__m256 z = _mm256_loadu_ps(s.z + i);
+			__m256 radius, ex, ey, ez;
+			if (Aabb)
+			{
+				ex = _mm256_loadu_ps(s.extentX + i);
+				ey = _mm256_loadu_ps(s.extentY + i);
+				ez = _mm256_loadu_ps(s.extentZ + i);
+			}
+			else
+			{
+				radius = _mm256_loadu_ps(s.radius + i);
+			}
+
+			__m256 zero = _mm256_setzero_ps();
+			__m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+			for (int k = 0; k < 6; k++)
+			{
+				__m256 distance = _mm256_fmadd_ps(p.x[k], x, _mm256_fmadd_ps(p.y[k], y, _mm256_fmadd_ps(p.z[k], z, p.w[k])));
+				if (Aabb)
+				{
+					radius = _mm256_fmadd_ps(p.absX[k], ex, _mm256_fmadd_ps(p.absY[k], ey, _mm256_mul_ps(p.absZ[k], ez)));
+				}
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_GE_OQ));
+			}
+			return static_cast<uint32_t>(_mm256_movemask_ps(inside));
+		}
+
+		// two registers per iteration, 16 bounds
+		template<bool Aabb>
+		JHB_TARGET_AVX2 size_t cullAVX2(const Planes& planes, const Streams& s, size_t begin, size_t end, uint32_t* out)
+		{
+			PlanesAVX2 p = broadcastAVX2(planes);
+			size_t count = 0;
+			size_t i = begin;
+			for (; i + 16 <= end; i += 16)
+			{
+				uint32_t bits = testAVX2<Aabb>(p, s, i) | testAVX2<Aabb>(p, s, i + 8) << 8;
+				count = appendVisible(bits, i, out, count);
+			}
+			return count + cullScalar<Aabb>(planes, s, i, end, out + count);
+		}
+
+		bool cpuHasAVX2()
+		{
+#ifdef _MSC_VER
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7)
+			{
+				return false;
+			}
+			// fma and os saving ymm registers
+			__cpuid(info, 1);
+			if ((info[2] & (1 << 12)) == 0 || (info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6)
+			{
+				return false;
+			}
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1 << 5)) != 0;
+#else
+			// also checks os support
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+		}
+#endif
+
+#if JHB_CULL_NEON
+		// 4 bit visible mask of bounds i .. i + 3
+		template<bool Aabb>
+		inline uint32_t testNEON(const Planes& p, const Streams& s, size_t i)
+		{
+			float32x4_t x = vld1q_f32(s.x + i);
+			float32x4_t y = vld1q_f32(s.y + i);
+			float32x4_t z = vld1q_f32(s.z + i);
+			float32x4_t radius, ex, ey, ez;
+			if (Aabb)
+			{
+				ex = vld1q_f32(s.extentX + i);
+				ey = vld1q_f32(s.extentY + i);
+				ez = vld1q_f32(s.extentZ + i);
+			}
+			else
+			{
+				radius = vld1q_f32(s.radius + i);
+			}
+
+			float32x4_t zero = vdupq_n_f32(0.f);
+			uint32x4_t inside = vdupq_n_u32(0xffffffffu);
+			for (int k = 0; k < 6; k++)
+			{
+				float32x4_t distance = vfmaq_n_f32(vfmaq_n_f32(vfmaq_n_f32(vdupq_n_f32(p.w[k]), z, p.z[k]), y, p.y[k]), x, p.x[k]);
+				if (Aabb)
+				{
+					radius = vfmaq_n_f32(vfmaq_n_f32(vmulq_n_f32(ez, p.absZ[k]), ey, p.absY[k]), ex, p.absX[k]);
+				}
+				inside = vandq_u32(inside, vcgeq_f32(vaddq_f32(distance, radius), zero));
+			}
+			static const uint32_t laneBits[4] = { 1, 2, 4, 8 };
+			return vaddvq_u32(vandq_u32(inside, vld1q_u32(laneBits)));
+		}
+
+		// two registers per iteration, 8 bounds
+		template<bool Aabb>
+		size_t cullNEON(const Planes& planes, const Streams& s, size_t begin, size_t end, uint32_t* out)
+		{
+			size_t count = 0;
+			size_t i = begin;
+			for (; i + 8 <= end; i += 8)
+			{
+				uint32_t bits = testNEON<Aabb>(planes, s, i) | testNEON<Aabb>(planes, s, i + 4) << 4;
+				count = appendVisible(bits, i, out, count);
+			}
+			return count + cullScalar<Aabb>(planes, s, i, end, out + count);
+		}
+#endif
+
+		template<bool Aabb>
+		Kernel selectKernel(FrustumCuller::Isa isa)
+		{
+			switch (isa)
+			{
+#if JHB_CULL_X86
+			case FrustumCuller::Isa::SSE:
+				return cullSSE<Aabb>;
+			case FrustumCuller::Isa::AVX2:
+				return cullAVX2<Aabb>;
+#endif
+#if JHB_CULL_NEON
+			case FrustumCuller::Isa::NEON:
+				return cullNEON<Aabb>;
+#endif
+			default:
+				return cullScalar<Aabb>;
+			}
+		}
+	}
+
+	void SphereBounds::resize(size_t count)
+	{
+		centerX.resize(count);
+		centerY.resize(count);
+		centerZ.resize(count);
+		radius.resize(count);
+	}
+
+	void SphereBounds::set(size_t i, const glm::vec3& center, float r)
+	{
+		centerX[i] = center.x;
+		centerY[i] = center.y;
+		centerZ[i] = center.z;
+		radius[i] = r;
+	}
+
+	void AabbBounds::resize(size_t count)
+	{
+		centerX.resize(count);
+		centerY.resize(count);
+		centerZ.resize(count);
+		extentX.resize(count);
+		extentY.resize(count);
+		extentZ.resize(count);
+	}
+
+	void AabbBounds::set(size_t i, const glm::vec3& min, const glm::vec3& max)
+	{
+		glm::vec3 center = (min + max) * 0.5f;
+		glm::vec3 extent = (max - min) * 0.5f;
+		centerX[i] = center.x;
+		centerY[i] = center.y;
+		centerZ[i] = center.z;
+		extentX[i] = extent.x;
+		extentY[i] = extent.y;
+		extentZ[i] = extent.z;
+	}
+
+	FrustumCuller::FrustumCuller(uint32_t threadCount) : isa{ detectIsa() }, pool{ threadCount }
+	{
+	}
+
+	FrustumCuller::Isa FrustumCuller::detectIsa()
+	{
+		for (Isa isa : { Isa::AVX2, Isa::NEON, Isa::SSE })
+		{
+			if (isSupported(isa))
+			{
+				return isa;
+			}
+		}
+		return Isa::Scalar;
+	}
+
+	bool FrustumCuller::isSupported(Isa isa)
+	{
+		switch (isa)
+		{
+		case Isa::Scalar:
+			return true;
+		case Isa::SSE:
+			// x64 always has sse2, 32 bit builds are assumed to as well
+			return JHB_CULL_X86;
+		case Isa::AVX2:
+		{
+#if JHB_CULL_X86
+			static const bool avx2 = cpuHasAVX2();
+			return avx2;
+#else
+			return false;
+#endif
+		}
+		case Isa::NEON:
+			return JHB_CULL_NEON;
+		}
+		return false;
+	}
+
+	const char* FrustumCuller::getIsaName(Isa isa)
+	{
+		switch (isa)
+		{
+		case Isa::SSE:
+			return "SSE";
+		case Isa::AVX2:
+			return "AVX2";
+		case Isa::NEON:
+			return "NEON";
+		default:
+			return "scalar";
+		}
+	}
+
+	void FrustumCuller::setIsa(Isa newIsa)
+	{
+		isa = isSupported(newIsa) ? newIsa : detectIsa();
+	}
+
+	void FrustumCuller::cull(const glm::mat4& viewProjection, const SphereBounds& bounds, std::vector<uint32_t>& visible)
+	{
+		cullBounds(viewProjection, bounds, visible);
+	}
+
+	void FrustumCuller::cull(const glm::mat4& viewProjection, const AabbBounds& bounds, std::vector<uint32_t>& visible)
+	{
+		cullBounds(viewProjection, bounds, visible);
+	}
+
+	template<typename Bounds>
+	void FrustumCuller::cullBounds(const glm::mat4& viewProjection, const Bounds& bounds, std::vector<uint32_t>& visible)
+	{
+		// small arrays aren't worth waking workers
+		static constexpr size_t MIN_JOB_SIZE = 16384;
+
+		Planes planes = extractPlanes(viewProjection);
+		Streams streams = makeStreams(bounds);
+		Kernel kernel = selectKernel<std::is_same<Bounds, AabbBounds>::value>(isa);
+		size_t count = bounds.size();
+
+		uint32_t jobs = static_cast<uint32_t>(std::min<size_t>(count / MIN_JOB_SIZE, getThreadCount()));
+		if (jobs <= 1)
+		{
+			visible.resize(count);
+			visible.resize(kernel(planes, streams, 0, count, visible.data()));
+			return;
+		}
+
+		// multiple of 16 so only last job has scalar tail
+		size_t chunk = ((count + jobs - 1) / jobs + 15) & ~static_cast<size_t>(15);
+		if (jobVisible.size() < jobs)
+		{
+			jobVisible.resize(jobs);
+		}
+		pool.parallelFor(jobs, [&](uint32_t job) {
+			size_t begin = std::min(count, job * chunk);
+			size_t end = std::min(count, begin + chunk);
+			std::vector<uint32_t>& out = jobVisible[job];
+			out.resize(end - begin);
+			out.resize(kernel(planes, streams, begin, end, out.data()));
+		});
+
+		// jobs are in index order, so joined list stays sorted
+		size_t total = 0;
+		for (uint32_t job = 0; job < jobs; job++)
+		{
+			total += jobVisible[job].size();
+		}
+		visible.resize(total);
+		uint32_t* out = visible.data();
+		for (uint32_t job = 0; job < jobs; job++)
+		{
+			out = std::copy(jobVisible[job].begin(), jobVisible[job].end(), out);
+		}
+	}
+
+	void FrustumCuller::runBenchmark(uint32_t count)
+	{
+		// same seed every run, bounds spread around camera and only a small part of them survives
+		std::mt19937 random{ 1234 };
+		std::uniform_real_distribution<float> position{ -100.f, 100.f };
+		std::uniform_real_distribution<float> size{ 0.1f, 2.f };
+		SphereBounds spheres;
+		AabbBounds aabbs;
+		spheres.resize(count);
+		aabbs.resize(count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			glm::vec3 center{ position(random), position(random), position(random) };
+			glm::vec3 extent{ size(random), size(random), size(random) };
+			spheres.set(i, center, glm::length(extent));
+			aabbs.set(i, center - extent, center + extent);
+		}
+		glm::mat4 viewProjection = glm::perspective(glm::radians(60.f), 16.f / 9.f, 0.1f, 200.f) * glm::lookAt(glm::vec3{ 0.f }, glm::vec3{ 1.f, 0.f, 0.3f }, glm::vec3{ 0.f, 1.f, 0.f });
+
+		FrustumCuller single{ 1 };
+		FrustumCuller pool{ 0 };
+		std::vector<uint32_t> visible;
+		std::cout << "[cull benchmark] " << count << " bounds, " << pool.getThreadCount() << " threads, detected " << getIsaName(detectIsa()) << std::endl;
+
+		static constexpr int RUNS = 20;
+		size_t expectedSpheres = 0;
+		size_t expectedAabbs = 0;
+		for (Isa isa : { Isa::Scalar, Isa::SSE, Isa::AVX2, Isa::NEON })
+		{
+			if (!isSupported(isa))
+			{
+				continue;
+			}
+			for (FrustumCuller* culler : { &single, &pool })
+			{
+				culler->setIsa(isa);
+				auto measure = [&](const char* kind, const auto& bounds, size_t& expected) {
+					// first run warms caches and grows output vectors
+					culler->cull(viewProjection, bounds, visible);
+					auto start = std::chrono::high_resolution_clock::now();
+					for (int run = 0; run < RUNS; run++)
+					{
+						culler->cull(viewProjection, bounds, visible);
+					}
+					double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count() / RUNS;
+
+					// fma rounds differently, so a bound exactly on a plane may flip
+					if (expected == 0)
+					{
+						expected = visible.size();
+					}
+					else if (expected != visible.size())
+					{
+						std::cout << "  " << getIsaName(isa) << " " << kind << " differs from scalar by " << static_cast<int64_t>(visible.size()) - static_cast<int64_t>(expected) << std::endl;
+					}
+
+					double perCore = count / seconds / culler->getThreadCount() / 1e6;
+					std::cout << "  " << getIsaName(isa) << " " << kind << " x" << culler->getThreadCount() << " : " << seconds * 1000.0 << " ms, "
+						<< perCore << " M bounds/s per core, " << visible.size() << " visible" << std::endl;
+				};
+				measure("sphere", spheres, expectedSpheres);
+				measure("aabb", aabbs, expectedAabbs);
+			}
+		}
+	}
+}
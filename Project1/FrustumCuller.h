@@ -0,0 +1,80 @@
+#pragma once
+#define GLM_FORCE_RADIANS // not use degree;
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+
+#include <glm/glm.hpp>
+
+#include "WorkerPool.h"
+
+#include <vector>
+#include <stdint.h>
+
+namespace jhb {
+	// bounds as struct of arrays, so one load fills a register with same component of 4 or 8 bounds
+	struct SphereBounds {
+		std::vector<float> centerX, centerY, centerZ;
+		std::vector<float> radius;
+
+		size_t size() const { return radius.size(); }
+		void resize(size_t count);
+		void set(size_t i, const glm::vec3& center, float r);
+	};
+
+	struct AabbBounds {
+		std::vector<float> centerX, centerY, centerZ;
+		std::vector<float> extentX, extentY, extentZ;
+
+		size_t size() const { return extentX.size(); }
+		void resize(size_t count);
+		void set(size_t i, const glm::vec3& min, const glm::vec3& max);
+	};
+
+	// cpu frustum culling of many bounds at once. kernel is picked at startup from what cpu supports,
+	// avx2 tests 16 bounds per iteration, sse and neon 8, and big arrays are split over a small worker pool
+	class FrustumCuller
+	{
+	public:
+		enum class Isa {
+			Scalar,
+			SSE,
+			AVX2,
+			NEON,
+		};
+
+		// 0 uses every hardware thread
+		explicit FrustumCuller(uint32_t threadCount = 0);
+
+		FrustumCuller(const FrustumCuller&) = delete;
+		FrustumCuller& operator=(const FrustumCuller&) = delete;
+
+		// best kernel this cpu and os can run
+		static Isa detectIsa();
+		static bool isSupported(Isa isa);
+		static const char* getIsaName(Isa isa);
+
+		Isa getIsa() const { return isa; }
+		// falls back to detected isa when cpu can't run it
+		void setIsa(Isa isa);
+		uint32_t getThreadCount() const { return pool.getThreadCount(); }
+		// shared with other per frame cpu work, culling is done when cull returns
+		WorkerPool& getWorkerPool() { return pool; }
+
+		// indices of bounds intersecting frustum of viewProjection, ascending
+		void cull(const glm::mat4& viewProjection, const SphereBounds& bounds, std::vector<uint32_t>& visible);
+		void cull(const glm::mat4& viewProjection, const AabbBounds& bounds, std::vector<uint32_t>& visible);
+
+		// Project1.exe --cull-benchmark [count], random bounds against fixed camera with every supported kernel, single thread and pool
+		static void runBenchmark(uint32_t count = 1000000);
+
+	private:
+		template<typename Bounds>
+		void cullBounds(const glm::mat4& viewProjection, const Bounds& bounds, std::vector<uint32_t>& visible);
+
+	private:
+		Isa isa;
+		WorkerPool pool;
+
+		// visible indices of each job before they are joined in order
+		std::vector<std::vector<uint32_t>> jobVisible;
+	};
+}
@@ -56,9 +56,9 @@ namespace jhb {
         std::shared_ptr<Model> model{};
         glm::vec3 color{};
         TransformComponent transform{};
-    public:
-        uint32_t instanceCount = 1;
-        std::unique_ptr<Buffer> instanceBuffer = nullptr;
+        // per instance material, gathered with transform by InstanceBatcher
+        float roughness = 0.f;
+        float metallic = 0.f;
 
     private:
         GameObject(id_t objId) : id{ objId } {}
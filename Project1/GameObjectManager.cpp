@@ -5,6 +5,15 @@ jhb::GameObjectManager* jhb::GameObjectManager::objectManager = nullptr;
 void jhb::GameObjectManager::AddGameObject(jhb::GameObject&& gameObject)
 {
 	gameObjects.emplace(gameObject.getId(), std::move(gameObject));
+	generation++;
+}
+
+void jhb::GameObjectManager::RemoveGameObject(GameObject::id_t id)
+{
+	if (gameObjects.erase(id) > 0)
+	{
+		generation++;
+	}
 }
 
 void jhb::GameObjectManager::GetGameObject(unsigned int id)
@@ -15,14 +15,19 @@ namespace jhb {
 		}
 
 		void AddGameObject(GameObject&&);
+		void RemoveGameObject(GameObject::id_t id);
 
 		void GetGameObject(unsigned int);
 
+		// bumped on every add and remove, same count after a remove and an add is still a different set of objects
+		uint32_t GetGeneration() const { return generation; }
 
 	public:
+		// objects are added and removed only through manager, so generation follows the set
 		jhb::GameObject::Map gameObjects;
 	private:
 		static GameObjectManager* objectManager;
+		uint32_t generation = 0;
 	};
 }
 
@@ -2,6 +2,7 @@
 #include "JHBApplication.h"
 #include "Model.h"
 #include "FrameInfo.h"
+#include "CommandStats.h"
 #include <memory>
 #include <array>
 
@@ -79,6 +80,96 @@ namespace jhb {
 
 		ImGui::SliderFloat("roughness", &roughness, 0.1f, 1.0f);
 		ImGui::SliderFloat("metalic", &metalic, 0.1f, 1.0f);
+		const char* antiAliasingItems[] = { "TAA", "MSAA 2x", "MSAA 4x", "MSAA 8x" };
+		ImGui::Combo("anti aliasing", &antiAliasing, antiAliasingItems, IM_ARRAYSIZE(antiAliasingItems));
+		measureAAQuality |= ImGui::Button("measure aa quality");
+		ImGui::SameLine();
+		ImGui::Text("rmse %.4f, psnr %.2f dB", aaQuality.rmse, aaQuality.psnr);
+		ImGui::Checkbox("gpu picking", &gpuPicking);
+		ImGui::Checkbox("frame arena", &frameArena);
+		ImGui::Checkbox("depth prepass", &depthPrepass);
+		ImGui::Checkbox("transient attachments", &transientAttachments);
+		rebakeEnvironment |= ImGui::Button("rebake environment");
+
+		if (ImGui::CollapsingHeader("lod"))
+		{
+			ImGui::Checkbox("lod enabled", &lod);
+			ImGui::SliderFloat("error (px)", &lodErrorPixels, 0.25f, 16.f);
+			ImGui::Checkbox("lod debug view", &lodDebugView);
+			for (uint32_t level = 0; level < Model::MAX_LOD_LEVEL; level++)
+			{
+				ImGui::Text("lod %u : %u instances", level, lodInstanceCounts[level]);
+			}
+		}
+
+		if (ImGui::CollapsingHeader("cpu culling"))
+		{
+			ImGui::Checkbox("instance frustum culling", &cpuFrustumCulling);
+			ImGui::Checkbox("occlusion culling", &occlusionCulling);
+			ImGui::Text("%s : %u / %u instances visible", FrustumCuller::getIsaName(FrustumCuller::detectIsa()), visibleInstanceCount, totalInstanceCount);
+			ImGui::Text("instancing : %u objects in %u draws", batchedInstances, instancedDraws);
+			ImGui::Text("occluders : %llu / %llu tris, %.3f ms", static_cast<unsigned long long>(occlusionStats.rasterizedTriangles),
+				static_cast<unsigned long long>(occlusionStats.occluderTriangles), occlusionStats.rasterMs);
+			ImGui::Text("occluded : %llu / %llu tested, %.3f ms", static_cast<unsigned long long>(occlusionStats.occluded),
+				static_cast<unsigned long long>(occlusionStats.tested), occlusionStats.testMs);
+		}
+
+		if (ImGui::CollapsingHeader("meshlet culling"))
+		{
+			ImGui::Checkbox("meshlet culling enabled", &meshletCulling);
+			ImGui::Checkbox("frustum", &meshletFrustumCulling);
+			ImGui::Checkbox("normal cone", &meshletConeCulling);
+			auto passText = [](const char* pass, const MeshletCullSystem::PassStats& stats) {
+				ImGui::Text("%s : %llu tris, frustum -%llu, cone -%llu", pass, static_cast<unsigned long long>(stats.triangles),
+					static_cast<unsigned long long>(stats.frustumRejected), static_cast<unsigned long long>(stats.coneRejected));
+			};
+			passText("gbuffer", meshletGBufferStats);
+			passText("shadow", meshletShadowStats);
+		}
+
+		if (ImGui::CollapsingHeader("texture streaming"))
+		{
+			const float mb = 1024.f * 1024.f;
+			ImGui::SliderInt("budget MB", &textureBudgetMB, 32, 4096);
+			ImGui::Text("resident : %.1f / %.1f MB%s", textureStreamStats.residentBytes / mb, textureStreamStats.budgetBytes / mb,
+				textureStreamStats.memoryBudgetExtension ? "" : " (no memory budget extension)");
+			ImGui::Text("%u / %u images at wanted mip, %u loading", textureStreamStats.satisfiedCount, textureStreamStats.imageCount, textureStreamStats.pendingLoads);
+			ImGui::Text("uploaded %.1f MB, %llu evictions", textureStreamStats.uploadedBytes / mb, static_cast<unsigned long long>(textureStreamStats.evictions));
+		}
+
+		// what each pass recorded last frame
+		if (ImGui::CollapsingHeader("command stats"))
+		{
+			auto& passes = CommandStats::GetSingleton().getLastFrame();
+			if (ImGui::BeginTable("command stats", 9, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollX))
+			{
+				ImGui::TableSetupColumn("pass");
+				ImGui::TableSetupColumn("draws");
+				ImGui::TableSetupColumn("tris");
+				ImGui::TableSetupColumn("inst");
+				ImGui::TableSetupColumn("pso");
+				ImGui::TableSetupColumn("sets");
+				ImGui::TableSetupColumn("push B");
+				ImGui::TableSetupColumn("barriers");
+				ImGui::TableSetupColumn("copies");
+				ImGui::TableHeadersRow();
+				for (auto& pass : passes)
+				{
+					auto& s = pass.stats;
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn(); ImGui::TextUnformatted(pass.name.c_str());
+					ImGui::TableNextColumn(); ImGui::Text("%u", s.draws + s.indirectDraws);
+					ImGui::TableNextColumn(); ImGui::Text("%llu", static_cast<unsigned long long>(s.triangles));
+					ImGui::TableNextColumn(); ImGui::Text("%llu", static_cast<unsigned long long>(s.instances));
+					ImGui::TableNextColumn(); ImGui::Text("%u", s.pipelineBinds);
+					ImGui::TableNextColumn(); ImGui::Text("%u", s.descriptorBinds);
+					ImGui::TableNextColumn(); ImGui::Text("%u", s.pushConstantBytes);
+					ImGui::TableNextColumn(); ImGui::Text("%u", s.barriers);
+					ImGui::TableNextColumn(); ImGui::Text("%u", s.copies);
+				}
+				ImGui::EndTable();
+			}
+		}
 		ImGui::End();
 
 		ImGui::Render();
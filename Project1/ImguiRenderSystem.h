@@ -10,6 +10,10 @@
 #include "Device.h"
 #include "SwapChain.h"
 #include "Model.h"
+#include "MeshletCullSystem.h"
+#include "OcclusionCuller.h"
+#include "TextureStreamer.h"
+#include "AAQualityProbe.h"
 #include "Camera.h"
 #include "Descriptors.h"
 #include "FrameInfo.h"
@@ -33,6 +37,51 @@ namespace jhb {
 	public:
 		float metalic = 0.1f;
 		float roughness= 0.1f;
+		// 0 : taa, 1~3 : msaa 2x, 4x, 8x (clamped to device limit)
+		int antiAliasing = 3;
+		// compare current mode against supersampled reference, cleared when probe starts
+		bool measureAAQuality = false;
+		// filled by application, last finished probe
+		AAQualityProbe::Result aaQuality{};
+		// render picking pass and read back instead of bvh ray cast
+		bool gpuPicking = false;
+		// filter irradiance and prefilter cube again on async compute, cleared when job is queued
+		bool rebakeEnvironment = false;
+		// transient cpu data of frame from linear arena instead of heap
+		bool frameArena = true;
+		// gbuffer, depth and msaa color without store and on lazily allocated memory where device has it
+		bool transientAttachments = true;
+		// depth only pass before gbuffer, gbuffer then shades with equal depth test
+		bool depthPrepass = true;
+		// distance based lod of instanced gltf models
+		bool lod = true;
+		float lodErrorPixels = 1.f;
+		// tint deferred albedo by lod level
+		bool lodDebugView = false;
+		// filled by application, instances per lod last frame
+		std::array<uint32_t, Model::MAX_LOD_LEVEL> lodInstanceCounts{};
+		// simd frustum culling of instances on cpu
+		bool cpuFrustumCulling = true;
+		// software rasterized occluders, needs frustum culling
+		bool occlusionCulling = true;
+		// filled by application, last frame
+		uint32_t visibleInstanceCount = 0;
+		uint32_t totalInstanceCount = 0;
+		// filled by application, automatic instancing of objects sharing a model
+		uint32_t instancedDraws = 0;
+		uint32_t batchedInstances = 0;
+		OcclusionCuller::Stats occlusionStats{};
+		// gpu meshlet culling of sponza for gbuffer and shadow
+		bool meshletCulling = true;
+		bool meshletFrustumCulling = true;
+		bool meshletConeCulling = true;
+		// filled by application, last finished frame
+		MeshletCullSystem::PassStats meshletGBufferStats{};
+		MeshletCullSystem::PassStats meshletShadowStats{};
+		// gltf texture memory, memory budget extension may lower it further
+		int textureBudgetMB = 512;
+		// filled by application
+		TextureStreamer::Stats textureStreamStats{};
 	private:
 		ImGuiStyle vulkanStyle;
 	public:
@@ -0,0 +1,121 @@
+#include "InstanceBatcher.h"
+#include "DeletionQueue.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace jhb {
+	InstanceBatcher::InstanceBatcher(Device& device) : device{ device }
+	{
+	}
+
+	void InstanceBatcher::group(GameObject::Map& gameObjects, uint32_t objectGeneration)
+	{
+		groups.clear();
+		entities.clear();
+
+		std::unordered_map<const Model*, uint32_t> groupLookup;
+		for (auto& kv : gameObjects)
+		{
+			auto& obj = kv.second;
+			if (obj.model == nullptr)
+			{
+				continue;
+			}
+			auto it = groupLookup.find(obj.model.get());
+			if (it == groupLookup.end())
+			{
+				it = groupLookup.emplace(obj.model.get(), static_cast<uint32_t>(groups.size())).first;
+				groups.push_back(Group{ obj.model });
+			}
+			groups[it->second].objects.push_back(&obj);
+		}
+
+		// map order changes with rehash, ids keep slots and owners stable between runs
+		auto byId = [](const GameObject* a, const GameObject* b) { return a->getId() < b->getId(); };
+		for (auto& group : groups)
+		{
+			std::sort(group.objects.begin(), group.objects.end(), byId);
+		}
+		std::sort(groups.begin(), groups.end(), [&](const Group& a, const Group& b) { return byId(a.objects[0], b.objects[0]); });
+
+		for (auto& group : groups)
+		{
+			group.model->batchOwner = group.objects[0]->getId();
+			group.firstInstance = static_cast<uint32_t>(entities.size());
+			for (auto obj : group.objects)
+			{
+				entities.push_back(obj->getId());
+			}
+		}
+		groupedObjectGeneration = objectGeneration;
+		generation++;
+
+		// no stream yet, bind skips instance binding until first gather
+		fillInstances();
+		for (auto& group : groups)
+		{
+			group.model->setInstances(&instances[group.firstInstance], static_cast<uint32_t>(group.objects.size()), VK_NULL_HANDLE, 0);
+		}
+	}
+
+	void InstanceBatcher::gather(GameObject::Map& gameObjects, uint32_t objectGeneration, int frameIndex)
+	{
+		if (objectGeneration != groupedObjectGeneration)
+		{
+			group(gameObjects, objectGeneration);
+		}
+		if (entities.empty())
+		{
+			return;
+		}
+
+		fillInstances();
+
+		auto& stream = streams[frameIndex];
+		if (stream == nullptr || stream->getInstanceCount() < entities.size())
+		{
+			// old stream may still be read by this slot's last frame
+			if (stream)
+			{
+				device.getDeletionQueue().retire(std::move(stream));
+			}
+			stream = std::make_unique<Buffer>(device, sizeof(Model::InstanceData), static_cast<uint32_t>(entities.size()), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+			stream->map();
+		}
+		stream->writeToBuffer(instances.data(), sizeof(Model::InstanceData) * instances.size(), 0);
+		stream->flush();
+
+		for (auto& group : groups)
+		{
+			group.model->setInstances(&instances[group.firstInstance], static_cast<uint32_t>(group.objects.size()), stream->getBuffer(),
+				sizeof(Model::InstanceData) * group.firstInstance);
+		}
+	}
+
+	int InstanceBatcher::resolveEntity(uint32_t slot) const
+	{
+		return slot < entities.size() ? static_cast<int>(entities[slot]) : -1;
+	}
+
+	void InstanceBatcher::fillInstances()
+	{
+		instances.resize(entities.size());
+		for (auto& group : groups)
+		{
+			for (uint32_t i = 0; i < group.objects.size(); i++)
+			{
+				const GameObject& obj = *group.objects[i];
+				Model::InstanceData& data = instances[group.firstInstance + i];
+				data = Model::InstanceData{};
+				data.pos = obj.transform.translation;
+				data.rot = obj.transform.rotation;
+				data.roughness = obj.roughness;
+				data.metallic = obj.metallic;
+				// float is exact up to 2^24 slots
+				data.r = static_cast<float>(group.firstInstance + i);
+			}
+		}
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+#define GLM_FORCE_RADIANS // not use degree;
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+
+#include <glm/glm.hpp>
+
+#include "Device.h"
+#include "Buffer.h"
+#include "SwapChain.h"
+#include "Model.h"
+#include "GameObject.h"
+
+#include <array>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+namespace jhb {
+	// groups game objects sharing one model (same mesh and materials) into one instanced draw, recorded by the group's owner object.
+	// every frame transform and material of each object are gathered into a transient instance stream, and the slot of each instance
+	// goes to InstanceData::r so picking resolves it through the entity table instead of id arithmetic
+	class InstanceBatcher
+	{
+	public:
+		explicit InstanceBatcher(Device& device);
+
+		InstanceBatcher(const InstanceBatcher&) = delete;
+		InstanceBatcher& operator=(const InstanceBatcher&) = delete;
+
+		// assigns owners, instance slots and cpu instance data, call once after scene is created so systems see grouped models at init.
+		// objectGeneration is GameObjectManager::GetGeneration of the map
+		void group(GameObject::Map& gameObjects, uint32_t objectGeneration);
+		// writes this frame's instance stream and points every model at its range, regroups first when objects were added or removed
+		void gather(GameObject::Map& gameObjects, uint32_t objectGeneration, int frameIndex);
+
+		// instance slot read back from picking to game object id, -1 when slot is out of range
+		int resolveEntity(uint32_t slot) const;
+		// bumped when slots are reassigned, picks rendered before it may resolve to another object
+		uint32_t getGeneration() const { return generation; }
+
+		uint32_t getDrawCount() const { return static_cast<uint32_t>(groups.size()); }
+		uint32_t getInstanceCount() const { return static_cast<uint32_t>(entities.size()); }
+
+	private:
+		struct Group {
+			std::shared_ptr<Model> model;
+			// ascending id, first one owns the draw
+			std::vector<GameObject*> objects;
+			uint32_t firstInstance = 0;
+		};
+
+		void fillInstances();
+
+	private:
+		Device& device;
+
+		std::vector<Group> groups;
+		// instance slot to game object id
+		std::vector<GameObject::id_t> entities;
+		std::vector<Model::InstanceData> instances;
+		uint32_t groupedObjectGeneration = 0;
+		uint32_t generation = 0;
+
+		// host visible, one per frame in flight since last frames may still read theirs
+		std::array<std::unique_ptr<Buffer>, SwapChain::MAX_FRAMES_IN_FLIGHT> streams;
+	};
+}
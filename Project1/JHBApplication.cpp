@@ -12,9 +12,20 @@
 #include "MousePickingRenderSystem.h"
 #include "ShadowRenderSystem.h"
 #include "DeferedPBRRenderSystem.h"
+#include "CommandStats.h"
+#include "TAARenderSystem.h"
+#include "AAQualityProbe.h"
 #include "ComputerShadeSystem.h"
 #include "GameObjectManager.h"
 #include "Scene.h"
+#include "SceneBVH.h"
+#include "RenderGraph.h"
+#include "AsyncComputeScheduler.h"
+#include "UniformRing.h"
+#include "MeshletCullSystem.h"
+#include "OcclusionCuller.h"
+#include "InstanceBatcher.h"
+#include "TextureStreamer.h"
 
 #define _USE_MATH_DEFINESimgui
 #include <math.h>
@@ -22,13 +33,10 @@
 #include <numeric>
 
 namespace jhb {
-	JHBApplication::JHBApplication()
+	JHBApplication::JHBApplication(const SceneConfig& sceneConfig, const BenchmarkSettings& benchmarkSettings) : sceneConfig{ sceneConfig }, benchmarkSettings{ benchmarkSettings }
 	{
-		uboBuffers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
 		CubeBoxDescriptorSets.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
-		globalDescriptorSets.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
 		pbrResourceDescriptorSets.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
-		pickingObjUboDescriptorSets.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
 
 		//computeShaderSystem = std::make_unique<ComputerShadeSystem>(device);
 		GlobalScene = new jhb::Scene();
@@ -38,6 +46,7 @@ namespace jhb {
 
 	JHBApplication::~JHBApplication()
 	{
+		taaRenderSystem = nullptr;
 		ImGui_ImplVulkan_Shutdown();
 		ImGui_ImplGlfw_Shutdown();
 		ImGui::DestroyContext();
@@ -49,6 +58,12 @@ namespace jhb {
 		viewerObject.transform.translation.y = -5.5f;
 		viewerObject.transform.translation.z = -2.5f;
 		InputController cameraController{device.getWindow().GetGLFWwindow(), viewerObject};
+		// replays camera path and mouse timeline instead of user input
+		std::unique_ptr<Benchmark> benchmark;
+		if (benchmarkSettings.enabled)
+		{
+			benchmark = std::make_unique<Benchmark>(benchmarkSettings, sceneConfig);
+		}
 		double x, y;
 		auto currentTime = std::chrono::high_resolution_clock::now();
 
@@ -59,46 +74,109 @@ namespace jhb {
 		
 		//computeShaderSystem->SetupDescriptor(deferedPbrRenderSystem->pbrObjects);
 
-		while (!glfwWindowShouldClose(&window.GetGLFWwindow()))
+		updateAntiAliasing();
+
+		// finished benchmark still runs quality probe of last pose
+		while (!glfwWindowShouldClose(&window.GetGLFWwindow()) && !(benchmark && benchmark->isFinished() && !aaQualityProbe->isActive()))
 		{
 			glfwPollEvents(); //may block
+			updateAntiAliasing();
+			updateTransientAttachments();
+			if (imguiRenderSystem->measureAAQuality && !aaQualityProbe->isActive())
+			{
+				startAntiAliasingQuality();
+			}
+			imguiRenderSystem->measureAAQuality = false;
 			glfwGetCursorPos(&window.GetGLFWwindow(), &x, &y);
 			auto newTime = std::chrono::high_resolution_clock::now();
 			float frameTime = std::chrono::duration<float, std::chrono::seconds::period>(newTime - currentTime).count();
+			float wallFrameTime = frameTime;
 			currentTime = newTime;
+			if (benchmark)
+			{
+				// fixed step, so every run simulates same frames
+				frameTime = benchmark->getFrameTime();
+				if (!aaQualityProbe->isActive())
+				{
+					benchmark->applyMouse(window, x, y);
+				}
+			}
 
 			auto commandBuffer = renderer.beginFrame();
 			if (commandBuffer == nullptr) // begine frame return null pointer if swap chain need recreated
 			{
-				mousePickingRenderSystem->destroyOffscreenFrameBuffer();
-				mousePickingRenderSystem->createOffscreenFrameBuffers();
-
 				renderer.setWindowExtent(window.getExtent());
 				imguiRenderSystem->recreateFrameBuffer(device, renderer.GetSwapChain(), window.getExtent());
 				deferedPbrRenderSystem->createFrameBuffers(renderer.getSwapChainImageViews(), true);
+				if (taaRenderSystem)
+				{
+					taaRenderSystem->recreate(renderer.getSwapChainImageViews(), deferedPbrRenderSystem->getSceneColorView(), deferedPbrRenderSystem->getVelocityView());
+				}
+				// picking image follows window size and scene color, velocity are recreated
+				buildRenderGraph();
+				aaQualityProbe->cancel();
 				window.resetWindowResizedFlag();
 				continue;
 			}
 
+			auto recordBegin = std::chrono::high_resolution_clock::now();
 			int frameIndex = renderer.getFrameIndex();
-			//renderer.excuteComputeDispatch(&(computeShaderSystem->computeCommandBuffers[frameIndex]));
+			uniformRing->beginFrame(frameIndex);
+			CommandStats::GetSingleton().beginFrame();
+			bool useFrameArena = imguiRenderSystem->frameArena;
+			device.getFrameArena().setEnabled(useFrameArena);
+			uint64_t heapAllocationsBefore = getHeapAllocationCount();
+
+			// probe frames wait for readback
+			if (!aaQualityProbe->isActive())
+			{
+				aaFrameCount++;
+				aaTotalFrameTime += frameTime;
+				aaMinFrameTime = aaFrameCount == 1 ? frameTime : std::min(aaMinFrameTime, frameTime);
+				aaMaxFrameTime = std::max(aaMaxFrameTime, frameTime);
+			}
 
 			FrameInfo frameInfo{
 				frameIndex,
 				frameTime,
 				commandBuffer,
 				*window.getCamera(),
-				globalDescriptorSets[frameIndex],
+				globalDescriptorSet,
 				pbrResourceDescriptorSets[frameIndex],
 				CubeBoxDescriptorSets[frameIndex],
 				shadowMapDescriptorSet,
 			};
 
+			// acquires results of earlier compute submissions and swaps in finished background work
+			asyncCompute->beginGraphics(commandBuffer, frameIndex);
+			if (imguiRenderSystem->rebakeEnvironment && !asyncCompute->isBackgroundJobPending())
+			{
+				pbrSourceGenerator->filterEnvironmentAsync(*asyncCompute);
+			}
+			imguiRenderSystem->rebakeEnvironment = false;
+
+			if (aaQualityProbe->isReferenceFrame())
+			{
+				// still camera, every reference frame adds one more sample position inside pixel, in msaa too
+				window.getCamera()->setJitter(aaQualityProbe->getReferenceIndex(), static_cast<float>(window.getExtent().width), static_cast<float>(window.getExtent().height),
+					AAQualityProbe::REFERENCE_FRAMES);
+				window.getCamera()->setPerspectiveProjection(renderer.getAspectRatio(), 0.1f, 200.f);
+				if (taaRenderSystem)
+				{
+					taaRenderSystem->resetHistory();
+				}
+			}
+
 			// update part : resources
 			GlobalUbo ubo{};
-			ubo.projection = window.getCamera()->getProjection();
+			// jitter only goes to rasterization, velocity uses unjittered viewProjection
+			ubo.projection = taaRenderSystem || aaQualityProbe->isReferenceFrame() ? window.getCamera()->getJitteredProjection() : window.getCamera()->getProjection();
 			ubo.view = window.getCamera()->getView();
 			ubo.inverseView = window.getCamera()->getInverseView();
+			ubo.viewProjection = window.getCamera()->getProjection() * window.getCamera()->getView();
+			ubo.prevViewProjection = prevViewProjection;
+			std::copy(pbrSourceGenerator->irradianceSH.begin(), pbrSourceGenerator->irradianceSH.end(), ubo.irradianceSH);
+			prevViewProjection = ubo.viewProjection;
 			ubo.exposure = 1.f;
 			ubo.gamma = 1.f;
 			ubo.pointLights[0].color.r = 40.f;
@@ -110,87 +188,357 @@ namespace jhb {
 			
 
 			pointLightSystem->update(frameInfo, ubo);
-			uboBuffers[frameIndex]->writeToBuffer(&ubo); // wrtie to using frame buffer index
-			uboBuffers[frameIndex]->flush(); //not using coherent_bit flag, so must to flush memory manually
+			// picking rotation of last frame lands here
+			instanceBatcher->gather(GameObjectManager::GetSingleton().gameObjects, GameObjectManager::GetSingleton().GetGeneration(), frameIndex);
+			imguiRenderSystem->instancedDraws = instanceBatcher->getDrawCount();
+			imguiRenderSystem->batchedInstances = instanceBatcher->getInstanceCount();
+			// same camera as ubo of this frame
+			textureStreamer->beginFrame();
+			deferedPbrRenderSystem->selectLods(frameInfo, static_cast<float>(window.getExtent().height), imguiRenderSystem->lod, imguiRenderSystem->lodErrorPixels, imguiRenderSystem->lodDebugView,
+				imguiRenderSystem->cpuFrustumCulling ? frustumCuller.get() : nullptr, imguiRenderSystem->occlusionCulling ? occlusionCuller.get() : nullptr, textureStreamer.get());
+			// uploads land before any pass samples them, material sets of this slot follow swapped images
+			textureStreamer->budgetBytes = static_cast<VkDeviceSize>(imguiRenderSystem->textureBudgetMB) * 1024 * 1024;
+			// recorded before graph executes, own bucket so uploads and their barriers show up in command stats
+			CommandStats::GetSingleton().beginPass("streaming");
+			textureStreamer->update(commandBuffer);
+			CommandStats::GetSingleton().endPass();
+			updateMaterialDescriptors(frameIndex);
+			imguiRenderSystem->textureStreamStats = textureStreamer->getStats();
+			imguiRenderSystem->lodInstanceCounts = deferedPbrRenderSystem->getLodInstanceCounts();
+			imguiRenderSystem->visibleInstanceCount = deferedPbrRenderSystem->getVisibleInstanceCount();
+			imguiRenderSystem->totalInstanceCount = deferedPbrRenderSystem->getTotalInstanceCount();
+			imguiRenderSystem->occlusionStats = occlusionCuller->getStats();
+			deferedPbrRenderSystem->depthPrepass = imguiRenderSystem->depthPrepass;
+			meshletCullingActive = imguiRenderSystem->meshletCulling;
+			if (meshletCullingActive)
+			{
+				meshletCullSystem->frustumCulling = imguiRenderSystem->meshletFrustumCulling;
+				meshletCullSystem->coneCulling = imguiRenderSystem->meshletConeCulling;
+				// jittered, same frustum as rasterization
+				meshletCullSystem->prepare(frameIndex, ubo.projection * ubo.view, glm::vec3(ubo.inverseView[3]), *shadowMapRenderSystem);
+				frameInfo.meshletCulling = meshletCullSystem.get();
+			}
+			imguiRenderSystem->meshletGBufferStats = meshletCullSystem->getGBufferStats();
+			imguiRenderSystem->meshletShadowStats = meshletCullSystem->getShadowStats();
+			frameInfo.globalUboOffset = uniformRing->push(ubo); // wrtie to this frame's region of ring, coherent so no flush
 			// and now we need tell to pipeline object where this buffer is and how data within it's structure
 			// so using descriptor
 
-			if (!pickingPhase(commandBuffer, ubo, frameIndex, x, y))
+			// scene and camera stay still while quality probe renders same view
+			if (!aaQualityProbe->isActive())
 			{
-				// camera controll phase
-				if (window.objectId ==0 && window.GetMousePressed())
+				if (!pickingPhase(commandBuffer, ubo, frameIndex, x, y))
 				{
-					window.mouseMove(x, y, frameTime, viewerObject);
+					// camera controll phase
+					if (window.objectId ==0 && window.GetMousePressed())
+					{
+						window.mouseMove(x, y, frameTime, viewerObject);
+					}
 				}
-			}
 
-			auto forwardDir = cameraController.move(&window.GetGLFWwindow(), frameTime, viewerObject);
-			window.getCamera()->setViewDirection(viewerObject.transform.translation, forwardDir);
+				auto forwardDir = benchmark ? benchmark->applyCamera(viewerObject) : cameraController.move(&window.GetGLFWwindow(), frameTime, viewerObject);
+				window.getCamera()->setViewDirection(viewerObject.transform.translation, forwardDir);
+			}
 			float aspect = renderer.getAspectRatio();
+			if (taaRenderSystem)
+			{
+				window.getCamera()->setJitter(jitterFrameCount++, static_cast<float>(window.getExtent().width), static_cast<float>(window.getExtent().height));
+			}
 			window.getCamera()->setPerspectiveProjection(aspect, 0.1f, 200.f);
 			// render part : vkcmd
 			// this is why beginFram and beginswapchian renderpass are not combined;
 			// because main application control over this multiple render pass like reflections, shadows, post-processing effects
+			// passes and barriers between them are recorded by render graph
+			renderGraph->setImportedImage(rgSwapChainImage, renderer.getSwapChainImage(frameIndex), VK_IMAGE_LAYOUT_UNDEFINED);
+			renderGraph->execute(frameInfo);
+			pickRequested = false;
+			asyncCompute->submit(commandBuffer, frameIndex);
+			auto recordEnd = std::chrono::high_resolution_clock::now();
+			renderer.endFrame(asyncCompute->getGraphicsSync());
+			arenaFrameCount[useFrameArena]++;
+			arenaHeapAllocations[useFrameArena] += getHeapAllocationCount() - heapAllocationsBefore;
+			if (aaQualityProbe->isActive())
+			{
+				aaQualityProbe->endFrame();
+				if (aaQualityProbe->hasResult())
+				{
+					printAntiAliasingQuality();
+					if (benchmark)
+					{
+						auto& quality = aaQualityProbe->getResult();
+						benchmark->setAntiAliasingQuality(taaRenderSystem ? "TAA" : "MSAA " + std::to_string(deferedPbrRenderSystem->getSampleCount()) + "x", quality.rmse, quality.psnr);
+					}
+				}
+			}
+			else if (benchmark && !benchmark->isFinished())
+			{
+				benchmark->endFrame(wallFrameTime * 1000.0, std::chrono::duration<double, std::milli>(recordEnd - recordBegin).count(), *renderGraph, device);
+				if (benchmark->isFinished())
+				{
+					startAntiAliasingQuality();
+				}
+			}
+		}
 
-			shadowMapRenderSystem->updateShadowMap(commandBuffer, GameObjectManager::GetSingleton().gameObjects, frameIndex);
+		vkDeviceWaitIdle(device.getLogicalDevice());
+		printAntiAliasingStats();
+		asyncCompute->printReport();
+		meshletCullSystem->printReport();
+		occlusionCuller->printReport();
+		textureStreamer->printReport();
+		printFrameArenaStats();
+		std::cout << "[descriptors] " << device.getDescriptorLayoutCache().getLayoutCount() << " set layouts, " << device.getDescriptorLayoutCache().getHitCount()
+			<< " duplicate builds shared, " << descriptorAllocator->getAllocatedSetCount() << " sets in " << descriptorAllocator->getPoolCount() << " pools" << std::endl;
+		std::cout << "[deletion queue] peak " << device.getDeletionQueue().getPeakPendingCount() << " objects waiting for their frame" << std::endl;
+		std::cout << "[uniform ring] peak " << uniformRing->getPeakFrameUsage() << " / " << uniformRing->getFrameCapacity() << " bytes per frame" << std::endl;
+		if (benchmark && benchmark->isFinished())
+		{
+			benchmark->writeReport(device, *renderGraph);
+		}
+	}
 
-			renderer.beginSwapChainRenderPass(commandBuffer, deferedPbrRenderSystem->getRenderPass(), deferedPbrRenderSystem->getFrameBuffer(frameIndex), window.getExtent(), 8);
-			/*
-			pbrRenderSystem->renderGameObjects(frameInfo);
-			pointLightSystem->renderGameObjects(frameInfo);
-			*/
-			deferedPbrRenderSystem->renderGameObjects(frameInfo);
-			renderer.endSwapChainRenderPass(commandBuffer);
-		
-			renderer.beginSwapChainRenderPass(commandBuffer, device.imguiRenderPass, imguiRenderSystem->framebuffers[frameIndex], window.getExtent());
-			imguiRenderSystem->newFrame();
-			ImDrawData* draw_data = ImGui::GetDrawData();
-			ImGui_ImplVulkan_RenderDrawData(draw_data, commandBuffer);
-			renderer.endSwapChainRenderPass(commandBuffer);
-			renderer.endFrame();
+	void JHBApplication::updateAntiAliasing()
+	{
+		if (antiAliasing == imguiRenderSystem->antiAliasing)
+		{
+			return;
 		}
 
-		vkDeviceWaitIdle(device.getLogicalDevice());
+		if (antiAliasing >= 0)
+		{
+			printAntiAliasingStats();
+		}
+		antiAliasing = imguiRenderSystem->antiAliasing;
+		// result and reference belong to previous mode
+		aaQualityProbe->cancel();
+
+		if (antiAliasing == 0)
+		{
+			deferedPbrRenderSystem->setAntiAliasing(AntiAliasingMode::TAA, VK_SAMPLE_COUNT_1_BIT, renderer.getSwapChainImageViews());
+			taaRenderSystem = std::make_unique<TAARenderSystem>(device, renderer.getSwapChainImageViews(), renderer.GetSwapChain().getSwapChainImageFormat(),
+				deferedPbrRenderSystem->getSceneColorView(), deferedPbrRenderSystem->getVelocityView());
+			jitterFrameCount = 0;
+		}
+		else
+		{
+			// last taa frames may still be in flight
+			device.getDeletionQueue().retire(std::move(taaRenderSystem));
+			window.getCamera()->clearJitter();
+			deferedPbrRenderSystem->setAntiAliasing(AntiAliasingMode::MSAA, static_cast<VkSampleCountFlagBits>(1 << antiAliasing), renderer.getSwapChainImageViews());
+		}
+		buildRenderGraph();
+
+		aaFrameCount = 0;
+		aaTotalFrameTime = 0.f;
+		aaMinFrameTime = 0.f;
+		aaMaxFrameTime = 0.f;
 	}
 
-	void JHBApplication::init()
+	void JHBApplication::updateTransientAttachments()
+	{
+		if (imguiRenderSystem->transientAttachments == deferedPbrRenderSystem->getTransientAttachments())
+		{
+			return;
+		}
+
+		// every attachment is created again, taa descriptors and imported images of graph follow them
+		deferedPbrRenderSystem->setTransientAttachments(imguiRenderSystem->transientAttachments, renderer.getSwapChainImageViews());
+		if (taaRenderSystem)
+		{
+			taaRenderSystem->recreate(renderer.getSwapChainImageViews(), deferedPbrRenderSystem->getSceneColorView(), deferedPbrRenderSystem->getVelocityView());
+		}
+		buildRenderGraph();
+		aaQualityProbe->cancel();
+	}
+
+	void JHBApplication::printFrameArenaStats()
+	{
+#if JHB_HEAP_STATS
+		const char* names[2] = { "off", "on" };
+		double perFrame[2] = {};
+		for (int i = 0; i < 2; i++)
+		{
+			if (arenaFrameCount[i] == 0)
+			{
+				continue;
+			}
+			perFrame[i] = static_cast<double>(arenaHeapAllocations[i]) / arenaFrameCount[i];
+			std::cout << "[frame arena] " << names[i] << " : " << arenaFrameCount[i] << " frames, " << perFrame[i] << " heap allocations per frame" << std::endl;
+		}
+		// before and after, needs frames recorded with checkbox in both states
+		if (arenaFrameCount[0] > 0 && arenaFrameCount[1] > 0)
+		{
+			std::cout << "[frame arena] heap allocations per frame " << perFrame[0] << " -> " << perFrame[1] << std::endl;
+		}
+#else
+		std::cout << "[frame arena] heap allocations are not counted, build with JHB_HEAP_STATS=1" << std::endl;
+#endif
+		auto& arena = device.getFrameArena();
+		std::cout << "[frame arena] peak " << arena.getPeakFrameUsage() << " / " << arena.getFrameCapacity() << " bytes per frame, "
+			<< arena.getOverflowCount() << " allocations overflowed to heap" << std::endl;
+	}
+
+	void JHBApplication::updateMaterialDescriptors(int frameIndex)
+	{
+		// this slot's fence was waited, its sets are not read by gpu anymore
+		for (auto& kv : GameObjectManager::GetSingleton().gameObjects)
+		{
+			auto& model = kv.second.model;
+			if (model == nullptr || kv.first != model->batchOwner || !model->materialTexturesDirty[frameIndex])
+			{
+				continue;
+			}
+			for (auto& material : model->materials)
+			{
+				auto imageinfos = model->getMaterialImageInfos(material);
+				DescriptorWriter(*descSetLayouts[3], *descriptorAllocator).writeImage(0, &imageinfos[0]).writeImage(1, &imageinfos[1])
+					.writeImage(2, &imageinfos[2]).writeImage(3, &imageinfos[3]).writeImage(4, &imageinfos[4])
+					.overwrite(material.descriptorSets[frameIndex]);
+			}
+			model->materialTexturesDirty[frameIndex] = false;
+		}
+	}
+
+	void JHBApplication::printAntiAliasingStats()
 	{
-		globalPools[0] = DescriptorPool::Builder(device).setMaxSets(SwapChain::MAX_FRAMES_IN_FLIGHT).addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, SwapChain::MAX_FRAMES_IN_FLIGHT).build();
-		// ubo
-		globalPools[1] = DescriptorPool::Builder(device).setMaxSets(SwapChain::MAX_FRAMES_IN_FLIGHT).addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, SwapChain::MAX_FRAMES_IN_FLIGHT).build(); // skybox
+		if (aaFrameCount == 0)
+		{
+			return;
+		}
 
-		globalPools[2] = DescriptorPool::Builder(device).setMaxSets(SwapChain::MAX_FRAMES_IN_FLIGHT).addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, SwapChain::MAX_FRAMES_IN_FLIGHT * 3).build();	// prefiter, brud, irradiane
+		VkDeviceSize memory = deferedPbrRenderSystem->getAttachmentMemorySize();
+		if (taaRenderSystem)
+		{
+			memory += taaRenderSystem->getHistoryMemorySize();
+		}
 
-		// for gltf model color map and normal map and emissive, occlusion, metallicRoughness Textures
-		globalPools[3] = DescriptorPool::Builder(device).setMaxSets(SwapChain::MAX_FRAMES_IN_FLIGHT*35).addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, SwapChain::MAX_FRAMES_IN_FLIGHT * 10*25).build();
+		const char* modeName = taaRenderSystem ? "TAA" : "MSAA";
+		std::cout << "[anti aliasing] " << modeName << " " << deferedPbrRenderSystem->getSampleCount() << "x : "
+			<< aaFrameCount << " frames, avg " << aaTotalFrameTime / aaFrameCount * 1000.f << " ms, min " << aaMinFrameTime * 1000.f
+			<< " ms, max " << aaMaxFrameTime * 1000.f << " ms, attachment memory " << memory / 1024 << " KB" << std::endl;
+		printAntiAliasingQuality();
+	}
 
-		// for picking object index storage
-		globalPools[4] = DescriptorPool::Builder(device).setMaxSets(SwapChain::MAX_FRAMES_IN_FLIGHT).addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, SwapChain::MAX_FRAMES_IN_FLIGHT).build();
+	void JHBApplication::startAntiAliasingQuality()
+	{
+		if (!renderer.GetSwapChain().supportsReadback())
+		{
+			std::cout << "[anti aliasing] swapchain images can't be copied, quality is not measured" << std::endl;
+			return;
+		}
+		aaQualityProbe->start(renderer.GetSwapChain().getSwapChainExtent());
+	}
 
-		globalPools[5] = DescriptorPool::Builder(device).setMaxSets(1).addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1).build();
+	void JHBApplication::printAntiAliasingQuality()
+	{
+		if (!aaQualityProbe->hasResult())
+		{
+			return;
+		}
 
-		for (int i = 0; i < uboBuffers.size(); i++)
+		auto& quality = aaQualityProbe->getResult();
+		imguiRenderSystem->aaQuality = quality;
+		const char* modeName = taaRenderSystem ? "TAA" : "MSAA";
+		std::cout << "[anti aliasing] " << modeName << " " << deferedPbrRenderSystem->getSampleCount() << "x quality : rmse " << quality.rmse << ", psnr " << quality.psnr
+			<< " dB against " << AAQualityProbe::REFERENCE_FRAMES << " jittered frames" << std::endl;
+	}
+
+	void JHBApplication::buildRenderGraph()
+	{
+		// transient images and framebuffers of previous graph may still be in flight, they are retired to deletion queue
+		renderGraph = std::make_unique<RenderGraph>(device);
+
+		VkExtent2D extent = window.getExtent();
+		rgSwapChainImage = renderGraph->importImage("swapchain", renderer.getSwapChainImage(0), VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+		renderGraph->markOutput(rgSwapChainImage);
+		auto shadowCube = renderGraph->importImage("shadow cube", shadowMapRenderSystem->GetShadowMap().image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		auto shadowDepth = renderGraph->createImage("shadow depth", { shadowMapRenderSystem->getDepthFormat(), shadowMapRenderSystem->getExtent(),
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, shadowMapRenderSystem->getDepthAspect() });
+		rgPickingImage = renderGraph->createImage("picking", { VK_FORMAT_R32G32B32A32_UINT, extent,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_IMAGE_ASPECT_COLOR_BIT });
+
+		// only the texel under cursor is rendered and copied
+		renderGraph->addPass("picking", [this](FrameInfo& frameInfo) {
+			renderer.beginSwapChainRenderPassWithMouseCoordinate(frameInfo.commandBuffer, mousePickingRenderSystem->pickingRenderpass, mousePickingRenderSystem->offscreenFrameBuffer, window.getExtent(), pickX, pickY);
+			mousePickingRenderSystem->renderMousePickedObjToOffscreen(frameInfo.commandBuffer, frameInfo.globaldDescriptorSet, frameInfo.globalUboOffset, frameInfo.frameIndex);
+			renderer.endSwapChainRenderPass(frameInfo.commandBuffer);
+		}).write(rgPickingImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT)
+			.condition([this]() { return pickRequested; });
+
+		renderGraph->addPass("picking readback", [this](FrameInfo& frameInfo) {
+			mousePickingRenderSystem->copyPickedTexel(frameInfo.commandBuffer, frameInfo.frameIndex, renderGraph->getImage(rgPickingImage), pickX, pickY);
+		}).read(rgPickingImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT)
+			.condition([this]() { return pickRequested; })
+			.sideEffect();
+
+		// indirect draws and index streams of every view, buffers aren't tracked by graph so pass keeps its own barriers
+		renderGraph->addPass("meshlet cull", [this](FrameInfo& frameInfo) {
+			meshletCullSystem->record(frameInfo.commandBuffer, frameInfo.frameIndex);
+		}).condition([this]() { return meshletCullingActive; })
+			.sideEffect();
+
+		// shadow depth is dead after this pass, so it shares memory with picking image
+		renderGraph->addPass("shadow", [this](FrameInfo& frameInfo) {
+			shadowMapRenderSystem->updateShadowMap(frameInfo.commandBuffer, GameObjectManager::GetSingleton().gameObjects, frameInfo.frameIndex, frameInfo.meshletCulling);
+		}).write(shadowCube, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT)
+			.write(shadowDepth, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+				VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+
+		auto deferredPass = renderGraph->addPass("deferred", [this](FrameInfo& frameInfo) {
+			renderer.beginSwapChainRenderPass(frameInfo.commandBuffer, deferedPbrRenderSystem->getRenderPass(), deferedPbrRenderSystem->getFrameBuffer(frameInfo.frameIndex), window.getExtent(), deferedPbrRenderSystem->getAttachmentCount());
+			deferedPbrRenderSystem->renderGameObjects(frameInfo);
+			renderer.endSwapChainRenderPass(frameInfo.commandBuffer);
+		});
+		deferredPass.read(shadowCube, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT)
+			.write(rgSwapChainImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+
+		if (taaRenderSystem)
 		{
-			uboBuffers[i] = std::make_unique<Buffer>(
-				device,
-				sizeof(GlobalUbo),
-				1,
-				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-			);
-
-			uboPickingIndexBuffer[i] = std::make_unique<Buffer>(
-				device,
-				sizeof(PickingUbo),
-				1,
-				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-			);
-
-			uboBuffers[i]->map();
-			uboPickingIndexBuffer[i]->map();
+			// scene color and velocity belong to deferred system, they are only tracked here
+			auto sceneColor = renderGraph->importImage("scene color", deferedPbrRenderSystem->getSceneColorImage(), VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+			auto velocity = renderGraph->importImage("velocity", deferedPbrRenderSystem->getVelocityImage(), VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+			deferredPass.write(sceneColor, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT)
+				.write(velocity, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+
+			renderGraph->addPass("taa", [this](FrameInfo& frameInfo) {
+				renderer.beginSwapChainRenderPass(frameInfo.commandBuffer, taaRenderSystem->getRenderPass(), taaRenderSystem->getFrameBuffer(frameInfo.frameIndex), window.getExtent(), 2);
+				taaRenderSystem->renderGameObjects(frameInfo);
+				renderer.endSwapChainRenderPass(frameInfo.commandBuffer);
+			}).read(sceneColor, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT)
+				.read(velocity, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT)
+				.write(rgSwapChainImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
 		}
 
+		// final image without ui, only in frames quality probe compares
+		renderGraph->addPass("aa capture", [this](FrameInfo& frameInfo) {
+			aaQualityProbe->recordCapture(frameInfo.commandBuffer, renderGraph->getImage(rgSwapChainImage));
+		}).read(rgSwapChainImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT)
+			.condition([this]() { return aaQualityProbe->capturesFrame(); })
+			.sideEffect();
+
+		renderGraph->addPass("imgui", [this](FrameInfo& frameInfo) {
+			renderer.beginSwapChainRenderPass(frameInfo.commandBuffer, device.imguiRenderPass, imguiRenderSystem->framebuffers[frameInfo.frameIndex], window.getExtent());
+			imguiRenderSystem->newFrame();
+			ImDrawData* draw_data = ImGui::GetDrawData();
+			ImGui_ImplVulkan_RenderDrawData(draw_data, frameInfo.commandBuffer);
+			renderer.endSwapChainRenderPass(frameInfo.commandBuffer);
+		}).write(rgSwapChainImage, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+
+		renderGraph->compile();
+		mousePickingRenderSystem->createOffscreenFrameBuffer(renderGraph->getImageView(rgPickingImage), extent);
+		shadowMapRenderSystem->createOffscreenFrameBuffer(renderGraph->getImageView(shadowDepth));
+	}
+
+	void JHBApplication::init()
+	{
+		// ubo, skybox, pbr resources, gltf material textures and shadow map all come from here.
+		// sizes are per set, largest set is material's five textures
+		descriptorAllocator = std::make_unique<DescriptorAllocator>(device, std::vector<VkDescriptorPoolSize>{
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 }, { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 5 } });
+
+		// global ubo and shadow light ubo per frame, leaves room for more systems
+		uniformRing = std::make_unique<UniformRing>(device, 64 * 1024);
+
 		// because of simultenous
 		// for example, while frame0 rendering and frame1 using ubo either,
 		// so just copy instance makes you safe from multithread env
@@ -205,10 +553,9 @@ namespace jhb {
 		//	 start Rendering
 		// can do all this without having to wait for frame0 to finish rendering
 
-		// two descriptor sets
-		// each descriptor set contain two UNIFORM_BUFFER descriptor
+		// one descriptor set for all frames, frame is picked with dynamic offset at bind
 		descSetLayouts.push_back(DescriptorSetLayout::Builder(device)
-			.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS).
+			.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_ALL_GRAPHICS).
 			build());
 
 		// for sky box
@@ -228,39 +575,74 @@ namespace jhb {
 			.addBinding(4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
 			.build());
 
-		// for mouse picking object index ubo buffers;
-		descSetLayouts.push_back(DescriptorSetLayout::Builder(device)
-			.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS).
-			build());
-
 		// for using shadow map
 		descSetLayouts.push_back(DescriptorSetLayout::Builder(device)
 			.addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_ALL_GRAPHICS).
 			build());
 
-		mousePickingRenderSystem = std::make_unique<MousePickingRenderSystem>(device, std::vector{ descSetLayouts[0]->getDescriptorSetLayout(), descSetLayouts[4]->getDescriptorSetLayout() }, "shaders/pbr.vert.spv", "shaders/picking.frag.spv");
+		mousePickingRenderSystem = std::make_unique<MousePickingRenderSystem>(device, std::vector{ descSetLayouts[0]->getDescriptorSetLayout() }, "shaders/pbr.vert.spv", "shaders/picking.frag.spv");
 		imguiRenderSystem = std::make_unique<ImguiRenderSystem>(device, renderer.GetSwapChain());
+		aaQualityProbe = std::make_unique<AAQualityProbe>(device);
 
 		deferedPbrRenderSystem = std::make_unique<DeferedPBRRenderSystem>(device, std::vector{ descSetLayouts[0]->getDescriptorSetLayout(), descSetLayouts[3]->getDescriptorSetLayout(), descSetLayouts[2]->getDescriptorSetLayout()
-		, descSetLayouts[5]->getDescriptorSetLayout(), descSetLayouts[1]->getDescriptorSetLayout()}, renderer.getSwapChainImageViews(), renderer.GetSwapChain().getSwapChainImageFormat());
+		, descSetLayouts[4]->getDescriptorSetLayout(), descSetLayouts[1]->getDescriptorSetLayout()}, renderer.getSwapChainImageViews(), renderer.GetSwapChain().getSwapChainImageFormat(), sceneConfig);
+		// owners and instance data must exist before systems below look at models
+		instanceBatcher = std::make_unique<InstanceBatcher>(device);
+		instanceBatcher->group(GameObjectManager::GetSingleton().gameObjects, GameObjectManager::GetSingleton().GetGeneration());
+		// placeholders are bound here so material sets below are valid, real mips arrive over first frames
+		textureStreamer = std::make_unique<TextureStreamer>(device);
+		for (auto& kv : GameObjectManager::GetSingleton().gameObjects)
+		{
+			auto& model = kv.second.model;
+			if (model && kv.first == model->batchOwner)
+			{
+				textureStreamer->addModel(model);
+			}
+		}
+		bool stressScene = sceneConfig.name == "stress";
 		pointLightSystem = std::make_unique<PointLightSystem>(device, renderer.getSwapChainRenderPass(), std::vector { descSetLayouts[0]->getDescriptorSetLayout()}, "shaders/point_light.vert.spv",
-			"shaders/point_light.frag.spv");
+			"shaders/point_light.frag.spv", stressScene ? sceneConfig.lightCount : 1, stressScene ? sceneConfig.getRadius() : 10.f);
 
 		skyboxRenderSystem = std::make_unique<SkyBoxRenderSystem>(device, renderer.getSwapChainRenderPass(), std::vector { descSetLayouts[0]->getDescriptorSetLayout(), descSetLayouts[1]->getDescriptorSetLayout() }, "shaders/skybox.vert.spv",
 			"shaders/skybox.frag.spv");
 
-		shadowMapRenderSystem = std::make_unique<ShadowRenderSystem>(device, "shaders/shadowOffscreen.vert.spv", "shaders/shadowOffscreen.frag.spv");
+		auto bvhStart = std::chrono::high_resolution_clock::now();
+		sceneBVH = std::make_unique<SceneBVH>();
+		sceneBVH->build(GameObjectManager::GetSingleton().gameObjects);
+		float bvhBuildTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - bvhStart).count();
+		std::cout << "[bvh] " << sceneBVH->getInstanceCount() << " instances, " << sceneBVH->getTriangleCount() << " triangles, built in " << bvhBuildTime << " ms" << std::endl;
+
+		shadowMapRenderSystem = std::make_unique<ShadowRenderSystem>(device, *uniformRing, "shaders/shadowOffscreen.vert.spv", "shaders/shadowOffscreen.frag.spv");
 		shadowMapRenderSystem->updateUniformBuffer(pointLightSystem->getLightobjects()[0].transform.translation); // put the light objects poistion
 
-		// for uniform buffer
-		for (int i = 0; i < SwapChain::MAX_FRAMES_IN_FLIGHT; i++)
+		frustumCuller = std::make_unique<FrustumCuller>();
+		std::cout << "[cull] " << FrustumCuller::getIsaName(frustumCuller->getIsa()) << ", " << frustumCuller->getThreadCount() << " threads" << std::endl;
+		// big primitives of static single instance models hide instances behind them
+		occlusionCuller = std::make_unique<OcclusionCuller>(frustumCuller->getWorkerPool());
+		for (auto& kv : GameObjectManager::GetSingleton().gameObjects)
+		{
+			auto& model = kv.second.model;
+			if (model && kv.first == model->batchOwner && model->instanceData.size() == 1)
+			{
+				occlusionCuller->addOccluders(*model);
+			}
+		}
+
+		// static models split into meshlets at load
+		meshletCullSystem = std::make_unique<MeshletCullSystem>(device, *uniformRing);
+		for (auto& kv : GameObjectManager::GetSingleton().gameObjects)
 		{
-			auto bufferInfo = uboBuffers[i]->descriptorInfo();
-			auto pickingBufferInfo = uboPickingIndexBuffer[i]->descriptorInfo();
-			DescriptorWriter(*descSetLayouts[0], *globalPools[0]).writeBuffer(0, &bufferInfo).build(globalDescriptorSets[i]);
-			DescriptorWriter(*descSetLayouts[4], *globalPools[4]).writeBuffer(0, &pickingBufferInfo).build(pickingObjUboDescriptorSets[i]);
+			auto& model = kv.second.model;
+			if (model && kv.first == model->batchOwner && !model->meshlets.empty())
+			{
+				meshletCullSystem->addModel(model);
+			}
 		}
 
+		// for uniform buffer
+		auto bufferInfo = uniformRing->descriptorInfo(sizeof(GlobalUbo));
+		DescriptorWriter(*descSetLayouts[0], *descriptorAllocator).writeBuffer(0, &bufferInfo).build(globalDescriptorSet);
+
 		VkDescriptorImageInfo skyBoximageInfo{};
 		skyBoximageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 		skyBoximageInfo.imageView = GameObjectManager::GetSingleton().gameObjects[1].model->getTexture(0).view;
@@ -268,12 +650,13 @@ namespace jhb {
 
 		for (int i = 0; i < CubeBoxDescriptorSets.size(); i++)
 		{
-			DescriptorWriter(*descSetLayouts[1], *globalPools[1]).writeImage(0, &skyBoximageInfo).build(CubeBoxDescriptorSets[i]);
+			DescriptorWriter(*descSetLayouts[1], *descriptorAllocator).writeImage(0, &skyBoximageInfo).build(CubeBoxDescriptorSets[i]);
 		}
 
 		// should create pbr resource images using pipeline once
-		pbrSourceGenerator = std::make_unique<PBRResourceGenerator>(device, std::vector { descSetLayouts[0]->getDescriptorSetLayout(), descSetLayouts[1]->getDescriptorSetLayout() }, std::vector { globalDescriptorSets[0], CubeBoxDescriptorSets[0]});
+		pbrSourceGenerator = std::make_unique<PBRResourceGenerator>(device, std::vector { descSetLayouts[0]->getDescriptorSetLayout(), descSetLayouts[1]->getDescriptorSetLayout() }, std::vector { globalDescriptorSet, CubeBoxDescriptorSets[0]});
 		pbrSourceGenerator->createPBRResource();
+		asyncCompute = std::make_unique<AsyncComputeScheduler>(device);
 
 		VkDescriptorImageInfo brdfImgInfo{};
 		brdfImgInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
@@ -292,24 +675,27 @@ namespace jhb {
 		// for image sampler descriptor pool
 		for (int i = 0; i < pbrResourceDescriptorSets.size(); i++)
 		{
-			DescriptorWriter(*descSetLayouts[2], *globalPools[2]).writeImage(0, &descImageInfos[0]).writeImage(1, &descImageInfos[1])
+			DescriptorWriter(*descSetLayouts[2], *descriptorAllocator).writeImage(0, &descImageInfos[0]).writeImage(1, &descImageInfos[1])
 				.writeImage(2, &descImageInfos[2]).build(pbrResourceDescriptorSets[i]);
 		}
 
 		// for gltf color map and normal map and emissive, occlusion, metallicRoughness Textures
 		// this time, only need damaged helmet materials info
+		// every instance object shares its model, materials are written once per model
 		auto& gltfModels = GameObjectManager::GetSingleton().gameObjects;
 		for (auto& gltfModel : gltfModels)
 		{
 			uint32_t id = gltfModel.first;
+			if (gltfModel.second.model == nullptr || id != gltfModel.second.model->batchOwner)
+			{
+				continue;
+			}
 			for (auto& material : gltfModel.second.model->materials)
 			{
-				std::vector<VkDescriptorImageInfo> imageinfos = { gltfModel.second.model->getTexture(material.baseColorTextureIndex).descriptor, gltfModel.second.model->getTexture(material.normalTextureIndex).descriptor
-				,gltfModel.second.model->getTexture(material.occlusionTextureIndex).descriptor, gltfModel.second.model->getTexture(material.emissiveTextureIndex).descriptor, gltfModel.second.model->getTexture(material.metallicRoughnessTextureIndex).descriptor
-				};
+				auto imageinfos = gltfModel.second.model->getMaterialImageInfos(material);
 				for (int i = 0; i < SwapChain::MAX_FRAMES_IN_FLIGHT; i++)
 				{
-					DescriptorWriter(*descSetLayouts[3], *globalPools[3]).writeImage(0, &imageinfos[0]).writeImage(1, &imageinfos[1])
+					DescriptorWriter(*descSetLayouts[3], *descriptorAllocator).writeImage(0, &imageinfos[0]).writeImage(1, &imageinfos[1])
 						.writeImage(2, &imageinfos[2]).writeImage(3, &imageinfos[3]).writeImage(4, &imageinfos[4])
 						.build(material.descriptorSets[i]);
 				}
@@ -321,39 +707,43 @@ namespace jhb {
 		shadowMapImageInfo.imageView = shadowMapRenderSystem->GetShadowMap().view;
 		shadowMapImageInfo.sampler = shadowMapRenderSystem->GetShadowMap().sampler;
 
-		DescriptorWriter(*descSetLayouts[5], *globalPools[5]).writeImage(0, &shadowMapImageInfo)
+		DescriptorWriter(*descSetLayouts[4], *descriptorAllocator).writeImage(0, &shadowMapImageInfo)
 			.build(shadowMapDescriptorSet);
 	}
 
 	bool JHBApplication::pickingPhase(VkCommandBuffer commandBuffer, GlobalUbo& ubo, int frameIndex, int x, int y)
 	{
-		void* data;
-		float tmp;
+		if (!imguiRenderSystem->gpuPicking && window.GetMousePressed() == true && window.objectId < 0)
+		{
+			window.objectId = rayCastPick(x, y);
+		}
+
+		// resolve object id copied a frame or two ago, never waits on gpu
+		int pickedId;
+		if (mousePickingRenderSystem->pollPickedObject(renderer.GetSwapChain().inFlightFences, pickedId))
+		{
+			// mouse released before result arrived, or objects were regrouped while it was in flight
+			if (window.GetMousePressed() == true && window.objectId < 0 && pickGeneration == instanceBatcher->getGeneration())
+			{
+				int entity = pickedId > 0 ? instanceBatcher->resolveEntity(static_cast<uint32_t>(pickedId - 1)) : -1;
+				window.objectId = entity + 1;
+			}
+		}
+
 		if (window.GetMousePressed() == true && window.objectId <0)
 		{
-			renderer.beginSwapChainRenderPass(commandBuffer, mousePickingRenderSystem->pickingRenderpass, mousePickingRenderSystem->offscreenFrameBuffer[frameIndex], window.getExtent());
-			mousePickingRenderSystem->renderMousePickedObjToOffscreen(commandBuffer,  {globalDescriptorSets[frameIndex], pickingObjUboDescriptorSets[frameIndex]}, frameIndex, uboPickingIndexBuffer[frameIndex].get());
-			renderer.endSwapChainRenderPass(commandBuffer);
-
-			// check object id from a pixel whicch located in mouse pointer coordinate
-			VkBuffer stagingBuffer;
-			VkDeviceMemory stagingBufferMemory;
-			VkDeviceSize imageSize = window.getExtent().width * window.getExtent().height * 16; // 4byte per pixel
-			device.createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, stagingBuffer, stagingBufferMemory);
-
-			auto offscreenCmd = device.beginSingleTimeCommands();
-			device.transitionImageLayout(offscreenCmd, mousePickingRenderSystem->offscreenImage[frameIndex], VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-			device.endSingleTimeCommands(offscreenCmd);
-			device.copyImageToBuffer(stagingBuffer, mousePickingRenderSystem->offscreenImage[frameIndex], window.getExtent().width, window.getExtent().height);
-
-			vkMapMemory(device.getLogicalDevice(), stagingBufferMemory, 0, imageSize, 0, &data);
-			int offset = (window.getExtent().width * ((int)y - 1) + (int)x) * 4;
-			window.objectId = *((uint32_t*)data + offset);
-			vkUnmapMemory(device.getLogicalDevice(), stagingBufferMemory);
-			if (window.objectId <= 0)
+			// picking passes of render graph are enabled for this frame
+			if (!mousePickingRenderSystem->isPickPending())
 			{
-				return false;
+				pickRequested = true;
+				pickGeneration = instanceBatcher->getGeneration();
+				pickX = x;
+				pickY = y;
 			}
+
+			px = x;
+			py = y;
+			return false;
 		}
 
 		// picking only apply to pbrobjects
@@ -364,26 +754,10 @@ namespace jhb {
 				if (pickedObject.model && pickedObject.getId()>= 2)
 				{
 					// should transfer rotation axis to object space;
-					uint32_t obj_first_id = pickedObject.model->firstid;
+					// instance batcher gathers the new rotation next frame
 					pickedObject.transform.rotation = glm::rotate(glm::mat4{ 1.f }, (float)((px - x) * (0.001)), glm::vec3{ 1, 0, 0 }) * glm::vec4(pickedObject.transform.rotation, 1);
 					px = x, py = y;
-
-					std::vector<glm::vec3> tmplist(pickedObject.model->instanceCount);
-					for (int i = 0; i < pickedObject.model->instanceCount; i++)
-					{
-						tmplist[i] = GameObjectManager::GetSingleton().gameObjects[obj_first_id + i].transform.translation;
-					}
-
-					std::vector<glm::vec3> tmprot(pickedObject.model->instanceCount);
-					for (int i = 0; i < pickedObject.model->instanceCount; i++)
-					{
-						tmprot[i] = GameObjectManager::GetSingleton().gameObjects[obj_first_id + i].transform.rotation;
-					}
-
-					tmprot[pickedObject.getId() - pickedObject.model->firstid] = pickedObject.transform.rotation;
-					{
-						pickedObject.model->updateInstanceBuffer(pickedObject.model->instanceCount, tmplist, tmprot);
-					}
+					sceneBVH->refit();
 				}
 			}
 			return true;
@@ -396,4 +770,19 @@ namespace jhb {
 		// and return false boolean for processing camera phase
 		return false;
 	}
+
+	int JHBApplication::rayCastPick(int x, int y)
+	{
+		Ray ray = SceneBVH::screenRay(window.getCamera()->getInverseViewProjection(), static_cast<float>(x), static_cast<float>(y),
+			static_cast<float>(window.getExtent().width), static_cast<float>(window.getExtent().height));
+
+		RayHit hit;
+		if (!sceneBVH->rayCast(ray, hit))
+		{
+			return 0;
+		}
+
+		// sponza and skybox still occlude but are not pickable, same objects as picking pass
+		return hit.instanceId >= 2 ? static_cast<int>(hit.instanceId) + 1 : 0;
+	}
 }
@@ -14,6 +14,7 @@
 #include "Buffer.h"
 #include "Descriptors.h"
 #include "FrameInfo.h"
+#include "Benchmark.h"
 
 #include <stdint.h>
 #include <chrono>
@@ -22,7 +23,7 @@
 namespace jhb {
 	class JHBApplication {
 	public:
-		JHBApplication();
+		JHBApplication(const SceneConfig& sceneConfig = {}, const BenchmarkSettings& benchmarkSettings = {});
 		~JHBApplication();
 
 		JHBApplication(const JHBApplication&) = delete;
@@ -34,10 +35,26 @@ namespace jhb {
 	private:
 		void init();
 		bool pickingPhase(VkCommandBuffer commandBuffer, GlobalUbo& ubo, int frameIndex, int x, int y);
+		// returns picked game object id + 1, 0 when nothing pickable is under cursor
+		int rayCastPick(int x, int y);
+		// apply imgui anti aliasing selection, prints stats of previous mode when changed
+		void updateAntiAliasing();
+		void updateTransientAttachments();
+		void printAntiAliasingStats();
+		// frozen camera, reference and measured frame of current mode, see AAQualityProbe
+		void startAntiAliasingQuality();
+		void printAntiAliasingQuality();
+		void printFrameArenaStats();
+		// material sets of this frame slot for models whose streamed textures were swapped
+		void updateMaterialDescriptors(int frameIndex);
+		// declare frame passes and their images, called again when anti aliasing mode or window size changes
+		void buildRenderGraph();
 
 	private:
 		// init top to bottom
-		Window window{ 800, 600, "TriangleApp!" };
+		SceneConfig sceneConfig;
+		BenchmarkSettings benchmarkSettings;
+		Window window{ 800, 600, "TriangleApp!", !benchmarkSettings.headless };
 		Device device{ window };
 
 		std::vector<VkSubpassDependency> subdependencies = { {VK_SUBPASS_EXTERNAL,0,VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
@@ -47,17 +64,17 @@ namespace jhb {
 		} };
 		Renderer renderer{ window, device, subdependencies, true, VK_FORMAT_R16G16B16A16_SFLOAT, 2 };
 
-		std::array<std::unique_ptr<DescriptorPool>, 6> globalPools{};
-		std::vector<std::unique_ptr<Buffer>> uboBuffers{};
-		std::vector<std::unique_ptr<Buffer>> uboPickingIndexBuffer{SwapChain::MAX_FRAMES_IN_FLIGHT};
+		// global sets and model materials, chains another pool when a loaded model needs more sets
+		std::unique_ptr<DescriptorAllocator> descriptorAllocator;
+		// every per frame uniform block (global ubo, shadow light) is allocated here
+		std::unique_ptr<class UniformRing> uniformRing;
 	private:
-		std::vector<std::unique_ptr<jhb::DescriptorSetLayout>> descSetLayouts;
+		std::vector<std::shared_ptr<jhb::DescriptorSetLayout>> descSetLayouts;
 		std::vector<VkDescriptorSet> vkDescSets;
 
 		std::vector<VkDescriptorSet> CubeBoxDescriptorSets{}; // skybox
-		std::vector<VkDescriptorSet> globalDescriptorSets{}; // global uniform buffer
+		VkDescriptorSet globalDescriptorSet; // global uniform buffer, dynamic offset selects frame
 		std::vector<VkDescriptorSet> pbrResourceDescriptorSets{}; // pbr resource
-		std::vector<VkDescriptorSet> pickingObjUboDescriptorSets{}; // global uniform buffer
 		VkDescriptorSet shadowMapDescriptorSet;
 
 		VkImage fontImage;
@@ -74,11 +91,50 @@ namespace jhb {
 		std::unique_ptr<class PointLightSystem> pointLightSystem;
 		std::unique_ptr<class SkyBoxRenderSystem> skyboxRenderSystem;
 		std::unique_ptr<class DeferedPBRRenderSystem> deferedPbrRenderSystem;
+		std::unique_ptr<class TAARenderSystem> taaRenderSystem;
+		std::unique_ptr<class AAQualityProbe> aaQualityProbe;
+		std::unique_ptr<class SceneBVH> sceneBVH;
+		std::unique_ptr<class RenderGraph> renderGraph;
+		std::unique_ptr<class AsyncComputeScheduler> asyncCompute;
+		std::unique_ptr<class MeshletCullSystem> meshletCullSystem;
+		// groups objects sharing a model into instanced draws every frame
+		std::unique_ptr<class InstanceBatcher> instanceBatcher;
+		// cpu simd culling of instances against camera before lod selection
+		std::unique_ptr<FrustumCuller> frustumCuller;
+		std::unique_ptr<class OcclusionCuller> occlusionCuller;
+		// gltf texture mips by screen density under a memory budget
+		std::unique_ptr<class TextureStreamer> textureStreamer;
 
 		class Scene* GlobalScene;
 
 	private:
 		double px, py, pz;
 		bool isComputeFrustumCulling;
+
+		// render graph resources
+		uint32_t rgSwapChainImage = 0;
+		uint32_t rgPickingImage = 0;
+		// gpu picking pass only runs in frames it's requested
+		bool pickRequested = false;
+		int pickX = 0, pickY = 0;
+		// batcher generation of requested pick, slots of older generation are dropped
+		uint32_t pickGeneration = 0;
+		// meshlet culling pass runs and shadow, gbuffer draw its output
+		bool meshletCullingActive = false;
+
+		// taa
+		int antiAliasing = -1;
+		uint32_t jitterFrameCount = 0;
+		glm::mat4 prevViewProjection{ 1.f };
+
+		// per anti aliasing mode frame time, for comparing msaa and taa
+		uint32_t aaFrameCount = 0;
+		float aaTotalFrameTime = 0.f;
+		float aaMinFrameTime = 0.f;
+		float aaMaxFrameTime = 0.f;
+
+		// heap allocations while recording a frame, [0] frame arena off, [1] on
+		uint64_t arenaFrameCount[2] = {};
+		uint64_t arenaHeapAllocations[2] = {};
 	};
 }
\ No newline at end of file
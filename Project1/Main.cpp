@@ -1,11 +1,49 @@
 #include <iostream>
+#include <string>
 #include "JHBApplication.h"
+#include "PBRResourceGenerator.h"
 
-int main() {
+int main(int argc, char** argv) {
 	try {
+		// offline bake, brdf lut depends on nothing so ship Texture/brdflut.ktx2 with the build
+		if (argc > 1 && std::string(argv[1]) == "--bake-brdf-lut")
+		{
+			jhb::Window window{ 800, 600, "BRDF LUT bake" };
+			jhb::Device device{ window };
+			jhb::PBRResourceGenerator generator{ device, {}, {} };
+			generator.bakeBRDFLUT();
+			return EXIT_SUCCESS;
+		}
+
+		// cpu culling kernels only, no window
+		if (argc > 1 && std::string(argv[1]) == "--cull-benchmark")
+		{
+			jhb::FrustumCuller::runBenchmark(argc > 2 ? static_cast<uint32_t>(std::stoul(argv[2])) : 1000000);
+			return EXIT_SUCCESS;
+		}
+
+		// fixed camera path and frame count, writes timings to json so builds can be compared
+		jhb::BenchmarkSettings benchmarkSettings{};
+		int first = 1;
+		if (argc > 1 && std::string(argv[1]) == "--benchmark")
+		{
+			benchmarkSettings.enabled = true;
+			first = 2;
+		}
+		// scene options work with or without benchmark
+		jhb::SceneConfig sceneConfig{};
+		for (int i = first; i < argc; i++)
+		{
+			if (!sceneConfig.parseOption(argc, argv, i) && !(benchmarkSettings.enabled && benchmarkSettings.parseOption(argc, argv, i)))
+			{
+				throw std::runtime_error("unknown option " + std::string(argv[i]) + "!");
+			}
+		}
+		sceneConfig.validate();
+
 		// swapchain, framebuffer, color, depth attachment are to fixed with window size
 		// every time window resize, you must create new swapcahin and others...
-		jhb::JHBApplication app;
+		jhb::JHBApplication app{ sceneConfig, benchmarkSettings };
 		app.Run();
 	}
 	catch (const std::exception& e) {
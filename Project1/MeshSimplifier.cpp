@@ -0,0 +1,297 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <unordered_map>
+
+namespace jhb {
+	void MeshSimplifier::Quadric::addPlane(const glm::dvec3& n, double d, double w)
+	{
+		a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z;
+		a11 += w * n.y * n.y; a12 += w * n.y * n.z; a22 += w * n.z * n.z;
+		b0 += w * n.x * d; b1 += w * n.y * d; b2 += w * n.z * d;
+		c += w * d * d;
+		weight += w;
+	}
+
+	void MeshSimplifier::Quadric::add(const Quadric& q)
+	{
+		a00 += q.a00; a01 += q.a01; a02 += q.a02;
+		a11 += q.a11; a12 += q.a12; a22 += q.a22;
+		b0 += q.b0; b1 += q.b1; b2 += q.b2;
+		c += q.c;
+		weight += q.weight;
+	}
+
+	double MeshSimplifier::Quadric::evaluate(const glm::dvec3& p) const
+	{
+		if (weight <= 0.0)
+		{
+			return 0.0;
+		}
+		// p^T A p + 2 b.p + c
+		double result = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z
+			+ 2.0 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z)
+			+ 2.0 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+		return std::max(result, 0.0) / weight;
+	}
+
+	MeshSimplifier::MeshSimplifier(const std::vector<glm::vec3>& vertexPositions, const uint32_t* indices, size_t indexCount)
+	{
+		// compact to vertices this primitive uses
+		std::unordered_map<uint32_t, uint32_t> localIds;
+		triangles.resize(indexCount - indexCount % 3);
+		for (size_t i = 0; i < triangles.size(); i++)
+		{
+			auto result = localIds.emplace(indices[i], static_cast<uint32_t>(globalIds.size()));
+			if (result.second)
+			{
+				globalIds.push_back(indices[i]);
+				positions.push_back(vertexPositions[indices[i]]);
+			}
+			triangles[i] = result.first->second;
+		}
+
+		quadrics.resize(positions.size());
+		for (size_t i = 0; i < triangles.size(); i += 3)
+		{
+			glm::dvec3 p0 = positions[triangles[i]];
+			glm::dvec3 p1 = positions[triangles[i + 1]];
+			glm::dvec3 p2 = positions[triangles[i + 2]];
+			glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+			double length = glm::length(n);
+			if (length <= 0.0)
+			{
+				continue;
+			}
+			n /= length;
+			double area = length * 0.5;
+			for (int k = 0; k < 3; k++)
+			{
+				quadrics[triangles[i + k]].addPlane(n, -glm::dot(n, p0), area);
+			}
+		}
+
+		lockSeamsAndBorders();
+	}
+
+	void MeshSimplifier::lockSeamsAndBorders()
+	{
+		// vertices split by uv or normal share position, weld them to find seams and real borders
+		std::vector<uint32_t> order(positions.size());
+		std::iota(order.begin(), order.end(), 0);
+		auto less = [&](uint32_t a, uint32_t b) {
+			const glm::vec3& pa = positions[a];
+			const glm::vec3& pb = positions[b];
+			if (pa.x != pb.x) return pa.x < pb.x;
+			if (pa.y != pb.y) return pa.y < pb.y;
+			return pa.z < pb.z;
+		};
+		std::sort(order.begin(), order.end(), less);
+
+		std::vector<uint32_t> welded(positions.size());
+		std::vector<bool> lockedWeld(positions.size(), false);
+		for (size_t i = 0; i < order.size();)
+		{
+			size_t j = i + 1;
+			while (j < order.size() && positions[order[j]] == positions[order[i]])
+			{
+				j++;
+			}
+			for (size_t k = i; k < j; k++)
+			{
+				welded[order[k]] = order[i];
+			}
+			// seam
+			lockedWeld[order[i]] = j - i > 1;
+			i = j;
+		}
+
+		// edge used by one triangle is border, by more than two is non manifold. both stay
+		std::unordered_map<uint64_t, uint32_t> edgeUse;
+		edgeUse.reserve(triangles.size());
+		for (size_t i = 0; i < triangles.size(); i += 3)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				uint64_t a = welded[triangles[i + k]];
+				uint64_t b = welded[triangles[i + (k + 1) % 3]];
+				if (a == b)
+				{
+					continue;
+				}
+				edgeUse[a < b ? (a << 32 | b) : (b << 32 | a)]++;
+			}
+		}
+		for (auto& kv : edgeUse)
+		{
+			if (kv.second != 2)
+			{
+				lockedWeld[static_cast<uint32_t>(kv.first >> 32)] = true;
+				lockedWeld[static_cast<uint32_t>(kv.first & 0xffffffffu)] = true;
+			}
+		}
+
+		locked.resize(positions.size());
+		for (size_t i = 0; i < positions.size(); i++)
+		{
+			locked[i] = lockedWeld[welded[i]];
+		}
+	}
+
+	void MeshSimplifier::buildAdjacency()
+	{
+		adjacencyOffsets.assign(positions.size() + 1, 0);
+		for (uint32_t index : triangles)
+		{
+			adjacencyOffsets[index + 1]++;
+		}
+		for (size_t i = 1; i < adjacencyOffsets.size(); i++)
+		{
+			adjacencyOffsets[i] += adjacencyOffsets[i - 1];
+		}
+
+		adjacency.resize(triangles.size());
+		std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < triangles.size(); i++)
+		{
+			adjacency[fill[triangles[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+
+	bool MeshSimplifier::flipsTriangle(uint32_t from, uint32_t to) const
+	{
+		for (uint32_t a = adjacencyOffsets[from]; a < adjacencyOffsets[from + 1]; a++)
+		{
+			const uint32_t* triangle = &triangles[adjacency[a] * 3];
+			if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+			{
+				// collapses away
+				continue;
+			}
+
+			glm::vec3 p[3];
+			glm::vec3 moved[3];
+			for (int k = 0; k < 3; k++)
+			{
+				p[k] = positions[triangle[k]];
+				moved[k] = triangle[k] == from ? positions[to] : p[k];
+			}
+			glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+			glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+			if (glm::dot(before, after) <= 0.f)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	size_t MeshSimplifier::removedTriangleCount(uint32_t from, uint32_t to) const
+	{
+		size_t count = 0;
+		for (uint32_t a = adjacencyOffsets[from]; a < adjacencyOffsets[from + 1]; a++)
+		{
+			const uint32_t* triangle = &triangles[adjacency[a] * 3];
+			if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+			{
+				count++;
+			}
+		}
+		return count;
+	}
+
+	void MeshSimplifier::simplify(size_t targetIndexCount, float targetError)
+	{
+		std::vector<Collapse> collapses;
+		std::vector<bool> touched;
+		std::vector<uint32_t> remap(positions.size());
+
+		// every pass collapses cheapest independent edges, then triangles are rewritten and adjacency rebuilt
+		while (triangles.size() > targetIndexCount)
+		{
+			buildAdjacency();
+
+			collapses.clear();
+			for (size_t i = 0; i < triangles.size(); i += 3)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					uint32_t a = triangles[i + k];
+					uint32_t b = triangles[i + (k + 1) % 3];
+					if (!locked[a])
+					{
+						collapses.push_back({ a, b, static_cast<float>(std::sqrt(quadrics[a].evaluate(positions[b]))) });
+					}
+					if (!locked[b])
+					{
+						collapses.push_back({ b, a, static_cast<float>(std::sqrt(quadrics[b].evaluate(positions[a]))) });
+					}
+				}
+			}
+			if (collapses.empty())
+			{
+				break;
+			}
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+			touched.assign(positions.size(), false);
+			std::iota(remap.begin(), remap.end(), 0);
+			size_t triangleCount = triangles.size() / 3;
+			size_t collapsed = 0;
+			for (const Collapse& collapse : collapses)
+			{
+				if (collapse.error > targetError || triangleCount * 3 <= targetIndexCount)
+				{
+					break;
+				}
+				if (touched[collapse.from] || touched[collapse.to] || flipsTriangle(collapse.from, collapse.to))
+				{
+					continue;
+				}
+
+				// whole one ring is frozen for this pass, so later flip tests still see current triangles
+				for (uint32_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; a++)
+				{
+					const uint32_t* triangle = &triangles[adjacency[a] * 3];
+					touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+				}
+				triangleCount -= std::min(triangleCount, removedTriangleCount(collapse.from, collapse.to));
+				remap[collapse.from] = collapse.to;
+				quadrics[collapse.to].add(quadrics[collapse.from]);
+				error = std::max(error, collapse.error);
+				collapsed++;
+			}
+			if (collapsed == 0)
+			{
+				break;
+			}
+
+			size_t write = 0;
+			for (size_t i = 0; i < triangles.size(); i += 3)
+			{
+				uint32_t a = remap[triangles[i]];
+				uint32_t b = remap[triangles[i + 1]];
+				uint32_t c = remap[triangles[i + 2]];
+				if (a == b || b == c || a == c)
+				{
+					continue;
+				}
+				triangles[write++] = a;
+				triangles[write++] = b;
+				triangles[write++] = c;
+			}
+			triangles.resize(write);
+		}
+	}
+
+	void MeshSimplifier::getIndices(std::vector<uint32_t>& out) const
+	{
+		out.resize(triangles.size());
+		for (size_t i = 0; i < triangles.size(); i++)
+		{
+			out[i] = globalIds[triangles[i]];
+		}
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <stdint.h>
+
+namespace jhb {
+	// quadric error edge collapse (garland heckbert) working only on indices.
+	// vertices are never moved or added, collapse snaps one vertex onto its neighbor, so every lod keeps using model's vertex buffer.
+	// vertices on uv seams and open borders are locked so simplified mesh doesn't crack
+	class MeshSimplifier
+	{
+	public:
+		// positions of whole vertex buffer, indices of one primitive
+		MeshSimplifier(const std::vector<glm::vec3>& positions, const uint32_t* indices, size_t indexCount);
+
+		MeshSimplifier(const MeshSimplifier&) = delete;
+		MeshSimplifier& operator=(const MeshSimplifier&) = delete;
+
+		// continues from result of last call, so consecutive calls with smaller targets build a lod chain.
+		// stops at targetIndexCount or when next collapse would move surface more than targetError (same unit as positions)
+		void simplify(size_t targetIndexCount, float targetError);
+
+		// indices into original vertex buffer
+		void getIndices(std::vector<uint32_t>& out) const;
+		size_t getIndexCount() const { return triangles.size(); }
+		// largest error of collapses done so far
+		float getError() const { return error; }
+
+	private:
+		// symmetric 4x4 plane quadric, weight is summed triangle area so error can be normalized to distance
+		struct Quadric {
+			double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+			double b0 = 0, b1 = 0, b2 = 0, c = 0;
+			double weight = 0;
+
+			void addPlane(const glm::dvec3& n, double d, double w);
+			void add(const Quadric& q);
+			// area weighted mean squared distance of p to quadric's planes
+			double evaluate(const glm::dvec3& p) const;
+		};
+
+		struct Collapse {
+			uint32_t from;
+			uint32_t to;
+			float error;
+		};
+
+		void lockSeamsAndBorders();
+		void buildAdjacency();
+		bool flipsTriangle(uint32_t from, uint32_t to) const;
+		size_t removedTriangleCount(uint32_t from, uint32_t to) const;
+
+	private:
+		// local vertex data, only vertices referenced by primitive
+		std::vector<uint32_t> globalIds;
+		std::vector<glm::vec3> positions;
+		std::vector<Quadric> quadrics;
+		std::vector<bool> locked;
+
+		// 3 local indices per triangle, degenerate ones are dropped after every pass
+		std::vector<uint32_t> triangles;
+
+		// triangles around each vertex, rebuilt every pass
+		std::vector<uint32_t> adjacencyOffsets;
+		std::vector<uint32_t> adjacency;
+
+		float error = 0.f;
+	};
+}
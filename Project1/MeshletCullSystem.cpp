@@ -0,0 +1,314 @@
+#include "MeshletCullSystem.h"
+#include "ShadowRenderSystem.h"
+#include "CommandStats.h"
+#include "Pipeline.h"
+
+#include <iostream>
+#include <stdexcept>
+
+namespace jhb {
+	MeshletCullSystem::MeshletCullSystem(Device& device, UniformRing& uniformRing) : device{ device }, uniformRing{ uniformRing }
+	{
+		createPipeline();
+
+		statsBuffer = std::make_unique<Buffer>(device, sizeof(uint32_t), SwapChain::MAX_FRAMES_IN_FLIGHT * VIEW_COUNT * 4,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		statsBuffer->map();
+	}
+
+	MeshletCullSystem::~MeshletCullSystem()
+	{
+		vkDestroyPipeline(device.getLogicalDevice(), pipeline, nullptr);
+		vkDestroyPipelineLayout(device.getLogicalDevice(), pipelineLayout, nullptr);
+	}
+
+	void MeshletCullSystem::createPipeline()
+	{
+		descriptorSetLayout = DescriptorSetLayout::Builder(device)
+			.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_COMPUTE_BIT)
+			.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.addBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.addBinding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.addBinding(6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.build();
+
+		VkDescriptorSetLayout setLayout = descriptorSetLayout->getDescriptorSetLayout();
+		VkPushConstantRange pushConstantRange{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstant) };
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &setLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+		if (vkCreatePipelineLayout(device.getLogicalDevice(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create pipeline layout!");
+		}
+
+		auto code = Pipeline::readFile("shaders/meshletCull.comp.spv");
+		VkShaderModuleCreateInfo moduleCI{};
+		moduleCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		moduleCI.codeSize = code.size();
+		moduleCI.pCode = reinterpret_cast<const uint32_t*>(code.data());
+		VkShaderModule shaderModule;
+		if (vkCreateShaderModule(device.getLogicalDevice(), &moduleCI, nullptr, &shaderModule) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create shader module!");
+		}
+
+		VkComputePipelineCreateInfo pipelineCI{};
+		pipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineCI.layout = pipelineLayout;
+		pipelineCI.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineCI.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineCI.stage.module = shaderModule;
+		pipelineCI.stage.pName = "main";
+		if (vkCreateComputePipelines(device.getLogicalDevice(), VK_NULL_HANDLE, 1, &pipelineCI, nullptr, &pipeline) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create compute pipeline!");
+		}
+		vkDestroyShaderModule(device.getLogicalDevice(), shaderModule, nullptr);
+	}
+
+	std::unique_ptr<Buffer> MeshletCullSystem::createDeviceBuffer(const void* data, VkDeviceSize instanceSize, uint32_t instanceCount, VkBufferUsageFlags usage)
+	{
+		Buffer stagingBuffer{
+			device,
+			instanceSize,
+			instanceCount,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		};
+		stagingBuffer.map();
+		stagingBuffer.writeToBuffer(const_cast<void*>(data));
+
+		auto buffer = std::make_unique<Buffer>(device, instanceSize, instanceCount, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		device.copyBuffer(stagingBuffer.getBuffer(), buffer->getBuffer(), instanceSize * instanceCount);
+		return buffer;
+	}
+
+	void MeshletCullSystem::addModel(std::shared_ptr<Model> model)
+	{
+		if (model->meshlets.empty() || model->getIndexBuffer() == nullptr)
+		{
+			throw std::runtime_error("failed to add model to meshlet culling, it has no meshlets!");
+		}
+
+		Entry entry{};
+		entry.model = model;
+		entry.meshletCount = static_cast<uint32_t>(model->meshlets.size());
+		entry.drawCount = model->meshletDrawCount;
+		entry.triangles = 0;
+		for (auto& meshlet : model->meshlets)
+		{
+			entry.triangles += meshlet.indexCount / 3;
+		}
+
+		std::vector<glm::mat4> nodeMatrices;
+		for (const Node* node : model->meshletNodes)
+		{
+			nodeMatrices.push_back(model->getNodeMatrix(node));
+		}
+
+		// every view owns a whole copy of model's index range, a primitive's draw starts where its indices start in that copy
+		uint32_t indexCount = model->getIndexCount();
+		std::vector<VkDrawIndexedIndirectCommand> commands(VIEW_COUNT * entry.drawCount);
+		std::vector<Node*> stack(model->nodes.begin(), model->nodes.end());
+		while (!stack.empty())
+		{
+			Node* node = stack.back();
+			stack.pop_back();
+			stack.insert(stack.end(), node->children.begin(), node->children.end());
+			for (auto& primitive : node->mesh.primitives)
+			{
+				if (primitive.meshletDraw < 0)
+				{
+					continue;
+				}
+				for (uint32_t view = 0; view < VIEW_COUNT; view++)
+				{
+					commands[view * entry.drawCount + primitive.meshletDraw] = { 0, 1, view * indexCount + primitive.firstIndex, 0, 0 };
+				}
+			}
+		}
+
+		entry.meshletBuffer = createDeviceBuffer(model->meshlets.data(), sizeof(Meshlet), entry.meshletCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+		entry.nodeBuffer = createDeviceBuffer(nodeMatrices.data(), sizeof(glm::mat4), static_cast<uint32_t>(nodeMatrices.size()), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+		entry.commandTemplateBuffer = createDeviceBuffer(commands.data(), sizeof(VkDrawIndexedIndirectCommand), static_cast<uint32_t>(commands.size()), VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+		entry.commandBuffer = std::make_unique<Buffer>(device, sizeof(VkDrawIndexedIndirectCommand), static_cast<uint32_t>(commands.size()),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		entry.culledIndexBuffer = std::make_unique<Buffer>(device, sizeof(uint32_t), VIEW_COUNT * indexCount,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		for (uint32_t view = 0; view < VIEW_COUNT; view++)
+		{
+			entry.views[view] = { entry.culledIndexBuffer->getBuffer(), entry.commandBuffer->getBuffer(), view * entry.drawCount * sizeof(VkDrawIndexedIndirectCommand) };
+		}
+
+		entry.descriptorPool = DescriptorPool::Builder(device).setMaxSets(1)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6).build();
+		auto viewInfo = uniformRing.descriptorInfo(sizeof(ViewData));
+		auto meshletInfo = entry.meshletBuffer->descriptorInfo();
+		auto nodeInfo = entry.nodeBuffer->descriptorInfo();
+		auto indexInfo = model->getIndexBuffer()->descriptorInfo();
+		auto commandInfo = entry.commandBuffer->descriptorInfo();
+		auto culledInfo = entry.culledIndexBuffer->descriptorInfo();
+		auto statsInfo = statsBuffer->descriptorInfo();
+		DescriptorWriter(*descriptorSetLayout, *entry.descriptorPool)
+			.writeBuffer(0, &viewInfo)
+			.writeBuffer(1, &meshletInfo)
+			.writeBuffer(2, &nodeInfo)
+			.writeBuffer(3, &indexInfo)
+			.writeBuffer(4, &commandInfo)
+			.writeBuffer(5, &culledInfo)
+			.writeBuffer(6, &statsInfo)
+			.build(entry.descriptorSet);
+
+		std::cout << "[meshlet cull] " << model->path << " : " << entry.meshletCount << " meshlets, " << entry.triangles << " triangles, "
+			<< (entry.culledIndexBuffer->getBufferSize() + entry.commandBuffer->getBufferSize() * 2) / 1024 << " KB of culling output" << std::endl;
+		entries.push_back(std::move(entry));
+	}
+
+	void MeshletCullSystem::extractPlanes(const glm::mat4& m, glm::vec4* planes)
+	{
+		// rows of clip matrix, depth is 0 to 1
+		glm::vec4 row0{ m[0][0], m[1][0], m[2][0], m[3][0] };
+		glm::vec4 row1{ m[0][1], m[1][1], m[2][1], m[3][1] };
+		glm::vec4 row2{ m[0][2], m[1][2], m[2][2], m[3][2] };
+		glm::vec4 row3{ m[0][3], m[1][3], m[2][3], m[3][3] };
+		planes[0] = row3 + row0;
+		planes[1] = row3 - row0;
+		planes[2] = row3 + row1;
+		planes[3] = row3 - row1;
+		planes[4] = row2;
+		planes[5] = row3 - row2;
+		for (int i = 0; i < 6; i++)
+		{
+			planes[i] /= glm::length(glm::vec3(planes[i]));
+		}
+	}
+
+	void MeshletCullSystem::prepare(int frameIndex, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, const ShadowRenderSystem& shadow)
+	{
+		// fence of this slot was waited, so its counters are final
+		if (statsPending[frameIndex])
+		{
+			const uint32_t* counters = static_cast<const uint32_t*>(statsBuffer->getMappedMemory()) + frameIndex * VIEW_COUNT * 4;
+			uint64_t triangles = 0;
+			for (auto& entry : entries)
+			{
+				triangles += entry.triangles;
+			}
+
+			gbufferStats = { triangles, counters[0], counters[1] };
+			shadowStats = { triangles * (VIEW_COUNT - SHADOW_VIEW), 0, 0 };
+			for (uint32_t view = SHADOW_VIEW; view < VIEW_COUNT; view++)
+			{
+				shadowStats.frustumRejected += counters[view * 4];
+				shadowStats.coneRejected += counters[view * 4 + 1];
+			}
+
+			auto accumulate = [](PassStats& total, const PassStats& stats) {
+				total.triangles += stats.triangles;
+				total.frustumRejected += stats.frustumRejected;
+				total.coneRejected += stats.coneRejected;
+			};
+			accumulate(gbufferTotal, gbufferStats);
+			accumulate(shadowTotal, shadowStats);
+			frameCount++;
+			statsPending[frameIndex] = false;
+		}
+
+		ViewData views{};
+		extractPlanes(viewProjection, &views.planes[0]);
+		views.positions[0] = { cameraPosition, 1.f };
+		for (uint32_t face = 0; face < 6; face++)
+		{
+			extractPlanes(shadow.getFaceViewProjection(face), &views.planes[(SHADOW_VIEW + face) * 6]);
+			views.positions[SHADOW_VIEW + face] = { shadow.getLightPosition(), 1.f };
+		}
+		viewUboOffset = uniformRing.push(views);
+	}
+
+	void MeshletCullSystem::record(VkCommandBuffer cmd, int frameIndex)
+	{
+		if (entries.empty())
+		{
+			return;
+		}
+
+		// last frame's draws may still read commands and indices
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		cmd::pipelineBarrier(cmd, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		// index counts start at zero, culling adds surviving meshlets to them
+		for (auto& entry : entries)
+		{
+			VkBufferCopy copy{ 0, 0, entry.commandBuffer->getBufferSize() };
+			vkCmdCopyBuffer(cmd, entry.commandTemplateBuffer->getBuffer(), entry.commandBuffer->getBuffer(), 1, &copy);
+		}
+		VkDeviceSize statsSize = VIEW_COUNT * 4 * sizeof(uint32_t);
+		vkCmdFillBuffer(cmd, statsBuffer->getBuffer(), frameIndex * statsSize, statsSize, 0);
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		cmd::pipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		cmd::bindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		PushConstant push{};
+		push.statsOffset = frameIndex * VIEW_COUNT * 4;
+		push.flags = (frustumCulling ? 1u : 0u) | (coneCulling ? 2u : 0u);
+		for (auto& entry : entries)
+		{
+			push.drawCount = entry.drawCount;
+			cmd::bindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &entry.descriptorSet, 1, &viewUboOffset);
+			cmd::pushConstants(cmd, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstant), &push);
+			// workgroup per meshlet and view
+			cmd::dispatch(cmd, entry.meshletCount, VIEW_COUNT, 1);
+		}
+
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+		cmd::pipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+			0, 1, &barrier, 0, nullptr, 0, nullptr);
+		statsPending[frameIndex] = true;
+	}
+
+	const CulledGeometry* MeshletCullSystem::getCulledGeometry(const Model* model, uint32_t view) const
+	{
+		for (auto& entry : entries)
+		{
+			if (entry.model.get() == model)
+			{
+				return &entry.views[view];
+			}
+		}
+		return nullptr;
+	}
+
+	void MeshletCullSystem::printReport() const
+	{
+		if (frameCount == 0)
+		{
+			return;
+		}
+
+		auto print = [&](const char* pass, const PassStats& total) {
+			double triangles = static_cast<double>(total.triangles) / frameCount;
+			double frustum = static_cast<double>(total.frustumRejected) / frameCount;
+			double cone = static_cast<double>(total.coneRejected) / frameCount;
+			std::cout << "[meshlet cull] " << pass << " : " << static_cast<uint64_t>(triangles) << " triangles, frustum rejected " << static_cast<uint64_t>(frustum)
+				<< ", cone rejected " << static_cast<uint64_t>(cone) << " (" << (triangles > 0.0 ? 100.0 * (frustum + cone) / triangles : 0.0) << "%) per frame" << std::endl;
+		};
+		std::cout << "[meshlet cull] average over " << frameCount << " frames" << std::endl;
+		print("gbuffer", gbufferTotal);
+		print("shadow", shadowTotal);
+	}
+}
@@ -0,0 +1,117 @@
+#pragma once
+#define GLM_FORCE_RADIANS // not use degree;
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+
+#include <glm/glm.hpp>
+
+#include "Device.h"
+#include "Buffer.h"
+#include "Descriptors.h"
+#include "SwapChain.h"
+#include "Model.h"
+#include "UniformRing.h"
+
+#include <array>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+namespace jhb {
+	class ShadowRenderSystem;
+
+	// culls meshlets of static models against frustum of every view and normal cone of camera view with one compute pass, before shadow and gbuffer.
+	// surviving triangles are copied to a compacted index buffer per view and each primitive gets one indirect draw over its part of it,
+	// so it runs on any hardware without mesh shaders
+	class MeshletCullSystem
+	{
+	public:
+		// view 0 is camera, 1 to 6 are shadow cube faces
+		static constexpr uint32_t VIEW_COUNT = 7;
+		static constexpr uint32_t SHADOW_VIEW = 1;
+
+		// rejected triangles of last finished frame, summed over views of the pass
+		struct PassStats {
+			uint64_t triangles = 0;
+			uint64_t frustumRejected = 0;
+			uint64_t coneRejected = 0;
+		};
+
+	public:
+		MeshletCullSystem(Device& device, UniformRing& uniformRing);
+		~MeshletCullSystem();
+
+		MeshletCullSystem(const MeshletCullSystem&) = delete;
+		MeshletCullSystem& operator=(const MeshletCullSystem&) = delete;
+
+		// model needs meshlets from Model::buildMeshlets, node matrices are baked here so model must not move afterwards
+		void addModel(std::shared_ptr<Model> model);
+
+		// after beginFrame, reads back counters this frame slot wrote last time and uploads frustums of every view
+		void prepare(int frameIndex, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, const ShadowRenderSystem& shadow);
+		// outside of render pass, draws of both passes read what this writes
+		void record(VkCommandBuffer cmd, int frameIndex);
+		// null when model isn't culled
+		const CulledGeometry* getCulledGeometry(const Model* model, uint32_t view) const;
+
+		const PassStats& getGBufferStats() const { return gbufferStats; }
+		const PassStats& getShadowStats() const { return shadowStats; }
+		// average rejected triangles per pass over whole run
+		void printReport() const;
+
+	public:
+		bool frustumCulling = true;
+		bool coneCulling = true;
+
+	private:
+		struct ViewData {
+			glm::vec4 planes[VIEW_COUNT * 6];
+			glm::vec4 positions[VIEW_COUNT];
+		};
+
+		struct PushConstant {
+			uint32_t drawCount;
+			uint32_t statsOffset;
+			uint32_t flags;
+		};
+
+		struct Entry {
+			std::shared_ptr<Model> model;
+			uint32_t meshletCount;
+			uint32_t drawCount;
+			uint64_t triangles;
+			std::unique_ptr<Buffer> meshletBuffer;
+			std::unique_ptr<Buffer> nodeBuffer;
+			std::unique_ptr<Buffer> commandTemplateBuffer;
+			std::unique_ptr<Buffer> commandBuffer;
+			std::unique_ptr<Buffer> culledIndexBuffer;
+			std::unique_ptr<DescriptorPool> descriptorPool;
+			VkDescriptorSet descriptorSet;
+			std::array<CulledGeometry, VIEW_COUNT> views;
+		};
+
+		void createPipeline();
+		std::unique_ptr<Buffer> createDeviceBuffer(const void* data, VkDeviceSize instanceSize, uint32_t instanceCount, VkBufferUsageFlags usage);
+		static void extractPlanes(const glm::mat4& viewProjection, glm::vec4* planes);
+
+	private:
+		Device& device;
+		UniformRing& uniformRing;
+
+		std::vector<Entry> entries;
+
+		std::shared_ptr<DescriptorSetLayout> descriptorSetLayout;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+
+		// 4 counters per view and frame slot, host visible so they are read without a copy once slot's fence was waited
+		std::unique_ptr<Buffer> statsBuffer;
+		std::array<bool, SwapChain::MAX_FRAMES_IN_FLIGHT> statsPending{};
+		uint32_t viewUboOffset = 0;
+
+		PassStats gbufferStats;
+		PassStats shadowStats;
+		PassStats gbufferTotal;
+		PassStats shadowTotal;
+		uint64_t frameCount = 0;
+	};
+}
@@ -1,6 +1,10 @@
 
 #include <iostream>
 #include <unordered_map>
+#include <chrono>
+#include <algorithm>
+#include <limits>
+#include <cstring>
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
@@ -15,13 +19,18 @@
 
 #include "Utils.hpp"
 #include "Model.h"
+#include "CommandStats.h"
 #include "Device.h"
+#include "DeletionQueue.h"
+#include "MeshSimplifier.h"
+#include "TextureStreamer.h"
 #include "JHBApplication.h"
 #include <ktx.h>
 #include <ktxvulkan.h>
 #include "BaseRenderSystem.h"
 #include "Pipeline.h"
 #include <random>
+#include <filesystem>
 
 namespace std{
 	template <>
@@ -50,25 +59,82 @@ jhb::Model::~Model()
 {
 }
 
-void jhb::Model::draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, int frameIndex)
+void jhb::Model::draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, int frameIndex, const CulledGeometry* culled, MaterialPass pass)
 {
 	if (!nodes.empty())
 	{
-		for (auto& node : nodes) {
-			drawNode(commandBuffer, pipelineLayout, node, frameIndex);
+		if (culled)
+		{
+			cmd::bindIndexBuffer(commandBuffer, culled->indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+		}
+		if (lodFrames[frameIndex].active)
+		{
+			VkBuffer instance[] = { lodFrames[frameIndex].instanceBuffer->getBuffer() };
+			VkDeviceSize offsets[] = { 0 };
+			cmd::bindVertexBuffers(commandBuffer, 1, 1, instance, offsets);
+		}
+		if (drawBuckets[static_cast<size_t>(DrawBucket::Opaque)].empty() && drawBuckets[static_cast<size_t>(DrawBucket::Masked)].empty())
+		{
+			for (auto& node : nodes) {
+				drawNode(commandBuffer, pipelineLayout, node, frameIndex, culled);
+			}
+			return;
+		}
+
+		const Node* boundNode = nullptr;
+		int32_t boundMaterial = -1;
+		for (size_t bucket = 0; bucket < drawBuckets.size(); bucket++)
+		{
+			// opaque depth pipelines only differ in unused textures, one bind covers the whole bucket
+			bool sharedPipeline = pass == MaterialPass::DepthPrepass && bucket == static_cast<size_t>(DrawBucket::Opaque);
+			for (const DrawItem& item : drawBuckets[bucket])
+			{
+				if (!item.node->visible)
+				{
+					continue;
+				}
+				if (item.node != boundNode)
+				{
+					glm::mat4 nodeMatrix = getNodeMatrix(item.node);
+					cmd::pushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &nodeMatrix);
+					boundNode = item.node;
+				}
+				if (item.primitive->materialIndex != boundMaterial && !(sharedPipeline && boundMaterial >= 0))
+				{
+					Material& material = materials[item.primitive->materialIndex];
+					Pipeline* pipeline = material.pipeline.get();
+					if (pass == MaterialPass::DepthPrepass && material.depthPipeline)
+					{
+						pipeline = material.depthPipeline.get();
+					}
+					else if (pass == MaterialPass::GBufferEqual && material.equalPipeline)
+					{
+						pipeline = material.equalPipeline.get();
+					}
+					cmd::bindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->getPipeline());
+					cmd::bindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 2, 1, &material.descriptorSets[frameIndex], 0, nullptr);
+					boundMaterial = item.primitive->materialIndex;
+				}
+				drawPrimitive(commandBuffer, *item.primitive, frameIndex, culled);
+			}
+			boundMaterial = -1;
 		}
 	}
 	else {
+		if (pass == MaterialPass::DepthPrepass)
+		{
+			return;
+		}
 		if (noTexturePipeline)
 		{
 			noTexturePipeline->bind(commandBuffer);
 		}
 		if (hasIndexBuffer)
 		{
-			vkCmdDrawIndexed(commandBuffer, indexCount, instanceCount, 0, 0, 0);
+			cmd::drawIndexed(commandBuffer, indexCount, instanceCount, 0, 0, 0);
 		}
 		else {
-			vkCmdDraw(commandBuffer, vertexCount, instanceCount, 0, 0);
+			cmd::draw(commandBuffer, vertexCount, instanceCount, 0, 0);
 		}
 	}
 }
@@ -88,7 +154,7 @@ void jhb::Model::drawIndirect(VkCommandBuffer commandBuffer, const Buffer& indir
 		}
 		if (hasIndexBuffer)
 		{
-			vkCmdDrawIndexedIndirect(commandBuffer, indirectCommandBuffer.getBuffer(),0 , 1, sizeof(VkDrawIndirectCommand));
+			cmd::drawIndexedIndirect(commandBuffer, indirectCommandBuffer.getBuffer(),0 , 1, sizeof(VkDrawIndirectCommand));
 		}
 		//else {
 		//	vkCmdDraw(commandBuffer, vertexCount, instanceCount, 0, 0);
@@ -112,24 +178,28 @@ void jhb::Model::buildIndirectCommand(std::vector<VkDrawIndexedIndirectCommand>&
 	}
 }
 
-void jhb::Model::drawNoTexture(VkCommandBuffer buffer, VkPipeline pipeline, VkPipelineLayout pipelineLayout, int frameIndex)
+void jhb::Model::drawNoTexture(VkCommandBuffer buffer, VkPipeline pipeline, VkPipelineLayout pipelineLayout, int frameIndex, const CulledGeometry* culled)
 {
 	if (!nodes.empty())
 	{
+		if (culled)
+		{
+			cmd::bindIndexBuffer(buffer, culled->indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+		}
 		for (auto& node : nodes) {
-			drawNodeNotexture(buffer, pipeline, pipelineLayout, node);
+			drawNodeNotexture(buffer, pipeline, pipelineLayout, node, culled);
 		}
 	}
 	else {
 		auto matrix = glm::mat4{ 1.f };
-		vkCmdPushConstants(buffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 128, sizeof(glm::mat4), &matrix);
-		vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+		cmd::pushConstants(buffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 128, sizeof(glm::mat4), &matrix);
+		cmd::bindPipeline(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 		if (hasIndexBuffer)
 		{
-			vkCmdDrawIndexed(buffer, indexCount, instanceCount, 0, 0, 0);
+			cmd::drawIndexed(buffer, indexCount, instanceCount, 0, 0, 0);
 		}
 		else {
-			vkCmdDraw(buffer, vertexCount, instanceCount, 0, 0);
+			cmd::draw(buffer, vertexCount, instanceCount, 0, 0);
 		}
 	}
 }
@@ -149,10 +219,10 @@ void jhb::Model::drawInPickPhase(VkCommandBuffer commandBuffer, VkPipelineLayout
 		}
 		if (hasIndexBuffer)
 		{
-			vkCmdDrawIndexed(commandBuffer, indexCount, instanceCount, 0, 0, 0);
+			cmd::drawIndexed(commandBuffer, indexCount, instanceCount, 0, 0, 0);
 		}
 		else {
-			vkCmdDraw(commandBuffer, vertexCount, instanceCount, 0, 0);
+			cmd::draw(commandBuffer, vertexCount, instanceCount, 0, 0);
 		}
 	}
 }
@@ -162,21 +232,28 @@ void jhb::Model::bind(VkCommandBuffer commandBuffer)
 	VkBuffer buffers[] = { vertexBuffer->getBuffer()};
 	VkDeviceSize offsets[] = { 0 };
 	// combine command buffer and vertex Buffer
-	vkCmdBindVertexBuffers(commandBuffer, 0,  1, buffers, offsets);
-	if (instanceBuffer)
+	cmd::bindVertexBuffers(commandBuffer, 0,  1, buffers, offsets);
+	if (instanceStream != VK_NULL_HANDLE)
 	{
-		VkBuffer instance[] = {instanceBuffer->getBuffer()};
-		vkCmdBindVertexBuffers(commandBuffer, 1, 1, instance, offsets);
+		VkBuffer instance[] = { instanceStream };
+		VkDeviceSize instanceOffsets[] = { instanceStreamOffset };
+		cmd::bindVertexBuffers(commandBuffer, 1, 1, instance, instanceOffsets);
 	}
 
 	if (hasIndexBuffer)
 	{
-		vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
+		cmd::bindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
 	}
 }
 
 void jhb::Model::createVertexBuffer(const std::vector<Vertex>& vertices)
 {
+	vertices_p.resize(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		vertices_p[i] = vertices[i].position;
+	}
+
 	vertexCount = static_cast<uint32_t>(vertices.size());
 	assert(vertexCount >= 3 && "Vertex count must be at least 3");
 	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertexCount;
@@ -209,6 +286,7 @@ void jhb::Model::createVertexBuffer(const std::vector<Vertex>& vertices)
 
 void jhb::Model::createIndexBuffer(const std::vector<uint32_t>& indices)
 {
+	this->indices = indices;
 	indexCount = static_cast<uint32_t>(indices.size());
 	hasIndexBuffer = indexCount > 0;
 	if (!hasIndexBuffer)
@@ -235,7 +313,8 @@ void jhb::Model::createIndexBuffer(const std::vector<uint32_t>& indices)
 		device,
 		indexSize,
 		indexCount,
-		VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		// storage for meshlet culling, it copies surviving triangles out of here
+		VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
 	);
 
@@ -264,6 +343,22 @@ void jhb::Model::createGraphicsPipelinePerMaterial(const std::string& vertFilepa
 	}
 }
 
+void jhb::Model::createDepthPrepassPipelinesPerMaterial(const std::string& vertFilepath, const std::string& depthFragFilepath, PipelineConfigInfo& depthConfigInfo,
+	const std::string& gbufferFragFilepath, PipelineConfigInfo& equalConfigInfo)
+{
+	for (auto& material : materials)
+	{
+		if (material.depthPipeline == nullptr)
+		{
+			material.depthPipeline = std::make_unique<Pipeline>(device, vertFilepath, depthFragFilepath, depthConfigInfo, material);
+		}
+		if (material.equalPipeline == nullptr)
+		{
+			material.equalPipeline = std::make_unique<Pipeline>(device, vertFilepath, gbufferFragFilepath, equalConfigInfo, material);
+		}
+	}
+}
+
 std::vector<VkVertexInputBindingDescription> jhb::Vertex::getBindingDescriptions()
 {
 	std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
@@ -374,35 +469,122 @@ void jhb::Model::loadModel(const std::string& filepath)
 	createIndexBuffer(indices);
 }
 
-void jhb::Model::loadImages(tinygltf::Model& input, VkSamplerAddressMode samplerMode)
+// KHR_texture_basisu points texture at its ktx2 image, source is then a png fallback or missing
+static int32_t textureSource(const tinygltf::Texture& texture)
+{
+	auto basisu = texture.extensions.find("KHR_texture_basisu");
+	if (basisu != texture.extensions.end() && basisu->second.Has("source"))
+	{
+		return basisu->second.Get("source").GetNumberAsInt();
+	}
+	return texture.source;
+}
+
+bool jhb::Model::loadGLTFImageData(tinygltf::Image* image, const int imageIndex, std::string* err, std::string* warn, int reqWidth, int reqHeight,
+	const unsigned char* bytes, int size, void* userData)
 {
+	static const unsigned char ktx2Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+	if (size >= 12 && memcmp(bytes, ktx2Identifier, 12) == 0)
+	{
+		return true;
+	}
+	return tinygltf::LoadImageData(image, imageIndex, err, warn, reqWidth, reqHeight, bytes, size, userData);
+}
+
+void jhb::Model::loadImages(tinygltf::Model& input, VkSamplerAddressMode samplerMode, bool streamed)
+{
+	// ktx2 normal maps may be transcoded to two channel formats
+	std::vector<bool> normalMaps(input.images.size(), false);
+	for (auto& glTFMaterial : input.materials)
+	{
+		int32_t textureIndex = glTFMaterial.normalTexture.index;
+		if (textureIndex >= 0 && textureIndex < static_cast<int32_t>(input.textures.size()))
+		{
+			int32_t imageIndex = textureSource(input.textures[textureIndex]);
+			if (imageIndex >= 0 && imageIndex < static_cast<int32_t>(normalMaps.size()))
+			{
+				normalMaps[imageIndex] = true;
+			}
+		}
+	}
+
+	VkDeviceSize compressedTotal = 0, uncompressedTotal = 0;
 	images.resize(input.images.size());
 	for (size_t i = 0; i < input.images.size(); i++) {
 		tinygltf::Image& glTFImage = input.images[i];
 		bool isKtx = false;
+		std::string ktx2Uri;
 		// Image points to an external ktx file
 		if (glTFImage.uri.find_last_of(".") != std::string::npos) {
-			if (glTFImage.uri.substr(glTFImage.uri.find_last_of(".") + 1) == "ktx") {
+			std::string extension = glTFImage.uri.substr(glTFImage.uri.find_last_of(".") + 1);
+			if (extension == "ktx") {
 				isKtx = true;
 			}
+			else if (extension == "ktx2") {
+				ktx2Uri = glTFImage.uri;
+			}
+			else {
+				// compressed copy made offline (toktx) is taken over png/jpg
+				std::string sibling = glTFImage.uri.substr(0, glTFImage.uri.find_last_of(".")) + ".ktx2";
+				if (std::filesystem::exists(path + "/" + sibling)) {
+					ktx2Uri = sibling;
+				}
+			}
 		}
 
 		if (isKtx)
 		{
 			images[i].loadKTXTexture(device, path + "/" + glTFImage.uri);
 		}
+		else if (!ktx2Uri.empty())
+		{
+			Image& image = images[i];
+			image.loadKTX2Texture(device, path + "/" + ktx2Uri, samplerMode, normalMaps[i]);
+			compressedTotal += image.gpuBytes;
+			uncompressedTotal += image.uncompressedBytes;
+			std::cout << "[texture compression] " << ktx2Uri << " " << image.width << "x" << image.height << " " << image.formatName << " "
+				<< image.gpuBytes / 1024 << " KB, rgba8 " << image.uncompressedBytes / 1024 << " KB ("
+				<< static_cast<double>(image.uncompressedBytes) / std::max<VkDeviceSize>(image.gpuBytes, 1) << "x smaller)" << std::endl;
+		}
+		else if (streamed)
+		{
+			// header only, pixels are decoded by streamer workers
+			int texWidth, texHeight, texChannels;
+			std::string filepath = path + "/" + glTFImage.uri;
+			if (!stbi_info(filepath.c_str(), &texWidth, &texHeight, &texChannels)) {
+				throw std::runtime_error("failed to load texture image!");
+			}
+			Image& image = images[i];
+			image.image = VK_NULL_HANDLE;
+			image.deviceMemory = VK_NULL_HANDLE;
+			image.view = VK_NULL_HANDLE;
+			image.width = static_cast<uint32_t>(texWidth);
+			image.height = static_cast<uint32_t>(texHeight);
+			image.mipLevels = static_cast<uint32_t>(floor(log2(std::max(texWidth, texHeight))) + 1.0);
+			image.layerCount = 1;
+			image.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			image.streamPath = filepath;
+			image.createSampler(device, samplerMode, image.mipLevels);
+		}
 		else
 		{
 			images[i].loadTexture2D(device, path + "/" + glTFImage.uri, samplerMode);
 		}
 	}
+
+	if (compressedTotal > 0)
+	{
+		const double mb = 1024.0 * 1024.0;
+		std::cout << "[texture compression] " << path << " total " << compressedTotal / mb << " MB, rgba8 " << uncompressedTotal / mb << " MB, "
+			<< (uncompressedTotal / mb - compressedTotal / mb) << " MB saved" << std::endl;
+	}
 }
 
 void jhb::Model::loadTextures(tinygltf::Model& input)
 {
 	textures.resize(input.textures.size());
 	for (size_t i = 0; i < input.textures.size(); i++) {
-		textures[i].imageIndex = input.textures[i].source;
+		textures[i].imageIndex = textureSource(input.textures[i]);
 	}
 }
 
@@ -531,6 +713,35 @@ void jhb::Image::updateDescriptor()
 	descriptor.imageLayout = imageLayout;
 }
 
+void jhb::Image::createSampler(Device& device, VkSamplerAddressMode samplerMode, uint32_t mipLevels)
+{
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+
+	samplerInfo.addressModeU = samplerMode;
+	samplerInfo.addressModeV = samplerMode;
+	samplerInfo.addressModeW = samplerMode;
+
+	samplerInfo.anisotropyEnable = VK_FALSE;
+	samplerInfo.maxAnisotropy = 0;
+	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+	samplerInfo.unnormalizedCoordinates = VK_FALSE;
+	samplerInfo.compareEnable = VK_FALSE;
+	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+
+	// full chain, a view of fewer resident mips clamps by itself
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	samplerInfo.mipLodBias = 0.0f;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = static_cast<float>(mipLevels);
+
+	if (vkCreateSampler(device.getLogicalDevice(), &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create texture sampler!");
+	}
+}
+
 void jhb::Model::loadNode(const tinygltf::Node& inputNode, const tinygltf::Model& input, Node* parent, std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer)
 {
 	Node* node = new Node{};
@@ -700,7 +911,7 @@ void jhb::Model::loadNode(const tinygltf::Node& inputNode, const tinygltf::Model
 	}
 }
 
-void jhb::Model::drawNode(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, Node* node, int frameIndex)
+void jhb::Model::drawNode(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, Node* node, int frameIndex, const CulledGeometry* culled)
 {
 	if (!node->visible) {
 		return;
@@ -708,30 +919,89 @@ void jhb::Model::drawNode(VkCommandBuffer commandBuffer, VkPipelineLayout pipeli
 	if (node->mesh.primitives.size() > 0) {
 		// Pass the node's matrix via push constants
 		// Traverse the node hierarchy to the top-most parent to get the final matrix of the current node
-		glm::mat4 nodeMatrix =  node->matrix *rootModelMatrix;
-		Node* currentParent = node->parent;
-		while (currentParent) {
-			nodeMatrix = currentParent->matrix * nodeMatrix;
-			currentParent = currentParent->parent;
-		}
+		glm::mat4 nodeMatrix = getNodeMatrix(node);
 		// Pass the final matrix to the vertex shader using push constants
-		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &nodeMatrix);
+		cmd::pushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &nodeMatrix);
 		for (Primitive& primitive : node->mesh.primitives) {
 			if (primitive.indexCount > 0) {
 				Material& material = materials[primitive.materialIndex];
 				// POI: Bind the pipeline for the node's material
-				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, material.pipeline->getPipeline());
-				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 2, 1, &material.descriptorSets[frameIndex], 0, nullptr);
-				vkCmdDrawIndexed(commandBuffer, primitive.indexCount, instanceCount, primitive.firstIndex, 0, 0);
+				cmd::bindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, material.pipeline->getPipeline());
+				cmd::bindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 2, 1, &material.descriptorSets[frameIndex], 0, nullptr);
+				drawPrimitive(commandBuffer, primitive, frameIndex, culled);
 			}
 		}
 	}
 	for (auto& child : node->children) {
-		drawNode(commandBuffer, pipelineLayout, child, frameIndex);
+		drawNode(commandBuffer, pipelineLayout, child, frameIndex, culled);
 	}
 	
 }
 
+void jhb::Model::drawPrimitive(VkCommandBuffer commandBuffer, const Primitive& primitive, int frameIndex, const CulledGeometry* culled)
+{
+	const LodFrame& lodFrame = lodFrames[frameIndex];
+	if (lodFrame.batchCulled && primitive.staticBatch >= 0 && !lodFrame.batchVisible[primitive.staticBatch])
+	{
+		return;
+	}
+	if (culled && primitive.meshletDraw >= 0)
+	{
+		// surviving meshlets of this primitive, index count is written by culling pass
+		cmd::drawIndexedIndirect(commandBuffer, culled->commandBuffer, culled->commandOffset + primitive.meshletDraw * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+		return;
+	}
+	if (!lodFrame.active)
+	{
+		cmd::drawIndexed(commandBuffer, primitive.indexCount, instanceCount, primitive.firstIndex, 0, 0);
+		return;
+	}
+	// instances of same lod are next to each other in lod instance buffer, culled only model has just lod 0
+	for (uint32_t level = 0; level < std::max(getLodCount(), 1u); level++)
+	{
+		if (lodFrame.instanceCount[level] == 0)
+		{
+			continue;
+		}
+		PrimitiveLod range = level == 0 ? PrimitiveLod{ primitive.firstIndex, primitive.indexCount } : primitive.lods[level - 1];
+		cmd::drawIndexed(commandBuffer, range.indexCount, lodFrame.instanceCount[level], range.firstIndex, 0, lodFrame.firstInstance[level]);
+	}
+}
+
+void jhb::Model::buildDrawBuckets()
+{
+	for (auto& bucket : drawBuckets)
+	{
+		bucket.clear();
+	}
+
+	std::vector<Node*> stack(nodes.rbegin(), nodes.rend());
+	while (!stack.empty())
+	{
+		Node* node = stack.back();
+		stack.pop_back();
+		if (!node->visible)
+		{
+			continue;
+		}
+		for (auto& primitive : node->mesh.primitives)
+		{
+			if (primitive.indexCount > 0)
+			{
+				DrawBucket bucket = materials[primitive.materialIndex].isAlphaMasked() ? DrawBucket::Masked : DrawBucket::Opaque;
+				drawBuckets[static_cast<size_t>(bucket)].push_back(DrawItem{ node, &primitive });
+			}
+		}
+		stack.insert(stack.end(), node->children.rbegin(), node->children.rend());
+	}
+
+	// pipeline and material change once per material, node order is kept inside it
+	for (auto& bucket : drawBuckets)
+	{
+		std::stable_sort(bucket.begin(), bucket.end(), [](const DrawItem& a, const DrawItem& b) { return a.primitive->materialIndex < b.primitive->materialIndex; });
+	}
+}
+
 void jhb::Model::buildIndriectNode(Node* node, std::vector<VkDrawIndexedIndirectCommand>& indirectCommandsBuffer)
 {
 	if (!node->visible) {
@@ -750,7 +1020,18 @@ void jhb::Model::buildIndriectNode(Node* node, std::vector<VkDrawIndexedIndirect
 	}
 }
 
-void jhb::Model::drawNodeNotexture(VkCommandBuffer commandBuffer, VkPipeline pipeline, VkPipelineLayout pipelineLayout, Node* node)
+glm::mat4 jhb::Model::getNodeMatrix(const Node* node) const
+{
+	glm::mat4 nodeMatrix = node->matrix * rootModelMatrix;
+	Node* currentParent = node->parent;
+	while (currentParent) {
+		nodeMatrix = currentParent->matrix * nodeMatrix;
+		currentParent = currentParent->parent;
+	}
+	return nodeMatrix;
+}
+
+void jhb::Model::drawNodeNotexture(VkCommandBuffer commandBuffer, VkPipeline pipeline, VkPipelineLayout pipelineLayout, Node* node, const CulledGeometry* culled)
 {
 	if (!node->visible) {
 		return;
@@ -765,18 +1046,23 @@ void jhb::Model::drawNodeNotexture(VkCommandBuffer commandBuffer, VkPipeline pip
 			currentParent = currentParent->parent;
 		}
 		// Pass the final matrix to the vertex shader using push constants
-		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 128, sizeof(glm::mat4), &nodeMatrix);
+		cmd::pushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 128, sizeof(glm::mat4), &nodeMatrix);
 		for (Primitive& primitive : node->mesh.primitives) {
 			if (primitive.indexCount > 0) {
 				Material& material = materials[primitive.materialIndex];
 				// POI: Bind the pipeline for the node's material
-				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-				vkCmdDrawIndexed(commandBuffer, primitive.indexCount, instanceCount, primitive.firstIndex, 0, 0);
+				cmd::bindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+				if (culled && primitive.meshletDraw >= 0)
+				{
+					cmd::drawIndexedIndirect(commandBuffer, culled->commandBuffer, culled->commandOffset + primitive.meshletDraw * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+					continue;
+				}
+				cmd::drawIndexed(commandBuffer, primitive.indexCount, instanceCount, primitive.firstIndex, 0, 0);
 			}
 		}
 	}
 	for (auto& child : node->children) {
-		drawNodeNotexture(commandBuffer, pipeline, pipelineLayout, child);
+		drawNodeNotexture(commandBuffer, pipeline, pipelineLayout, child, culled);
 	}
 }
 
@@ -851,33 +1137,7 @@ void jhb::Image::loadTexture2D(Device& device, const std::string& filepath, VkSa
 		throw std::runtime_error("failed to create texture image view!");
 	}
 
-	VkSamplerCreateInfo samplerInfo{};
-	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-	samplerInfo.magFilter = VK_FILTER_LINEAR;
-	samplerInfo.minFilter = VK_FILTER_LINEAR;
-
-	samplerInfo.addressModeU = samplerMode;
-	samplerInfo.addressModeV = samplerMode;
-	samplerInfo.addressModeW = samplerMode;
-
-	VkPhysicalDeviceProperties properties{};
-	vkGetPhysicalDeviceProperties(device.getPhysicalDevice(), &properties);
-	samplerInfo.anisotropyEnable = VK_FALSE;
-	samplerInfo.maxAnisotropy = 0;
-	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
-	samplerInfo.unnormalizedCoordinates = VK_FALSE;
-	samplerInfo.compareEnable = VK_FALSE;
-	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
-
-	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-	samplerInfo.mipLodBias = 0.0f;
-	samplerInfo.minLod = 0.0f;
-	samplerInfo.maxLod = mipleves;
-
-	if (vkCreateSampler(device.getLogicalDevice(), &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create texture sampler!");
-	}
-
+	createSampler(device, samplerMode, mipleves);
 	updateDescriptor();
 }
 
@@ -1015,6 +1275,244 @@ void jhb::Image::loadKTXTexture(Device& device, const std::string& filepath, VkI
 	updateDescriptor();
 }
 
+namespace {
+	struct TranscodeTarget {
+		ktx_transcode_fmt_e transcodeFormat;
+		VkFormat format;
+		const char* name;
+	};
+
+	// best first, rgba8 last so there is always one. unorm like loadTexture2D, shaders decode srgb themselves
+	const TranscodeTarget twoChannelTargets[] = {
+		{ KTX_TTF_BC5_RG, VK_FORMAT_BC5_UNORM_BLOCK, "bc5" },
+		{ KTX_TTF_ETC2_EAC_RG11, VK_FORMAT_EAC_R11G11_UNORM_BLOCK, "eac rg11" },
+		{ KTX_TTF_ASTC_4x4_RGBA, VK_FORMAT_ASTC_4x4_UNORM_BLOCK, "astc 4x4" },
+		{ KTX_TTF_RGBA32, VK_FORMAT_R8G8B8A8_UNORM, "rgba8" },
+	};
+	const TranscodeTarget oneChannelTargets[] = {
+		{ KTX_TTF_BC4_R, VK_FORMAT_BC4_UNORM_BLOCK, "bc4" },
+		{ KTX_TTF_ETC2_EAC_R11, VK_FORMAT_EAC_R11_UNORM_BLOCK, "eac r11" },
+		{ KTX_TTF_ASTC_4x4_RGBA, VK_FORMAT_ASTC_4x4_UNORM_BLOCK, "astc 4x4" },
+		{ KTX_TTF_RGBA32, VK_FORMAT_R8G8B8A8_UNORM, "rgba8" },
+	};
+	const TranscodeTarget colorTargets[] = {
+		{ KTX_TTF_BC7_RGBA, VK_FORMAT_BC7_UNORM_BLOCK, "bc7" },
+		{ KTX_TTF_ASTC_4x4_RGBA, VK_FORMAT_ASTC_4x4_UNORM_BLOCK, "astc 4x4" },
+		{ KTX_TTF_ETC2_RGBA, VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK, "etc2 rgba" },
+		{ KTX_TTF_RGBA32, VK_FORMAT_R8G8B8A8_UNORM, "rgba8" },
+	};
+
+	bool canSample(jhb::Device& device, VkFormat format)
+	{
+		VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+		VkFormatProperties props;
+		vkGetPhysicalDeviceFormatProperties(device.getPhysicalDevice(), format, &props);
+		return (props.optimalTilingFeatures & required) == required;
+	}
+
+	// block compressed formats are never blit destinations, their mips must come with the file
+	bool canBlit(jhb::Device& device, VkFormat format)
+	{
+		VkFormatFeatureFlags required = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+		VkFormatProperties props;
+		vkGetPhysicalDeviceFormatProperties(device.getPhysicalDevice(), format, &props);
+		return (props.optimalTilingFeatures & required) == required;
+	}
+
+	template<size_t N>
+	const TranscodeTarget& pickTarget(jhb::Device& device, const TranscodeTarget(&targets)[N])
+	{
+		for (auto& target : targets)
+		{
+			if (canSample(device, target.format))
+			{
+				return target;
+			}
+		}
+		return targets[N - 1];
+	}
+}
+
+void jhb::Image::loadKTX2Texture(Device& device, const std::string& filepath, VkSamplerAddressMode samplerMode, bool normalMap)
+{
+	ktxTexture2* texture;
+	if (ktxTexture2_CreateFromNamedFile(filepath.c_str(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &texture) != KTX_SUCCESS) {
+		throw std::runtime_error("failed to load ktx2 texture image!");
+	}
+
+	// two component files keep x in opaque and y in alpha slice (toktx --normal_mode), one component is replicated to rgb
+	uint32_t components = ktxTexture2_GetNumComponents(texture);
+	VkComponentMapping swizzle{ VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY };
+	VkFormat format = static_cast<VkFormat>(texture->vkFormat);
+	formatName = "ktx2";
+	if (ktxTexture2_NeedsTranscoding(texture))
+	{
+		const TranscodeTarget& target = components == 2 ? pickTarget(device, twoChannelTargets)
+			: components == 1 ? pickTarget(device, oneChannelTargets) : pickTarget(device, colorTargets);
+		if (ktxTexture2_TranscodeBasis(texture, target.transcodeFormat, 0) != KTX_SUCCESS) {
+			ktxTexture_Destroy(ktxTexture(texture));
+			throw std::runtime_error("failed to transcode ktx2 texture image!");
+		}
+		format = target.format;
+		formatName = target.name;
+
+		bool twoChannelFormat = target.transcodeFormat == KTX_TTF_BC5_RG || target.transcodeFormat == KTX_TTF_ETC2_EAC_RG11;
+		bool oneChannelFormat = target.transcodeFormat == KTX_TTF_BC4_R || target.transcodeFormat == KTX_TTF_ETC2_EAC_R11;
+		if (oneChannelFormat)
+		{
+			swizzle = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_ONE };
+		}
+		else if (components == 2 && twoChannelFormat && !normalMap)
+		{
+			swizzle = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G };
+		}
+		else if (components == 2 && !twoChannelFormat && normalMap)
+		{
+			// rgba fallback holds x, x, x, y. deferred shader rebuilds z from xy
+			swizzle = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_A, VK_COMPONENT_SWIZZLE_ZERO, VK_COMPONENT_SWIZZLE_ONE };
+		}
+	}
+	else if (!canSample(device, format))
+	{
+		ktxTexture_Destroy(ktxTexture(texture));
+		throw std::runtime_error("failed to find supported format for ktx2 texture image!");
+	}
+
+	width = texture->baseWidth;
+	height = texture->baseHeight;
+	uint32_t fileLevels = texture->numLevels;
+	mipLevels = fileLevels;
+	layerCount = 1;
+
+	// without mips distant surfaces alias, uncompressed files get their chain by blit
+	bool generateMips = false;
+	uint32_t fullChain = static_cast<uint32_t>(floor(log2(std::max(width, height))) + 1.0);
+	if (fileLevels == 1 && fullChain > 1)
+	{
+		if (canBlit(device, format))
+		{
+			generateMips = true;
+			mipLevels = fullChain;
+		}
+		else
+		{
+			std::cout << "[ktx2] " << filepath << " has no mips and " << formatName << " can't be blit, encode it with toktx --genmipmap" << std::endl;
+		}
+	}
+
+	ktx_uint8_t* ktxTextureData = ktxTexture_GetData(ktxTexture(texture));
+	ktx_size_t ktxTextureSize = ktxTexture_GetDataSize(ktxTexture(texture));
+
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+
+	device.createBuffer(ktxTextureSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+	void* data;
+	vkMapMemory(device.getLogicalDevice(), stagingBufferMemory, 0, ktxTextureSize, 0, &data);
+	memcpy(data, ktxTextureData, ktxTextureSize);
+	vkUnmapMemory(device.getLogicalDevice(), stagingBufferMemory);
+
+	std::vector<VkBufferImageCopy> bufferCopyRegions;
+	for (uint32_t level = 0; level < fileLevels; level++)
+	{
+		ktx_size_t offset;
+		ktxTexture_GetImageOffset(ktxTexture(texture), level, 0, 0, &offset);
+
+		VkBufferImageCopy bufferCopyRegion = {};
+		bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		bufferCopyRegion.imageSubresource.mipLevel = level;
+		bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
+		bufferCopyRegion.imageSubresource.layerCount = 1;
+		bufferCopyRegion.imageExtent.width = std::max(1u, width >> level);
+		bufferCopyRegion.imageExtent.height = std::max(1u, height >> level);
+		bufferCopyRegion.imageExtent.depth = 1;
+		bufferCopyRegion.bufferOffset = offset;
+
+		bufferCopyRegions.push_back(bufferCopyRegion);
+	}
+	ktxTexture_Destroy(ktxTexture(texture));
+
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.extent.width = width;
+	imageInfo.extent.height = height;
+	imageInfo.extent.depth = 1;
+	imageInfo.mipLevels = mipLevels;
+	imageInfo.arrayLayers = 1;
+	imageInfo.format = format;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	if (generateMips)
+	{
+		imageInfo.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	}
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.flags = 0;
+	device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, deviceMemory);
+
+	VkMemoryRequirements memRequirements;
+	vkGetImageMemoryRequirements(device.getLogicalDevice(), image, &memRequirements);
+	gpuBytes = memRequirements.size;
+	// rgba8 image with same levels, so ratio compares same chain
+	uncompressedBytes = 0;
+	for (uint32_t level = 0; level < mipLevels; level++)
+	{
+		uncompressedBytes += static_cast<VkDeviceSize>(std::max(1u, width >> level)) * std::max(1u, height >> level) * 4;
+	}
+
+	VkImageSubresourceRange subresourceRange = {};
+	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	subresourceRange.baseMipLevel = 0;
+	subresourceRange.levelCount = mipLevels;
+	subresourceRange.layerCount = 1;
+
+	VkCommandBuffer commandBuffer = device.beginSingleTimeCommands();
+	device.transitionImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
+
+	vkCmdCopyBufferToImage(
+		commandBuffer,
+		stagingBuffer,
+		image,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		static_cast<uint32_t>(bufferCopyRegions.size()),
+		bufferCopyRegions.data());
+
+	if (generateMips)
+	{
+		// every level is in transfer dst, generateMipmap leaves them shader read
+		device.endSingleTimeCommands(commandBuffer);
+		generateMipmap(device, image, mipLevels, width, height);
+	}
+	else
+	{
+		device.transitionImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
+		device.endSingleTimeCommands(commandBuffer);
+	}
+
+	vkDestroyBuffer(device.getLogicalDevice(), stagingBuffer, nullptr);
+	vkFreeMemory(device.getLogicalDevice(), stagingBufferMemory, nullptr);
+	imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = format;
+	viewInfo.components = swizzle;
+	viewInfo.subresourceRange = subresourceRange;
+
+	if (vkCreateImageView(device.getLogicalDevice(), &viewInfo, nullptr, &view) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create texture image view!");
+	}
+
+	createSampler(device, samplerMode, mipLevels);
+	updateDescriptor();
+}
+
 void jhb::Model::PickingPhasedrawNode(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, Node* node, int frameIndex, VkPipeline pipeline)
 {
 	if (!node->visible) {
@@ -1031,13 +1529,13 @@ void jhb::Model::PickingPhasedrawNode(VkCommandBuffer commandBuffer, VkPipelineL
 			currentParent = currentParent->parent;
 		}
 		// Pass the final matrix to the vertex shader using push constants
-		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &nodeMatrix);
+		cmd::pushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &nodeMatrix);
 		for (Primitive& primitive : node->mesh.primitives) {
 			if (primitive.indexCount > 0) {
 				Material& material = materials[primitive.materialIndex];
 				// POI: Bind the pipeline for the node's material
-				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-				vkCmdDrawIndexed(commandBuffer, primitive.indexCount, instanceCount, primitive.firstIndex, 0, 0);
+				cmd::bindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+				cmd::drawIndexed(commandBuffer, primitive.indexCount, instanceCount, primitive.firstIndex, 0, 0);
 			}
 		}
 	}
@@ -1092,36 +1590,746 @@ void jhb::Model::createObjectSphere(const std::vector<Vertex> vertices)
 	sphere.radius = (float)(sqrt(pow(abs(sphere.maxcoordinate.x - sphere.mincoordinate.x), 2) + pow(abs(sphere.maxcoordinate.x - sphere.mincoordinate.x), 2) + pow(abs(sphere.maxcoordinate.x - sphere.mincoordinate.x), 2)));
 }
 
-void jhb::Model::updateInstanceBuffer(uint32_t _instanceCount, const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& rotations, float roughness, float metallic)
+void jhb::Model::setInstances(const InstanceData* data, uint32_t count, VkBuffer stream, VkDeviceSize streamOffset)
 {
-	instanceCount = _instanceCount;
-	if (instanceBuffer == nullptr)
+	instanceCount = count;
+	instanceStream = stream;
+	instanceStreamOffset = streamOffset;
+
+	// gathered every frame, bounds are only rebuilt when something moved
+	if (instanceData.size() != count || std::memcmp(instanceData.data(), data, sizeof(InstanceData) * count) != 0)
 	{
-		instanceBuffer = std::make_unique<Buffer>(device, sizeof(InstanceData), instanceCount, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT , VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-		instanceBuffer->map();
+		instanceData.assign(data, data + count);
+		instanceBoundsDirty = true;
 	}
+}
 
-	instanceData.resize(instanceCount);
+void jhb::Model::generateLods(std::vector<uint32_t>& indexBuffer)
+{
+	// target error of each lod as fraction of model radius, every lod also aims at half the triangles of previous one
+	static constexpr float lodTargetErrors[MAX_LOD_LEVEL] = { 0.f, 0.002f, 0.008f, 0.025f, 0.07f };
 
-	for (float i = 0; i < instanceCount; i++)
+	auto start = std::chrono::high_resolution_clock::now();
+	lodRadius = 0.f;
+	for (auto& position : vertices_p)
 	{
-		instanceData[i].r = i; // this is instance id offset
+		lodRadius = std::max(lodRadius, glm::length(position));
 	}
-	for (int i = 0; i < positions.size(); i++)
+
+	std::vector<Primitive*> primitives;
+	std::vector<Node*> stack(nodes.begin(), nodes.end());
+	while (!stack.empty())
 	{
-		instanceData[i].pos = positions[i];
+		Node* node = stack.back();
+		stack.pop_back();
+		for (auto& primitive : node->mesh.primitives)
+		{
+			if (primitive.indexCount >= 3)
+			{
+				primitives.push_back(&primitive);
+			}
+		}
+		stack.insert(stack.end(), node->children.begin(), node->children.end());
 	}
-	for (int i = 0; i < rotations.size(); i++)
+
+	std::vector<std::unique_ptr<MeshSimplifier>> simplifiers;
+	size_t previousCount = 0;
+	for (auto primitive : primitives)
 	{
-		instanceData[i].rot = rotations[i];
+		simplifiers.push_back(std::make_unique<MeshSimplifier>(vertices_p, &indexBuffer[primitive->firstIndex], primitive->indexCount));
+		previousCount += primitive->indexCount;
 	}
 
+	lodErrors = { 0.f };
+	std::vector<size_t> levelTriangles = { previousCount / 3 };
+	std::vector<uint32_t> lodIndices;
+	for (uint32_t level = 1; level < MAX_LOD_LEVEL && !primitives.empty(); level++)
+	{
+		size_t levelCount = 0;
+		float levelError = 0.f;
+		for (size_t i = 0; i < primitives.size(); i++)
+		{
+			simplifiers[i]->simplify(simplifiers[i]->getIndexCount() / 2, lodTargetErrors[level] * lodRadius);
+			levelCount += simplifiers[i]->getIndexCount();
+			levelError = std::max(levelError, simplifiers[i]->getError());
+		}
+		// not worth another level of draws
+		if (levelCount > previousCount * 9 / 10)
+		{
+			break;
+		}
 
+		for (size_t i = 0; i < primitives.size(); i++)
+		{
+			Primitive& primitive = *primitives[i];
+			PrimitiveLod previous = primitive.lods.empty() ? PrimitiveLod{ primitive.firstIndex, primitive.indexCount } : primitive.lods.back();
+			if (simplifiers[i]->getIndexCount() == previous.indexCount)
+			{
+				primitive.lods.push_back(previous);
+				continue;
+			}
+			simplifiers[i]->getIndices(lodIndices);
+			primitive.lods.push_back({ static_cast<uint32_t>(indexBuffer.size()), static_cast<uint32_t>(lodIndices.size()) });
+			indexBuffer.insert(indexBuffer.end(), lodIndices.begin(), lodIndices.end());
+		}
+		lodErrors.push_back(levelError);
+		levelTriangles.push_back(levelCount / 3);
+		previousCount = levelCount;
+	}
 
-	//Buffer stagingBuffer(device, sizeof(InstanceData), 64, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	instanceBuffer->writeToBuffer(instanceData.data(), instanceBuffer->getBufferSize(), 0);
-	instanceBuffer->flush();
+	auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	std::cout << "[lod] " << path << " : " << getLodCount() << " levels, triangles";
+	for (size_t level = 0; level < levelTriangles.size(); level++)
+	{
+		std::cout << " " << levelTriangles[level] << " (" << lodErrors[level] << ")";
+	}
+	std::cout << ", " << elapsed << " ms" << std::endl;
+}
+
+void jhb::Model::selectLods(int frameIndex, const glm::vec3& cameraPosition, float pixelScale, float errorPixels, bool debugView, const std::vector<uint32_t>* visible)
+{
+	LodFrame& frame = lodFrames[frameIndex];
+	frame.active = false;
+	if ((getLodCount() < 2 && visible == nullptr) || instanceStream == VK_NULL_HANDLE || instanceData.empty())
+	{
+		return;
+	}
 
-	//device.copyBuffer(stagingBuffer.getBuffer(), instanceBuffer->getBuffer(), instanceBuffer->getBufferSize());
-	//stagingBuffer.unmap();
+	uint32_t count = visible ? static_cast<uint32_t>(visible->size()) : static_cast<uint32_t>(instanceData.size());
+	uint32_t capacity = static_cast<uint32_t>(instanceData.size());
+	if (frame.instanceBuffer == nullptr || frame.instanceBuffer->getInstanceCount() < capacity)
+	{
+		// old buffer may still be read by this slot's last frame
+		if (frame.instanceBuffer)
+		{
+			device.getDeletionQueue().retire(std::move(frame.instanceBuffer));
+		}
+		frame.instanceBuffer = std::make_unique<Buffer>(device, sizeof(InstanceData), capacity, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+		frame.instanceBuffer->map();
+	}
+
+	// instance positions are in vertex space of mesh node, same as vertex shader
+	glm::mat4 nodeMatrix = rootModelMatrix;
+	for (auto node : nodes)
+	{
+		if (!node->mesh.primitives.empty())
+		{
+			nodeMatrix = getNodeMatrix(node);
+			break;
+		}
+	}
+	float scale = std::max({ glm::length(glm::vec3(nodeMatrix[0])), glm::length(glm::vec3(nodeMatrix[1])), glm::length(glm::vec3(nodeMatrix[2])) });
+
+	// coarsest lod whose error projected from nearest point of bounding sphere stays under errorPixels
+	frame.instanceCount.fill(0);
+	instanceLods.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		glm::vec3 center = nodeMatrix * glm::vec4(instanceData[visible ? (*visible)[i] : i].pos, 1.f);
+		float distance = std::max(glm::length(center - cameraPosition) - lodRadius * scale, 0.001f);
+		float errorScale = scale * pixelScale / distance;
+		uint32_t level = 0;
+		while (level + 1 < getLodCount() && lodErrors[level + 1] * errorScale <= errorPixels)
+		{
+			level++;
+		}
+		instanceLods[i] = static_cast<uint8_t>(level);
+		frame.instanceCount[level]++;
+	}
+
+	std::array<uint32_t, MAX_LOD_LEVEL> cursor{};
+	for (uint32_t level = 0, first = 0; level < MAX_LOD_LEVEL; level++)
+	{
+		frame.firstInstance[level] = first;
+		cursor[level] = first;
+		first += frame.instanceCount[level];
+	}
+
+	// r keeps instance id offset, so picking still works on sorted data
+	lodInstanceData.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		InstanceData& data = lodInstanceData[cursor[instanceLods[i]]++];
+		data = instanceData[visible ? (*visible)[i] : i];
+		data.g = debugView ? static_cast<float>(instanceLods[i] + 1) : 0.f;
+	}
+	if (count > 0)
+	{
+		frame.instanceBuffer->writeToBuffer(lodInstanceData.data(), sizeof(InstanceData) * count, 0);
+		frame.instanceBuffer->flush();
+	}
+	frame.active = true;
+}
+
+const jhb::SphereBounds& jhb::Model::getInstanceBounds()
+{
+	if (!instanceBoundsDirty)
+	{
+		return instanceBounds;
+	}
+	instanceBoundsDirty = false;
+
+	// same space as selectLods, instances are offset from vertex space origin of mesh node
+	glm::mat4 nodeMatrix = rootModelMatrix;
+	for (auto node : nodes)
+	{
+		if (!node->mesh.primitives.empty())
+		{
+			nodeMatrix = getNodeMatrix(node);
+			break;
+		}
+	}
+	float scale = std::max({ glm::length(glm::vec3(nodeMatrix[0])), glm::length(glm::vec3(nodeMatrix[1])), glm::length(glm::vec3(nodeMatrix[2])) });
+	// instance rotation spins around origin, so sphere around origin covers every rotation
+	float radius = 0.f;
+	for (auto& position : vertices_p)
+	{
+		radius = std::max(radius, glm::length(position));
+	}
+
+	instanceBounds.resize(instanceData.size());
+	for (size_t i = 0; i < instanceData.size(); i++)
+	{
+		instanceBounds.set(i, nodeMatrix * glm::vec4(instanceData[i].pos, 1.f), radius * scale);
+	}
+	return instanceBounds;
+}
+
+void jhb::Model::computeTexelDensity(const std::vector<Vertex>& vertexBuffer, const std::vector<uint32_t>& indexBuffer)
+{
+	std::vector<double> worldArea(materials.size(), 0.0);
+	std::vector<double> uvArea(materials.size(), 0.0);
+	std::vector<Node*> stack(nodes.begin(), nodes.end());
+	while (!stack.empty())
+	{
+		Node* node = stack.back();
+		stack.pop_back();
+		stack.insert(stack.end(), node->children.begin(), node->children.end());
+
+		glm::mat4 nodeMatrix = getNodeMatrix(node);
+		for (auto& primitive : node->mesh.primitives)
+		{
+			if (primitive.materialIndex < 0 || primitive.materialIndex >= static_cast<int32_t>(materials.size()))
+			{
+				continue;
+			}
+			for (uint32_t i = primitive.firstIndex; i + 2 < primitive.firstIndex + primitive.indexCount; i += 3)
+			{
+				const Vertex& v0 = vertexBuffer[indexBuffer[i]];
+				const Vertex& v1 = vertexBuffer[indexBuffer[i + 1]];
+				const Vertex& v2 = vertexBuffer[indexBuffer[i + 2]];
+				glm::vec3 p0 = nodeMatrix * glm::vec4(v0.position, 1.f);
+				glm::vec3 p1 = nodeMatrix * glm::vec4(v1.position, 1.f);
+				glm::vec3 p2 = nodeMatrix * glm::vec4(v2.position, 1.f);
+				glm::vec2 e1 = v1.uv - v0.uv;
+				glm::vec2 e2 = v2.uv - v0.uv;
+				// degenerate uv would weigh area with no texels on it
+				float uv = std::abs(e1.x * e2.y - e1.y * e2.x) * 0.5f;
+				if (uv <= 0.f)
+				{
+					continue;
+				}
+				worldArea[primitive.materialIndex] += glm::length(glm::cross(p1 - p0, p2 - p0)) * 0.5f;
+				uvArea[primitive.materialIndex] += uv;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < materials.size(); i++)
+	{
+		materials[i].worldPerUv = uvArea[i] > 0.0 ? static_cast<float>(std::sqrt(worldArea[i] / uvArea[i])) : 0.f;
+	}
+}
+
+void jhb::Model::requestTextureMips(TextureStreamer& streamer, int frameIndex, const glm::vec3& cameraPosition, float pixelScale, const std::vector<uint32_t>* visible)
+{
+	if (materials.empty() || instanceData.empty())
+	{
+		return;
+	}
+	const float farAway = (std::numeric_limits<float>::max)();
+	materialDistances.assign(materials.size(), farAway);
+
+	// nearest visible instance, primitives without bounds of their own use it
+	const SphereBounds& bounds = getInstanceBounds();
+	float instanceDistance = farAway;
+	size_t count = visible ? visible->size() : bounds.size();
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t index = visible ? (*visible)[i] : i;
+		glm::vec3 center{ bounds.centerX[index], bounds.centerY[index], bounds.centerZ[index] };
+		instanceDistance = std::min(instanceDistance, std::max(glm::length(center - cameraPosition) - bounds.radius[index], 0.f));
+	}
+
+	const LodFrame& frame = lodFrames[frameIndex];
+	std::vector<Node*> stack(nodes.begin(), nodes.end());
+	while (!stack.empty())
+	{
+		Node* node = stack.back();
+		stack.pop_back();
+		stack.insert(stack.end(), node->children.begin(), node->children.end());
+		if (!node->visible)
+		{
+			continue;
+		}
+		for (auto& primitive : node->mesh.primitives)
+		{
+			if (primitive.materialIndex < 0 || primitive.materialIndex >= static_cast<int32_t>(materials.size()))
+			{
+				continue;
+			}
+			float distance = instanceDistance;
+			// batch boxes are world space after cullStaticBatches of this frame
+			if (frame.batchCulled && primitive.staticBatch >= 0)
+			{
+				if (!frame.batchVisible[primitive.staticBatch])
+				{
+					continue;
+				}
+				glm::vec3 center{ staticBatchBounds.centerX[primitive.staticBatch], staticBatchBounds.centerY[primitive.staticBatch], staticBatchBounds.centerZ[primitive.staticBatch] };
+				glm::vec3 extent{ staticBatchBounds.extentX[primitive.staticBatch], staticBatchBounds.extentY[primitive.staticBatch], staticBatchBounds.extentZ[primitive.staticBatch] };
+				distance = glm::length(glm::max(glm::abs(cameraPosition - center) - extent, glm::vec3(0.f)));
+			}
+			materialDistances[primitive.materialIndex] = std::min(materialDistances[primitive.materialIndex], distance);
+		}
+	}
+
+	for (size_t i = 0; i < materials.size(); i++)
+	{
+		if (materialDistances[i] == farAway)
+		{
+			continue;
+		}
+		const Material& material = materials[i];
+		// pixels one uv unit covers on screen at nearest point, unknown density keeps full resolution
+		float uvPixels = material.worldPerUv > 0.f ? material.worldPerUv * pixelScale / std::max(materialDistances[i], 0.01f) : farAway;
+		for (uint32_t textureIndex : { material.baseColorTextureIndex, material.normalTextureIndex, material.occlusionTextureIndex, material.emissiveTextureIndex,
+			material.metallicRoughnessTextureIndex })
+		{
+			if (textureIndex < textures.size() && textures[textureIndex].imageIndex >= 0 && textures[textureIndex].imageIndex < static_cast<int32_t>(images.size()))
+			{
+				streamer.request(images[textures[textureIndex].imageIndex], uvPixels);
+			}
+		}
+	}
+}
+
+std::array<VkDescriptorImageInfo, 5> jhb::Model::getMaterialImageInfos(const Material& material)
+{
+	return { getTexture(material.baseColorTextureIndex).descriptor, getTexture(material.normalTextureIndex).descriptor, getTexture(material.occlusionTextureIndex).descriptor,
+		getTexture(material.emissiveTextureIndex).descriptor, getTexture(material.metallicRoughnessTextureIndex).descriptor };
+}
+
+void jhb::Model::buildStaticBatches(std::vector<Vertex>& vertexBuffer, std::vector<uint32_t>& indexBuffer)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// vertices are appended per node in loadNode, so no vertex is shared by nodes with different matrices
+	std::vector<Primitive> sources;
+	std::vector<uint8_t> transformed(vertexBuffer.size(), 0);
+	uint32_t nodeCount = 0;
+	std::vector<Node*> stack(nodes.begin(), nodes.end());
+	while (!stack.empty())
+	{
+		Node* node = stack.back();
+		stack.pop_back();
+		stack.insert(stack.end(), node->children.begin(), node->children.end());
+		if (node->mesh.primitives.empty())
+		{
+			continue;
+		}
+		nodeCount++;
+
+		// hierarchy only, rootModelMatrix stays object placement and is applied on top of batch node
+		glm::mat4 matrix = node->matrix;
+		for (Node* parent = node->parent; parent; parent = parent->parent)
+		{
+			matrix = parent->matrix * matrix;
+		}
+		glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(matrix)));
+
+		for (auto& primitive : node->mesh.primitives)
+		{
+			for (uint32_t i = primitive.firstIndex; i < primitive.firstIndex + primitive.indexCount; i++)
+			{
+				uint32_t index = indexBuffer[i];
+				if (transformed[index])
+				{
+					continue;
+				}
+				transformed[index] = 1;
+				Vertex& vertex = vertexBuffer[index];
+				vertex.position = glm::vec3(matrix * glm::vec4(vertex.position, 1.f));
+				if (glm::dot(vertex.normal, vertex.normal) > 0.f)
+				{
+					vertex.normal = glm::normalize(normalMatrix * vertex.normal);
+				}
+				glm::vec3 tangent = glm::mat3(matrix) * glm::vec3(vertex.tangent);
+				if (glm::dot(tangent, tangent) > 0.f)
+				{
+					vertex.tangent = glm::vec4(glm::normalize(tangent), vertex.tangent.w);
+				}
+			}
+			if (primitive.indexCount > 0)
+			{
+				sources.push_back(primitive);
+			}
+		}
+	}
+
+	// same material next to each other, file order kept inside a material
+	std::stable_sort(sources.begin(), sources.end(), [](const Primitive& a, const Primitive& b) { return a.materialIndex < b.materialIndex; });
+
+	Node* batchNode = new Node{};
+	batchNode->parent = nullptr;
+	batchNode->matrix = glm::mat4(1.f);
+	batchNode->name = "static batches";
+
+	std::vector<uint32_t> mergedIndices;
+	mergedIndices.reserve(indexBuffer.size());
+	staticBatches.clear();
+	for (size_t i = 0; i < sources.size(); i++)
+	{
+		if (i == 0 || sources[i].materialIndex != sources[i - 1].materialIndex)
+		{
+			Primitive batch{};
+			batch.firstIndex = static_cast<uint32_t>(mergedIndices.size());
+			batch.materialIndex = sources[i].materialIndex;
+			batch.staticBatch = static_cast<int32_t>(staticBatches.size());
+			batchNode->mesh.primitives.push_back(batch);
+			staticBatches.push_back(StaticBatch{ glm::vec3{ (std::numeric_limits<float>::max)() }, glm::vec3{ -(std::numeric_limits<float>::max)() }, 0 });
+		}
+
+		Primitive& batch = batchNode->mesh.primitives.back();
+		StaticBatch& bounds = staticBatches.back();
+		for (uint32_t j = sources[i].firstIndex; j < sources[i].firstIndex + sources[i].indexCount; j++)
+		{
+			uint32_t index = indexBuffer[j];
+			mergedIndices.push_back(index);
+			bounds.min = glm::min(bounds.min, vertexBuffer[index].position);
+			bounds.max = glm::max(bounds.max, vertexBuffer[index].position);
+		}
+		batch.indexCount += sources[i].indexCount;
+		bounds.primitiveCount++;
+	}
+	indexBuffer = std::move(mergedIndices);
+
+	for (auto node : nodes)
+	{
+		delete node;
+	}
+	nodes = { batchNode };
+
+	auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	std::cout << "[batch] " << path << " : " << sources.size() << " primitives of " << nodeCount << " nodes merged into " << staticBatches.size()
+		<< " material batches, " << elapsed << " ms" << std::endl;
+}
+
+void jhb::Model::cullStaticBatches(int frameIndex, const glm::mat4& viewProjection, FrustumCuller* culler)
+{
+	LodFrame& frame = lodFrames[frameIndex];
+	frame.batchCulled = false;
+	// static batching is for single placed models, instance is only an offset like sponza
+	if (culler == nullptr || staticBatches.empty() || instanceData.size() != 1)
+	{
+		return;
+	}
+
+	glm::mat4 nodeMatrix = getNodeMatrix(nodes[0]);
+	glm::vec3 offset = instanceData[0].pos;
+	staticBatchBounds.resize(staticBatches.size());
+	for (size_t i = 0; i < staticBatches.size(); i++)
+	{
+		glm::vec3 min{ (std::numeric_limits<float>::max)() };
+		glm::vec3 max{ -(std::numeric_limits<float>::max)() };
+		for (int c = 0; c < 8; c++)
+		{
+			const StaticBatch& batch = staticBatches[i];
+			glm::vec3 corner{ (c & 1) ? batch.max.x : batch.min.x, (c & 2) ? batch.max.y : batch.min.y, (c & 4) ? batch.max.z : batch.min.z };
+			glm::vec3 world = glm::vec3(nodeMatrix * glm::vec4(corner + offset, 1.f));
+			min = glm::min(min, world);
+			max = glm::max(max, world);
+		}
+		staticBatchBounds.set(i, min, max);
+	}
+
+	culler->cull(viewProjection, staticBatchBounds, visibleStaticBatches);
+	frame.batchVisible.assign(staticBatches.size(), 0);
+	for (uint32_t batch : visibleStaticBatches)
+	{
+		frame.batchVisible[batch] = 1;
+	}
+	frame.batchCulled = true;
+}
+
+void jhb::Model::buildMeshlets(std::vector<uint32_t>& indexBuffer)
+{
+	static constexpr uint32_t maxVertices = 64;
+	static constexpr uint32_t maxTriangles = 124;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	meshlets.clear();
+	meshletNodes.clear();
+	meshletDrawCount = 0;
+
+	// vertex stamp tells if vertex is already in current meshlet, saves a set per meshlet
+	std::vector<uint32_t> vertexStamp(vertices_p.size(), UINT32_MAX);
+	std::vector<uint32_t> meshletVertices;
+	std::vector<uint32_t> reordered;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> adjacencyOffsets;
+	std::vector<uint32_t> adjacency;
+	std::vector<bool> emitted;
+
+	std::vector<Node*> stack(nodes.begin(), nodes.end());
+	while (!stack.empty())
+	{
+		Node* node = stack.back();
+		stack.pop_back();
+		stack.insert(stack.end(), node->children.begin(), node->children.end());
+		for (auto& primitive : node->mesh.primitives)
+		{
+			uint32_t triangleCount = primitive.indexCount / 3;
+			if (triangleCount == 0)
+			{
+				continue;
+			}
+			const uint32_t* triangles = &indexBuffer[primitive.firstIndex];
+			// back facing meshlet may only be dropped if rasterizer would drop its triangles too
+			bool coneCulling = (materials[primitive.materialIndex].getCullMode() & VK_CULL_MODE_BACK_BIT) != 0;
+			primitive.meshletDraw = static_cast<int32_t>(meshletDrawCount++);
+
+			// triangles around each vertex of this primitive
+			adjacencyOffsets.assign(vertices_p.size() + 1, 0);
+			for (uint32_t i = 0; i < triangleCount * 3; i++)
+			{
+				adjacencyOffsets[triangles[i] + 1]++;
+			}
+			for (size_t i = 1; i < adjacencyOffsets.size(); i++)
+			{
+				adjacencyOffsets[i] += adjacencyOffsets[i - 1];
+			}
+			adjacency.resize(triangleCount * 3);
+			std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (uint32_t i = 0; i < triangleCount * 3; i++)
+			{
+				adjacency[fill[triangles[i]]++] = i / 3;
+			}
+
+			emitted.assign(triangleCount, false);
+			reordered.clear();
+			uint32_t seed = 0;
+			while (true)
+			{
+				while (seed < triangleCount && emitted[seed])
+				{
+					seed++;
+				}
+				if (seed == triangleCount)
+				{
+					break;
+				}
+
+				// grow from seed, next triangle is the neighbor adding fewest new vertices so meshlet stays compact
+				uint32_t stamp = static_cast<uint32_t>(meshlets.size());
+				uint32_t meshletFirst = static_cast<uint32_t>(reordered.size());
+				meshletVertices.clear();
+				candidates.clear();
+				uint32_t next = seed;
+				while (next != UINT32_MAX)
+				{
+					emitted[next] = true;
+					for (int k = 0; k < 3; k++)
+					{
+						uint32_t vertex = triangles[next * 3 + k];
+						reordered.push_back(vertex);
+						if (vertexStamp[vertex] != stamp)
+						{
+							vertexStamp[vertex] = stamp;
+							meshletVertices.push_back(vertex);
+							candidates.insert(candidates.end(), adjacency.begin() + adjacencyOffsets[vertex], adjacency.begin() + adjacencyOffsets[vertex + 1]);
+						}
+					}
+					if ((reordered.size() - meshletFirst) / 3 == maxTriangles)
+					{
+						break;
+					}
+
+					next = UINT32_MAX;
+					uint32_t bestNew = 4;
+					size_t write = 0;
+					for (uint32_t candidate : candidates)
+					{
+						if (emitted[candidate])
+						{
+							continue;
+						}
+						candidates[write++] = candidate;
+						uint32_t newVertices = 0;
+						for (int k = 0; k < 3; k++)
+						{
+							newVertices += vertexStamp[triangles[candidate * 3 + k]] != stamp;
+						}
+						if (newVertices < bestNew && meshletVertices.size() + newVertices <= maxVertices)
+						{
+							bestNew = newVertices;
+							next = candidate;
+						}
+					}
+					candidates.resize(write);
+				}
+
+				Meshlet meshlet{};
+				meshlet.firstIndex = primitive.firstIndex + meshletFirst;
+				meshlet.indexCount = static_cast<uint32_t>(reordered.size()) - meshletFirst;
+				meshlet.draw = static_cast<uint32_t>(primitive.meshletDraw);
+				if (meshletNodes.empty() || meshletNodes.back() != node)
+				{
+					meshletNodes.push_back(node);
+				}
+				meshlet.node = static_cast<uint32_t>(meshletNodes.size() - 1);
+
+				glm::vec3 minPos = vertices_p[meshletVertices[0]];
+				glm::vec3 maxPos = minPos;
+				for (uint32_t vertex : meshletVertices)
+				{
+					minPos = glm::min(minPos, vertices_p[vertex]);
+					maxPos = glm::max(maxPos, vertices_p[vertex]);
+				}
+				glm::vec3 center = (minPos + maxPos) * 0.5f;
+				float radius = 0.f;
+				for (uint32_t vertex : meshletVertices)
+				{
+					radius = std::max(radius, glm::length(vertices_p[vertex] - center));
+				}
+				meshlet.sphere = { center, radius };
+
+				// normal cone, spread over 84 degrees rejects too little to be worth the test
+				glm::vec3 axis{ 0.f };
+				for (uint32_t i = meshletFirst; i < reordered.size(); i += 3)
+				{
+					glm::vec3 p0 = vertices_p[reordered[i]];
+					axis += glm::cross(vertices_p[reordered[i + 1]] - p0, vertices_p[reordered[i + 2]] - p0);
+				}
+				meshlet.cone = { 0.f, 0.f, 0.f, 1.f };
+				float axisLength = glm::length(axis);
+				if (coneCulling && axisLength > 0.f)
+				{
+					axis /= axisLength;
+					float minDot = 1.f;
+					for (uint32_t i = meshletFirst; i < reordered.size(); i += 3)
+					{
+						glm::vec3 p0 = vertices_p[reordered[i]];
+						glm::vec3 normal = glm::cross(vertices_p[reordered[i + 1]] - p0, vertices_p[reordered[i + 2]] - p0);
+						float length = glm::length(normal);
+						if (length > 0.f)
+						{
+							minDot = std::min(minDot, glm::dot(normal / length, axis));
+						}
+					}
+					if (minDot > 0.1f)
+					{
+						meshlet.cone = { axis, std::sqrt(1.f - minDot * minDot) };
+					}
+				}
+				meshlets.push_back(meshlet);
+			}
+			std::copy(reordered.begin(), reordered.end(), indexBuffer.begin() + primitive.firstIndex);
+		}
+	}
+
+	auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	size_t coneCount = std::count_if(meshlets.begin(), meshlets.end(), [](const Meshlet& meshlet) { return meshlet.cone.w < 1.f; });
+	std::cout << "[meshlet] " << path << " : " << meshlets.size() << " meshlets in " << meshletDrawCount << " primitives, " << coneCount << " with normal cone, "
+		<< elapsed << " ms" << std::endl;
+}
+
+uint32_t jhb::Model::getOccluderTriangles(float minSize, size_t maxTriangles, std::vector<glm::vec3>& triangles) const
+{
+	// single instance only, offset without rotation like sponza
+	glm::vec3 instanceOffset = instanceData.empty() ? glm::vec3{ 0.f } : instanceData[0].pos;
+	uint32_t picked = 0;
+	std::vector<uint32_t> simplified;
+
+	std::vector<const Node*> stack(nodes.begin(), nodes.end());
+	while (!stack.empty())
+	{
+		const Node* node = stack.back();
+		stack.pop_back();
+		stack.insert(stack.end(), node->children.begin(), node->children.end());
+		if (!node->visible || node->mesh.primitives.empty())
+		{
+			continue;
+		}
+
+		glm::mat4 nodeMatrix = getNodeMatrix(node);
+		for (const Primitive& primitive : node->mesh.primitives)
+		{
+			// masked leaves and glass would hide what's behind them
+			if (primitive.indexCount < 3 || materials[primitive.materialIndex].alphaMode != "OPAQUE")
+			{
+				continue;
+			}
+
+			glm::vec3 minPos{ std::numeric_limits<float>::max() };
+			glm::vec3 maxPos{ -std::numeric_limits<float>::max() };
+			float area = 0.f;
+			for (uint32_t i = primitive.firstIndex; i + 2 < primitive.firstIndex + primitive.indexCount; i += 3)
+			{
+				glm::vec3 p[3];
+				for (int k = 0; k < 3; k++)
+				{
+					p[k] = nodeMatrix * glm::vec4(vertices_p[indices[i + k]] + instanceOffset, 1.f);
+					minPos = glm::min(minPos, p[k]);
+					maxPos = glm::max(maxPos, p[k]);
+				}
+				area += glm::length(glm::cross(p[1] - p[0], p[2] - p[0])) * 0.5f;
+			}
+			glm::vec3 size = maxPos - minPos;
+			if (std::max({ size.x, size.y, size.z }) < minSize || area < minSize * minSize)
+			{
+				continue;
+			}
+
+			// error bound keeps simplified surface within 1% of primitive size of the real one
+			MeshSimplifier simplifier{ vertices_p, &indices[primitive.firstIndex], primitive.indexCount };
+			float nodeScale = std::max(glm::length(glm::vec3(nodeMatrix[0])), 0.0001f);
+			float vertexSpaceSize = glm::length(size) / nodeScale;
+			simplifier.simplify(maxTriangles * 3, vertexSpaceSize * 0.01f);
+			simplifier.getIndices(simplified);
+
+			// collapses can push outline past the real one, so every triangle is shrunk by the error toward its incenter.
+			// occluder then stays inside the mesh, too small only makes culling miss
+			float inset = simplifier.getError() * nodeScale;
+			for (size_t i = 0; i + 2 < simplified.size(); i += 3)
+			{
+				glm::vec3 p[3];
+				for (int k = 0; k < 3; k++)
+				{
+					p[k] = nodeMatrix * glm::vec4(vertices_p[simplified[i + k]] + instanceOffset, 1.f);
+				}
+				if (inset > 0.f)
+				{
+					float a = glm::length(p[1] - p[2]);
+					float b = glm::length(p[2] - p[0]);
+					float c = glm::length(p[0] - p[1]);
+					float perimeter = a + b + c;
+					float inradius = perimeter > 0.f ? glm::length(glm::cross(p[1] - p[0], p[2] - p[0])) / perimeter : 0.f;
+					if (inradius <= inset)
+					{
+						continue;
+					}
+					glm::vec3 incenter = (a * p[0] + b * p[1] + c * p[2]) / perimeter;
+					float scale = 1.f - inset / inradius;
+					for (int k = 0; k < 3; k++)
+					{
+						p[k] = incenter + (p[k] - incenter) * scale;
+					}
+				}
+				triangles.insert(triangles.end(), p, p + 3);
+			}
+			picked++;
+		}
+	}
+	return picked;
 }
@@ -9,7 +9,10 @@
 
 #include <glm/glm.hpp>
 
+#include <array>
+
 #include "SwapChain.h"
+#include "FrustumCuller.h"
 
 #define STB_IMAGE_IMPLEMENTATION_WRITE
 #define TINYGLTF_NO_STB_IMAGE_WRITE
@@ -44,11 +47,49 @@ namespace jhb {
 		glm::vec4 maxcoordinate{glm::vec3{(std::numeric_limits<float>::min)()}, 1};
 	};
 
+	// index range of simplified primitive, appended after original indices in same index buffer
+	struct PrimitiveLod {
+		uint32_t firstIndex;
+		uint32_t indexCount;
+	};
+
 	// A primitive contains the data for a single draw call
 	struct Primitive {
 		uint32_t firstIndex;
 		uint32_t indexCount;
 		int32_t materialIndex;
+		// lods[0] is lod 1, lod 0 is firstIndex and indexCount
+		std::vector<PrimitiveLod> lods;
+		// command slot in meshlet culling output, -1 when primitive has no meshlets
+		int32_t meshletDraw = -1;
+		// index to Model::staticBatches, -1 when primitive was not merged
+		int32_t staticBatch = -1;
+	};
+
+	// primitives of static nodes merged per material into one index range
+	struct StaticBatch {
+		// vertex space of batch node, vertices are already pre-transformed by their node hierarchy
+		glm::vec3 min;
+		glm::vec3 max;
+		uint32_t primitiveCount;
+	};
+
+	// up to 64 vertices and 124 triangles of one primitive, indices are contiguous in model index buffer.
+	// same layout as meshletCull.comp
+	struct Meshlet {
+		glm::vec4 sphere; // center and radius in vertex space of node
+		glm::vec4 cone; // normal cone axis and sine of backface cone angle, 1 is never culled
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		uint32_t draw; // Primitive::meshletDraw
+		uint32_t node; // index to Model::meshletNodes
+	};
+
+	// index stream and one indirect draw per primitive written by meshlet culling for one view, replaces model's index buffer
+	struct CulledGeometry {
+		VkBuffer indexBuffer;
+		VkBuffer commandBuffer;
+		VkDeviceSize commandOffset;
 	};
 
 	//   ٸ   (alpha  ϼ Ƿ )
@@ -68,8 +109,19 @@ namespace jhb {
 		std::string alphaMode = "OPAQUE";
 		float alphaCutOff;
 		bool doubleSided = false;
+		// world size of one uv unit over material's triangles, texture streaming turns it into texels per pixel. 0 is unknown
+		float worldPerUv = 0.f;
 		std::vector<VkDescriptorSet> descriptorSets{SwapChain::MAX_FRAMES_IN_FLIGHT}; // same type descriptor set for each frame
 		std::unique_ptr<class Pipeline> pipeline = nullptr;
+		// writes depth only, alpha test runs only for MASK
+		std::unique_ptr<class Pipeline> depthPipeline = nullptr;
+		// gbuffer after depth prepass, equal depth test and no discard so every fragment keeps early depth test
+		std::unique_ptr<class Pipeline> equalPipeline = nullptr;
+
+		bool isAlphaMasked() const { return alphaMode == "MASK"; }
+		// winding of loaded meshes isn't verified yet, so nothing culls back faces. meshlet cone culling follows this too
+		static constexpr bool backFaceCulling = false;
+		VkCullModeFlags getCullMode() const { return backFaceCulling && !doubleSided ? VK_CULL_MODE_BACK_BIT : VK_CULL_MODE_NONE; }
 	};
 
 	struct Mesh {
@@ -90,6 +142,25 @@ namespace jhb {
 		}
 	};
 
+	// which per material pipeline a textured draw binds
+	enum class MaterialPass {
+		GBuffer,
+		DepthPrepass,
+		GBufferEqual,
+	};
+
+	// textured draws are split by alpha mode, opaque first so discarding masked fragments come after the bulk of depth is laid down
+	enum class DrawBucket {
+		Opaque,
+		Masked,
+		Count,
+	};
+
+	struct DrawItem {
+		Node* node;
+		Primitive* primitive;
+	};
+
 	// Contains the texture for a single glTF image
 	// Images may be reused by texture objects and are as such separated
 	struct Image {
@@ -102,11 +173,21 @@ namespace jhb {
 		uint32_t              layerCount;
 		VkDescriptorImageInfo descriptor;
 		VkSampler             sampler;
+		// set by Model::loadImages when TextureStreamer loads mips, width, height and mipLevels are of resident chain then
+		std::string           streamPath;
+		int32_t               streamEntry = -1;
+		// set by loadKTX2Texture for memory report, uncompressedBytes is what rgba8 chain of same size would take
+		const char*           formatName = nullptr;
+		VkDeviceSize          gpuBytes = 0;
+		VkDeviceSize          uncompressedBytes = 0;
 
 		void loadTexture2D(Device& device, const std::string& filepath, VkSamplerAddressMode samplerMode);
 		void loadKTXTexture(Device& device, const std::string& filepath, VkImageViewType imgViewType = VK_IMAGE_VIEW_TYPE_2D, int arrayCount = 1);
+		// basis supercompressed files are transcoded to best block format device samples, two channel normal maps to bc5 or eac rg11
+		void loadKTX2Texture(Device& device, const std::string& filepath, VkSamplerAddressMode samplerMode, bool normalMap);
 		void generateMipmap(Device& device, VkImage image, int miplevels, uint32_t width, uint32_t height);
 		void updateDescriptor();
+		void createSampler(Device& device, VkSamplerAddressMode samplerMode, uint32_t mipLevels);
 	};
 
 	// A glTF texture stores a reference to the image and a sampler
@@ -137,9 +218,16 @@ namespace jhb {
 			return images[textures[idx].imageIndex];
 		}
 
+		// cpu copy of geometry, for bvh and other cpu side queries
+		const std::vector<glm::vec3>& getPositions() const { return vertices_p; }
+		const std::vector<uint32_t>& getIndices() const { return indices; }
+		// same matrix pushed to vertex shader in drawNode
+		glm::mat4 getNodeMatrix(const Node* node) const;
+
 		//static std::unique_ptr<Model> createModelFromFile(Device& device, const std::string& Modelfilepath, const std::string& texturefilepath);
-		void draw(VkCommandBuffer buffer, VkPipelineLayout pipelineLayout, int frameIndex);
-		void drawNoTexture(VkCommandBuffer buffer, VkPipeline pipeline, VkPipelineLayout pipelineLayout, int frameIndex);
+		// textured models draw their buckets, pass picks the material pipeline
+		void draw(VkCommandBuffer buffer, VkPipelineLayout pipelineLayout, int frameIndex, const CulledGeometry* culled = nullptr, MaterialPass pass = MaterialPass::GBuffer);
+		void drawNoTexture(VkCommandBuffer buffer, VkPipeline pipeline, VkPipelineLayout pipelineLayout, int frameIndex, const CulledGeometry* culled = nullptr);
 		void drawIndirect(VkCommandBuffer commandBuffer, const Buffer& indirectCommandBuffer, VkPipelineLayout pipelineLayout, int frameIndex);
 
 		void drawInPickPhase(VkCommandBuffer buffer, VkPipelineLayout pipelineLayout, VkPipeline pipeline, int frameIndex);
@@ -149,22 +237,71 @@ namespace jhb {
 		void createIndexBuffer(const std::vector<uint32_t>& indices);
 		void createPipelineForModel(const std::string& vertFilepath, const std::string& fragFilepath, class PipelineConfigInfo& configInfo);
 		void createGraphicsPipelinePerMaterial(const std::string& vertFilepath, const std::string& fragFilepath, PipelineConfigInfo& configInfo);
+		// depthPipeline and equalPipeline of every material, vertex shader must be same as gbuffer one so equal test matches
+		void createDepthPrepassPipelinesPerMaterial(const std::string& vertFilepath, const std::string& depthFragFilepath, PipelineConfigInfo& depthConfigInfo,
+			const std::string& gbufferFragFilepath, PipelineConfigInfo& equalConfigInfo);
 
 	public:
 		void loadModel(const std::string& filepath);
-		void loadImages(tinygltf::Model& input, VkSamplerAddressMode samplerMode);
+		// streamed only reads image headers, TextureStreamer::addModel creates vulkan images later.
+		// .ktx2 images, or a .ktx2 next to png/jpg, are always loaded whole and their size against rgba8 is printed
+		void loadImages(tinygltf::Model& input, VkSamplerAddressMode samplerMode, bool streamed = false);
+		// tinygltf image loader that leaves ktx2 data to loadImages, stb can't decode it
+		static bool loadGLTFImageData(tinygltf::Image* image, const int imageIndex, std::string* err, std::string* warn, int reqWidth, int reqHeight,
+			const unsigned char* bytes, int size, void* userData);
 		void loadTextures(tinygltf::Model& input);
 		void loadMaterials(tinygltf::Model& input);
 		void loadNode(const tinygltf::Node& inputNode, const tinygltf::Model& input, Node* parent, std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer);
-		void drawNode(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, Node* node, int frameIndex);
+		void drawNode(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, Node* node, int frameIndex, const CulledGeometry* culled = nullptr);
+		// draw of one primitive with pipeline and material already bound, meshlet, lod and static batch culling applied
+		void drawPrimitive(VkCommandBuffer commandBuffer, const Primitive& primitive, int frameIndex, const CulledGeometry* culled);
+		// sorts primitives of visible nodes into opaque and masked buckets, by material then node. call once node tree is final
+		void buildDrawBuckets();
+		const std::vector<DrawItem>& getDrawBucket(DrawBucket bucket) const { return drawBuckets[static_cast<size_t>(bucket)]; }
 		void buildIndriectNode(Node* node, std::vector<VkDrawIndexedIndirectCommand>& indirectCommandsBuffer);
-		void drawNodeNotexture(VkCommandBuffer commandBuffer, VkPipeline pipeline, VkPipelineLayout pipelineLayout, Node* node);
+		void drawNodeNotexture(VkCommandBuffer commandBuffer, VkPipeline pipeline, VkPipelineLayout pipelineLayout, Node* node, const CulledGeometry* culled = nullptr);
 		void buildIndirectCommand(std::vector<VkDrawIndexedIndirectCommand>& indirectCommandBuffer);
 
 		void PickingPhasedrawNode(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, Node* node, int frameIndex, VkPipeline pipeline);
 		void calculateTangent(glm::vec2 uv1, glm::vec2 uv2, glm::vec2 uv3, glm::vec3 pos1, glm::vec3 pos2, glm::vec3 pos3, glm::vec4& tangent);
 		void createObjectSphere(const std::vector<Vertex> vertices);
-		void updateInstanceBuffer(uint32_t _instanceCount, const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& rotations, float roughness =0, float metallic=0);
+		// Material::worldPerUv from triangles of every node, call before buildStaticBatches moves vertices
+		void computeTexelDensity(const std::vector<Vertex>& vertexBuffer, const std::vector<uint32_t>& indexBuffer);
+		// asks streamer for mips each material needs from nearest visible geometry, visible as in selectLods
+		void requestTextureMips(class TextureStreamer& streamer, int frameIndex, const glm::vec3& cameraPosition, float pixelScale, const std::vector<uint32_t>* visible = nullptr);
+		// base color, normal, occlusion, emissive, metallic roughness, binding order of material set
+		std::array<VkDescriptorImageInfo, 5> getMaterialImageInfos(const Material& material);
+		// instances gathered by InstanceBatcher, bind reads them from stream at streamOffset. null stream skips instance binding
+		void setInstances(const InstanceData* data, uint32_t count, VkBuffer stream, VkDeviceSize streamOffset);
+
+		// lod 0 is full mesh, same count as computeCull.comp
+		static constexpr uint32_t MAX_LOD_LEVEL = 5;
+		// simplifies every primitive and appends lod indices to indexBuffer, call between createVertexBuffer and createIndexBuffer
+		void generateLods(std::vector<uint32_t>& indexBuffer);
+		uint32_t getLodCount() const { return static_cast<uint32_t>(lodErrors.size()); }
+		// picks lod of each instance from projected error and regroups this frame's instance buffer by lod, draw then issues one draw per lod.
+		// pixelScale turns size at distance 1 into pixels, debugView makes deferred pass tint instances by lod.
+		// visible limits it to those instances (from FrustumCuller), negative errorPixels keeps all of them on lod 0
+		void selectLods(int frameIndex, const glm::vec3& cameraPosition, float pixelScale, float errorPixels, bool debugView, const std::vector<uint32_t>* visible = nullptr);
+		// frame is drawn with full mesh again
+		void clearLods(int frameIndex) { lodFrames[frameIndex].active = false; }
+		const std::array<uint32_t, MAX_LOD_LEVEL>& getLodInstanceCounts(int frameIndex) const { return lodFrames[frameIndex].instanceCount; }
+		// world space sphere of every instance in instanceData order, rebuilt when setInstances changes them
+		const SphereBounds& getInstanceBounds();
+		// world space triangles (3 positions each) of big opaque primitives for software occlusion. primitive is picked when its
+		// bounds span minSize and its area is at least minSize^2, then simplified toward maxTriangles. returns picked primitive count
+		uint32_t getOccluderTriangles(float minSize, size_t maxTriangles, std::vector<glm::vec3>& triangles) const;
+
+		// splits every primitive into meshlets, reorders triangles of each primitive in place so meshlets are contiguous.
+		// call before createIndexBuffer, only for models drawn once (culling output has no instances)
+		void buildMeshlets(std::vector<uint32_t>& indexBuffer);
+		// pre-transforms vertices of every mesh node and merges primitives sharing a material, node tree becomes one identity node.
+		// call after tangents are made and before createVertexBuffer, generateLods and buildMeshlets
+		void buildStaticBatches(std::vector<Vertex>& vertexBuffer, std::vector<uint32_t>& indexBuffer);
+		// frustum culls batches for this frame's textured draw, null culler draws every batch
+		void cullStaticBatches(int frameIndex, const glm::mat4& viewProjection, FrustumCuller* culler);
+		Buffer* getIndexBuffer() const { return indexBuffer.get(); }
+		uint32_t getIndexCount() const { return indexCount; }
 
 	public:
 		// only for no gftl model
@@ -187,11 +324,49 @@ namespace jhb {
 
 	public:
 		uint32_t instanceCount = 1;
-		uint32_t firstid = 0;
+		// game object recording the instanced draw of this model, set by InstanceBatcher
+		uint32_t batchOwner = 0;
 
-		std::unique_ptr<Buffer> instanceBuffer = nullptr;
 		std::vector<InstanceData> instanceData;
 
+	private:
+		struct LodFrame {
+			// instanceData sorted by lod, instance stream is still used by picking and shadow
+			std::unique_ptr<Buffer> instanceBuffer;
+			std::array<uint32_t, MAX_LOD_LEVEL> firstInstance{};
+			std::array<uint32_t, MAX_LOD_LEVEL> instanceCount{};
+			bool active = false;
+			// per StaticBatch, only read when batchCulled
+			std::vector<uint8_t> batchVisible;
+			bool batchCulled = false;
+		};
+
+		// vertex space, largest error over primitives, lodErrors[0] is 0
+		std::vector<float> lodErrors;
+		// bounding radius around vertex space origin, instances are offset from there
+		float lodRadius = 0.f;
+		std::array<LodFrame, SwapChain::MAX_FRAMES_IN_FLIGHT> lodFrames;
+		std::vector<InstanceData> lodInstanceData;
+		std::vector<uint8_t> instanceLods;
+		SphereBounds instanceBounds;
+		bool instanceBoundsDirty = true;
+		AabbBounds staticBatchBounds;
+		std::vector<uint32_t> visibleStaticBatches;
+		// range of this frame's transient stream
+		VkBuffer instanceStream = VK_NULL_HANDLE;
+		VkDeviceSize instanceStreamOffset = 0;
+
+	public:
+		std::vector<Meshlet> meshlets;
+		// nodes referenced by Meshlet::node, cull system turns them to matrices
+		std::vector<const Node*> meshletNodes;
+		std::vector<StaticBatch> staticBatches;
+		std::array<std::vector<DrawItem>, static_cast<size_t>(DrawBucket::Count)> drawBuckets;
+		uint32_t meshletDrawCount = 0;
+		// streamer swapped an image, material sets of each frame are rewritten before that frame binds them
+		std::array<bool, SwapChain::MAX_FRAMES_IN_FLIGHT> materialTexturesDirty{};
+		std::vector<float> materialDistances;
+
 	public:
 		std::vector<Material> materials;
 		std::vector<Node*> nodes;
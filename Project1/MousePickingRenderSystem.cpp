@@ -1,4 +1,5 @@
 #include "MousePickingRenderSystem.h"
+#include "CommandStats.h"
 #include "JHBApplication.h"
 #include "Model.h"
 #include "Pipeline.h"
@@ -14,7 +15,6 @@ jhb::MousePickingRenderSystem::MousePickingRenderSystem(Device& device, const st
 	: BaseRenderSystem(device)
 {
 	createRenderPass();
-	createOffscreenFrameBuffers();
 
 	std::vector<VkPushConstantRange> pushConstantRanges;
 	VkPushConstantRange pushVertexConstantRange{};
@@ -30,23 +30,30 @@ jhb::MousePickingRenderSystem::MousePickingRenderSystem(Device& device, const st
 
 	BaseRenderSystem::createPipeLineLayout(globalSetLayOut, pushConstantRanges);
 	createPipeline(pickingRenderpass, vert, frag);
+
+	for (auto& readbackBuffer : readbackBuffers)
+	{
+		readbackBuffer = std::make_unique<Buffer>(device, sizeof(uint32_t) * 4, 1, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		readbackBuffer->map();
+	}
 }
 
 jhb::MousePickingRenderSystem::~MousePickingRenderSystem()
 {
+	destroyOffscreenFrameBuffer();
 
 }
 
-void jhb::MousePickingRenderSystem::renderMousePickedObjToOffscreen(VkCommandBuffer cmd, const std::vector<VkDescriptorSet>& descriptorsets,
-	int frameIndex, Buffer* pickingUbo)
+void jhb::MousePickingRenderSystem::renderMousePickedObjToOffscreen(VkCommandBuffer cmd, VkDescriptorSet globalDescriptorSet, uint32_t globalUboOffset, int frameIndex)
 {
-	vkCmdBindDescriptorSets(
+	cmd::bindDescriptorSets(
 		cmd,
 		VK_PIPELINE_BIND_POINT_GRAPHICS,
 		pipelineLayout,
 		0, 1
-		, &descriptorsets[0],
-		0, nullptr
+		, &globalDescriptorSet,
+		1, &globalUboOffset
 	);
 
 	// update object id per object
@@ -59,20 +66,65 @@ void jhb::MousePickingRenderSystem::renderMousePickedObjToOffscreen(VkCommandBuf
 			continue;
 		}
 
-		if (kv.first == 2)
+		// sponza (0) and skybox (1) are not pickable, instanced model is drawn by owner of its batch
+		if (kv.first > 1 && kv.first == obj.model->batchOwner)
 		{
 			obj.model->bind(cmd);
-			if (pickingUbo)
-			{
-				uint32_t objId = obj.getId()+1;
-				vkCmdPushConstants(cmd, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(glm::mat4), sizeof(uint32_t), &objId);
-				obj.model->drawInPickPhase(cmd, pipelineLayout, pipeline->getPipeline(), frameIndex);
-			}
-			else {
-				obj.model->draw(cmd, pipelineLayout, frameIndex);
-			}
+			// shader adds instance slot, so texel is slot + 1 and 0 stays nothing
+			uint32_t objId = 1;
+			cmd::pushConstants(cmd, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(glm::mat4), sizeof(uint32_t), &objId);
+			obj.model->drawInPickPhase(cmd, pipelineLayout, pipeline->getPipeline(), frameIndex);
+		}
+	}
+}
+
+void jhb::MousePickingRenderSystem::copyPickedTexel(VkCommandBuffer cmd, int frameIndex, VkImage image, int x, int y)
+{
+	VkExtent2D extent = device.getWindow().getExtent();
+	VkBufferImageCopy region{};
+	region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	region.imageOffset = { std::clamp(x, 0, (int)extent.width - 1), std::clamp(y, 0, (int)extent.height - 1), 0 };
+	region.imageExtent = { 1, 1, 1 };
+	vkCmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffers[frameIndex]->getBuffer(), 1, &region);
+
+	VkBufferMemoryBarrier bufferBarrier{};
+	bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.buffer = readbackBuffers[frameIndex]->getBuffer();
+	bufferBarrier.size = VK_WHOLE_SIZE;
+	cmd::pipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+
+	readbackPending[frameIndex] = true;
+}
+
+bool jhb::MousePickingRenderSystem::pollPickedObject(const std::vector<VkFence>& frameFences, int& objectId)
+{
+	// must be called before this frame's copy is recorded, so a signaled fence always belongs to the frame that copied
+	for (int i = 0; i < readbackPending.size(); i++)
+	{
+		if (readbackPending[i] && vkGetFenceStatus(device.getLogicalDevice(), frameFences[i]) == VK_SUCCESS)
+		{
+			readbackPending[i] = false;
+			objectId = static_cast<int>(*static_cast<uint32_t*>(readbackBuffers[i]->getMappedMemory()));
+			return true;
+		}
+	}
+	return false;
+}
+
+bool jhb::MousePickingRenderSystem::isPickPending() const
+{
+	for (bool pending : readbackPending)
+	{
+		if (pending)
+		{
+			return true;
 		}
 	}
+	return false;
 }
 
 void jhb::MousePickingRenderSystem::createPipeline(VkRenderPass renderPass, const std::string& vert, const std::string& frag)
@@ -191,61 +243,35 @@ void jhb::MousePickingRenderSystem::createRenderPass()
 	}
 }
 
-void jhb::MousePickingRenderSystem::createOffscreenFrameBuffers()
+void jhb::MousePickingRenderSystem::createOffscreenFrameBuffer(VkImageView colorView, VkExtent2D extent)
 {
-	for (int i = 0; i < SwapChain::MAX_FRAMES_IN_FLIGHT; i++)
-	{
-		// Image
-		VkImageCreateInfo imageCI{};
-		imageCI.imageType = VK_IMAGE_TYPE_2D;
-		imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-		imageCI.format = VK_FORMAT_R32G32B32A32_UINT;
-		imageCI.extent.width = device.getWindow().getExtent().width;
-		imageCI.extent.height = device.getWindow().getExtent().height;
-		imageCI.extent.depth = 1;
-		imageCI.mipLevels = 1;
-		imageCI.arrayLayers = 1;
-		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
-		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-		device.createImageWithInfo(imageCI, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, offscreenImage[i], offscreenMemory[i]);
-		// Image view
-		VkImageViewCreateInfo viewCI{};
-		viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		viewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-		viewCI.format = VK_FORMAT_R32G32B32A32_UINT;
-		viewCI.subresourceRange = {};
-		viewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		viewCI.subresourceRange.levelCount = 1;
-		viewCI.subresourceRange.layerCount = 1;
-		viewCI.image = offscreenImage[i];
-		if (vkCreateImageView(device.getLogicalDevice(), &viewCI, nullptr, &offscreenImageView[i]))
-		{
-			throw std::runtime_error("failed to create ImageView!");
-		}
+	destroyOffscreenFrameBuffer();
 
-		std::vector<VkImageView> attachments = { offscreenImageView[i] };
+	std::vector<VkImageView> attachments = { colorView };
 
-		VkFramebufferCreateInfo fbufCreateInfo{};
-		fbufCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		fbufCreateInfo.renderPass = pickingRenderpass;
-		fbufCreateInfo.attachmentCount = attachments.size();
-		fbufCreateInfo.pAttachments = attachments.data();
-		fbufCreateInfo.width = device.getWindow().getExtent().width;
-		fbufCreateInfo.height = device.getWindow().getExtent().height;
-		fbufCreateInfo.layers = 1;
+	VkFramebufferCreateInfo fbufCreateInfo{};
+	fbufCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	fbufCreateInfo.renderPass = pickingRenderpass;
+	fbufCreateInfo.attachmentCount = attachments.size();
+	fbufCreateInfo.pAttachments = attachments.data();
+	fbufCreateInfo.width = extent.width;
+	fbufCreateInfo.height = extent.height;
+	fbufCreateInfo.layers = 1;
 
-		if (vkCreateFramebuffer(device.getLogicalDevice(), &fbufCreateInfo, nullptr, &offscreenFrameBuffer[i]))
-		{
-			throw std::runtime_error("failed to create frameBuffer!");
-		}
+	if (vkCreateFramebuffer(device.getLogicalDevice(), &fbufCreateInfo, nullptr, &offscreenFrameBuffer))
+	{
+		throw std::runtime_error("failed to create frameBuffer!");
 	}
 }
 
 void jhb::MousePickingRenderSystem::destroyOffscreenFrameBuffer()
 {
-	for (auto& frameBuffer : offscreenFrameBuffer)
+	if (offscreenFrameBuffer != VK_NULL_HANDLE)
 	{
-		vkDestroyFramebuffer(device.getLogicalDevice(), frameBuffer, nullptr);
+		// last picking frame may still be in flight
+		VkDevice logicalDevice = device.getLogicalDevice();
+		VkFramebuffer framebuffer = offscreenFrameBuffer;
+		device.getDeletionQueue().retire([logicalDevice, framebuffer]() { vkDestroyFramebuffer(logicalDevice, framebuffer, nullptr); });
+		offscreenFrameBuffer = VK_NULL_HANDLE;
 	}
 }
@@ -14,24 +14,32 @@ namespace jhb {
 		MousePickingRenderSystem& operator=(const MousePickingRenderSystem&) = delete;
 
 	public:
-		void renderMousePickedObjToOffscreen(VkCommandBuffer cmd,  const std::vector<VkDescriptorSet>& descriptorsets,
-			int frameIndex, Buffer* pickingUbo
-		);
+		// object id goes in push constant, global set is bound with this frame's dynamic offset
+		void renderMousePickedObjToOffscreen(VkCommandBuffer cmd, VkDescriptorSet globalDescriptorSet, uint32_t globalUboOffset, int frameIndex);
+
+		// copy one texel of picking image to this frame's persistent readback buffer, image must already be in transfer src layout
+		void copyPickedTexel(VkCommandBuffer cmd, int frameIndex, VkImage image, int x, int y);
+		// never waits, returns true once a copied texel's frame fence is signaled. texel is instance slot + 1, 0 when nothing was hit
+		bool pollPickedObject(const std::vector<VkFence>& frameFences, int& objectId);
+		bool isPickPending() const;
 
 	private:
 		void createPipeline(VkRenderPass renderPass, const std::string& vert, const std::string& frag) override;
 		void createRenderPass();
 
 	public:
-		void createOffscreenFrameBuffers();
+		// picking image is transient render graph image, so framebuffer is recreated whenever graph is compiled
+		void createOffscreenFrameBuffer(VkImageView colorView, VkExtent2D extent);
 	public: 
 		void destroyOffscreenFrameBuffer();
 	public:
 		// offscreen with object index info pixels;
-		std::vector<VkImage> offscreenImage{SwapChain::MAX_FRAMES_IN_FLIGHT};
-		std::vector<VkDeviceMemory> offscreenMemory{SwapChain::MAX_FRAMES_IN_FLIGHT};
-		std::vector<VkImageView> offscreenImageView{SwapChain::MAX_FRAMES_IN_FLIGHT};
-		std::vector<VkFramebuffer> offscreenFrameBuffer{SwapChain::MAX_FRAMES_IN_FLIGHT};
+		VkFramebuffer offscreenFrameBuffer = VK_NULL_HANDLE;
 		VkRenderPass pickingRenderpass;
+
+	private:
+		// host visible, one R32G32B32A32_UINT texel per frame in flight
+		std::vector<std::unique_ptr<Buffer>> readbackBuffers{SwapChain::MAX_FRAMES_IN_FLIGHT};
+		std::vector<bool> readbackPending = std::vector<bool>(SwapChain::MAX_FRAMES_IN_FLIGHT, false);
 	};
 }
@@ -0,0 +1,462 @@
+#include "OcclusionCuller.h"
+#include "Model.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define JHB_OCCLUSION_SSE 1
+#include <emmintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define JHB_OCCLUSION_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace jhb {
+	namespace {
+		// 4 pixels of a row. sse2 and neon are baseline of x64 and arm64, so no runtime dispatch is needed here
+#if JHB_OCCLUSION_SSE
+		using Float4 = __m128;
+
+		inline Float4 splat(float v) { return _mm_set1_ps(v); }
+		inline Float4 ramp(float v) { return _mm_setr_ps(v, v + 1.f, v + 2.f, v + 3.f); }
+		inline Float4 load4(const float* p) { return _mm_loadu_ps(p); }
+		inline void store4(float* p, Float4 v) { _mm_storeu_ps(p, v); }
+		inline Float4 mulAdd(Float4 a, Float4 b, Float4 c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+		inline Float4 insideMask(Float4 e0, Float4 e1, Float4 e2)
+		{
+			Float4 zero = _mm_setzero_ps();
+			return _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+		}
+		inline bool anyLane(Float4 mask) { return _mm_movemask_ps(mask) != 0; }
+		inline Float4 selectMin(Float4 mask, Float4 depth, Float4 z) { return _mm_or_ps(_mm_and_ps(mask, _mm_min_ps(depth, z)), _mm_andnot_ps(mask, depth)); }
+		inline bool anyGreaterEqual(Float4 a, Float4 b) { return _mm_movemask_ps(_mm_cmpge_ps(a, b)) != 0; }
+		inline Float4 max4(Float4 a, Float4 b) { return _mm_max_ps(a, b); }
+#elif JHB_OCCLUSION_NEON
+		using Float4 = float32x4_t;
+
+		inline Float4 splat(float v) { return vdupq_n_f32(v); }
+		inline Float4 ramp(float v)
+		{
+			const float values[4] = { v, v + 1.f, v + 2.f, v + 3.f };
+			return vld1q_f32(values);
+		}
+		inline Float4 load4(const float* p) { return vld1q_f32(p); }
+		inline void store4(float* p, Float4 v) { vst1q_f32(p, v); }
+		inline Float4 mulAdd(Float4 a, Float4 b, Float4 c) { return vmlaq_f32(c, a, b); }
+		inline Float4 insideMask(Float4 e0, Float4 e1, Float4 e2)
+		{
+			Float4 zero = vdupq_n_f32(0.f);
+			return vreinterpretq_f32_u32(vandq_u32(vandq_u32(vcgeq_f32(e0, zero), vcgeq_f32(e1, zero)), vcgeq_f32(e2, zero)));
+		}
+		inline bool anyLane(Float4 mask) { return vmaxvq_u32(vreinterpretq_u32_f32(mask)) != 0; }
+		inline Float4 selectMin(Float4 mask, Float4 depth, Float4 z) { return vbslq_f32(vreinterpretq_u32_f32(mask), vminq_f32(depth, z), depth); }
+		inline bool anyGreaterEqual(Float4 a, Float4 b) { return vmaxvq_u32(vcgeq_f32(a, b)) != 0; }
+		inline Float4 max4(Float4 a, Float4 b) { return vmaxq_f32(a, b); }
+#else
+		struct Float4 {
+			float v[4];
+		};
+
+		inline Float4 splat(float v) { return { { v, v, v, v } }; }
+		inline Float4 ramp(float v) { return { { v, v + 1.f, v + 2.f, v + 3.f } }; }
+		inline Float4 load4(const float* p) { return { { p[0], p[1], p[2], p[3] } }; }
+		inline void store4(float* p, Float4 v) { std::copy(v.v, v.v + 4, p); }
+		inline Float4 mulAdd(Float4 a, Float4 b, Float4 c)
+		{
+			Float4 result;
+			for (int i = 0; i < 4; i++) result.v[i] = a.v[i] * b.v[i] + c.v[i];
+			return result;
+		}
+		inline Float4 insideMask(Float4 e0, Float4 e1, Float4 e2)
+		{
+			Float4 result;
+			for (int i = 0; i < 4; i++) result.v[i] = e0.v[i] >= 0.f && e1.v[i] >= 0.f && e2.v[i] >= 0.f ? 1.f : 0.f;
+			return result;
+		}
+		inline bool anyLane(Float4 mask) { return mask.v[0] != 0.f || mask.v[1] != 0.f || mask.v[2] != 0.f || mask.v[3] != 0.f; }
+		inline Float4 selectMin(Float4 mask, Float4 depth, Float4 z)
+		{
+			Float4 result;
+			for (int i = 0; i < 4; i++) result.v[i] = mask.v[i] != 0.f ? std::min(depth.v[i], z.v[i]) : depth.v[i];
+			return result;
+		}
+		inline bool anyGreaterEqual(Float4 a, Float4 b) { return a.v[0] >= b.v[0] || a.v[1] >= b.v[1] || a.v[2] >= b.v[2] || a.v[3] >= b.v[3]; }
+		inline Float4 max4(Float4 a, Float4 b)
+		{
+			Float4 result;
+			for (int i = 0; i < 4; i++) result.v[i] = std::max(a.v[i], b.v[i]);
+			return result;
+		}
+#endif
+
+		// near plane and guard band of 2x screen, farther out float edge functions lose precision.
+		// dot(plane, clip) >= 0 is inside
+		constexpr float GUARD_BAND = 2.f;
+		const glm::vec4 clipPlanes[5] = {
+			{ 0.f, 0.f, 1.f, 0.f },
+			{ -1.f, 0.f, 0.f, GUARD_BAND },
+			{ 1.f, 0.f, 0.f, GUARD_BAND },
+			{ 0.f, -1.f, 0.f, GUARD_BAND },
+			{ 0.f, 1.f, 0.f, GUARD_BAND },
+		};
+
+		// below this an instance tests faster than waking workers
+		constexpr size_t MIN_PARALLEL_TESTS = 2048;
+	}
+
+	OcclusionCuller::OcclusionCuller(WorkerPool& pool) : pool{ pool }, cornerDepth(CORNER_STRIDE * (HEIGHT + 1), 1.f), depth(WIDTH * HEIGHT, 1.f)
+	{
+	}
+
+	bool OcclusionCuller::addOccluders(const Model& model)
+	{
+		size_t first = occluderTriangles.size();
+		uint32_t primitives = model.getOccluderTriangles(MIN_OCCLUDER_SIZE, MAX_OCCLUDER_TRIANGLES, occluderTriangles);
+		if (primitives == 0)
+		{
+			return false;
+		}
+		occluderModels.push_back(&model);
+		stats.occluderTriangles = occluderTriangles.size() / 3;
+		std::cout << "[occlusion] " << model.path << " : " << primitives << " occluder primitives, " << (occluderTriangles.size() - first) / 3 << " triangles" << std::endl;
+		return true;
+	}
+
+	bool OcclusionCuller::isOccluder(const Model* model) const
+	{
+		return std::find(occluderModels.begin(), occluderModels.end(), model) != occluderModels.end();
+	}
+
+	void OcclusionCuller::render(const glm::mat4& newViewProjection)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		uint64_t occluderCount = stats.occluderTriangles;
+		stats = {};
+		stats.occluderTriangles = occluderCount;
+		frameCount++;
+		viewProjection = newViewProjection;
+
+		// transform and clip on calling thread, few thousand triangles
+		screenTriangles.clear();
+		for (size_t i = 0; i < occluderTriangles.size(); i += 3)
+		{
+			glm::vec4 clip[3];
+			for (int k = 0; k < 3; k++)
+			{
+				clip[k] = viewProjection * glm::vec4(occluderTriangles[i + k], 1.f);
+			}
+			clipTriangle(clip);
+		}
+		stats.rasterizedTriangles = screenTriangles.size();
+
+		// bands own their rows, so workers never touch same corner or pixel
+		uint32_t cornerBandCount = (HEIGHT + 1 + BAND_HEIGHT - 1) / BAND_HEIGHT;
+		pool.parallelFor(cornerBandCount, [&](uint32_t band) {
+			rasterizeBand(band * BAND_HEIGHT, std::min(HEIGHT + 1, (band + 1) * BAND_HEIGHT));
+		});
+		// pixel rows read corner row below them, so resolve waits for every band
+		uint32_t bandCount = (HEIGHT + BAND_HEIGHT - 1) / BAND_HEIGHT;
+		pool.parallelFor(bandCount, [&](uint32_t band) {
+			resolveBand(band * BAND_HEIGHT, std::min(HEIGHT, (band + 1) * BAND_HEIGHT));
+		});
+
+		stats.rasterMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		total.rasterizedTriangles += stats.rasterizedTriangles;
+		total.rasterMs += stats.rasterMs;
+	}
+
+	void OcclusionCuller::clipTriangle(const glm::vec4* clip)
+	{
+		// fully outside one side of real frustum
+		for (int axis = 0; axis < 2; axis++)
+		{
+			if ((clip[0][axis] > clip[0].w && clip[1][axis] > clip[1].w && clip[2][axis] > clip[2].w) ||
+				(clip[0][axis] < -clip[0].w && clip[1][axis] < -clip[1].w && clip[2][axis] < -clip[2].w))
+			{
+				return;
+			}
+		}
+		if ((clip[0].z < 0.f && clip[1].z < 0.f && clip[2].z < 0.f) || (clip[0].z > clip[0].w && clip[1].z > clip[1].w && clip[2].z > clip[2].w))
+		{
+			return;
+		}
+
+		bool inside = true;
+		for (const glm::vec4& plane : clipPlanes)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				inside &= glm::dot(plane, clip[k]) >= 0.f;
+			}
+		}
+		if (inside)
+		{
+			setupTriangle(clip[0], clip[1], clip[2]);
+			return;
+		}
+
+		// sutherland hodgman, every plane adds at most one vertex
+		glm::vec4 polygon[8];
+		glm::vec4 next[8];
+		int count = 3;
+		std::copy(clip, clip + 3, polygon);
+		for (const glm::vec4& plane : clipPlanes)
+		{
+			int nextCount = 0;
+			for (int i = 0; i < count; i++)
+			{
+				const glm::vec4& a = polygon[i];
+				const glm::vec4& b = polygon[(i + 1) % count];
+				float da = glm::dot(plane, a);
+				float db = glm::dot(plane, b);
+				if (da >= 0.f)
+				{
+					next[nextCount++] = a;
+				}
+				if ((da >= 0.f) != (db >= 0.f))
+				{
+					next[nextCount++] = a + (b - a) * (da / (da - db));
+				}
+			}
+			count = nextCount;
+			std::copy(next, next + count, polygon);
+			if (count < 3)
+			{
+				return;
+			}
+		}
+		for (int i = 1; i + 1 < count; i++)
+		{
+			setupTriangle(polygon[0], polygon[i], polygon[i + 1]);
+		}
+	}
+
+	void OcclusionCuller::setupTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+	{
+		ScreenTriangle triangle;
+		const glm::vec4* clip[3] = { &a, &b, &c };
+		for (int k = 0; k < 3; k++)
+		{
+			float invW = 1.f / clip[k]->w;
+			triangle.x[k] = (clip[k]->x * invW * 0.5f + 0.5f) * WIDTH;
+			triangle.y[k] = (clip[k]->y * invW * 0.5f + 0.5f) * HEIGHT;
+			triangle.z[k] = clip[k]->z * invW;
+		}
+
+		// both facings are occluders
+		float area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) - (triangle.x[2] - triangle.x[0]) * (triangle.y[1] - triangle.y[0]);
+		if (std::abs(area) < 1e-6f)
+		{
+			return;
+		}
+		if (area < 0.f)
+		{
+			std::swap(triangle.x[1], triangle.x[2]);
+			std::swap(triangle.y[1], triangle.y[2]);
+			std::swap(triangle.z[1], triangle.z[2]);
+		}
+
+		// pixel corners that can be covered
+		float minX = std::min({ triangle.x[0], triangle.x[1], triangle.x[2] });
+		float maxX = std::max({ triangle.x[0], triangle.x[1], triangle.x[2] });
+		float minY = std::min({ triangle.y[0], triangle.y[1], triangle.y[2] });
+		float maxY = std::max({ triangle.y[0], triangle.y[1], triangle.y[2] });
+		triangle.minX = std::max(static_cast<int32_t>(std::ceil(minX)), 0);
+		triangle.maxX = std::min(static_cast<int32_t>(std::floor(maxX)), static_cast<int32_t>(WIDTH));
+		triangle.minY = std::max(static_cast<int32_t>(std::ceil(minY)), 0);
+		triangle.maxY = std::min(static_cast<int32_t>(std::floor(maxY)), static_cast<int32_t>(HEIGHT));
+		if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+		{
+			return;
+		}
+		screenTriangles.push_back(triangle);
+	}
+
+	void OcclusionCuller::rasterizeBand(uint32_t firstRow, uint32_t endRow)
+	{
+		std::fill(cornerDepth.begin() + firstRow * CORNER_STRIDE, cornerDepth.begin() + endRow * CORNER_STRIDE, 1.f);
+
+		for (const ScreenTriangle& t : screenTriangles)
+		{
+			int32_t minY = std::max(t.minY, static_cast<int32_t>(firstRow));
+			int32_t maxY = std::min(t.maxY, static_cast<int32_t>(endRow) - 1);
+			if (minY > maxY)
+			{
+				continue;
+			}
+
+			// edge i is opposite vertex i, e = a * x + b * y + c is positive inside
+			float a[3], b[3], c[3];
+			for (int i = 0; i < 3; i++)
+			{
+				int from = (i + 1) % 3;
+				int to = (i + 2) % 3;
+				a[i] = t.y[from] - t.y[to];
+				b[i] = t.x[to] - t.x[from];
+				c[i] = -(a[i] * t.x[from] + b[i] * t.y[from]);
+			}
+			// edge values over area are barycentrics, so depth is a plane in x y too
+			float area = c[0] + c[1] + c[2];
+			float zA = (a[0] * t.z[0] + a[1] * t.z[1] + a[2] * t.z[2]) / area;
+			float zB = (b[0] * t.z[0] + b[1] * t.z[1] + b[2] * t.z[2]) / area;
+			float zC = (c[0] * t.z[0] + c[1] * t.z[1] + c[2] * t.z[2]) / area;
+
+			Float4 a0 = splat(a[0]), a1 = splat(a[1]), a2 = splat(a[2]);
+			Float4 zStep = splat(zA);
+			int32_t firstX = t.minX & ~3;
+			for (int32_t y = minY; y <= maxY; y++)
+			{
+				float py = static_cast<float>(y);
+				Float4 rowE0 = splat(b[0] * py + c[0]);
+				Float4 rowE1 = splat(b[1] * py + c[1]);
+				Float4 rowE2 = splat(b[2] * py + c[2]);
+				Float4 rowZ = splat(zB * py + zC);
+				float* row = &cornerDepth[y * CORNER_STRIDE];
+				// lanes past bounds of triangle fail edge tests, row stride is whole lanes
+				for (int32_t x = firstX; x <= t.maxX; x += 4)
+				{
+					Float4 px = ramp(static_cast<float>(x));
+					Float4 mask = insideMask(mulAdd(a0, px, rowE0), mulAdd(a1, px, rowE1), mulAdd(a2, px, rowE2));
+					if (!anyLane(mask))
+					{
+						continue;
+					}
+					store4(row + x, selectMin(mask, load4(row + x), mulAdd(zStep, px, rowZ)));
+				}
+			}
+		}
+	}
+
+	void OcclusionCuller::resolveBand(uint32_t firstRow, uint32_t endRow)
+	{
+		// pixel is occluded only as far as its farthest corner, an uncovered corner keeps it empty.
+		// silhouette pixels the occluder only partly covers stay empty, so nothing just behind an edge is hidden
+		for (uint32_t y = firstRow; y < endRow; y++)
+		{
+			const float* top = &cornerDepth[y * CORNER_STRIDE];
+			const float* bottom = top + CORNER_STRIDE;
+			float* row = &depth[y * WIDTH];
+			for (uint32_t x = 0; x < WIDTH; x += 4)
+			{
+				Float4 farthest = max4(max4(load4(top + x), load4(top + x + 1)), max4(load4(bottom + x), load4(bottom + x + 1)));
+				store4(row + x, farthest);
+			}
+		}
+	}
+
+	bool OcclusionCuller::isVisible(const glm::vec3& center, float radius) const
+	{
+		// box around sphere, its nearest corner is never farther than sphere and its rect covers sphere
+		float minX = static_cast<float>(WIDTH), maxX = 0.f;
+		float minY = static_cast<float>(HEIGHT), maxY = 0.f;
+		float minDepth = 1.f;
+		for (int corner = 0; corner < 8; corner++)
+		{
+			glm::vec3 offset{ corner & 1 ? radius : -radius, corner & 2 ? radius : -radius, corner & 4 ? radius : -radius };
+			glm::vec4 clip = viewProjection * glm::vec4(center + offset, 1.f);
+			// crosses near plane, camera may be inside it
+			if (clip.z < 0.f || clip.w <= 0.f)
+			{
+				return true;
+			}
+			float invW = 1.f / clip.w;
+			float x = (clip.x * invW * 0.5f + 0.5f) * WIDTH;
+			float y = (clip.y * invW * 0.5f + 0.5f) * HEIGHT;
+			minX = std::min(minX, x);
+			maxX = std::max(maxX, x);
+			minY = std::min(minY, y);
+			maxY = std::max(maxY, y);
+			minDepth = std::min(minDepth, clip.z * invW);
+		}
+
+		int32_t x0 = std::max(static_cast<int32_t>(std::floor(minX)), 0);
+		int32_t x1 = std::min(static_cast<int32_t>(std::floor(maxX)), static_cast<int32_t>(WIDTH) - 1);
+		int32_t y0 = std::max(static_cast<int32_t>(std::floor(minY)), 0);
+		int32_t y1 = std::min(static_cast<int32_t>(std::floor(maxY)), static_cast<int32_t>(HEIGHT) - 1);
+		if (x0 > x1 || y0 > y1)
+		{
+			// off screen is frustum culler's job
+			return true;
+		}
+
+		// visible when any pixel of rect has nothing nearer. extra lanes around rect only make it more conservative
+		Float4 nearest = splat(minDepth);
+		for (int32_t y = y0; y <= y1; y++)
+		{
+			const float* row = &depth[y * WIDTH];
+			for (int32_t x = x0 & ~3; x <= x1; x += 4)
+			{
+				if (anyGreaterEqual(load4(row + x), nearest))
+				{
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	void OcclusionCuller::cull(const SphereBounds& bounds, std::vector<uint32_t>& visible)
+	{
+		if (occluderTriangles.empty() || visible.empty())
+		{
+			return;
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+		size_t count = visible.size();
+		hidden.resize(count);
+		auto testRange = [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+			{
+				uint32_t index = visible[i];
+				hidden[i] = !isVisible({ bounds.centerX[index], bounds.centerY[index], bounds.centerZ[index] }, bounds.radius[index]);
+			}
+		};
+		if (count < MIN_PARALLEL_TESTS)
+		{
+			testRange(0, count);
+		}
+		else
+		{
+			uint32_t jobs = std::min(pool.getThreadCount() * 4, static_cast<uint32_t>(count / (MIN_PARALLEL_TESTS / 4)));
+			size_t chunk = (count + jobs - 1) / jobs;
+			pool.parallelFor(jobs, [&](uint32_t job) {
+				testRange(std::min(count, job * chunk), std::min(count, (job + 1) * chunk));
+			});
+		}
+
+		size_t write = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			if (!hidden[i])
+			{
+				visible[write++] = visible[i];
+			}
+		}
+		visible.resize(write);
+
+		double elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		stats.tested += count;
+		stats.occluded += count - write;
+		stats.testMs += elapsed;
+		total.tested += count;
+		total.occluded += count - write;
+		total.testMs += elapsed;
+	}
+
+	void OcclusionCuller::printReport() const
+	{
+		if (frameCount == 0)
+		{
+			return;
+		}
+		double frames = static_cast<double>(frameCount);
+		double rate = total.tested > 0 ? 100.0 * total.occluded / total.tested : 0.0;
+		std::cout << "[occlusion] " << stats.occluderTriangles << " occluder triangles, " << total.rasterizedTriangles / frames << " rasterized, "
+			<< total.occluded / frames << " of " << total.tested / frames << " instances occluded (" << rate << "%), "
+			<< total.rasterMs / frames << " ms raster, " << total.testMs / frames << " ms test per frame" << std::endl;
+	}
+}
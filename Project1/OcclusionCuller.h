@@ -0,0 +1,94 @@
+#pragma once
+#define GLM_FORCE_RADIANS // not use degree;
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+
+#include <glm/glm.hpp>
+
+#include "FrustumCuller.h"
+#include "WorkerPool.h"
+
+#include <vector>
+#include <stdint.h>
+
+namespace jhb {
+	class Model;
+
+	// cpu occlusion culling without gpu readback latency. big static primitives are simplified once into occluder triangles,
+	// rasterized every frame into a small depth buffer in row bands on worker threads, then instance bounds are tested against it
+	// before any draw is recorded
+	class OcclusionCuller
+	{
+	public:
+		// width is multiple of 4 so every row is whole simd lanes
+		static constexpr uint32_t WIDTH = 256;
+		static constexpr uint32_t HEIGHT = 144;
+		static constexpr uint32_t BAND_HEIGHT = 16;
+		// corners of pixels are rasterized, WIDTH + 1 of them per row padded to whole lanes
+		static constexpr uint32_t CORNER_STRIDE = WIDTH + 4;
+		// world units, smaller primitives rarely hide anything
+		static constexpr float MIN_OCCLUDER_SIZE = 4.f;
+		static constexpr size_t MAX_OCCLUDER_TRIANGLES = 256;
+
+		struct Stats {
+			uint64_t occluderTriangles = 0;
+			uint64_t rasterizedTriangles = 0;
+			uint64_t tested = 0;
+			uint64_t occluded = 0;
+			double rasterMs = 0.0;
+			double testMs = 0.0;
+		};
+
+	public:
+		explicit OcclusionCuller(WorkerPool& pool);
+
+		OcclusionCuller(const OcclusionCuller&) = delete;
+		OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+		// picks occluders of a static single instance model, false when none is big enough
+		bool addOccluders(const Model& model);
+		// occluders would hide themselves
+		bool isOccluder(const Model* model) const;
+
+		// starts a frame, clears depth and rasterizes occluders seen from viewProjection
+		void render(const glm::mat4& viewProjection);
+		// removes indices whose sphere is behind occluders of this frame, order is kept
+		void cull(const SphereBounds& bounds, std::vector<uint32_t>& visible);
+
+		// last frame
+		const Stats& getStats() const { return stats; }
+		// average per frame over whole run
+		void printReport() const;
+
+	private:
+		// buffer space, pixel corners are at integers, counter clockwise after setup
+		struct ScreenTriangle {
+			float x[3], y[3], z[3];
+			int32_t minX, maxX, minY, maxY;
+		};
+
+		void clipTriangle(const glm::vec4* clip);
+		void setupTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+		void rasterizeBand(uint32_t firstRow, uint32_t endRow);
+		void resolveBand(uint32_t firstRow, uint32_t endRow);
+		bool isVisible(const glm::vec3& center, float radius) const;
+
+	private:
+		WorkerPool& pool;
+
+		std::vector<const Model*> occluderModels;
+		// world space, 3 per triangle
+		std::vector<glm::vec3> occluderTriangles;
+		std::vector<ScreenTriangle> screenTriangles;
+
+		// nearest occluder depth at every pixel corner, 1 is empty
+		std::vector<float> cornerDepth;
+		// farthest of 4 corners of every pixel, what instances are tested against
+		std::vector<float> depth;
+		glm::mat4 viewProjection{ 1.f };
+		std::vector<uint8_t> hidden;
+
+		Stats stats;
+		Stats total;
+		uint64_t frameCount = 0;
+	};
+}
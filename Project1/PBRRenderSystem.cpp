@@ -1,4 +1,5 @@
 #include "PBRRenderSystem.h"
+#include "CommandStats.h"
 #include "JHBApplication.h"
 #include "Model.h"
 #include "FrameInfo.h"
@@ -168,6 +169,7 @@ namespace jhb {
 		tinygltf::TinyGLTF gltfContext;
 		std::string error, warning;
 
+		gltfContext.SetImageLoader(Model::loadGLTFImageData, nullptr);
 		bool fileLoaded = gltfContext.LoadASCIIFromFile(&glTFInput, &error, &warning, filename);
 
 		size_t pos = filename.find_last_of('/');
@@ -233,7 +235,7 @@ namespace jhb {
 			if (kv.first == 1)
 			{
 				auto modelmat = kv.second.transform.mat4();
-				vkCmdPushConstants(frameInfo.commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &modelmat);
+				cmd::pushConstants(frameInfo.commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &modelmat);
 			}
 
 			obj.model->draw(frameInfo. commandBuffer, pipelineLayout, frameInfo.frameIndex);
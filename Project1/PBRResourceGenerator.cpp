@@ -1,4 +1,10 @@
 #include "PBRResourceGenerator.h"
+#include "AsyncComputeScheduler.h"
+#include <ktx.h>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
 
 jhb::PBRResourceGenerator::PBRResourceGenerator(Device& _device, const std::vector<VkDescriptorSetLayout>& globalSetLayOut, const std::vector<VkDescriptorSet>& _descSets)
 	: device(_device), descSetlayouts(globalSetLayOut), descSets(_descSets)
@@ -9,9 +15,44 @@ jhb::PBRResourceGenerator::PBRResourceGenerator(Device& _device, const std::vect
 
 jhb::PBRResourceGenerator::~PBRResourceGenerator()
 {
-	vkDestroyImage(device.getLogicalDevice(), preFilterCubeImg, nullptr);
-	vkDestroyImage(device.getLogicalDevice(), IrradianceCubeImg, nullptr);
-	vkDestroyImage(device.getLogicalDevice(), lutBrdfImg, nullptr);
+	if (preFilterCubeImg != VK_NULL_HANDLE)
+	{
+		vkDestroyImage(device.getLogicalDevice(), preFilterCubeImg, nullptr);
+		vkFreeMemory(device.getLogicalDevice(), preFilterCubeMemory, nullptr);
+	}
+	if (IrradianceCubeImg != VK_NULL_HANDLE)
+	{
+		vkDestroyImage(device.getLogicalDevice(), IrradianceCubeImg, nullptr);
+		vkFreeMemory(device.getLogicalDevice(), IrradianceCubeMemory, nullptr);
+	}
+	if (lutBrdfImg != VK_NULL_HANDLE)
+	{
+		vkDestroyImage(device.getLogicalDevice(), lutBrdfImg, nullptr);
+		vkFreeMemory(device.getLogicalDevice(), lutBrdfMemory, nullptr);
+	}
+
+	if (filterPipelinelayout != VK_NULL_HANDLE)
+	{
+		vkDestroyPipeline(device.getLogicalDevice(), irradiancePipeline, nullptr);
+		vkDestroyPipeline(device.getLogicalDevice(), prefilterPipeline, nullptr);
+		vkDestroyPipelineLayout(device.getLogicalDevice(), filterPipelinelayout, nullptr);
+	}
+	if (shPipelinelayout != VK_NULL_HANDLE)
+	{
+		vkDestroyPipeline(device.getLogicalDevice(), shPipeline, nullptr);
+		vkDestroyPipelineLayout(device.getLogicalDevice(), shPipelinelayout, nullptr);
+	}
+	if (backIrradianceCubeImg != VK_NULL_HANDLE)
+	{
+		vkDestroySampler(device.getLogicalDevice(), backIrradianceCubeSampler, nullptr);
+		vkDestroyImageView(device.getLogicalDevice(), backIrradianceCubeView, nullptr);
+		vkDestroyImage(device.getLogicalDevice(), backIrradianceCubeImg, nullptr);
+		vkFreeMemory(device.getLogicalDevice(), backIrradianceCubeMemory, nullptr);
+		vkDestroySampler(device.getLogicalDevice(), backPrefilterCubeSampler, nullptr);
+		vkDestroyImageView(device.getLogicalDevice(), backPrefilterCubeView, nullptr);
+		vkDestroyImage(device.getLogicalDevice(), backPrefilterCubeImg, nullptr);
+		vkFreeMemory(device.getLogicalDevice(), backPrefilterCubeMemory, nullptr);
+	}
 }
 
 
@@ -56,7 +97,7 @@ void jhb::PBRResourceGenerator::createCube()
 	std::shared_ptr<Model> cubeModel = std::make_unique<Model>(device);
 	cubeModel->createVertexBuffer(vertices);
 	cubeModel->createIndexBuffer(indices);
-	cubeModel->getTexture(0).loadKTXTexture(device, "Texture/pisa_cube.ktx", VK_IMAGE_VIEW_TYPE_CUBE, 6);
+	cubeModel->getTexture(0).loadKTXTexture(device, environmentPath, VK_IMAGE_VIEW_TYPE_CUBE, 6);
 	cube = std::make_unique<GameObject>(GameObject::createGameObject());
 	cube->model = cubeModel;
 	cube->transform.translation = { 0.f, 0.f, 0.f };
@@ -68,6 +109,252 @@ void jhb::PBRResourceGenerator::createPBRResource()
 	generateBRDFLUT();
 	generateIrradianceCube();
 	generatePrefilteredCube();
+	filterEnvironment();
+	projectIrradianceSH();
+}
+
+void jhb::PBRResourceGenerator::bakeBRDFLUT()
+{
+	bool prevUseCache = useCache;
+	useCache = false;
+	generateBRDFLUT();
+	useCache = prevUseCache;
+}
+
+uint64_t jhb::PBRResourceGenerator::hashBytes(const void* data, size_t size, uint64_t hash)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+uint64_t jhb::PBRResourceGenerator::hashFile(const std::string& path, uint64_t hash)
+{
+	std::error_code error;
+	uint64_t size = std::filesystem::file_size(path, error);
+	if (error)
+	{
+		throw std::runtime_error("failed to open file: " + path);
+	}
+	int64_t writeTime = static_cast<int64_t>(std::filesystem::last_write_time(path).time_since_epoch().count());
+
+	loadFileHashes();
+	auto found = fileHashes.find(path);
+	if (found == fileHashes.end() || found->second.size != size || found->second.writeTime != writeTime)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open())
+		{
+			throw std::runtime_error("failed to open file: " + path);
+		}
+		std::vector<char> buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		fileHashes[path] = { size, writeTime, hashBytes(buffer.data(), buffer.size()) };
+		saveFileHashes();
+		found = fileHashes.find(path);
+	}
+	return hashBytes(&found->second.hash, sizeof(found->second.hash), hash);
+}
+
+void jhb::PBRResourceGenerator::loadFileHashes()
+{
+	if (fileHashesLoaded)
+	{
+		return;
+	}
+	fileHashesLoaded = true;
+
+	// size, write time, hash, path per line
+	std::ifstream file(cacheDirectory + "/file_hashes.txt");
+	FileHash entry;
+	std::string path;
+	while (file >> entry.size >> entry.writeTime >> entry.hash && std::getline(file >> std::ws, path))
+	{
+		fileHashes[path] = entry;
+	}
+}
+
+void jhb::PBRResourceGenerator::saveFileHashes()
+{
+	std::filesystem::create_directories(cacheDirectory);
+	std::ofstream file(cacheDirectory + "/file_hashes.txt", std::ios::trunc);
+	for (auto& kv : fileHashes)
+	{
+		file << kv.second.size << " " << kv.second.writeTime << " " << kv.second.hash << " " << kv.first << "\n";
+	}
+}
+
+std::string jhb::PBRResourceGenerator::getCachePath(const std::string& name, uint64_t key)
+{
+	std::stringstream ss;
+	ss << cacheDirectory << "/" << name << "_" << std::hex << std::setw(16) << std::setfill('0') << key << ".ktx2";
+	return ss.str();
+}
+
+bool jhb::PBRResourceGenerator::loadCachedImage(const std::string& path, uint64_t key, VkImage image, VkFormat format, uint32_t dim, uint32_t numMips, uint32_t faceCount)
+{
+	if (!std::filesystem::exists(path))
+	{
+		return false;
+	}
+
+	ktxTexture2* texture;
+	if (ktxTexture2_CreateFromNamedFile(path.c_str(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &texture) != KTX_SUCCESS)
+	{
+		return false;
+	}
+
+	// stale or different generator settings, bake again
+	unsigned int keyLen = 0;
+	void* keyValue = nullptr;
+	bool valid = ktxHashList_FindValue(&texture->kvDataHead, "jhbCacheKey", &keyLen, &keyValue) == KTX_SUCCESS
+		&& keyLen == sizeof(uint64_t) && memcmp(keyValue, &key, sizeof(uint64_t)) == 0
+		&& texture->vkFormat == format && texture->baseWidth == dim && texture->baseHeight == dim
+		&& texture->numLevels == numMips && texture->numFaces == faceCount;
+	if (!valid)
+	{
+		ktxTexture_Destroy(ktxTexture(texture));
+		return false;
+	}
+
+	ktx_uint8_t* textureData = ktxTexture_GetData(ktxTexture(texture));
+	ktx_size_t textureSize = ktxTexture_GetDataSize(ktxTexture(texture));
+
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	device.createBuffer(textureSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+	void* data;
+	vkMapMemory(device.getLogicalDevice(), stagingBufferMemory, 0, textureSize, 0, &data);
+	memcpy(data, textureData, textureSize);
+	vkUnmapMemory(device.getLogicalDevice(), stagingBufferMemory);
+
+	std::vector<VkBufferImageCopy> bufferCopyRegions;
+	for (uint32_t face = 0; face < faceCount; face++)
+	{
+		for (uint32_t level = 0; level < numMips; level++)
+		{
+			ktx_size_t offset;
+			ktxTexture_GetImageOffset(ktxTexture(texture), level, 0, face, &offset);
+
+			VkBufferImageCopy bufferCopyRegion = {};
+			bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			bufferCopyRegion.imageSubresource.mipLevel = level;
+			bufferCopyRegion.imageSubresource.baseArrayLayer = face;
+			bufferCopyRegion.imageSubresource.layerCount = 1;
+			bufferCopyRegion.imageExtent.width = dim >> level;
+			bufferCopyRegion.imageExtent.height = dim >> level;
+			bufferCopyRegion.imageExtent.depth = 1;
+			bufferCopyRegion.bufferOffset = offset;
+			bufferCopyRegions.push_back(bufferCopyRegion);
+		}
+	}
+
+	VkImageSubresourceRange subresourceRange = {};
+	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	subresourceRange.baseMipLevel = 0;
+	subresourceRange.levelCount = numMips;
+	subresourceRange.layerCount = faceCount;
+
+	VkCommandBuffer cmd = device.beginSingleTimeCommands();
+	device.transitionImageLayout(cmd, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
+	vkCmdCopyBufferToImage(cmd, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(bufferCopyRegions.size()), bufferCopyRegions.data());
+	device.transitionImageLayout(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
+	device.endSingleTimeCommands(cmd);
+
+	vkDestroyBuffer(device.getLogicalDevice(), stagingBuffer, nullptr);
+	vkFreeMemory(device.getLogicalDevice(), stagingBufferMemory, nullptr);
+	ktxTexture_Destroy(ktxTexture(texture));
+
+	std::cout << "[ibl cache] loaded " << path << std::endl;
+	return true;
+}
+
+void jhb::PBRResourceGenerator::saveCachedImage(const std::string& path, uint64_t key, VkImage image, VkFormat format, uint32_t dim, uint32_t numMips, uint32_t faceCount)
+{
+	ktxTextureCreateInfo createInfo{};
+	createInfo.vkFormat = format;
+	createInfo.baseWidth = dim;
+	createInfo.baseHeight = dim;
+	createInfo.baseDepth = 1;
+	createInfo.numDimensions = 2;
+	createInfo.numLevels = numMips;
+	createInfo.numLayers = 1;
+	createInfo.numFaces = faceCount;
+	createInfo.isArray = KTX_FALSE;
+	createInfo.generateMipmaps = KTX_FALSE;
+
+	ktxTexture2* texture;
+	if (ktxTexture2_Create(&createInfo, KTX_TEXTURE_CREATE_ALLOC_STORAGE, &texture) != KTX_SUCCESS)
+	{
+		throw std::runtime_error("failed to create ktx2 texture!");
+	}
+
+	// read back every face and mip directly into ktx layout
+	ktx_size_t textureSize = ktxTexture_GetDataSize(ktxTexture(texture));
+	std::vector<VkBufferImageCopy> bufferCopyRegions;
+	for (uint32_t face = 0; face < faceCount; face++)
+	{
+		for (uint32_t level = 0; level < numMips; level++)
+		{
+			ktx_size_t offset;
+			ktxTexture_GetImageOffset(ktxTexture(texture), level, 0, face, &offset);
+
+			VkBufferImageCopy bufferCopyRegion = {};
+			bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			bufferCopyRegion.imageSubresource.mipLevel = level;
+			bufferCopyRegion.imageSubresource.baseArrayLayer = face;
+			bufferCopyRegion.imageSubresource.layerCount = 1;
+			bufferCopyRegion.imageExtent.width = dim >> level;
+			bufferCopyRegion.imageExtent.height = dim >> level;
+			bufferCopyRegion.imageExtent.depth = 1;
+			bufferCopyRegion.bufferOffset = offset;
+			bufferCopyRegions.push_back(bufferCopyRegion);
+		}
+	}
+
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	device.createBuffer(textureSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+	VkImageSubresourceRange subresourceRange = {};
+	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	subresourceRange.baseMipLevel = 0;
+	subresourceRange.levelCount = numMips;
+	subresourceRange.layerCount = faceCount;
+
+	VkCommandBuffer cmd = device.beginSingleTimeCommands();
+	device.transitionImageLayout(cmd, image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, subresourceRange);
+	vkCmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, stagingBuffer, static_cast<uint32_t>(bufferCopyRegions.size()), bufferCopyRegions.data());
+	device.transitionImageLayout(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
+	device.endSingleTimeCommands(cmd);
+
+	void* data;
+	vkMapMemory(device.getLogicalDevice(), stagingBufferMemory, 0, textureSize, 0, &data);
+	memcpy(ktxTexture_GetData(ktxTexture(texture)), data, textureSize);
+	vkUnmapMemory(device.getLogicalDevice(), stagingBufferMemory);
+	vkDestroyBuffer(device.getLogicalDevice(), stagingBuffer, nullptr);
+	vkFreeMemory(device.getLogicalDevice(), stagingBufferMemory, nullptr);
+
+	ktxHashList_AddKVPair(&texture->kvDataHead, "jhbCacheKey", sizeof(uint64_t), &key);
+
+	std::filesystem::path parent = std::filesystem::path(path).parent_path();
+	if (!parent.empty())
+	{
+		std::filesystem::create_directories(parent);
+	}
+	if (ktxTexture_WriteToNamedFile(ktxTexture(texture), path.c_str()) != KTX_SUCCESS)
+	{
+		std::cerr << "[ibl cache] failed to write " << path << std::endl;
+	}
+	else
+	{
+		std::cout << "[ibl cache] baked " << path << std::endl;
+	}
+	ktxTexture_Destroy(ktxTexture(texture));
 }
 
 void jhb::PBRResourceGenerator::generateBRDFLUT()
@@ -117,7 +404,7 @@ void jhb::PBRResourceGenerator::generateBRDFLUT()
 	imageCIa.arrayLayers = 1;
 	imageCIa.samples = VK_SAMPLE_COUNT_1_BIT;
 	imageCIa.tiling = VK_IMAGE_TILING_OPTIMAL;
-	imageCIa.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageCIa.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 
 	device.createImageWithInfo(imageCIa, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, lutBrdfImg, lutBrdfMemory);
 	// Image view
@@ -152,6 +439,16 @@ void jhb::PBRResourceGenerator::generateBRDFLUT()
 		throw std::runtime_error("failed to create Sampler!");
 	}
 
+	// lut depends only on generator settings, not on environment map
+	uint64_t cacheKey = hashBytes(&format, sizeof(format));
+	cacheKey = hashBytes(&dim, sizeof(dim), cacheKey);
+	cacheKey = hashFile("shaders/genbrdflut.vert.spv", cacheKey);
+	cacheKey = hashFile("shaders/genbrdflut.frag.spv", cacheKey);
+	if (useCache && loadCachedImage(brdfLutCachePath, cacheKey, lutBrdfImg, format, dim, 1, 1))
+	{
+		return;
+	}
+
 	std::vector<VkImageView> attachments = { lutBrdfView };
 
 
@@ -278,89 +575,42 @@ void jhb::PBRResourceGenerator::generateBRDFLUT()
 	vkCmdEndRenderPass(cmd);
 
 	device.endSingleTimeCommands(cmd);
+
+	saveCachedImage(brdfLutCachePath, cacheKey, lutBrdfImg, format, dim, 1, 1);
 }
 
-void jhb::PBRResourceGenerator::generateIrradianceCube()
+void jhb::PBRResourceGenerator::createCubeTarget(VkFormat format, uint32_t dim, uint32_t numMips, VkImage& image, VkDeviceMemory& memory, VkImageView& view, VkSampler& sampler)
 {
-	const VkFormat format = VK_FORMAT_R32G32B32A32_SFLOAT;
-	const int32_t dim = 64;
-	const uint32_t numMips = static_cast<uint32_t>(floor(log2(dim))) + 1;
-
-	std::vector<VkSubpassDependency> tmpdependencies(2);
-	tmpdependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-	tmpdependencies[0].dstSubpass = 0;
-	tmpdependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	tmpdependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	tmpdependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-	tmpdependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	tmpdependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-	tmpdependencies[1].srcSubpass = 0;
-	tmpdependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-	tmpdependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	tmpdependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	tmpdependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	tmpdependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-	tmpdependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-	IrradiencePushBlock pushBlock;
-
-	std::vector<VkPushConstantRange> pushConstantRanges;
-	VkPushConstantRange pushConstantRange{};
-	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT; // This means that both vertex and fragment shader using constant 
-	pushConstantRange.offset = 0;
-	pushConstantRange.size = sizeof(IrradiencePushBlock);
-	pushConstantRanges.push_back(pushConstantRange);
-
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = descSetlayouts.size();
-	pipelineLayoutInfo.pSetLayouts = descSetlayouts.data();
-	pipelineLayoutInfo.pushConstantRangeCount = pushConstantRanges.size();
-	pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.data();
-
-	if (vkCreatePipelineLayout(device.getLogicalDevice(), &pipelineLayoutInfo, nullptr, &irradiancePipelinelayout) != VK_SUCCESS)
-	{
-		throw std::runtime_error("failed to create pipeline layout!");
-	}
-
-	VkImage cubeImage;
-	VkDeviceMemory cubeMemory;
-	VkImageView cubeImageView;
-	VkSampler cubeSampler;
-
-	// Pre-filtered cube map
-	// Image
-	VkImageCreateInfo imageCIa{};
-	imageCIa.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-	imageCIa.imageType = VK_IMAGE_TYPE_2D;
-	imageCIa.format = format;
-	imageCIa.extent.width = dim;
-	imageCIa.extent.height = dim;
-	imageCIa.extent.depth = 1;
-	imageCIa.mipLevels = numMips;
-	imageCIa.arrayLayers = 6;
-	imageCIa.samples = VK_SAMPLE_COUNT_1_BIT;
-	imageCIa.tiling = VK_IMAGE_TILING_OPTIMAL;
-	imageCIa.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-	imageCIa.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+	VkImageCreateInfo imageCI{};
+	imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCI.imageType = VK_IMAGE_TYPE_2D;
+	imageCI.format = format;
+	imageCI.extent.width = dim;
+	imageCI.extent.height = dim;
+	imageCI.extent.depth = 1;
+	imageCI.mipLevels = numMips;
+	imageCI.arrayLayers = 6;
+	imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+	// storage for compute filtering, transfer for disk cache
+	imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	imageCI.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+	device.createImageWithInfo(imageCI, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, memory);
 
-	device.createImageWithInfo(imageCIa, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, IrradianceCubeImg, IrradianceCubeMemory);
-	// Image view
-	VkImageViewCreateInfo viewCIa{};
-	viewCIa.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-	viewCIa.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
-	viewCIa.format = format;
-	viewCIa.subresourceRange = {};
-	viewCIa.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	viewCIa.subresourceRange.levelCount = numMips;
-	viewCIa.subresourceRange.layerCount = 6;
-	viewCIa.image = IrradianceCubeImg;
-	if (vkCreateImageView(device.getLogicalDevice(), &viewCIa, nullptr, &IrradianceCubeImgView))
+	VkImageViewCreateInfo viewCI{};
+	viewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewCI.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
+	viewCI.format = format;
+	viewCI.subresourceRange = {};
+	viewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewCI.subresourceRange.levelCount = numMips;
+	viewCI.subresourceRange.layerCount = 6;
+	viewCI.image = image;
+	if (vkCreateImageView(device.getLogicalDevice(), &viewCI, nullptr, &view))
 	{
 		throw std::runtime_error("failed to create ImageView!");
 	}
 
-	// Sampler
 	VkSamplerCreateInfo samplerCI{};
 	samplerCI.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
 	samplerCI.magFilter = VK_FILTER_LINEAR;
@@ -372,601 +622,460 @@ void jhb::PBRResourceGenerator::generateIrradianceCube()
 	samplerCI.minLod = 0.0f;
 	samplerCI.maxLod = static_cast<float>(numMips);
 	samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-	if (vkCreateSampler(device.getLogicalDevice(), &samplerCI, nullptr, &IrradianceCubeSampler))
+	if (vkCreateSampler(device.getLogicalDevice(), &samplerCI, nullptr, &sampler))
 	{
 		throw std::runtime_error("failed to create Sampler!");
 	}
+}
 
-	// offscreen cube for hdr cube textre 2d
-	VkImage offscreenImage;
-	VkDeviceMemory offscreenMemory;
-	VkImageView offscreenImageView;
+void jhb::PBRResourceGenerator::generateIrradianceCube()
+{
+	createCubeTarget(irradianceFormat, irradianceDim, getIrradianceMips(), IrradianceCubeImg, IrradianceCubeMemory, IrradianceCubeImgView, IrradianceCubeSampler);
+}
 
-	VkFramebuffer frameBuffer;
-	VkRenderPass renderpass;
-	{
-		// Pre-filtered cube map
-		// Image
-		VkImageCreateInfo imageCI{};
-		imageCI.imageType = VK_IMAGE_TYPE_2D;
-		imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-		imageCI.format = format;
-		imageCI.extent.width = dim;
-		imageCI.extent.height = dim;
-		imageCI.extent.depth = 1;
-		imageCI.mipLevels = 1;
-		imageCI.arrayLayers = 6;
-		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
-		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-		imageCI.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
-		device.createImageWithInfo(imageCI, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, offscreenImage, offscreenMemory);
-		// Image view
-		VkImageViewCreateInfo viewCI{};
-		viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		viewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-		viewCI.format = format;
-		viewCI.subresourceRange = {};
-		viewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		viewCI.subresourceRange.levelCount = 1;
-		viewCI.subresourceRange.layerCount = 1;
-		viewCI.image = offscreenImage;
-		if (vkCreateImageView(device.getLogicalDevice(), &viewCI, nullptr, &offscreenImageView))
-		{
-			throw std::runtime_error("failed to create ImageView!");
-		}
+void jhb::PBRResourceGenerator::generatePrefilteredCube()
+{
+	createCubeTarget(prefilterFormat, prefilterDim, getPrefilterMips(), preFilterCubeImg, preFilterCubeMemory, preFilterCubeImgView, preFilterCubeSampler);
+}
 
-		VkAttachmentDescription attDesc = {};
-		// Color attachment
-		attDesc.format = format;
-		attDesc.samples = VK_SAMPLE_COUNT_1_BIT;
-		attDesc.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		attDesc.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-		attDesc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-		attDesc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		attDesc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		attDesc.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-		VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
-
-		VkSubpassDescription subpassDescription = {};
-		subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-		subpassDescription.colorAttachmentCount = 1;
-		subpassDescription.pColorAttachments = &colorReference;
-
-		// Renderpass
-		VkRenderPassCreateInfo renderPassCI{};
-		renderPassCI.attachmentCount = 1;
-		renderPassCI.pAttachments = &attDesc;
-		renderPassCI.subpassCount = 1;
-		renderPassCI.pSubpasses = &subpassDescription;
-		renderPassCI.dependencyCount = 2;
-		renderPassCI.pDependencies = tmpdependencies.data();
-		renderPassCI.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-
-		if (vkCreateRenderPass(device.getLogicalDevice(), &renderPassCI, nullptr, &renderpass))
-		{
-			throw std::runtime_error("failed to create renderpass!");
-		}
+uint64_t jhb::PBRResourceGenerator::getIrradianceCacheKey()
+{
+	IrradiencePushBlock pushBlock;
+	uint64_t cacheKey = hashFile(environmentPath, hashBytes(&irradianceFormat, sizeof(irradianceFormat)));
+	cacheKey = hashBytes(&irradianceDim, sizeof(irradianceDim), cacheKey);
+	cacheKey = hashBytes(&pushBlock.deltaPhi, sizeof(pushBlock.deltaPhi), cacheKey);
+	cacheKey = hashBytes(&pushBlock.deltaTheta, sizeof(pushBlock.deltaTheta), cacheKey);
+	return hashFile("shaders/irradiancecube.comp.spv", cacheKey);
+}
 
-		std::vector<VkImageView> attachments = { offscreenImageView };
+uint64_t jhb::PBRResourceGenerator::getPrefilterCacheKey()
+{
+	PrefileterPushBlock pushBlock;
+	uint64_t cacheKey = hashFile(environmentPath, hashBytes(&prefilterFormat, sizeof(prefilterFormat)));
+	cacheKey = hashBytes(&prefilterDim, sizeof(prefilterDim), cacheKey);
+	cacheKey = hashBytes(&pushBlock.numSamples, sizeof(pushBlock.numSamples), cacheKey);
+	return hashFile("shaders/prefilterenvmap.comp.spv", cacheKey);
+}
 
-		VkFramebufferCreateInfo fbufCreateInfo{};
-		fbufCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		fbufCreateInfo.renderPass = renderpass;
-		fbufCreateInfo.attachmentCount = attachments.size();
-		fbufCreateInfo.pAttachments = attachments.data();
-		fbufCreateInfo.width = dim;
-		fbufCreateInfo.height = dim;
-		fbufCreateInfo.layers = 1;
+void jhb::PBRResourceGenerator::createFilterPipelines()
+{
+	filterDescriptorSetLayout = DescriptorSetLayout::Builder(device)
+		.addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT)
+		.build();
 
-		if (vkCreateFramebuffer(device.getLogicalDevice(), &fbufCreateInfo, nullptr, &frameBuffer))
-		{
-			throw std::runtime_error("failed to create frameBuffer!");
-		}
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(FilterPushBlock);
 
-		VkCommandBuffer cmd = device.beginSingleTimeCommands();
-		device.transitionImageLayout(cmd, offscreenImage, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-		device.endSingleTimeCommands(cmd);
+	VkDescriptorSetLayout setLayout = filterDescriptorSetLayout->getDescriptorSetLayout();
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &setLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+	if (vkCreatePipelineLayout(device.getLogicalDevice(), &pipelineLayoutInfo, nullptr, &filterPipelinelayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create pipeline layout!");
 	}
 
-	assert(irradiancePipelinelayout != nullptr && "Cannot Create pipeline before pipeline layout!!");
-
-	PipelineConfigInfo pipelineConfig{};
-	pipelineConfig.depthStencilInfo.depthTestEnable = true;
-	pipelineConfig.depthStencilInfo.depthWriteEnable = true;
-	pipelineConfig.attributeDescriptions = jhb::Vertex::getAttrivuteDescriptions();
-	pipelineConfig.bindingDescriptions = jhb::Vertex::getBindingDescriptions();
-
-	Pipeline::defaultPipelineConfigInfo(pipelineConfig);
-	pipelineConfig.renderPass = renderpass;
-	pipelineConfig.pipelineLayout = irradiancePipelinelayout;
-	irradiancePipeline = std::make_unique<Pipeline>(
-		device,
-		"shaders/filtercube.vert.spv",
-		"shaders/irradiancecube.frag.spv",
-		pipelineConfig);
-
-	VkRenderPassBeginInfo renderPassInfo{};
-	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderPassInfo.renderPass = renderpass;
-	renderPassInfo.framebuffer = frameBuffer;
-
-	renderPassInfo.renderArea.offset = { 0, 0 };
-	renderPassInfo.renderArea.extent = { dim, dim };
-
-	std::array<VkClearValue, 2> clearValues{};
-	clearValues[0].color = { 0.01f, 0.1f, 0.1f, 1.0f };
-	clearValues[1].depthStencil = { 1.0f, 0 };
-	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-	renderPassInfo.pClearValues = clearValues.data();
-
-	std::vector<glm::mat4> matrices = {
-		// POSITIVE_X
-		glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f)), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-		// NEGATIVE_X
-		glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f)), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-		// POSITIVE_Y
-		glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-		// NEGATIVE_Y
-		glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-		// POSITIVE_Z
-		glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-		// NEGATIVE_Z
-		glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
-	};
-
-	VkImageSubresourceRange subresourceRange = {};
-	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	subresourceRange.baseMipLevel = 0;
-	subresourceRange.levelCount = numMips;
-	subresourceRange.layerCount = 6;
+	createComputePipeline("shaders/irradiancecube.comp.spv", filterPipelinelayout, irradiancePipeline);
+	createComputePipeline("shaders/prefilterenvmap.comp.spv", filterPipelinelayout, prefilterPipeline);
+}
 
-	auto cmdBuf = device.beginSingleTimeCommands();
-	VkViewport viewport{};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = static_cast<float>(dim);
-	viewport.height = static_cast<float>(dim);
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-	VkRect2D scissor{ {0, 0}, {(uint32_t)dim, (uint32_t)dim} };
-	vkCmdSetViewport(cmdBuf, 0, 1, &viewport);
-	vkCmdSetScissor(cmdBuf, 0, 1, &scissor);
-
-
-	device.transitionImageLayout(cmdBuf, IrradianceCubeImg, VK_IMAGE_LAYOUT_UNDEFINED,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
-
-	for (uint32_t m = 0; m < numMips; m++) {
-		for (uint32_t f = 0; f < 6; f++) {
-			viewport.width = static_cast<float>(dim * std::pow(0.5f, m));
-			viewport.height = static_cast<float>(dim * std::pow(0.5f, m));
-			vkCmdSetViewport(cmdBuf, 0, 1, &viewport);
-
-			// Render scene from cube face's point of view
-			vkCmdBeginRenderPass(cmdBuf, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-			// Update shader push constant block
-			pushBlock.mvp = glm::perspective((float)(M_PI / 2.0), 1.0f, 0.1f, 512.0f) * matrices[f];
-
-			/*irradianceCubeGenerator.bindPipeline(cmdBuf);
-			irradianceCubeGenerator.generateIrradianceCube(cmdBuf, gameObjects[0], descSets, pushBlock);*/
-
-			irradiancePipeline->bind(cmdBuf);
-
-			vkCmdBindDescriptorSets(
-				cmdBuf,
-				VK_PIPELINE_BIND_POINT_GRAPHICS,
-				irradiancePipelinelayout,
-				0, 1
-				, &descSets[0],
-				0, nullptr
-			);
-
-			vkCmdBindDescriptorSets(
-				cmdBuf,
-				VK_PIPELINE_BIND_POINT_GRAPHICS,
-				irradiancePipelinelayout,
-				1, 1
-				, &descSets[1],
-				0, nullptr
-			);
-
-			vkCmdPushConstants(cmdBuf, irradiancePipelinelayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(IrradiencePushBlock), &pushBlock);
-			cube->model->bind(cmdBuf);
-			cube->model->draw(cmdBuf, irradiancePipelinelayout, 0);
-			
-			vkCmdEndRenderPass(cmdBuf);
-
-			device.transitionImageLayout(
-				cmdBuf, offscreenImage, VK_IMAGE_ASPECT_COLOR_BIT,
-				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-
-			// Copy region for transfer from framebuffer to cube face
-			VkImageCopy copyRegion = {};
-
-			copyRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			copyRegion.srcSubresource.baseArrayLayer = 0;
-			copyRegion.srcSubresource.mipLevel = 0;
-			copyRegion.srcSubresource.layerCount = 1;
-			copyRegion.srcOffset = { 0, 0, 0 };
-
-			copyRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			copyRegion.dstSubresource.baseArrayLayer = f;
-			copyRegion.dstSubresource.mipLevel = m;
-			copyRegion.dstSubresource.layerCount = 1;
-			copyRegion.dstOffset = { 0, 0, 0 };
-
-			copyRegion.extent.width = static_cast<uint32_t>(viewport.width);
-			copyRegion.extent.height = static_cast<uint32_t>(viewport.height);
-			copyRegion.extent.depth = 1;
-
-			vkCmdCopyImage(
-				cmdBuf,
-				offscreenImage,
-				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				IrradianceCubeImg,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				1,
-				&copyRegion);
-
-			// Transform framebuffer color attachment back
-
-			device.transitionImageLayout(
-				cmdBuf, offscreenImage, VK_IMAGE_ASPECT_COLOR_BIT,
-				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
-			);
-		}
+void jhb::PBRResourceGenerator::createComputePipeline(const std::string& path, VkPipelineLayout layout, VkPipeline& pipeline)
+{
+	auto code = Pipeline::readFile(path);
+	VkShaderModuleCreateInfo moduleCI{};
+	moduleCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	moduleCI.codeSize = code.size();
+	moduleCI.pCode = reinterpret_cast<const uint32_t*>(code.data());
+	VkShaderModule shaderModule;
+	if (vkCreateShaderModule(device.getLogicalDevice(), &moduleCI, nullptr, &shaderModule) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create shader module");
 	}
 
-	device.transitionImageLayout(
-		cmdBuf, IrradianceCubeImg,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange
-	);
-	device.endSingleTimeCommands(cmdBuf);
+	VkComputePipelineCreateInfo pipelineCI{};
+	pipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineCI.layout = layout;
+	pipelineCI.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineCI.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineCI.stage.module = shaderModule;
+	pipelineCI.stage.pName = "main";
+	if (vkCreateComputePipelines(device.getLogicalDevice(), VK_NULL_HANDLE, 1, &pipelineCI, nullptr, &pipeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create compute pipeline!");
+	}
+	vkDestroyShaderModule(device.getLogicalDevice(), shaderModule, nullptr);
 }
 
-void jhb::PBRResourceGenerator::generatePrefilteredCube()
+void jhb::PBRResourceGenerator::createSHPipeline()
 {
-	std::vector<VkPushConstantRange> pushConstantRanges;
-	VkPushConstantRange pushConstantRange{};
-	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT; // This means that both vertex and fragment shader using constant 
-	pushConstantRange.offset = 0;
-	pushConstantRange.size = sizeof(PrefileterPushBlock);
-	pushConstantRanges.push_back(pushConstantRange);
+	shDescriptorSetLayout = DescriptorSetLayout::Builder(device)
+		.addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.build();
 
+	VkDescriptorSetLayout setLayout = shDescriptorSetLayout->getDescriptorSetLayout();
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = descSetlayouts.size();
-	pipelineLayoutInfo.pSetLayouts = descSetlayouts.data();
-
-	pipelineLayoutInfo.pushConstantRangeCount = pushConstantRanges.size();
-	pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.data();
-	if (vkCreatePipelineLayout(device.getLogicalDevice(), &pipelineLayoutInfo, nullptr, &prefilterPipelinelayout) != VK_SUCCESS)
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &setLayout;
+	if (vkCreatePipelineLayout(device.getLogicalDevice(), &pipelineLayoutInfo, nullptr, &shPipelinelayout) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create pipeline layout!");
 	}
+	createComputePipeline("shaders/shirradiance.comp.spv", shPipelinelayout, shPipeline);
 
+	// host visible, 9 coefficients are read back once per environment
+	shBuffer = std::make_unique<Buffer>(device, sizeof(glm::vec4), 9, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	shBuffer->map();
+}
 
-	const VkFormat format = VK_FORMAT_R16G16B16A16_SFLOAT;
-	const int32_t dim = 512;
-	const uint32_t numMips = static_cast<uint32_t>(floor(log2(dim))) + 1;
+void jhb::PBRResourceGenerator::projectIrradianceSH()
+{
+	if (shPipelinelayout == VK_NULL_HANDLE)
+	{
+		createSHPipeline();
+	}
 
-	std::vector<VkSubpassDependency> tmpdependencies(2);
-	tmpdependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-	tmpdependencies[0].dstSubpass = 0;
-	tmpdependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	tmpdependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	tmpdependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-	tmpdependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	tmpdependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-	tmpdependencies[1].srcSubpass = 0;
-	tmpdependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-	tmpdependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	tmpdependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	tmpdependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	tmpdependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-	tmpdependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+	auto descriptorPool = DescriptorPool::Builder(device).setMaxSets(1)
+		.addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1)
+		.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1).build();
 
-	PrefileterPushBlock pushBlock;
+	VkDescriptorImageInfo envImageInfo = cube->model->getTexture(0).descriptor;
+	VkDescriptorBufferInfo bufferInfo = shBuffer->descriptorInfo();
+	VkDescriptorSet descriptorSet;
+	DescriptorWriter(*shDescriptorSetLayout, *descriptorPool).writeImage(0, &envImageInfo).writeBuffer(1, &bufferInfo).build(descriptorSet);
 
-	VkImage cubeImage;
-	VkDeviceMemory cubeMemory;
-	VkImageView cubeImageView;
-	VkSampler cubeSampler;
+	VkCommandBuffer cmd = device.beginSingleTimeCommands();
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, shPipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, shPipelinelayout, 0, 1, &descriptorSet, 0, nullptr);
+	vkCmdDispatch(cmd, 1, 1, 1);
+
+	VkMemoryBarrier memoryBarrier{};
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	device.endSingleTimeCommands(cmd);
 
-	// Pre-filtered cube map
-	// Image
-	VkImageCreateInfo imageCIa{};
-	imageCIa.imageType = VK_IMAGE_TYPE_2D;
-	imageCIa.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-	imageCIa.format = format;
-	imageCIa.extent.width = dim;
-	imageCIa.extent.height = dim;
-	imageCIa.extent.depth = 1;
-	imageCIa.mipLevels = numMips;
-	imageCIa.arrayLayers = 6;
-	imageCIa.samples = VK_SAMPLE_COUNT_1_BIT;
-	imageCIa.tiling = VK_IMAGE_TILING_OPTIMAL;
-	imageCIa.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-	imageCIa.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
-	device.createImageWithInfo(imageCIa, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, preFilterCubeImg, preFilterCubeMemory);
-	// Image view
-	VkImageViewCreateInfo viewCIa{};
-	viewCIa.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
-	viewCIa.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-	viewCIa.format = format;
-	viewCIa.subresourceRange = {};
-	viewCIa.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	viewCIa.subresourceRange.levelCount = numMips;
-	viewCIa.subresourceRange.layerCount = 6;
-	viewCIa.image = preFilterCubeImg;
-	if (vkCreateImageView(device.getLogicalDevice(), &viewCIa, nullptr, &preFilterCubeImgView))
+	memcpy(irradianceSH.data(), shBuffer->getMappedMemory(), sizeof(glm::vec4) * irradianceSH.size());
+}
+
+void jhb::PBRResourceGenerator::filterEnvironment()
+{
+	const uint64_t irradianceKey = getIrradianceCacheKey();
+	const uint64_t prefilterKey = getPrefilterCacheKey();
+	const std::string irradiancePath = getCachePath("irradiance", irradianceKey);
+	const std::string prefilterPath = getCachePath("prefilter", prefilterKey);
+
+	bool bakeIrradiance = !(useCache && loadCachedImage(irradiancePath, irradianceKey, IrradianceCubeImg, irradianceFormat, irradianceDim, getIrradianceMips(), 6));
+	bool bakePrefilter = !(useCache && loadCachedImage(prefilterPath, prefilterKey, preFilterCubeImg, prefilterFormat, prefilterDim, getPrefilterMips(), 6));
+	if (!bakeIrradiance && !bakePrefilter)
 	{
-		throw std::runtime_error("failed to create ImageView!");
+		return;
 	}
 
-	// Sampler
-	VkSamplerCreateInfo samplerCI{};
-	samplerCI.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-	samplerCI.magFilter = VK_FILTER_LINEAR;
-	samplerCI.minFilter = VK_FILTER_LINEAR;
-	samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-	samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-	samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-	samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-	samplerCI.minLod = 0.0f;
-	samplerCI.maxLod = static_cast<float>(numMips);
-	samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-	if (vkCreateSampler(device.getLogicalDevice(), &samplerCI, nullptr, &preFilterCubeSampler))
+	if (filterPipelinelayout == VK_NULL_HANDLE)
 	{
-		throw std::runtime_error("failed to create Sampler!");
+		createFilterPipelines();
 	}
 
-	// offscreen cube for hdr cube textre 2d
-	VkImage offscreenImage;
-	VkDeviceMemory offscreenMemory;
-	VkImageView offscreenImageView;
-
-	// Pre-filtered cube map
-	// Image
-	VkImageCreateInfo imageCI{};
-	imageCI.imageType = VK_IMAGE_TYPE_2D;
-	imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-	imageCI.format = format;
-	imageCI.extent.width = dim;
-	imageCI.extent.height = dim;
-	imageCI.extent.depth = 1;
-	imageCI.mipLevels = 1;
-	imageCI.arrayLayers = 1;
-	imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
-	imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-	imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-	device.createImageWithInfo(imageCI, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, offscreenImage, offscreenMemory);
-	// Image view
-	VkImageViewCreateInfo viewCI{};
-	viewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-	viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
-	viewCI.format = format;
-	viewCI.subresourceRange = {};
-	viewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	viewCI.subresourceRange.levelCount = 1;
-	viewCI.subresourceRange.layerCount = 1;
-	viewCI.image = offscreenImage;
-	if (vkCreateImageView(device.getLogicalDevice(), &viewCI, nullptr, &offscreenImageView))
+	struct FilterJob {
+		bool irradiance;
+		VkPipeline pipeline;
+		VkImage image;
+		VkFormat format;
+		uint32_t dim;
+		uint32_t numMips;
+	};
+	std::vector<FilterJob> jobs;
+	if (bakeIrradiance)
 	{
-		throw std::runtime_error("failed to create ImageView!");
+		jobs.push_back({ true, irradiancePipeline, IrradianceCubeImg, irradianceFormat, irradianceDim, getIrradianceMips() });
+	}
+	if (bakePrefilter)
+	{
+		jobs.push_back({ false, prefilterPipeline, preFilterCubeImg, prefilterFormat, prefilterDim, getPrefilterMips() });
 	}
 
-	VkAttachmentDescription attDesc = {};
-	// Color attachment
-	attDesc.format = format;
-	attDesc.samples = VK_SAMPLE_COUNT_1_BIT;
-	attDesc.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	attDesc.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	attDesc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	attDesc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	attDesc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	attDesc.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-	VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
-
-	VkSubpassDescription subpassDescription = {};
-	subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-	subpassDescription.colorAttachmentCount = 1;
-	subpassDescription.pColorAttachments = &colorReference;
-
-	// Renderpass
-	VkRenderPassCreateInfo renderPassCI{};
-	renderPassCI.attachmentCount = 1;
-	renderPassCI.pAttachments = &attDesc;
-	renderPassCI.subpassCount = 1;
-	renderPassCI.pSubpasses = &subpassDescription;
-	renderPassCI.dependencyCount = 2;
-	renderPassCI.pDependencies = tmpdependencies.data();
-	renderPassCI.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	VkRenderPass renderpass;
-	if (vkCreateRenderPass(device.getLogicalDevice(), &renderPassCI, nullptr, &renderpass))
+	uint32_t totalMips = 0;
+	for (auto& job : jobs)
 	{
-		throw std::runtime_error("failed to create renderpass!");
+		totalMips += job.numMips;
 	}
 
-	std::vector<VkImageView> attachments = { offscreenImageView };
+	auto descriptorPool = DescriptorPool::Builder(device).setMaxSets(totalMips)
+		.addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, totalMips)
+		.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, totalMips).build();
 
-	VkFramebufferCreateInfo fbufCreateInfo{};
-	fbufCreateInfo.renderPass = renderpass;
-	fbufCreateInfo.attachmentCount = attachments.size();
-	fbufCreateInfo.pAttachments = attachments.data();
-	fbufCreateInfo.width = dim;
-	fbufCreateInfo.height = dim;
-	fbufCreateInfo.layers = 1;
-	fbufCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	VkDescriptorImageInfo envImageInfo = cube->model->getTexture(0).descriptor;
+	std::vector<VkImageView> mipViews;
 
-	VkFramebuffer frameBuffer;
-	if (vkCreateFramebuffer(device.getLogicalDevice(), &fbufCreateInfo, nullptr, &frameBuffer))
+	// every face and mip of both cubes goes into one command buffer, one wait at the end
+	VkCommandBuffer cmd = device.beginSingleTimeCommands();
+	for (auto& job : jobs)
 	{
-		throw std::runtime_error("failed to create frameBuffer!");
-	}
+		VkImageSubresourceRange subresourceRange = {};
+		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		subresourceRange.levelCount = job.numMips;
+		subresourceRange.layerCount = 6;
+		device.transitionImageLayout(cmd, job.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresourceRange);
+
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, job.pipeline);
+		for (uint32_t m = 0; m < job.numMips; m++)
+		{
+			// 2d array view of one mip, faces are layers
+			VkImageViewCreateInfo viewCI{};
+			viewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+			viewCI.format = job.format;
+			viewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			viewCI.subresourceRange.baseMipLevel = m;
+			viewCI.subresourceRange.levelCount = 1;
+			viewCI.subresourceRange.layerCount = 6;
+			viewCI.image = job.image;
+			VkImageView mipView;
+			if (vkCreateImageView(device.getLogicalDevice(), &viewCI, nullptr, &mipView))
+			{
+				throw std::runtime_error("failed to create ImageView!");
+			}
+			mipViews.push_back(mipView);
+
+			VkDescriptorImageInfo storageImageInfo{};
+			storageImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+			storageImageInfo.imageView = mipView;
+
+			VkDescriptorSet descriptorSet;
+			DescriptorWriter(*filterDescriptorSetLayout, *descriptorPool).writeImage(0, &envImageInfo).writeImage(1, &storageImageInfo).build(descriptorSet);
+			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, filterPipelinelayout, 0, 1, &descriptorSet, 0, nullptr);
+
+			IrradiencePushBlock irradiancePush;
+			PrefileterPushBlock prefilterPush;
+			FilterPushBlock pushBlock{};
+			pushBlock.mipSize = std::max(job.dim >> m, 1u);
+			if (job.irradiance)
+			{
+				pushBlock.param0 = irradiancePush.deltaPhi;
+				pushBlock.param1 = irradiancePush.deltaTheta;
+			}
+			else
+			{
+				pushBlock.param0 = job.numMips > 1 ? (float)m / (float)(job.numMips - 1) : 0.f;
+				pushBlock.numSamples = prefilterPush.numSamples;
+			}
+			vkCmdPushConstants(cmd, filterPipelinelayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(FilterPushBlock), &pushBlock);
+
+			uint32_t groupCount = (pushBlock.mipSize + 7) / 8;
+			vkCmdDispatch(cmd, groupCount, groupCount, 6);
+		}
 
-	VkCommandBuffer cmd = device.beginSingleTimeCommands();
-	device.transitionImageLayout(cmd, offscreenImage, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+		device.transitionImageLayout(cmd, job.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
+	}
 	device.endSingleTimeCommands(cmd);
 
-	VkRenderPassBeginInfo renderPassInfo{};
-	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderPassInfo.renderPass = renderpass;
-	renderPassInfo.framebuffer = frameBuffer;
+	for (auto mipView : mipViews)
+	{
+		vkDestroyImageView(device.getLogicalDevice(), mipView, nullptr);
+	}
 
-	renderPassInfo.renderArea.offset = { 0, 0 };
-	renderPassInfo.renderArea.extent = { dim, dim };
+	if (bakeIrradiance)
+	{
+		saveCachedImage(irradiancePath, irradianceKey, IrradianceCubeImg, irradianceFormat, irradianceDim, getIrradianceMips(), 6);
+	}
+	if (bakePrefilter)
+	{
+		saveCachedImage(prefilterPath, prefilterKey, preFilterCubeImg, prefilterFormat, prefilterDim, getPrefilterMips(), 6);
+	}
+}
 
-	std::array<VkClearValue, 2> clearValues{};
-	clearValues[0].color = { 0.01f, 0.1f, 0.1f, 1.0f };
-	clearValues[1].depthStencil = { 1.0f, 0 };
-	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-	renderPassInfo.pClearValues = clearValues.data();
+void jhb::PBRResourceGenerator::setEnvironment(const std::string& path)
+{
+	// cube images and views are reused, so descriptors pointing irradiance and prefilter stay valid
+	vkDeviceWaitIdle(device.getLogicalDevice());
+
+	auto& envTexture = cube->model->getTexture(0);
+	vkDestroySampler(device.getLogicalDevice(), envTexture.sampler, nullptr);
+	vkDestroyImageView(device.getLogicalDevice(), envTexture.view, nullptr);
+	vkDestroyImage(device.getLogicalDevice(), envTexture.image, nullptr);
+	vkFreeMemory(device.getLogicalDevice(), envTexture.deviceMemory, nullptr);
+
+	environmentPath = path;
+	envTexture.loadKTXTexture(device, environmentPath, VK_IMAGE_VIEW_TYPE_CUBE, 6);
+	filterEnvironment();
+	projectIrradianceSH();
+}
 
-	std::vector<glm::mat4> matrices = {
-		// POSITIVE_X
-		glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f)), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-		// NEGATIVE_X
-		glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f)), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-		// POSITIVE_Y
-		glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-		// NEGATIVE_Y
-		glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-		// POSITIVE_Z
-		glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-		// NEGATIVE_Z
-		glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
+void jhb::PBRResourceGenerator::filterEnvironmentAsync(AsyncComputeScheduler& scheduler)
+{
+	if (filterPipelinelayout == VK_NULL_HANDLE)
+	{
+		createFilterPipelines();
+	}
+	if (shPipelinelayout == VK_NULL_HANDLE)
+	{
+		createSHPipeline();
+	}
+	if (backIrradianceCubeImg == VK_NULL_HANDLE)
+	{
+		createCubeTarget(irradianceFormat, irradianceDim, getIrradianceMips(), backIrradianceCubeImg, backIrradianceCubeMemory, backIrradianceCubeView, backIrradianceCubeSampler);
+		createCubeTarget(prefilterFormat, prefilterDim, getPrefilterMips(), backPrefilterCubeImg, backPrefilterCubeMemory, backPrefilterCubeView, backPrefilterCubeSampler);
+	}
+
+	struct FilterJob {
+		bool irradiance;
+		VkPipeline pipeline;
+		VkImage image;
+		VkImage liveImage;
+		VkFormat format;
+		uint32_t dim;
+		uint32_t numMips;
 	};
+	std::vector<FilterJob> jobs = {
+		{ true, irradiancePipeline, backIrradianceCubeImg, IrradianceCubeImg, irradianceFormat, irradianceDim, getIrradianceMips() },
+		{ false, prefilterPipeline, backPrefilterCubeImg, preFilterCubeImg, prefilterFormat, prefilterDim, getPrefilterMips() }
+	};
+	uint32_t totalMips = getIrradianceMips() + getPrefilterMips();
 
-	VkImageSubresourceRange subresourceRange = {};
-	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	subresourceRange.baseMipLevel = 0;
-	subresourceRange.levelCount = numMips;
-	subresourceRange.layerCount = 6;
+	// pool and views live until graphics sees last step finished
+	std::shared_ptr<DescriptorPool> descriptorPool = DescriptorPool::Builder(device).setMaxSets(totalMips + 1)
+		.addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, totalMips + 1)
+		.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, totalMips)
+		.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1).build();
+	auto mipViews = std::make_shared<std::vector<VkImageView>>();
 
-	auto cmdBuf = device.beginSingleTimeCommands();
+	auto& envTexture = cube->model->getTexture(0);
+	VkDescriptorImageInfo envImageInfo = envTexture.descriptor;
 
-	VkViewport viewport{};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = static_cast<float>(dim);
-	viewport.height = static_cast<float>(dim);
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-	VkRect2D scissor{ {0, 0}, {(uint32_t)dim, (uint32_t)dim} };
-	vkCmdSetViewport(cmdBuf, 0, 1, &viewport);
-	vkCmdSetScissor(cmdBuf, 0, 1, &scissor);
+	// one dispatch per step, a compute submission signals only after all of it so steps keep each frame's compute short
+	std::vector<AsyncComputeScheduler::StepFunc> steps;
+	for (auto& job : jobs)
+	{
+		VkImageSubresourceRange subresourceRange = {};
+		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		subresourceRange.levelCount = job.numMips;
+		subresourceRange.layerCount = 6;
 
-	assert(irradiancePipelinelayout != nullptr && "Cannot Create pipeline before pipeline layout!!");
+		for (uint32_t m = 0; m < job.numMips; m++)
+		{
+			VkImageViewCreateInfo viewCI{};
+			viewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+			viewCI.format = job.format;
+			viewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			viewCI.subresourceRange.baseMipLevel = m;
+			viewCI.subresourceRange.levelCount = 1;
+			viewCI.subresourceRange.layerCount = 6;
+			viewCI.image = job.image;
+			VkImageView mipView;
+			if (vkCreateImageView(device.getLogicalDevice(), &viewCI, nullptr, &mipView))
+			{
+				throw std::runtime_error("failed to create ImageView!");
+			}
+			mipViews->push_back(mipView);
+
+			VkDescriptorImageInfo storageImageInfo{};
+			storageImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+			storageImageInfo.imageView = mipView;
+			VkDescriptorSet descriptorSet;
+			DescriptorWriter(*filterDescriptorSetLayout, *descriptorPool).writeImage(0, &envImageInfo).writeImage(1, &storageImageInfo).build(descriptorSet);
+
+			IrradiencePushBlock irradiancePush;
+			PrefileterPushBlock prefilterPush;
+			FilterPushBlock pushBlock{};
+			pushBlock.mipSize = std::max(job.dim >> m, 1u);
+			if (job.irradiance)
+			{
+				pushBlock.param0 = irradiancePush.deltaPhi;
+				pushBlock.param1 = irradiancePush.deltaTheta;
+			}
+			else
+			{
+				pushBlock.param0 = job.numMips > 1 ? (float)m / (float)(job.numMips - 1) : 0.f;
+				pushBlock.numSamples = prefilterPush.numSamples;
+			}
+
+			steps.push_back([this, &scheduler, job, m, subresourceRange, descriptorSet, pushBlock](VkCommandBuffer cmd) {
+				if (m == 0)
+				{
+					// previous contents were already copied out
+					device.transitionImageLayout(cmd, job.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresourceRange);
+				}
+				vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, job.pipeline);
+				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, filterPipelinelayout, 0, 1, &descriptorSet, 0, nullptr);
+				vkCmdPushConstants(cmd, filterPipelinelayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(FilterPushBlock), &pushBlock);
+				uint32_t groupCount = (pushBlock.mipSize + 7) / 8;
+				vkCmdDispatch(cmd, groupCount, groupCount, 6);
+				if (m == job.numMips - 1)
+				{
+					scheduler.releaseImage(job.image, subresourceRange, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+						VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+				}
+			});
+		}
+	}
 
-	PipelineConfigInfo pipelineConfig{};
-	pipelineConfig.depthStencilInfo.depthTestEnable = true;
-	pipelineConfig.depthStencilInfo.depthWriteEnable = true;
-	pipelineConfig.attributeDescriptions = jhb::Vertex::getAttrivuteDescriptions();
-	pipelineConfig.bindingDescriptions = jhb::Vertex::getBindingDescriptions();
+	VkDescriptorBufferInfo bufferInfo = shBuffer->descriptorInfo();
+	VkDescriptorSet shDescriptorSet;
+	DescriptorWriter(*shDescriptorSetLayout, *descriptorPool).writeImage(0, &envImageInfo).writeBuffer(1, &bufferInfo).build(shDescriptorSet);
+	steps.push_back([this, shDescriptorSet](VkCommandBuffer cmd) {
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, shPipeline);
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, shPipelinelayout, 0, 1, &shDescriptorSet, 0, nullptr);
+		vkCmdDispatch(cmd, 1, 1, 1);
+
+		VkMemoryBarrier memoryBarrier{};
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	});
+
+	// back cubes were acquired in transfer src by graphics before this runs, copy keeps descriptors of live cubes valid
+	auto onComplete = [this, jobs, descriptorPool, mipViews](VkCommandBuffer cmd) {
+		for (auto& job : jobs)
+		{
+			VkImageSubresourceRange subresourceRange = {};
+			subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			subresourceRange.levelCount = job.numMips;
+			subresourceRange.layerCount = 6;
+			device.transitionImageLayout(cmd, job.liveImage, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
+
+			std::vector<VkImageCopy> regions;
+			for (uint32_t m = 0; m < job.numMips; m++)
+			{
+				VkImageCopy region{};
+				region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				region.srcSubresource.mipLevel = m;
+				region.srcSubresource.layerCount = 6;
+				region.dstSubresource = region.srcSubresource;
+				region.extent.width = std::max(job.dim >> m, 1u);
+				region.extent.height = region.extent.width;
+				region.extent.depth = 1;
+				regions.push_back(region);
+			}
+			vkCmdCopyImage(cmd, job.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, job.liveImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				static_cast<uint32_t>(regions.size()), regions.data());
+			device.transitionImageLayout(cmd, job.liveImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
+		}
 
-	Pipeline::defaultPipelineConfigInfo(pipelineConfig);
-	pipelineConfig.renderPass = renderpass;
-	pipelineConfig.pipelineLayout = prefilterPipelinelayout;
-	prefilterPipeline = std::make_unique<Pipeline>(
-		device,
-		"shaders/filtercube.vert.spv",
-		"shaders/prefilterenvmap.frag.spv",
-		pipelineConfig);
+		memcpy(irradianceSH.data(), shBuffer->getMappedMemory(), sizeof(glm::vec4) * irradianceSH.size());
 
-	prefilterPipeline->bind(cmdBuf);
-	device.transitionImageLayout(cmdBuf, preFilterCubeImg, VK_IMAGE_LAYOUT_UNDEFINED,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
-
-	for (uint32_t m = 0; m < numMips; m++) {
-		pushBlock.roughness = (float)m / (float)(numMips - 1);
-		for (uint32_t f = 0; f < 6; f++) {
-			viewport.width = static_cast<float>(dim * std::pow(0.5f, m));
-			viewport.height = static_cast<float>(dim * std::pow(0.5f, m));
-			vkCmdSetViewport(cmdBuf, 0, 1, &viewport);
-
-			// Render scene from cube face's point of view
-			vkCmdBeginRenderPass(cmdBuf, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-			// Update shader push constant block
-			pushBlock.mvp = glm::perspective((float)(M_PI / 2.0), 1.0f, 0.1f, 512.0f) * matrices[f];
-			prefilterPipeline->bind(cmdBuf);
-
-			vkCmdBindDescriptorSets(
-				cmdBuf,
-				VK_PIPELINE_BIND_POINT_GRAPHICS,
-				prefilterPipelinelayout,
-				0, 1
-				, &descSets[0],
-				0, nullptr
-			);
-
-			vkCmdBindDescriptorSets(
-				cmdBuf,
-				VK_PIPELINE_BIND_POINT_GRAPHICS,
-				prefilterPipelinelayout,
-				1, 1
-				, &descSets[1],
-				0, nullptr
-			);
-			vkCmdPushConstants(cmdBuf, prefilterPipelinelayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PrefileterPushBlock), &pushBlock);
-			cube->model->bind(cmdBuf);
-			cube->model->draw(cmdBuf, prefilterPipelinelayout, 0);
-
-			vkCmdEndRenderPass(cmdBuf);
-
-			device.transitionImageLayout(
-				cmdBuf, offscreenImage, VK_IMAGE_ASPECT_COLOR_BIT,
-				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-
-			// Copy region for transfer from framebuffer to cube fdce
-			VkImageCopy copyRegion = {};
-
-			copyRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			copyRegion.srcSubresource.baseArrayLayer = 0;
-			copyRegion.srcSubresource.mipLevel = 0;
-			copyRegion.srcSubresource.layerCount = 1;
-			copyRegion.srcOffset = { 0, 0, 0 };
-
-			copyRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			copyRegion.dstSubresource.baseArrayLayer = f;
-			copyRegion.dstSubresource.mipLevel = m;
-			copyRegion.dstSubresource.layerCount = 1;
-			copyRegion.dstOffset = { 0, 0, 0 };
-
-			copyRegion.extent.width = static_cast<uint32_t>(viewport.width);
-			copyRegion.extent.height = static_cast<uint32_t>(viewport.height);
-			copyRegion.extent.depth = 1;
-
-			vkCmdCopyImage(
-				cmdBuf,
-				offscreenImage,
-				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				preFilterCubeImg,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				1,
-				&copyRegion);
-
-			// Transform framebuffer color attachment back
-
-			device.transitionImageLayout(
-				cmdBuf, offscreenImage, VK_IMAGE_ASPECT_COLOR_BIT,
-				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
-			);
+		// last step finished on gpu, nothing references views and sets anymore
+		for (auto mipView : *mipViews)
+		{
+			vkDestroyImageView(device.getLogicalDevice(), mipView, nullptr);
 		}
-	}
+	};
 
-	device.transitionImageLayout(
-		cmdBuf, preFilterCubeImg,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange
-	);
-	device.endSingleTimeCommands(cmdBuf);
+	VkImageSubresourceRange envRange = {};
+	envRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	envRange.levelCount = envTexture.mipLevels;
+	envRange.layerCount = envTexture.layerCount;
+	scheduler.addBackgroundJob("ibl rebake", std::move(steps), std::move(onComplete),
+		{ { envTexture.image, envRange, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL } });
 }
@@ -1,7 +1,12 @@
 #pragma once
 #include "BaseRenderSystem.h"
 
+#include <array>
+#include <unordered_map>
+
 namespace jhb {
+	class AsyncComputeScheduler;
+
 	class PBRResourceGenerator
 	{
 	public:
@@ -17,17 +22,74 @@ namespace jhb {
 		void generateBRDFLUT();
 		void generateIrradianceCube();
 		void generatePrefilteredCube();
+		// filter irradiance and prefiltered cube from environment with compute, skipped when cached
+		void filterEnvironment();
+		// swap environment map at runtime and filter again in a single submission
+		void setEnvironment(const std::string& path);
+		// filter current environment again on async compute queue into back cubes, spread over frames one mip per frame.
+		// live cubes and irradianceSH are swapped on graphics queue when it finishes, cache is not touched
+		void filterEnvironmentAsync(AsyncComputeScheduler& scheduler);
+		// project environment into l2 spherical harmonics of irradiance, result goes to irradianceSH
+		void projectIrradianceSH();
+
+		// bake brdf lut into brdfLutCachePath regardless of existing cache, lut depends on nothing so can be shipped
+		void bakeBRDFLUT();
+
+	public:
+		// baked images are stored as ktx2 and reused on next launch instead of gpu bake
+		bool useCache = true;
+		std::string environmentPath = "Texture/pisa_cube.ktx";
+		std::string cacheDirectory = "Texture/cache";
+		std::string brdfLutCachePath = "Texture/brdflut.ktx2";
+
+	private:
+		// fnv-1a 64bit
+		static uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull);
+		// content hash is remembered by size and write time in cacheDirectory, unchanged files are not read again
+		uint64_t hashFile(const std::string& path, uint64_t hash);
+		void loadFileHashes();
+		void saveFileHashes();
+		std::string getCachePath(const std::string& name, uint64_t key);
+		uint64_t getIrradianceCacheKey();
+		uint64_t getPrefilterCacheKey();
+
+		// image must be created with transfer dst, it ends in shader read only layout when returning true
+		bool loadCachedImage(const std::string& path, uint64_t key, VkImage image, VkFormat format, uint32_t dim, uint32_t numMips, uint32_t faceCount);
+		// image must be in shader read only layout and created with transfer src
+		void saveCachedImage(const std::string& path, uint64_t key, VkImage image, VkFormat format, uint32_t dim, uint32_t numMips, uint32_t faceCount);
+
+	private:
+		// shared push block of irradiancecube.comp and prefilterenvmap.comp
+		struct FilterPushBlock {
+			float param0; // deltaPhi or roughness
+			float param1; // deltaTheta
+			uint32_t numSamples;
+			uint32_t mipSize;
+		};
+
+		static constexpr VkFormat irradianceFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
+		static constexpr uint32_t irradianceDim = 64;
+		static constexpr VkFormat prefilterFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+		static constexpr uint32_t prefilterDim = 512;
+		static uint32_t getIrradianceMips() { return static_cast<uint32_t>(floor(log2(irradianceDim))) + 1; }
+		static uint32_t getPrefilterMips() { return static_cast<uint32_t>(floor(log2(prefilterDim))) + 1; }
+
+		void createCubeTarget(VkFormat format, uint32_t dim, uint32_t numMips, VkImage& image, VkDeviceMemory& memory, VkImageView& view, VkSampler& sampler);
+		void createFilterPipelines();
+		void createSHPipeline();
+		void createComputePipeline(const std::string& path, VkPipelineLayout layout, VkPipeline& pipeline);
 
 	private:
 		Device& device;
 
-		VkImage preFilterCubeImg;
-		VkImage IrradianceCubeImg;
-		VkImage lutBrdfImg;
+		// null until created, brdf lut bake never creates the cubes
+		VkImage preFilterCubeImg = VK_NULL_HANDLE;
+		VkImage IrradianceCubeImg = VK_NULL_HANDLE;
+		VkImage lutBrdfImg = VK_NULL_HANDLE;
 
-		VkDeviceMemory preFilterCubeMemory;
-		VkDeviceMemory IrradianceCubeMemory;
-		VkDeviceMemory lutBrdfMemory;
+		VkDeviceMemory preFilterCubeMemory = VK_NULL_HANDLE;
+		VkDeviceMemory IrradianceCubeMemory = VK_NULL_HANDLE;
+		VkDeviceMemory lutBrdfMemory = VK_NULL_HANDLE;
 	public:
 		VkImageView lutBrdfView;
 		VkImageView preFilterCubeImgView;
@@ -38,15 +100,42 @@ namespace jhb {
 		VkSampler lutBrdfSampler;
 
 		std::unique_ptr<GameObject> cube;
+
+		// rgb used, only diffuse irradiance of deferedPBR.frag. irradiance cube is left for forward pbr.frag
+		std::array<glm::vec4, 9> irradianceSH{};
 		
 	private:
 		VkPipelineLayout brdfPipelinelayout;
-		VkPipelineLayout irradiancePipelinelayout;
-		VkPipelineLayout prefilterPipelinelayout;
-
 		std::unique_ptr<Pipeline> brdfPipeline;
-		std::unique_ptr<Pipeline> irradiancePipeline;
-		std::unique_ptr<Pipeline> prefilterPipeline;
+
+		// compute filtering, created on first bake
+		VkPipelineLayout filterPipelinelayout = VK_NULL_HANDLE;
+		VkPipeline irradiancePipeline = VK_NULL_HANDLE;
+		VkPipeline prefilterPipeline = VK_NULL_HANDLE;
+		std::shared_ptr<DescriptorSetLayout> filterDescriptorSetLayout;
+
+		VkPipelineLayout shPipelinelayout = VK_NULL_HANDLE;
+		VkPipeline shPipeline = VK_NULL_HANDLE;
+		std::shared_ptr<DescriptorSetLayout> shDescriptorSetLayout;
+		std::unique_ptr<Buffer> shBuffer;
+
+		// async rebake targets, created on first rebake
+		VkImage backIrradianceCubeImg = VK_NULL_HANDLE;
+		VkDeviceMemory backIrradianceCubeMemory = VK_NULL_HANDLE;
+		VkImageView backIrradianceCubeView = VK_NULL_HANDLE;
+		VkSampler backIrradianceCubeSampler = VK_NULL_HANDLE;
+		VkImage backPrefilterCubeImg = VK_NULL_HANDLE;
+		VkDeviceMemory backPrefilterCubeMemory = VK_NULL_HANDLE;
+		VkImageView backPrefilterCubeView = VK_NULL_HANDLE;
+		VkSampler backPrefilterCubeSampler = VK_NULL_HANDLE;
+
+		struct FileHash {
+			uint64_t size;
+			int64_t writeTime;
+			uint64_t hash;
+		};
+		std::unordered_map<std::string, FileHash> fileHashes;
+		bool fileHashesLoaded = false;
 
 	private:
 		std::vector<VkDescriptorSetLayout> descSetlayouts;
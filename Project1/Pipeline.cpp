@@ -1,4 +1,5 @@
 #include "Pipeline.h"
+#include "CommandStats.h"
 
 #include <fstream>
 #include <stdexcept>
@@ -26,7 +27,7 @@ namespace jhb {
 
 	void Pipeline::bind(VkCommandBuffer commandBuffer)
 	{
-		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+		cmd::bindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
 	}
 
 	void Pipeline::defaultPipelineConfigInfo(PipelineConfigInfo& configInfo)
@@ -274,7 +275,7 @@ namespace jhb {
 			VkBool32 isOcculsion;
 		} materialSpecializationData;
 
-		materialSpecializationData.alphaMask = material.alphaMode == "MASK";
+		materialSpecializationData.alphaMask = configInfo.materialAlphaTest && material.isAlphaMasked();
 		materialSpecializationData.alphaMaskCutoff = material.alphaCutOff;
 		materialSpecializationData.isMetallicRoughness = false;
 		materialSpecializationData.isEmissive= false;
@@ -306,7 +307,7 @@ namespace jhb {
 		pipelineInfo.pStages = shaderStages;
 
 		// For double sided materials, culling will be disabled
-		configInfo.rasterizationInfo.cullMode = material.doubleSided ? VK_CULL_MODE_NONE : VK_CULL_MODE_NONE;
+		configInfo.rasterizationInfo.cullMode = material.getCullMode();
 		if (vkCreateGraphicsPipelines(
 			device.getLogicalDevice(),
 			pipelinCache,
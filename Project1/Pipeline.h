@@ -26,6 +26,8 @@ namespace jhb {
 		VkPipelineLayout pipelineLayout = nullptr;
 		VkRenderPass renderPass = nullptr;
 		uint32_t subpass = 0;
+		// MASK materials discard below cutoff, off when depth prepass already did the alpha test
+		bool materialAlphaTest = true;
 	};
 
 	class Pipeline
@@ -1,12 +1,15 @@
 #include "PointLightSystem.h"
+#include "CommandStats.h"
 #include <memory>
 #include <array>
+#include <algorithm>
 
 namespace jhb {
-	PointLightSystem::PointLightSystem(Device& device, VkRenderPass renderPass, const std::vector<VkDescriptorSetLayout>& globalSetLayOut, const std::string& vert, const std::string& frag) :
+	PointLightSystem::PointLightSystem(Device& device, VkRenderPass renderPass, const std::vector<VkDescriptorSetLayout>& globalSetLayOut, const std::string& vert, const std::string& frag,
+		uint32_t lightCount, float lightRadius) :
 		BaseRenderSystem(device, globalSetLayOut, { VkPushConstantRange{VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PointLightPushConstants)} }) {
 		createPipeline(renderPass, vert, frag);
-		createLights();
+		createLights(lightCount, lightRadius);
 	}
 
 	PointLightSystem::~PointLightSystem()
@@ -40,22 +43,21 @@ namespace jhb {
 	{
 		auto rotateLight = glm::rotate(glm::mat4(1.f), frameInfo.frameTime, { 0.f, -1.f, 0.f });
 		int lightIndex = 0;
-		for (auto& kv : lightObjects)
+		// in id order so light 0 is always first, lights past MaxLights are drawn but don't shade
+		for (uint32_t lightId = 0; lightId < lightObjects.size() && lightIndex < MaxLights; lightId++)
 		{
-			auto& obj = kv.second;
-			if (obj.pointLight == nullptr) continue;
+			auto it = lightObjects.find(lightId);
+			if (it == lightObjects.end() || it->second.pointLight == nullptr) continue;
+			auto& obj = it->second;
 
 			// update position
 			//obj.transform.translation = glm::vec3(rotateLight * glm::vec4(obj.transform.translation, 1.f));
 
 			// copy light to ubo
-			if (kv.first == 0)
-			{
-				ubo.pointLights[lightIndex].position = glm::vec4(obj.transform.translation, 1.f);
-				ubo.pointLights[lightIndex].color = glm::vec4(obj.color, obj.pointLight->lightIntensity);
+			ubo.pointLights[lightIndex].position = glm::vec4(obj.transform.translation, 1.f);
+			ubo.pointLights[lightIndex].color = glm::vec4(obj.color, obj.pointLight->lightIntensity);
 
-				lightIndex += 1;
-			}
+			lightIndex += 1;
 		}
 		ubo.numLights = lightIndex;
 	}
@@ -69,41 +71,42 @@ namespace jhb {
 			auto& obj = kv.second;
 			if (obj.pointLight == nullptr) continue;
 			{
-				if (kv.first == 0)
-				{
-					PointLightPushConstants push{};
-					push.position = glm::vec4(obj.transform.translation, 1.f);
-					push.color = glm::vec4(obj.color, obj.pointLight->lightIntensity);
-					push.radius = obj.transform.scale.x;
+				PointLightPushConstants push{};
+				push.position = glm::vec4(obj.transform.translation, 1.f);
+				push.color = glm::vec4(obj.color, obj.pointLight->lightIntensity);
+				push.radius = obj.transform.scale.x;
 
-					vkCmdPushConstants(
-						frameInfo.commandBuffer,
-						pipelineLayout,
-						VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-						0,
-						sizeof(PointLightPushConstants),
-						&push
-					);
-					vkCmdDraw(frameInfo.commandBuffer, 6, 1, 0, 0);
-				}
+				cmd::pushConstants(
+					frameInfo.commandBuffer,
+					pipelineLayout,
+					VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+					0,
+					sizeof(PointLightPushConstants),
+					&push
+				);
+				cmd::draw(frameInfo.commandBuffer, 6, 1, 0, 0);
 			}
 		}
 	}
 
-	void PointLightSystem::createLights()
+	void PointLightSystem::createLights(uint32_t lightCount, float lightRadius)
 	{
 		static uint32_t currentId = 0;
 		std::vector<glm::vec3> lightColors{
 			{1.f, 1.f, 1.f},
+			{1.f, .6f, .3f},
+			{.3f, .6f, 1.f},
+			{.5f, 1.f, .4f},
 		};
 
-		for (int i = 0; i < lightColors.size(); i++)
+		for (uint32_t i = 0; i < lightCount; i++)
 		{
 			auto pointLight = GameObject::makePointLight(1.f);
-			pointLight.color = lightColors[i];
+			pointLight.color = lightColors[i % lightColors.size()];
 			pointLight.pointLight->lightIntensity = 5.f;
-			auto rotateLight = glm::rotate(glm::mat4(1.f), (i * glm::two_pi<float>() / lightColors.size()), { 0.f, -1.f, 0.f });
-			pointLight.transform.translation = glm::vec3(rotateLight * glm::vec4(0.f, -10.5f, 0.f, 1.f));
+			auto rotateLight = glm::rotate(glm::mat4(1.f), (i * glm::two_pi<float>() / std::max(lightCount - 1, 1u)), { 0.f, -1.f, 0.f });
+			glm::vec4 offset = i == 0 ? glm::vec4(0.f, -10.5f, 0.f, 1.f) : glm::vec4(lightRadius, -10.5f, 0.f, 1.f);
+			pointLight.transform.translation = glm::vec3(rotateLight * offset);
 			pointLight.setId(currentId++);
 			lightObjects.emplace(pointLight.getId(), std::move(pointLight));
 		}
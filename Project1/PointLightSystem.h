@@ -25,7 +25,9 @@ namespace jhb {
 
 	class PointLightSystem : public BaseRenderSystem {
 	public:
-		PointLightSystem(Device& device, VkRenderPass renderPass, const std::vector<VkDescriptorSetLayout>& globalSetLayOut, const std::string& vert, const std::string& frag);
+		// light 0 stays above origin and casts shadow, others are spread on a ring of lightRadius
+		PointLightSystem(Device& device, VkRenderPass renderPass, const std::vector<VkDescriptorSetLayout>& globalSetLayOut, const std::string& vert, const std::string& frag,
+			uint32_t lightCount = 1, float lightRadius = 10.f);
 		~PointLightSystem();
 
 		PointLightSystem(const PointLightSystem&) = delete;
@@ -36,7 +38,7 @@ namespace jhb {
 		virtual void renderGameObjects(FrameInfo& frameInfo) override;
 		GameObject::Map& getLightobjects() { return lightObjects; }
 	private:
-		void createLights();
+		void createLights(uint32_t lightCount, float lightRadius);
 		// render pass only used to create pipeline
 		// render system doest not store render pass, beacuase render system's life cycle is not tie to render pass
 		virtual void createPipeline(VkRenderPass renderPass, const std::string& vert, const std::string& frag) override;
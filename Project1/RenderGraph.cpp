@@ -0,0 +1,538 @@
+#include "RenderGraph.h"
+#include "CommandStats.h"
+#include "SwapChain.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace jhb {
+	RenderGraph::PassBuilder& RenderGraph::PassBuilder::read(ResourceHandle resource, VkImageLayout layout, VkPipelineStageFlags stage, VkAccessFlags access)
+	{
+		graph.passes[passIndex].usages.push_back(Usage{ resource, layout, layout, stage, access, false });
+		return *this;
+	}
+
+	RenderGraph::PassBuilder& RenderGraph::PassBuilder::write(ResourceHandle resource, VkImageLayout initialLayout, VkImageLayout finalLayout, VkPipelineStageFlags stage, VkAccessFlags access)
+	{
+		graph.passes[passIndex].usages.push_back(Usage{ resource, initialLayout, finalLayout, stage, access, true });
+		return *this;
+	}
+
+	RenderGraph::PassBuilder& RenderGraph::PassBuilder::condition(std::function<bool()> enabled)
+	{
+		graph.passes[passIndex].enabled = std::move(enabled);
+		return *this;
+	}
+
+	RenderGraph::PassBuilder& RenderGraph::PassBuilder::sideEffect()
+	{
+		graph.passes[passIndex].sideEffect = true;
+		return *this;
+	}
+
+	RenderGraph::RenderGraph(Device& device) : device{ device }
+	{
+	}
+
+	RenderGraph::~RenderGraph()
+	{
+		destroyTransients();
+		if (queryPool != VK_NULL_HANDLE)
+		{
+			VkDevice logicalDevice = device.getLogicalDevice();
+			VkQueryPool pool = queryPool;
+			device.getDeletionQueue().retire([logicalDevice, pool]() { vkDestroyQueryPool(logicalDevice, pool, nullptr); });
+		}
+	}
+
+	RenderGraph::ResourceHandle RenderGraph::createImage(const std::string& name, const ImageDesc& desc)
+	{
+		Resource resource{};
+		resource.name = name;
+		resource.desc = desc;
+		resource.aspect = desc.aspect;
+		resource.transient = true;
+		resources.push_back(resource);
+		return static_cast<ResourceHandle>(resources.size() - 1);
+	}
+
+	RenderGraph::ResourceHandle RenderGraph::importImage(const std::string& name, VkImage image, VkImageAspectFlags aspect, VkImageLayout layout)
+	{
+		Resource resource{};
+		resource.name = name;
+		resource.image = image;
+		resource.aspect = aspect;
+		resource.layout = layout;
+		resources.push_back(resource);
+		return static_cast<ResourceHandle>(resources.size() - 1);
+	}
+
+	void RenderGraph::setImportedImage(ResourceHandle resource, VkImage image, VkImageLayout layout)
+	{
+		Resource& res = resources[resource];
+		assert(!res.transient && "Can't replace transient image!");
+		res.image = image;
+		res.layout = layout;
+		res.stage = 0;
+		res.access = 0;
+		res.written = false;
+	}
+
+	void RenderGraph::markOutput(ResourceHandle resource)
+	{
+		resources[resource].output = true;
+	}
+
+	RenderGraph::PassBuilder RenderGraph::addPass(const std::string& name, ExecuteFunc execute)
+	{
+		Pass pass{};
+		pass.name = name;
+		pass.execute = std::move(execute);
+		passes.push_back(std::move(pass));
+		return PassBuilder{ *this, static_cast<uint32_t>(passes.size() - 1) };
+	}
+
+	void RenderGraph::compile()
+	{
+		destroyTransients();
+
+		// lifetime over every declared pass, so aliasing stays valid whatever is culled at runtime
+		std::vector<std::pair<uint32_t, uint32_t>> lifetimes(resources.size(), { UINT32_MAX, 0 });
+		for (uint32_t i = 0; i < passes.size(); i++)
+		{
+			for (auto& usage : passes[i].usages)
+			{
+				lifetimes[usage.resource].first = std::min(lifetimes[usage.resource].first, i);
+				lifetimes[usage.resource].second = std::max(lifetimes[usage.resource].second, i);
+			}
+		}
+
+		std::vector<ResourceHandle> transients;
+		std::vector<VkMemoryRequirements> requirements(resources.size());
+		for (ResourceHandle i = 0; i < resources.size(); i++)
+		{
+			Resource& res = resources[i];
+			if (!res.transient || lifetimes[i].first == UINT32_MAX)
+			{
+				continue;
+			}
+
+			VkImageCreateInfo imageInfo{};
+			imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			imageInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageInfo.format = res.desc.format;
+			imageInfo.extent = { res.desc.extent.width, res.desc.extent.height, 1 };
+			imageInfo.mipLevels = 1;
+			imageInfo.arrayLayers = 1;
+			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageInfo.usage = res.desc.usage;
+			imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			if (vkCreateImage(device.getLogicalDevice(), &imageInfo, nullptr, &res.image) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create render graph image!");
+			}
+			vkGetImageMemoryRequirements(device.getLogicalDevice(), res.image, &requirements[i]);
+			transients.push_back(i);
+		}
+
+		// biggest first, put each image into first block whose images are all dead during its lifetime
+		std::sort(transients.begin(), transients.end(), [&](ResourceHandle a, ResourceHandle b) { return requirements[a].size > requirements[b].size; });
+		unaliasedMemorySize = 0;
+		for (ResourceHandle i : transients)
+		{
+			unaliasedMemorySize += requirements[i].size;
+
+			uint32_t blockIndex = static_cast<uint32_t>(memoryBlocks.size());
+			for (uint32_t b = 0; b < memoryBlocks.size(); b++)
+			{
+				if ((memoryBlocks[b].memoryTypeBits & requirements[i].memoryTypeBits) == 0)
+				{
+					continue;
+				}
+				bool overlap = std::any_of(memoryBlocks[b].resources.begin(), memoryBlocks[b].resources.end(), [&](ResourceHandle other) {
+					return lifetimes[i].first <= lifetimes[other].second && lifetimes[other].first <= lifetimes[i].second;
+				});
+				if (!overlap)
+				{
+					blockIndex = b;
+					break;
+				}
+			}
+			if (blockIndex == memoryBlocks.size())
+			{
+				memoryBlocks.push_back(MemoryBlock{});
+			}
+
+			MemoryBlock& block = memoryBlocks[blockIndex];
+			block.size = std::max(block.size, requirements[i].size);
+			block.memoryTypeBits &= requirements[i].memoryTypeBits;
+			block.resources.push_back(i);
+		}
+
+		// every image is bound at offset 0, so alignment is always satisfied
+		transientMemorySize = 0;
+		for (auto& block : memoryBlocks)
+		{
+			VkMemoryAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			allocInfo.allocationSize = block.size;
+			allocInfo.memoryTypeIndex = device.findMemoryType(block.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			if (vkAllocateMemory(device.getLogicalDevice(), &allocInfo, nullptr, &block.memory) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to allocate render graph memory!");
+			}
+			transientMemorySize += block.size;
+
+			for (ResourceHandle i : block.resources)
+			{
+				Resource& res = resources[i];
+				if (vkBindImageMemory(device.getLogicalDevice(), res.image, block.memory, 0) != VK_SUCCESS)
+				{
+					throw std::runtime_error("failed to bind render graph image memory!");
+				}
+
+				// framebuffer needs depth only view, barriers still use every aspect of the format
+				VkImageViewCreateInfo viewInfo{};
+				viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+				viewInfo.image = res.image;
+				viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+				viewInfo.format = res.desc.format;
+				viewInfo.subresourceRange.aspectMask = (res.aspect & VK_IMAGE_ASPECT_DEPTH_BIT) ? VK_IMAGE_ASPECT_DEPTH_BIT : res.aspect;
+				viewInfo.subresourceRange.levelCount = 1;
+				viewInfo.subresourceRange.layerCount = 1;
+				if (vkCreateImageView(device.getLogicalDevice(), &viewInfo, nullptr, &res.view) != VK_SUCCESS)
+				{
+					throw std::runtime_error("failed to create render graph image view!");
+				}
+			}
+		}
+
+		createQueryPool();
+		printReport();
+	}
+
+	void RenderGraph::createQueryPool()
+	{
+		if (queryPool != VK_NULL_HANDLE)
+		{
+			VkDevice logicalDevice = device.getLogicalDevice();
+			VkQueryPool pool = queryPool;
+			device.getDeletionQueue().retire([logicalDevice, pool]() { vkDestroyQueryPool(logicalDevice, pool, nullptr); });
+			queryPool = VK_NULL_HANDLE;
+		}
+		passGpuMs.assign(passes.size(), -1.0);
+		frameGpuMs = -1.0;
+
+		uint32_t queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(device.getPhysicalDevice(), &queueFamilyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(device.getPhysicalDevice(), &queueFamilyCount, queueFamilies.data());
+
+		timestampsSupported = !passes.empty() && device.properties.limits.timestampPeriod > 0.f &&
+			queueFamilies[device.getGraphicsQueueFamily()].timestampValidBits > 0;
+		if (!timestampsSupported)
+		{
+			return;
+		}
+
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = SwapChain::MAX_FRAMES_IN_FLIGHT * static_cast<uint32_t>(passes.size()) * 2;
+		if (vkCreateQueryPool(device.getLogicalDevice(), &queryPoolInfo, nullptr, &queryPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create render graph query pool!");
+		}
+		vkResetQueryPool(device.getLogicalDevice(), queryPool, 0, queryPoolInfo.queryCount);
+		queriesWritten.assign(SwapChain::MAX_FRAMES_IN_FLIGHT * passes.size(), false);
+	}
+
+	void RenderGraph::readTimestamps(int frameIndex)
+	{
+		// frame fence of this slot was waited in beginFrame, results are there unless pass wasn't recorded
+		uint32_t passCount = static_cast<uint32_t>(passes.size());
+		uint32_t firstQuery = frameIndex * passCount * 2;
+		double period = device.properties.limits.timestampPeriod * 1e-6;
+		uint64_t frameBegin = UINT64_MAX;
+		uint64_t frameEnd = 0;
+		for (uint32_t i = 0; i < passCount; i++)
+		{
+			passGpuMs[i] = -1.0;
+			if (!queriesWritten[frameIndex * passCount + i])
+			{
+				continue;
+			}
+			queriesWritten[frameIndex * passCount + i] = false;
+
+			uint64_t timestamps[2];
+			if (vkGetQueryPoolResults(device.getLogicalDevice(), queryPool, firstQuery + i * 2, 2, sizeof(timestamps), timestamps, sizeof(uint64_t),
+				VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+			{
+				passGpuMs[i] = (timestamps[1] - timestamps[0]) * period;
+				frameBegin = std::min(frameBegin, timestamps[0]);
+				frameEnd = std::max(frameEnd, timestamps[1]);
+			}
+		}
+		frameGpuMs = frameEnd > frameBegin ? (frameEnd - frameBegin) * period : -1.0;
+		vkResetQueryPool(device.getLogicalDevice(), queryPool, firstQuery, passCount * 2);
+	}
+
+	void RenderGraph::execute(FrameInfo& frameInfo)
+	{
+		// scratch of execute comes from frame arena
+		FrameVector<bool> live(device.getFrameArena());
+		cullPasses(live);
+
+		if (timestampsSupported)
+		{
+			readTimestamps(frameInfo.frameIndex);
+		}
+
+		// transient contents never survive a frame
+		for (auto& res : resources)
+		{
+			if (res.transient)
+			{
+				res.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+				res.stage = 0;
+				res.access = 0;
+				res.written = false;
+				res.touched = false;
+			}
+		}
+
+		executedPassCount = 0;
+		for (uint32_t i = 0; i < passes.size(); i++)
+		{
+			if (!live[i])
+			{
+				continue;
+			}
+			CommandStats::GetSingleton().beginPass(passes[i].name);
+			uint32_t query = (frameInfo.frameIndex * static_cast<uint32_t>(passes.size()) + i) * 2;
+			if (timestampsSupported)
+			{
+				// barriers of pass are counted to it
+				vkCmdWriteTimestamp(frameInfo.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, query);
+			}
+			recordBarriers(frameInfo.commandBuffer, passes[i]);
+			passes[i].execute(frameInfo);
+			if (timestampsSupported)
+			{
+				vkCmdWriteTimestamp(frameInfo.commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, query + 1);
+				queriesWritten[frameInfo.frameIndex * passes.size() + i] = true;
+			}
+			executedPassCount++;
+		}
+		CommandStats::GetSingleton().endPass();
+	}
+
+	void RenderGraph::cullPasses(FrameVector<bool>& live)
+	{
+		live.assign(passes.size(), false);
+
+		// walk backwards, a pass lives if it has side effect or writes something a later live pass or output needs
+		FrameVector<bool> needed(resources.size(), false, device.getFrameArena());
+		for (ResourceHandle i = 0; i < resources.size(); i++)
+		{
+			needed[i] = resources[i].output;
+		}
+
+		for (int i = static_cast<int>(passes.size()) - 1; i >= 0; i--)
+		{
+			Pass& pass = passes[i];
+			if (pass.enabled && !pass.enabled())
+			{
+				continue;
+			}
+
+			bool isLive = pass.sideEffect;
+			for (auto& usage : pass.usages)
+			{
+				isLive = isLive || (usage.write && needed[usage.resource]);
+			}
+			if (!isLive)
+			{
+				continue;
+			}
+
+			live[i] = true;
+			for (auto& usage : pass.usages)
+			{
+				// write that doesn't discard is read modify write, earlier writer is still needed
+				if (!usage.write || usage.initialLayout != VK_IMAGE_LAYOUT_UNDEFINED)
+				{
+					needed[usage.resource] = true;
+				}
+				else
+				{
+					needed[usage.resource] = false;
+				}
+			}
+		}
+	}
+
+	void RenderGraph::recordBarriers(VkCommandBuffer cmd, const Pass& pass)
+	{
+		FrameVector<VkImageMemoryBarrier> imageBarriers(device.getFrameArena());
+		VkPipelineStageFlags srcStages = 0;
+		VkPipelineStageFlags dstStages = 0;
+		VkAccessFlags memorySrcAccess = 0;
+		VkAccessFlags memoryDstAccess = 0;
+		bool memoryBarrier = false;
+
+		for (auto& usage : pass.usages)
+		{
+			Resource& res = resources[usage.resource];
+
+			VkImageMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = res.image;
+			barrier.subresourceRange = { res.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+			barrier.dstAccessMask = usage.access;
+
+			if (res.transient && !res.touched)
+			{
+				// memory can be aliased with image used earlier in this frame or by previous frame, wait every previous use
+				srcStages |= VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+				dstStages |= usage.stage;
+				if (usage.initialLayout != VK_IMAGE_LAYOUT_UNDEFINED)
+				{
+					barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+					barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+					barrier.newLayout = usage.initialLayout;
+					imageBarriers.push_back(barrier);
+				}
+				else
+				{
+					memoryBarrier = true;
+					memorySrcAccess |= VK_ACCESS_MEMORY_WRITE_BIT;
+					memoryDstAccess |= usage.access;
+				}
+			}
+			else
+			{
+				bool transition = usage.initialLayout != VK_IMAGE_LAYOUT_UNDEFINED && usage.initialLayout != res.layout;
+				// read after write, write after write and write after read, read after read is free
+				bool hazard = res.stage != 0 && (res.written || usage.write);
+				if (transition || hazard)
+				{
+					srcStages |= res.stage != 0 ? res.stage : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+					dstStages |= usage.stage;
+					barrier.srcAccessMask = res.written ? res.access : 0;
+					barrier.oldLayout = res.layout;
+					barrier.newLayout = transition ? usage.initialLayout : res.layout;
+					if (barrier.newLayout == VK_IMAGE_LAYOUT_UNDEFINED)
+					{
+						// nothing to transition, only execution dependency is needed
+						memoryBarrier = true;
+						memorySrcAccess |= barrier.srcAccessMask;
+						memoryDstAccess |= usage.access;
+					}
+					else
+					{
+						imageBarriers.push_back(barrier);
+					}
+				}
+			}
+
+			// reads after reads accumulate, so next write waits for every reader
+			if (!usage.write && !res.written && res.touched)
+			{
+				res.stage |= usage.stage;
+				res.access |= usage.access;
+			}
+			else
+			{
+				res.stage = usage.stage;
+				res.access = usage.access;
+			}
+			res.layout = usage.finalLayout;
+			res.written = usage.write;
+			res.touched = true;
+		}
+
+		if (imageBarriers.empty() && !memoryBarrier)
+		{
+			return;
+		}
+
+		VkMemoryBarrier globalBarrier{};
+		globalBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		globalBarrier.srcAccessMask = memorySrcAccess;
+		globalBarrier.dstAccessMask = memoryDstAccess;
+		cmd::pipelineBarrier(cmd, srcStages, dstStages, 0, memoryBarrier ? 1 : 0, &globalBarrier, 0, nullptr,
+			static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+	}
+
+	void RenderGraph::printReport() const
+	{
+		uint32_t transientCount = 0;
+		std::string transientNames;
+		for (auto& res : resources)
+		{
+			if (res.transient)
+			{
+				transientNames += (transientCount++ ? ", " : "") + res.name;
+			}
+		}
+		// render system attachments aren't in it, so this is not peak of frame
+		std::cout << "[render graph] " << passes.size() << " passes, " << transientCount << " graph owned transient images (" << transientNames << ") in "
+			<< memoryBlocks.size() << " allocations, " << transientMemorySize / 1024 << " KB (" << unaliasedMemorySize / 1024 << " KB without aliasing)" << std::endl;
+	}
+
+	void RenderGraph::destroyTransients()
+	{
+		// frames in flight may still use them, graph is rebuilt without waiting idle
+		std::vector<VkImageView> views;
+		std::vector<VkImage> images;
+		std::vector<VkDeviceMemory> memories;
+		for (auto& res : resources)
+		{
+			if (!res.transient)
+			{
+				continue;
+			}
+			if (res.view != VK_NULL_HANDLE)
+			{
+				views.push_back(res.view);
+				res.view = VK_NULL_HANDLE;
+			}
+			if (res.image != VK_NULL_HANDLE)
+			{
+				images.push_back(res.image);
+				res.image = VK_NULL_HANDLE;
+			}
+		}
+		for (auto& block : memoryBlocks)
+		{
+			memories.push_back(block.memory);
+		}
+		memoryBlocks.clear();
+
+		if (!views.empty() || !images.empty() || !memories.empty())
+		{
+			VkDevice logicalDevice = device.getLogicalDevice();
+			device.getDeletionQueue().retire([logicalDevice, views, images, memories]() {
+				for (auto view : views)
+				{
+					vkDestroyImageView(logicalDevice, view, nullptr);
+				}
+				for (auto image : images)
+				{
+					vkDestroyImage(logicalDevice, image, nullptr);
+				}
+				for (auto memory : memories)
+				{
+					vkFreeMemory(logicalDevice, memory, nullptr);
+				}
+			});
+		}
+		transientMemorySize = 0;
+		unaliasedMemorySize = 0;
+	}
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include "Device.h"
+#include "FrameInfo.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace jhb {
+	// frame graph, passes declare which images they read and write and graph records barriers and layout transitions between them.
+	// passes run in declaration order. a pass is culled for the frame when its condition is false or nothing live uses what it writes.
+	// transient images are owned by graph, images whose pass ranges don't overlap share one memory allocation.
+	// only images made by createImage are aliased, attachments render systems own (gbuffer, msaa color, taa history) are outside of it
+	class RenderGraph
+	{
+	public:
+		using ResourceHandle = uint32_t;
+		using ExecuteFunc = std::function<void(FrameInfo&)>;
+
+		struct ImageDesc {
+			VkFormat format;
+			VkExtent2D extent;
+			VkImageUsageFlags usage;
+			VkImageAspectFlags aspect;
+		};
+
+		class PassBuilder {
+		public:
+			PassBuilder(RenderGraph& graph, uint32_t passIndex) : graph{ graph }, passIndex{ passIndex } {}
+
+			PassBuilder& read(ResourceHandle resource, VkImageLayout layout, VkPipelineStageFlags stage, VkAccessFlags access);
+			// initialLayout undefined means old contents are discarded, pass (render pass) moves image to finalLayout by itself
+			PassBuilder& write(ResourceHandle resource, VkImageLayout initialLayout, VkImageLayout finalLayout, VkPipelineStageFlags stage, VkAccessFlags access);
+			// evaluated every frame, false culls this pass and every pass only feeding it
+			PassBuilder& condition(std::function<bool()> enabled);
+			// never culled by usage, for passes with results outside of graph (readback, present)
+			PassBuilder& sideEffect();
+
+		private:
+			RenderGraph& graph;
+			uint32_t passIndex;
+		};
+
+	public:
+		RenderGraph(Device& device);
+		~RenderGraph();
+
+		RenderGraph(const RenderGraph&) = delete;
+		RenderGraph& operator=(const RenderGraph&) = delete;
+
+		ResourceHandle createImage(const std::string& name, const ImageDesc& desc);
+		ResourceHandle importImage(const std::string& name, VkImage image, VkImageAspectFlags aspect, VkImageLayout layout);
+		// swapchain image changes every frame, state is reset because acquire semaphore already orders it
+		void setImportedImage(ResourceHandle resource, VkImage image, VkImageLayout layout);
+		// contents are used after graph (present), passes writing it are kept
+		void markOutput(ResourceHandle resource);
+		PassBuilder addPass(const std::string& name, ExecuteFunc execute);
+
+		// create and alias transient images, must be called after every pass is added
+		void compile();
+		void execute(FrameInfo& frameInfo);
+
+		VkImage getImage(ResourceHandle resource) const { return resources[resource].image; }
+		VkImageView getImageView(ResourceHandle resource) const { return resources[resource].view; }
+		// graph owned transients only, not transient memory of whole frame
+		VkDeviceSize getTransientMemorySize() const { return transientMemorySize; }
+		VkDeviceSize getUnaliasedMemorySize() const { return unaliasedMemorySize; }
+		uint32_t getExecutedPassCount() const { return executedPassCount; }
+		// gpu times of frame slot read at start of last execute, so they lag MAX_FRAMES_IN_FLIGHT frames behind.
+		// negative when pass was culled or timestamps are not supported
+		bool hasGpuTimes() const { return timestampsSupported; }
+		uint32_t getPassCount() const { return static_cast<uint32_t>(passes.size()); }
+		const std::string& getPassName(uint32_t pass) const { return passes[pass].name; }
+		const std::vector<double>& getPassGpuTimes() const { return passGpuMs; }
+		double getFrameGpuTime() const { return frameGpuMs; }
+		void printReport() const;
+
+	private:
+		struct Usage {
+			ResourceHandle resource;
+			VkImageLayout initialLayout;
+			VkImageLayout finalLayout;
+			VkPipelineStageFlags stage;
+			VkAccessFlags access;
+			bool write;
+		};
+
+		struct Pass {
+			std::string name;
+			ExecuteFunc execute;
+			std::function<bool()> enabled;
+			std::vector<Usage> usages;
+			bool sideEffect = false;
+		};
+
+		struct Resource {
+			std::string name;
+			ImageDesc desc{};
+			bool transient = false;
+			bool output = false;
+			VkImage image = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+			VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+
+			// tracked state, imported images keep it across frames
+			VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkPipelineStageFlags stage = 0;
+			VkAccessFlags access = 0;
+			bool written = false;
+			bool touched = false;
+		};
+
+		struct MemoryBlock {
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkDeviceSize size = 0;
+			uint32_t memoryTypeBits = ~0u;
+			std::vector<ResourceHandle> resources;
+		};
+
+		void cullPasses(FrameVector<bool>& live);
+		void recordBarriers(VkCommandBuffer cmd, const Pass& pass);
+		void destroyTransients();
+		void createQueryPool();
+		void readTimestamps(int frameIndex);
+
+	private:
+		Device& device;
+		std::vector<Pass> passes;
+		std::vector<Resource> resources;
+		std::vector<MemoryBlock> memoryBlocks;
+
+		VkDeviceSize transientMemorySize = 0;
+		VkDeviceSize unaliasedMemorySize = 0;
+		uint32_t executedPassCount = 0;
+
+		// two timestamps per pass per frame slot
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		bool timestampsSupported = false;
+		std::vector<bool> queriesWritten;
+		std::vector<double> passGpuMs;
+		double frameGpuMs = -1.0;
+	};
+}
@@ -1,4 +1,5 @@
 #include "Renderer.h"
+#include "CommandStats.h"
 #include <memory>
 #include <array>
 
@@ -51,6 +52,7 @@ namespace jhb {
 		}
 
 		vkDeviceWaitIdle(device.getLogicalDevice()); // wait until current swapchain is no longer being used
+		device.getDeletionQueue().flush(); // already idle, so everything retired can go
 
 		if (swapChain == nullptr)
 		{
@@ -72,17 +74,19 @@ namespace jhb {
 		// todo
 	}
 
-	void Renderer::excuteComputeDispatch(const VkCommandBuffer* buffers)
-	{
-		swapChain->submitComputeCommandBuffers(buffers);
-	}
-
 	VkCommandBuffer Renderer::beginFrame()
 	{
 		assert(!isFrameStarted && "Can't call beginFrame while already in progress");
 
 		auto result = swapChain->acquireNextImage(&currentImageIndex);
 
+		// fence of this frame slot was waited, so submission MAX_FRAMES_IN_FLIGHT frames ago and all before it are done
+		auto& deletionQueue = device.getDeletionQueue();
+		if (deletionQueue.getSubmittedFrames() >= SwapChain::MAX_FRAMES_IN_FLIGHT)
+		{
+			deletionQueue.collect(deletionQueue.getSubmittedFrames() - SwapChain::MAX_FRAMES_IN_FLIGHT + 1);
+		}
+
 		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || window.wasWindowResized())
 		{
 			// right after window resized
@@ -96,6 +100,7 @@ namespace jhb {
 		}
 
 		isFrameStarted = true;
+		device.getFrameArena().beginFrame(currentFrameIndex);
 		auto commandBuffer = getCurrentCommandBuffer();
 
 		VkCommandBufferBeginInfo beginInfo{};
@@ -107,7 +112,7 @@ namespace jhb {
 		return commandBuffer;
 	}
 
-	void Renderer::endFrame()
+	void Renderer::endFrame(const SwapChain::TimelineSync* timelineSync)
 	{
 		assert(isFrameStarted && "Can't call endFrame while frame is not in progress!!");
 		auto commandBuffer = getCurrentCommandBuffer();
@@ -116,7 +121,10 @@ namespace jhb {
 			throw std::runtime_error("failed to record command buffer!");
 		}
 
-		auto result = swapChain->submitCommandBuffers(&commandBuffer, &currentImageIndex);
+		auto result = swapChain->submitCommandBuffers(&commandBuffer, &currentImageIndex, timelineSync);
+		device.getDeletionQueue().frameSubmitted();
+		// swapchain recreate below and anything until next frame allocates from heap
+		device.getFrameArena().endFrame();
 		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || window.wasWindowResized())
 		{
 			//window.resetWindowResizedFlag();
@@ -146,35 +154,29 @@ namespace jhb {
 		renderPassInfo.renderPass = renderPass;
 		renderPassInfo.framebuffer = frameBuffer;
 
-		float halfWidth = extent.width / 2;
-		float halfHeight = extent.height / 2;
-		if (x - halfWidth < 0)
-		{
-			x = halfWidth;
-		}
-		if (y - halfHeight < 0)
-		{
-			y = halfHeight;
-		}
-		renderPassInfo.renderArea.offset = { 0, 0 };
-		renderPassInfo.renderArea.extent = { extent.width, extent.height };
+		// only the texel under cursor is rasterized and cleared, picking reads just that one
+		int32_t pickX = std::clamp(static_cast<int32_t>(x), 0, static_cast<int32_t>(extent.width) - 1);
+		int32_t pickY = std::clamp(static_cast<int32_t>(y), 0, static_cast<int32_t>(extent.height) - 1);
+		renderPassInfo.renderArea.offset = { pickX, pickY };
+		renderPassInfo.renderArea.extent = { 1, 1 };
 
+		// 0 is background id
 		std::array<VkClearValue, 2> clearValues{};
-		clearValues[0].color = { 0.2f, 0.2f, 0.2f, 1.f };
+		clearValues[0].color = { 0, 0, 0, 0 };
 		clearValues[1].depthStencil = { 1.0f, 0 };
 		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
 		renderPassInfo.pClearValues = clearValues.data();
 
-		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		cmd::beginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 		VkViewport viewport{};
-		viewport.x = x - halfWidth;
-		viewport.y = y - halfHeight;
+		viewport.x = 0.0f;
+		viewport.y = 0.0f;
 		viewport.width = static_cast<float>(extent.width);
 		viewport.height = static_cast<float>(extent.height);
 		viewport.minDepth = 0.0f;
 		viewport.maxDepth = 1.0f;
-		VkRect2D scissor{ {0, 0}, {extent.width, extent.height} };
+		VkRect2D scissor = renderPassInfo.renderArea;
 		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 	}
@@ -198,7 +200,7 @@ namespace jhb {
 			return false;
 		}
 
-		std::vector<VkClearValue> clearValues(attachmentCount);
+		FrameVector<VkClearValue> clearValues(attachmentCount, VkClearValue{}, device.getFrameArena());
 		for (int i = 0; i < attachmentCount; i++)
 		{
 			if (i == 6)
@@ -212,7 +214,7 @@ namespace jhb {
 		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
 		renderPassInfo.pClearValues = clearValues.data();
 
-		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		cmd::beginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 		VkViewport viewport{};
 		viewport.x = 0.0f;
@@ -31,13 +31,14 @@ namespace jhb {
 		VkRenderPass getSwapChainRenderPass() const { return swapChain->getRenderPass(); }
 		VkImageView getSwapChainImageView(int index) { return swapChain->getSwapChianImageView(index); }
 		const std::vector<VkImageView>& getSwapChainImageViews() const { return swapChain->getSwapChianImageViews(); }
+		VkImage getSwapChainImage(int index) const { return swapChain->getSwapChainImage(index); }
 		float getAspectRatio() const { return swapChain->extentAspectRatio(); }
 		void setWindowExtent(VkExtent2D _extent) { extent = _extent; }
 
-		void excuteComputeDispatch(const VkCommandBuffer* buffers);
 
 		VkCommandBuffer beginFrame();
-		void endFrame();
+		// timelineSync adds async compute wait and signal to this frame's submission
+		void endFrame(const SwapChain::TimelineSync* timelineSync = nullptr);
 		bool beginSwapChainRenderPass(VkCommandBuffer commandBuffer, VkRenderPass renderPass, VkFramebuffer frameBuffer, VkExtent2D extent, int attachmentCount = 2);
 		void beginSwapChainRenderPass(VkCommandBuffer commandBuffer);
 		void beginSwapChainRenderPassWithMouseCoordinate(VkCommandBuffer commandBuffer, VkRenderPass renderPass, VkFramebuffer frameBuffer, VkExtent2D extent, float x, float y);
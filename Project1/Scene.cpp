@@ -1 +1,166 @@
 #include "Scene.h"
+
+#include <glm/gtc/constants.hpp>
+
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+namespace jhb {
+	namespace {
+		bool setSceneValue(SceneConfig& config, const std::string& key, const std::string& value)
+		{
+			if (key == "scene") config.name = value;
+			else if (key == "instances") config.instanceCount = static_cast<uint32_t>(std::stoul(value));
+			else if (key == "models") config.modelCount = static_cast<uint32_t>(std::stoul(value));
+			else if (key == "materials") config.materialCount = static_cast<uint32_t>(std::stoul(value));
+			else if (key == "lights") config.lightCount = static_cast<uint32_t>(std::stoul(value));
+			else if (key == "seed") config.seed = static_cast<uint32_t>(std::stoul(value));
+			else if (key == "spacing") config.spacing = std::stof(value);
+			else if (key == "extent") config.extent = std::stof(value);
+			else if (key == "sponza") config.sponza = value != "0";
+			else if (key == "distribution")
+			{
+				if (value == "grid") config.distribution = SceneConfig::Distribution::Grid;
+				else if (value == "random") config.distribution = SceneConfig::Distribution::Random;
+				else throw std::runtime_error("unknown scene distribution " + value + "!");
+			}
+			else if (key == "model")
+			{
+				if (!config.modelFilesSet)
+				{
+					config.modelFiles.clear();
+					config.modelFilesSet = true;
+				}
+				config.modelFiles.push_back(value);
+			}
+			else return false;
+			return true;
+		}
+
+		// same numbers on every platform, std distributions are implementation defined
+		float random01(std::mt19937& rng)
+		{
+			return (rng() >> 8) * (1.f / 16777216.f);
+		}
+	}
+
+	bool SceneConfig::parseOption(int argc, char** argv, int& i)
+	{
+		std::string arg = argv[i];
+		if (arg.rfind("--", 0) != 0 || i + 1 >= argc)
+		{
+			return false;
+		}
+
+		if (arg == "--scene-config")
+		{
+			load(argv[++i]);
+			return true;
+		}
+		if (setSceneValue(*this, arg.substr(2), argv[i + 1]))
+		{
+			i++;
+			return true;
+		}
+		return false;
+	}
+
+	void SceneConfig::load(const std::string& filepath)
+	{
+		std::ifstream file{ filepath };
+		if (!file.is_open())
+		{
+			throw std::runtime_error("failed to open scene config " + filepath + "!");
+		}
+
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::istringstream stream{ line };
+			std::string key, value;
+			if (!(stream >> key) || key[0] == '#')
+			{
+				continue;
+			}
+			if (!(stream >> value) || !setSceneValue(*this, key, value))
+			{
+				throw std::runtime_error("failed to parse scene config line " + line + "!");
+			}
+		}
+	}
+
+	void SceneConfig::validate() const
+	{
+		if (name != "sponza" && name != "stress")
+		{
+			throw std::runtime_error("unknown scene " + name + "!");
+		}
+		if (name == "sponza")
+		{
+			return;
+		}
+		// every model needs one game object to draw its instances
+		if (modelCount == 0 || instanceCount < modelCount)
+		{
+			throw std::runtime_error("stress scene needs at least one instance per model!");
+		}
+		if (materialCount == 0 || lightCount == 0 || modelFiles.empty())
+		{
+			throw std::runtime_error("stress scene needs at least one material, light and model file!");
+		}
+	}
+
+	float SceneConfig::getRadius() const
+	{
+		if (distribution == Distribution::Random)
+		{
+			return extent * 0.5f;
+		}
+		return std::ceil(std::sqrt(static_cast<float>(instanceCount))) * spacing * 0.5f;
+	}
+
+	std::vector<SceneInstance> generateSceneInstances(const SceneConfig& config)
+	{
+		std::mt19937 rng{ config.seed };
+		std::vector<SceneInstance> instances(config.instanceCount);
+
+		uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(config.instanceCount))));
+		float half = (side - 1) * config.spacing * 0.5f;
+		for (uint32_t i = 0; i < config.instanceCount; i++)
+		{
+			SceneInstance& instance = instances[i];
+			instance.model = i % config.modelCount;
+			instance.material = config.materialCount > 1 ? rng() % config.materialCount : 0;
+
+			// y is down, same height as sponza helmets
+			if (config.distribution == SceneConfig::Distribution::Grid)
+			{
+				instance.position = { (i % side) * config.spacing - half, -1.5f, (i / side) * config.spacing - half };
+			}
+			else
+			{
+				float x = (random01(rng) - 0.5f) * config.extent;
+				float z = (random01(rng) - 0.5f) * config.extent;
+				instance.position = { x, -1.5f, z };
+			}
+			// helmet stands up with 90 degree around z, yaw varies
+			instance.rotation = { 0.f, random01(rng) * glm::two_pi<float>(), glm::radians(90.f) };
+		}
+		return instances;
+	}
+
+	glm::vec2 getSceneMaterial(uint32_t material)
+	{
+		if (material == 0)
+		{
+			return { 0.f, 0.f };
+		}
+		// golden ratio spreads roughness, metallic alternates. metallic never 0, that means keep
+		float roughness = 0.05f + 0.9f * std::fmod(material * 0.618034f, 1.f);
+		float metallic = (material & 1) ? 1.f : 0.02f;
+		return { roughness, metallic };
+	}
+}
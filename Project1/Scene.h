@@ -1,9 +1,67 @@
 #pragma once
 #include <unordered_map>
 #include <string>
+#include <vector>
 #include "Model.h"
 
 namespace jhb {
+	// which scene DeferedPBRRenderSystem builds. "sponza" is the hand placed scene, "stress" places
+	// instanceCount instances of modelCount models with materialCount material variants and lightCount lights.
+	// same config and seed always give same scene.
+	// from command line (--scene stress --instances 100000 ...) or a file of "key value" lines with the same names:
+	//   scene stress
+	//   instances 100000
+	//   models 4
+	//   materials 8
+	//   lights 4
+	//   seed 7
+	//   distribution random
+	//   spacing 3
+	//   extent 200
+	//   sponza 0
+	//   model Models/DamagedHelmet/DamagedHelmet.gltf
+	struct SceneConfig {
+		enum class Distribution {
+			Grid, // square grid on ground plane, spacing apart
+			Random, // uniform inside extent x extent square around origin
+		};
+
+		std::string name = "sponza";
+		uint32_t instanceCount = 1000;
+		uint32_t modelCount = 1;
+		uint32_t materialCount = 1;
+		uint32_t lightCount = 1;
+		uint32_t seed = 1;
+		Distribution distribution = Distribution::Grid;
+		float spacing = 3.f;
+		float extent = 200.f;
+		// keep sponza around generated instances
+		bool sponza = false;
+		// gltf files, model i loads modelFiles[i % size] into its own buffers
+		std::vector<std::string> modelFiles{ "Models/DamagedHelmet/DamagedHelmet.gltf" };
+		// first model entry replaces default list, later ones append
+		bool modelFilesSet = false;
+
+		// consumes option at argv[i] and its value, false when it is not a scene option
+		bool parseOption(int argc, char** argv, int& i);
+		void load(const std::string& filepath);
+		void validate() const;
+		// half size of area instances are placed in
+		float getRadius() const;
+	};
+
+	struct SceneInstance {
+		uint32_t model;
+		uint32_t material;
+		glm::vec3 position;
+		glm::vec3 rotation;
+	};
+
+	// placement of stress scene instances, instance i uses model i % modelCount
+	std::vector<SceneInstance> generateSceneInstances(const SceneConfig& config);
+	// roughness, metallic of material variant, variant 0 keeps model's own material
+	glm::vec2 getSceneMaterial(uint32_t material);
+
 	class Scene {
 	public:
 
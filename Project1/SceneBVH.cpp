@@ -0,0 +1,546 @@
+#include "SceneBVH.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <numeric>
+#include <array>
+
+namespace jhb {
+	// binned sah, 16 bins is close to full sweep quality and a lot cheaper for sponza sized meshes
+	static constexpr int BIN_COUNT = 16;
+	static constexpr uint32_t MAX_LEAF_SIZE = 4;
+	static constexpr int STACK_SIZE = 64;
+
+	// fixed array covers any balanced tree, deeper ones (sah can't split many coincident boxes evenly) spill to heap instead of dropping nodes
+	struct TraversalStack {
+		std::array<uint32_t, STACK_SIZE> fixed;
+		std::vector<uint32_t> overflow;
+		int top = 0;
+
+		bool empty() const { return top == 0; }
+		void push(uint32_t node)
+		{
+			if (top < STACK_SIZE)
+			{
+				fixed[top] = node;
+			}
+			else
+			{
+				overflow.push_back(node);
+			}
+			top++;
+		}
+		uint32_t pop()
+		{
+			top--;
+			if (top < STACK_SIZE)
+			{
+				return fixed[top];
+			}
+			uint32_t node = overflow.back();
+			overflow.pop_back();
+			return node;
+		}
+	};
+
+	float SceneBVH::AABB::area() const
+	{
+		if (!valid())
+		{
+			return 0.f;
+		}
+		glm::vec3 e = max - min;
+		return e.x * e.y + e.y * e.z + e.z * e.x;
+	}
+
+	void SceneBVH::build(const GameObject::Map& gameObjects)
+	{
+		meshes.clear();
+		meshLookup.clear();
+		instances.clear();
+
+		for (auto& kv : gameObjects)
+		{
+			auto& obj = kv.second;
+			if (obj.model == nullptr)
+			{
+				continue;
+			}
+			for (auto node : obj.model->nodes)
+			{
+				addMeshNodes(obj, node);
+			}
+		}
+
+		std::vector<AABB> boxes(instances.size());
+		for (size_t i = 0; i < instances.size(); i++)
+		{
+			updateInstance(instances[i]);
+			boxes[i] = instances[i].bounds;
+		}
+		buildNodes(boxes, topNodes, topItems);
+	}
+
+	void SceneBVH::refit()
+	{
+		for (auto& instance : instances)
+		{
+			updateInstance(instance);
+		}
+
+		// children are always pushed after parent, so reverse order visits children first
+		for (int i = static_cast<int>(topNodes.size()) - 1; i >= 0; i--)
+		{
+			BVHNode& node = topNodes[i];
+			node.bounds = AABB{};
+			if (node.count > 0)
+			{
+				for (uint32_t j = 0; j < node.count; j++)
+				{
+					node.bounds.grow(instances[topItems[node.leftFirst + j]].bounds);
+				}
+			}
+			else
+			{
+				node.bounds.grow(topNodes[node.leftFirst].bounds);
+				node.bounds.grow(topNodes[node.leftFirst + 1].bounds);
+			}
+		}
+	}
+
+	bool SceneBVH::rayCast(const Ray& ray, RayHit& hit, float maxDistance) const
+	{
+		hit.distance = maxDistance;
+		if (topNodes.empty())
+		{
+			return false;
+		}
+
+		bool found = false;
+		glm::vec3 invDirection = 1.f / ray.direction;
+		TraversalStack stack;
+		stack.push(0);
+
+		while (!stack.empty())
+		{
+			const BVHNode& node = topNodes[stack.pop()];
+			if (intersectAABB(node.bounds, ray.origin, invDirection, hit.distance) >= hit.distance)
+			{
+				continue;
+			}
+
+			if (node.count > 0)
+			{
+				for (uint32_t i = 0; i < node.count; i++)
+				{
+					const Instance& instance = instances[topItems[node.leftFirst + i]];
+					// direction is not normalized in local space, so t stays world distance
+					Ray localRay{ glm::vec3(instance.toLocal * glm::vec4(ray.origin, 1.f)), glm::mat3(instance.toLocal) * ray.direction };
+					if (rayCastMesh(instance, localRay, hit))
+					{
+						found = true;
+					}
+				}
+				continue;
+			}
+
+			// push far child first so near child is visited first
+			float leftDistance = intersectAABB(topNodes[node.leftFirst].bounds, ray.origin, invDirection, hit.distance);
+			float rightDistance = intersectAABB(topNodes[node.leftFirst + 1].bounds, ray.origin, invDirection, hit.distance);
+			uint32_t nearChild = leftDistance <= rightDistance ? node.leftFirst : node.leftFirst + 1;
+			stack.push(nearChild == node.leftFirst ? node.leftFirst + 1 : node.leftFirst);
+			stack.push(nearChild);
+		}
+		return found;
+	}
+
+	void SceneBVH::queryFrustum(const glm::mat4& viewProjection, std::vector<uint32_t>& instanceIds) const
+	{
+		instanceIds.clear();
+		if (topNodes.empty())
+		{
+			return;
+		}
+
+		// gribb-hartmann planes, depth is zero to one so near plane is just third row
+		glm::mat4 m = glm::transpose(viewProjection);
+		std::array<glm::vec4, 6> planes = { m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[2], m[3] - m[2] };
+
+		auto outside = [&planes](const AABB& box) {
+			for (auto& plane : planes)
+			{
+				// farthest corner along plane normal
+				glm::vec3 p{ plane.x >= 0.f ? box.max.x : box.min.x, plane.y >= 0.f ? box.max.y : box.min.y, plane.z >= 0.f ? box.max.z : box.min.z };
+				if (glm::dot(glm::vec3(plane), p) + plane.w < 0.f)
+				{
+					return true;
+				}
+			}
+			return false;
+		};
+
+		TraversalStack stack;
+		stack.push(0);
+		while (!stack.empty())
+		{
+			const BVHNode& node = topNodes[stack.pop()];
+			if (outside(node.bounds))
+			{
+				continue;
+			}
+
+			if (node.count > 0)
+			{
+				for (uint32_t i = 0; i < node.count; i++)
+				{
+					const Instance& instance = instances[topItems[node.leftFirst + i]];
+					if (!outside(instance.bounds))
+					{
+						instanceIds.push_back(instance.instanceId);
+					}
+				}
+			}
+			else
+			{
+				stack.push(node.leftFirst);
+				stack.push(node.leftFirst + 1);
+			}
+		}
+
+		// one instance can have several mesh nodes
+		std::sort(instanceIds.begin(), instanceIds.end());
+		instanceIds.erase(std::unique(instanceIds.begin(), instanceIds.end()), instanceIds.end());
+	}
+
+	Ray SceneBVH::screenRay(const glm::mat4& inverseViewProjection, float x, float y, float width, float height)
+	{
+		glm::vec2 ndc{ x / width * 2.f - 1.f, y / height * 2.f - 1.f };
+		glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndc, 0.f, 1.f);
+		glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndc, 1.f, 1.f);
+		nearPoint /= nearPoint.w;
+		farPoint /= farPoint.w;
+		return Ray{ glm::vec3(nearPoint), glm::normalize(glm::vec3(farPoint - nearPoint)) };
+	}
+
+	size_t SceneBVH::getTriangleCount() const
+	{
+		size_t count = 0;
+		for (auto& mesh : meshes)
+		{
+			count += mesh.triangles.size();
+		}
+		return count;
+	}
+
+	void SceneBVH::buildNodes(const std::vector<AABB>& boxes, std::vector<BVHNode>& nodes, std::vector<uint32_t>& items)
+	{
+		nodes.clear();
+		items.resize(boxes.size());
+		std::iota(items.begin(), items.end(), 0);
+		if (boxes.empty())
+		{
+			return;
+		}
+
+		nodes.reserve(boxes.size() * 2);
+		BVHNode root{};
+		root.leftFirst = 0;
+		root.count = static_cast<uint32_t>(boxes.size());
+		nodes.push_back(root);
+		subdivide(boxes, nodes, items, 0);
+	}
+
+	void SceneBVH::subdivide(const std::vector<AABB>& boxes, std::vector<BVHNode>& nodes, std::vector<uint32_t>& items, uint32_t nodeIndex)
+	{
+		// nodes can grow below, so never keep reference over push_back
+		uint32_t first = nodes[nodeIndex].leftFirst;
+		uint32_t count = nodes[nodeIndex].count;
+
+		AABB bounds;
+		AABB centroidBounds;
+		for (uint32_t i = first; i < first + count; i++)
+		{
+			bounds.grow(boxes[items[i]]);
+			centroidBounds.grow(boxes[items[i]].center());
+		}
+		nodes[nodeIndex].bounds = bounds;
+
+		if (count <= 1)
+		{
+			return;
+		}
+
+		int bestAxis = -1;
+		int bestSplit = 0;
+		float bestCost = (std::numeric_limits<float>::max)();
+		glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (extent[axis] <= 0.f)
+			{
+				continue;
+			}
+
+			std::array<AABB, BIN_COUNT> binBounds{};
+			std::array<uint32_t, BIN_COUNT> binCounts{};
+			float scale = BIN_COUNT / extent[axis];
+			for (uint32_t i = first; i < first + count; i++)
+			{
+				const AABB& box = boxes[items[i]];
+				int bin = std::min(BIN_COUNT - 1, static_cast<int>((box.center()[axis] - centroidBounds.min[axis]) * scale));
+				binCounts[bin]++;
+				binBounds[bin].grow(box);
+			}
+
+			// sweep from both sides, split i puts bins [0, i) on the left
+			std::array<float, BIN_COUNT - 1> leftAreas{};
+			std::array<uint32_t, BIN_COUNT - 1> leftCounts{};
+			AABB leftBox;
+			uint32_t leftSum = 0;
+			for (int i = 0; i < BIN_COUNT - 1; i++)
+			{
+				leftSum += binCounts[i];
+				leftBox.grow(binBounds[i]);
+				leftCounts[i] = leftSum;
+				leftAreas[i] = leftBox.area();
+			}
+
+			AABB rightBox;
+			uint32_t rightSum = 0;
+			for (int i = BIN_COUNT - 1; i > 0; i--)
+			{
+				rightSum += binCounts[i];
+				rightBox.grow(binBounds[i]);
+				float cost = leftCounts[i - 1] * leftAreas[i - 1] + rightSum * rightBox.area();
+				if (leftCounts[i - 1] > 0 && rightSum > 0 && cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = i;
+				}
+			}
+		}
+
+		// every centroid is at same point
+		if (bestAxis < 0)
+		{
+			return;
+		}
+
+		float leafCost = count * bounds.area();
+		if (count <= MAX_LEAF_SIZE && bestCost >= leafCost)
+		{
+			return;
+		}
+
+		float scale = BIN_COUNT / extent[bestAxis];
+		auto middle = std::partition(items.begin() + first, items.begin() + first + count, [&](uint32_t item) {
+			int bin = std::min(BIN_COUNT - 1, static_cast<int>((boxes[item].center()[bestAxis] - centroidBounds.min[bestAxis]) * scale));
+			return bin < bestSplit;
+		});
+		uint32_t leftCount = static_cast<uint32_t>(middle - (items.begin() + first));
+		if (leftCount == 0 || leftCount == count)
+		{
+			return;
+		}
+
+		uint32_t leftIndex = static_cast<uint32_t>(nodes.size());
+		BVHNode left{};
+		left.leftFirst = first;
+		left.count = leftCount;
+		BVHNode right{};
+		right.leftFirst = first + leftCount;
+		right.count = count - leftCount;
+		nodes.push_back(left);
+		nodes.push_back(right);
+
+		nodes[nodeIndex].leftFirst = leftIndex;
+		nodes[nodeIndex].count = 0;
+
+		subdivide(boxes, nodes, items, leftIndex);
+		subdivide(boxes, nodes, items, leftIndex + 1);
+	}
+
+	float SceneBVH::intersectAABB(const AABB& box, const glm::vec3& origin, const glm::vec3& invDirection, float maxDistance)
+	{
+		glm::vec3 t0 = (box.min - origin) * invDirection;
+		glm::vec3 t1 = (box.max - origin) * invDirection;
+		glm::vec3 tmin = glm::min(t0, t1);
+		glm::vec3 tmax = glm::max(t0, t1);
+		float enter = std::max(std::max(tmin.x, tmin.y), std::max(tmin.z, 0.f));
+		float exit = std::min(std::min(tmax.x, tmax.y), std::min(tmax.z, maxDistance));
+		return enter <= exit ? enter : (std::numeric_limits<float>::max)();
+	}
+
+	void SceneBVH::addMeshNodes(const GameObject& gameObject, const Node* node)
+	{
+		const Model& model = *gameObject.model;
+		if (!node->mesh.primitives.empty())
+		{
+			uint32_t mesh = buildMesh(model, node);
+			if (!meshes[mesh].nodes.empty())
+			{
+				Instance instance{};
+				instance.instanceId = gameObject.getId();
+				instance.object = &gameObject;
+				instance.model = gameObject.model;
+				instance.node = node;
+				instance.mesh = mesh;
+				instances.push_back(instance);
+			}
+		}
+
+		for (auto child : node->children)
+		{
+			addMeshNodes(gameObject, child);
+		}
+	}
+
+	uint32_t SceneBVH::buildMesh(const Model& model, const Node* node)
+	{
+		auto it = meshLookup.find(node);
+		if (it != meshLookup.end())
+		{
+			return it->second;
+		}
+
+		const auto& positions = model.getPositions();
+		const auto& indices = model.getIndices();
+
+		std::vector<uint32_t> triangles;
+		std::vector<AABB> boxes;
+		for (auto& primitive : node->mesh.primitives)
+		{
+			for (uint32_t i = primitive.firstIndex; i + 2 < primitive.firstIndex + primitive.indexCount && i + 2 < indices.size(); i += 3)
+			{
+				AABB box;
+				box.grow(positions[indices[i]]);
+				box.grow(positions[indices[i + 1]]);
+				box.grow(positions[indices[i + 2]]);
+				triangles.push_back(i);
+				boxes.push_back(box);
+			}
+		}
+
+		MeshBVH mesh;
+		std::vector<uint32_t> order;
+		buildNodes(boxes, mesh.nodes, order);
+		mesh.triangles.resize(order.size());
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			mesh.triangles[i] = triangles[order[i]];
+		}
+
+		uint32_t meshIndex = static_cast<uint32_t>(meshes.size());
+		meshes.push_back(std::move(mesh));
+		meshLookup.emplace(node, meshIndex);
+		return meshIndex;
+	}
+
+	void SceneBVH::updateInstance(Instance& instance)
+	{
+		// same data InstanceBatcher gathers into instance stream
+		const TransformComponent& data = instance.object->transform;
+
+		// same rotation as deferedoffscreen.vert, shader does position * rotMat so transpose here
+		glm::mat3 mx, my, mz;
+		float s = sin(data.rotation.x);
+		float c = cos(data.rotation.x);
+		mx[0] = glm::vec3(c, s, 0.f);
+		mx[1] = glm::vec3(-s, c, 0.f);
+		mx[2] = glm::vec3(0.f, 0.f, 1.f);
+
+		s = sin(data.rotation.y);
+		c = cos(data.rotation.y);
+		my[0] = glm::vec3(c, 0.f, s);
+		my[1] = glm::vec3(0.f, 1.f, 0.f);
+		my[2] = glm::vec3(-s, 0.f, c);
+
+		s = sin(data.rotation.z);
+		c = cos(data.rotation.z);
+		mz[0] = glm::vec3(1.f, 0.f, 0.f);
+		mz[1] = glm::vec3(0.f, c, s);
+		mz[2] = glm::vec3(0.f, -s, c);
+
+		glm::mat4 instanceMatrix = glm::translate(glm::mat4{ 1.f }, data.translation) * glm::mat4(glm::transpose(mz * my * mx));
+		instance.toWorld = instance.model->getNodeMatrix(instance.node) * instanceMatrix;
+		instance.toLocal = glm::inverse(instance.toWorld);
+
+		const AABB& local = meshes[instance.mesh].nodes[0].bounds;
+		instance.bounds = AABB{};
+		for (int i = 0; i < 8; i++)
+		{
+			glm::vec3 corner{ (i & 1) ? local.max.x : local.min.x, (i & 2) ? local.max.y : local.min.y, (i & 4) ? local.max.z : local.min.z };
+			instance.bounds.grow(glm::vec3(instance.toWorld * glm::vec4(corner, 1.f)));
+		}
+	}
+
+	bool SceneBVH::rayCastMesh(const Instance& instance, const Ray& localRay, RayHit& hit) const
+	{
+		const MeshBVH& mesh = meshes[instance.mesh];
+		const auto& positions = instance.model->getPositions();
+		const auto& indices = instance.model->getIndices();
+
+		bool found = false;
+		glm::vec3 invDirection = 1.f / localRay.direction;
+		TraversalStack stack;
+		stack.push(0);
+
+		while (!stack.empty())
+		{
+			const BVHNode& node = mesh.nodes[stack.pop()];
+			if (intersectAABB(node.bounds, localRay.origin, invDirection, hit.distance) >= hit.distance)
+			{
+				continue;
+			}
+
+			if (node.count > 0)
+			{
+				for (uint32_t i = 0; i < node.count; i++)
+				{
+					// moller-trumbore, double sided
+					uint32_t first = mesh.triangles[node.leftFirst + i];
+					const glm::vec3& v0 = positions[indices[first]];
+					glm::vec3 e1 = positions[indices[first + 1]] - v0;
+					glm::vec3 e2 = positions[indices[first + 2]] - v0;
+					glm::vec3 p = glm::cross(localRay.direction, e2);
+					float det = glm::dot(e1, p);
+					if (std::abs(det) < 1e-12f)
+					{
+						continue;
+					}
+					float invDet = 1.f / det;
+					glm::vec3 tv = localRay.origin - v0;
+					float u = glm::dot(tv, p) * invDet;
+					if (u < 0.f || u > 1.f)
+					{
+						continue;
+					}
+					glm::vec3 q = glm::cross(tv, e1);
+					float v = glm::dot(localRay.direction, q) * invDet;
+					if (v < 0.f || u + v > 1.f)
+					{
+						continue;
+					}
+					float t = glm::dot(e2, q) * invDet;
+					if (t > 0.f && t < hit.distance)
+					{
+						hit.distance = t;
+						hit.instanceId = instance.instanceId;
+						hit.primitiveIndex = first / 3;
+						found = true;
+					}
+				}
+				continue;
+			}
+
+			float leftDistance = intersectAABB(mesh.nodes[node.leftFirst].bounds, localRay.origin, invDirection, hit.distance);
+			float rightDistance = intersectAABB(mesh.nodes[node.leftFirst + 1].bounds, localRay.origin, invDirection, hit.distance);
+			uint32_t nearChild = leftDistance <= rightDistance ? node.leftFirst : node.leftFirst + 1;
+			stack.push(nearChild == node.leftFirst ? node.leftFirst + 1 : node.leftFirst);
+			stack.push(nearChild);
+		}
+		return found;
+	}
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include "GameObject.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <unordered_map>
+#include <limits>
+
+namespace jhb {
+	struct Ray {
+		glm::vec3 origin;
+		glm::vec3 direction; // normalized, so hit distance is world space distance
+	};
+
+	struct RayHit {
+		uint32_t instanceId; // game object id
+		uint32_t primitiveIndex; // triangle index in model index buffer (firstIndex / 3)
+		float distance;
+	};
+
+	// two level bvh on cpu, top level over instance bounds and bottom level over triangles of each mesh node.
+	// bottom level is built once per mesh and shared by instances, top level is refit when instance transforms change
+	class SceneBVH
+	{
+	public:
+		struct AABB {
+			glm::vec3 min{ (std::numeric_limits<float>::max)() };
+			glm::vec3 max{ -(std::numeric_limits<float>::max)() };
+
+			void grow(const glm::vec3& p) { min = glm::min(min, p); max = glm::max(max, p); }
+			void grow(const AABB& box) { min = glm::min(min, box.min); max = glm::max(max, box.max); }
+			glm::vec3 center() const { return (min + max) * 0.5f; }
+			float area() const;
+			bool valid() const { return min.x <= max.x; }
+		};
+
+		// flattened node, children are always stored next to each other at leftFirst and leftFirst + 1
+		struct BVHNode {
+			AABB bounds;
+			uint32_t leftFirst = 0; // left child index, or first item index when leaf
+			uint32_t count = 0; // > 0 means leaf
+		};
+
+	public:
+		SceneBVH() = default;
+
+		SceneBVH(const SceneBVH&) = delete;
+		SceneBVH& operator=(const SceneBVH&) = delete;
+
+		// every instanced gltf object is added, skybox has no instance data and always surrounds camera so it's skipped
+		void build(const GameObject::Map& gameObjects);
+		// recompute instance bounds from current object transforms and refit top level, no rebuild
+		void refit();
+
+		bool rayCast(const Ray& ray, RayHit& hit, float maxDistance = (std::numeric_limits<float>::max)()) const;
+		// game object ids whose bounds intersect frustum, sorted and unique
+		void queryFrustum(const glm::mat4& viewProjection, std::vector<uint32_t>& instanceIds) const;
+
+		// ray through pixel center, x and y are window coordinates
+		static Ray screenRay(const glm::mat4& inverseViewProjection, float x, float y, float width, float height);
+
+		size_t getTriangleCount() const;
+		size_t getInstanceCount() const { return instances.size(); }
+
+	private:
+		// bottom level, one per gltf node with mesh, in vertex space
+		struct MeshBVH {
+			std::vector<BVHNode> nodes;
+			std::vector<uint32_t> triangles; // first index of triangle in model index buffer, ordered by leaves
+		};
+
+		// top level item, one per (instance, mesh node)
+		struct Instance {
+			uint32_t instanceId;
+			// game objects live in map nodes, pointer stays valid until object is removed
+			const GameObject* object;
+			std::shared_ptr<Model> model;
+			const Node* node;
+			uint32_t mesh;
+			glm::mat4 toWorld{ 1.f };
+			glm::mat4 toLocal{ 1.f };
+			AABB bounds;
+		};
+
+		static void buildNodes(const std::vector<AABB>& boxes, std::vector<BVHNode>& nodes, std::vector<uint32_t>& items);
+		static void subdivide(const std::vector<AABB>& boxes, std::vector<BVHNode>& nodes, std::vector<uint32_t>& items, uint32_t nodeIndex);
+		static float intersectAABB(const AABB& box, const glm::vec3& origin, const glm::vec3& invDirection, float maxDistance);
+
+		void addMeshNodes(const GameObject& gameObject, const Node* node);
+		uint32_t buildMesh(const Model& model, const Node* node);
+		void updateInstance(Instance& instance);
+		bool rayCastMesh(const Instance& instance, const Ray& localRay, RayHit& hit) const;
+
+	private:
+		std::vector<MeshBVH> meshes;
+		std::unordered_map<const Node*, uint32_t> meshLookup;
+
+		std::vector<Instance> instances;
+		std::vector<BVHNode> topNodes;
+		std::vector<uint32_t> topItems;
+	};
+}
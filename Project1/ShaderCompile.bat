@@ -22,4 +22,11 @@ cd /d "%~dp0"
 %VULKAN_SDK%\Bin\glslc.exe .\shaders\deferedoffscreenSkybox.vert -o .\shaders\deferedoffscreenSkybox.vert.spv
 %VULKAN_SDK%\Bin\glslc.exe .\shaders\deferedoffscreenSkybox.frag -o .\shaders\deferedoffscreenSkybox.frag.spv
 %VULKAN_SDK%\Bin\glslc.exe .\shaders\computeCull.comp -o .\shaders\computeCull.comp.spv
+%VULKAN_SDK%\Bin\glslc.exe -DTAA .\shaders\deferedPBR.frag -o .\shaders\deferedPBRTAA.frag.spv
+%VULKAN_SDK%\Bin\glslc.exe .\shaders\taaResolve.frag -o .\shaders\taaResolve.frag.spv
+%VULKAN_SDK%\Bin\glslc.exe .\shaders\irradiancecube.comp -o .\shaders\irradiancecube.comp.spv
+%VULKAN_SDK%\Bin\glslc.exe .\shaders\prefilterenvmap.comp -o .\shaders\prefilterenvmap.comp.spv
+%VULKAN_SDK%\Bin\glslc.exe .\shaders\shirradiance.comp -o .\shaders\shirradiance.comp.spv
+%VULKAN_SDK%\Bin\glslc.exe .\shaders\meshletCull.comp -o .\shaders\meshletCull.comp.spv
+%VULKAN_SDK%\Bin\glslc.exe .\shaders\deferedDepthPrepass.frag -o .\shaders\deferedDepthPrepass.frag.spv
 exit /b 0
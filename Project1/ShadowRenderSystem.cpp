@@ -1,21 +1,23 @@
 #include "ShadowRenderSystem.h"
+#include "CommandStats.h"
+#include "MeshletCullSystem.h"
 #include <memory>
 #include <array>
 #include "GameObjectManager.h"
 
 namespace jhb {
-	ShadowRenderSystem::ShadowRenderSystem(Device& device, const std::string& vert, const std::string& frag)
-		:  BaseRenderSystem(device)
+	ShadowRenderSystem::ShadowRenderSystem(Device& device, UniformRing& uniformRing, const std::string& vert, const std::string& frag)
+		:  BaseRenderSystem(device), uniformRing{ uniformRing }
 	{
 		BaseRenderSystem::createPipeLineLayout({ initializeOffScreenDescriptor() }, { VkPushConstantRange{VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(OffscreenConstant) + sizeof(glm::mat4) } });
 		createOffscreenRenderPass();
 		createPipeline(offScreenRenderPass, vert, frag);
 		createShadowCubeMap();
-		createOffscreenFrameBuffer();
 	}
 
 	ShadowRenderSystem::~ShadowRenderSystem()
 	{
+		destroyOffscreenFrameBuffer();
 
 	}
 
@@ -62,54 +64,12 @@ namespace jhb {
 			pipelineConfig);
 	}
 
-	void ShadowRenderSystem::createOffscreenFrameBuffer()
+	void ShadowRenderSystem::createOffscreenFrameBuffer(VkImageView depthView)
 	{
-		VkFormat validDepthFormat = device.findSupportedFormat({ VK_FORMAT_D32_SFLOAT_S8_UINT,
-	VK_FORMAT_D32_SFLOAT,
-	VK_FORMAT_D24_UNORM_S8_UINT,
-	VK_FORMAT_D16_UNORM_S8_UINT,
-	VK_FORMAT_D16_UNORM
-			}, VK_IMAGE_TILING_OPTIMAL,
-			VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
-
-		// depth image create
-		VkImageCreateInfo imageCIa{};
-		imageCIa.imageType = VK_IMAGE_TYPE_2D;
-		imageCIa.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-		imageCIa.format = validDepthFormat;
-		imageCIa.extent = { offscreenImageSize.width, offscreenImageSize.height, 1 };
-		imageCIa.mipLevels = 1;
-		imageCIa.arrayLayers = 1;
-		imageCIa.samples = VK_SAMPLE_COUNT_1_BIT;
-		imageCIa.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		imageCIa.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-
-		device.createImageWithInfo(imageCIa, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, offScreenDepth.image, offScreenDepth.memory);
-		// Image view
-		VkImageViewCreateInfo viewCIa{};
-		viewCIa.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		viewCIa.format = validDepthFormat;
-		viewCIa.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-		viewCIa.subresourceRange = {};
-		viewCIa.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-		viewCIa.subresourceRange.baseArrayLayer = 0;
-		viewCIa.subresourceRange.baseMipLevel = 0;
-		viewCIa.subresourceRange.levelCount = 1;
-		viewCIa.subresourceRange.layerCount = 1;
-		viewCIa.image = offScreenDepth.image;
-		if (vkCreateImageView(device.getLogicalDevice(), &viewCIa, nullptr, &offScreenDepth.view))
-		{
-			throw std::runtime_error("failed to create ImageView!");
-		}
-
-		VkCommandBuffer cmd = device.beginSingleTimeCommands();
-
-		device.transitionImageLayout(cmd, offScreenDepth.image, VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
-
-		device.endSingleTimeCommands(cmd);
+		destroyOffscreenFrameBuffer();
 
 		VkImageView attachments[2];
-		attachments[1] = offScreenDepth.view;
+		attachments[1] = depthView;
 
 		VkFramebufferCreateInfo fbufCreateInfo{};
 		fbufCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
@@ -130,6 +90,25 @@ namespace jhb {
 		}
 	}
 
+	void ShadowRenderSystem::destroyOffscreenFrameBuffer()
+	{
+		for (auto& framebuffer : FramebuffersPerCubeFaces)
+		{
+			if (framebuffer != VK_NULL_HANDLE)
+			{
+				VkDevice logicalDevice = device.getLogicalDevice();
+				device.getDeletionQueue().retire([logicalDevice, framebuffer]() { vkDestroyFramebuffer(logicalDevice, framebuffer, nullptr); });
+				framebuffer = VK_NULL_HANDLE;
+			}
+		}
+	}
+
+	VkImageAspectFlags ShadowRenderSystem::getDepthAspect() const
+	{
+		bool hasStencil = depthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT || depthFormat == VK_FORMAT_D24_UNORM_S8_UINT || depthFormat == VK_FORMAT_D16_UNORM_S8_UINT;
+		return VK_IMAGE_ASPECT_DEPTH_BIT | (hasStencil ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+	}
+
 	VkRenderPass ShadowRenderSystem::createOffscreenRenderPass()
 	{
 		const VkFormat offscreenImageFormat{ VK_FORMAT_R32_SFLOAT };
@@ -153,11 +132,12 @@ namespace jhb {
 		osAttachments[0].initialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 		osAttachments[0].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-		// Depth attachment
+		// Depth attachment, only lives in this pass
+		depthFormat = validDepthFormat;
 		osAttachments[1].format = validDepthFormat;
 		osAttachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
 		osAttachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		osAttachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		osAttachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		osAttachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		osAttachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		osAttachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
@@ -293,22 +273,47 @@ namespace jhb {
 
 	std::vector<VkDescriptorSetLayout> ShadowRenderSystem::initializeOffScreenDescriptor()
 	{
-		descriptorPool = DescriptorPool::Builder(device).setMaxSets(1).addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1).build();
-
-		uboBuffer = std::make_unique<Buffer>(device, sizeof(UniformData), 1, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-		uboBuffer->map();
+		descriptorPool = DescriptorPool::Builder(device).setMaxSets(1).addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1).build();
 
 		descriptorSetLayout = DescriptorSetLayout::Builder(device)
-			.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS).
+			.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_ALL_GRAPHICS).
 			build();
 
-		auto ubo = uboBuffer->descriptorInfo();
+		auto ubo = uniformRing.descriptorInfo(sizeof(UniformData));
 		DescriptorWriter(*descriptorSetLayout, *descriptorPool).writeBuffer(0, &ubo).build(descriptorSet);
 		return { descriptorSetLayout->getDescriptorSetLayout()};
 	}
 
-	void ShadowRenderSystem::updateShadowMap(VkCommandBuffer cmd, GameObject::Map& gameObjs,  uint32_t frameIndex)
+	glm::mat4 ShadowRenderSystem::getFaceView(int faceIndex)
+	{
+		glm::mat4 viewMatrix = glm::mat4(1);
+		switch (faceIndex)
+		{
+		case 0: // POSITIVE_X
+			viewMatrix = glm::rotate(viewMatrix, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+			viewMatrix = glm::rotate(viewMatrix, glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+			break;
+		case 1:	// NEGATIVE_X
+			viewMatrix = glm::rotate(viewMatrix, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+			viewMatrix = glm::rotate(viewMatrix, glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+			break;
+		case 2:	// POSITIVE_Y
+			viewMatrix = glm::rotate(viewMatrix, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+			break;
+		case 3:	// NEGATIVE_Y
+			viewMatrix = glm::rotate(viewMatrix, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+			break;
+		case 4:	// POSITIVE_Z
+			viewMatrix = glm::rotate(viewMatrix, glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+			break;
+		case 5:	// NEGATIVE_Z
+			viewMatrix = glm::rotate(viewMatrix, glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+			break;
+		}
+		return viewMatrix;
+	}
+
+	void ShadowRenderSystem::updateShadowMap(VkCommandBuffer cmd, GameObject::Map& gameObjs,  uint32_t frameIndex, const MeshletCullSystem* culling)
 	{
 		VkViewport viewport{};
 		viewport.x = 0.0f;
@@ -321,6 +326,9 @@ namespace jhb {
 		vkCmdSetViewport(cmd, 0, 1, &viewport);
 		vkCmdSetScissor(cmd, 0, 1, &scissor);
 
+		// same block for all six faces, face view goes in push constant
+		uint32_t uboOffset = uniformRing.push(uniformData);
+
 		for (int faceIndex = 0; faceIndex < 6; faceIndex++)
 		{
 			VkClearValue clearValues[2];
@@ -339,38 +347,14 @@ namespace jhb {
 			renderPassBeginInfo.pClearValues = clearValues;
 
 			// Update view matrix via push constant
-
-			glm::mat4 viewMatrix = glm::mat4(1);
-			switch (faceIndex)
-			{
-			case 0: // POSITIVE_X
-				viewMatrix = glm::rotate(viewMatrix, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-				viewMatrix = glm::rotate(viewMatrix, glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-				break;
-			case 1:	// NEGATIVE_X
-				viewMatrix = glm::rotate(viewMatrix, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-				viewMatrix = glm::rotate(viewMatrix, glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-				break;
-			case 2:	// POSITIVE_Y
-				viewMatrix = glm::rotate(viewMatrix, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-				break;
-			case 3:	// NEGATIVE_Y
-				viewMatrix = glm::rotate(viewMatrix, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-				break;
-			case 4:	// POSITIVE_Z
-				viewMatrix = glm::rotate(viewMatrix, glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-				break;
-			case 5:	// NEGATIVE_Z
-				viewMatrix = glm::rotate(viewMatrix, glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-				break;
-			}
+			glm::mat4 viewMatrix = getFaceView(faceIndex);
 
 			// Render scene from cube face's point of view
-			vkCmdBeginRenderPass(cmd, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+			cmd::beginRenderPass(cmd, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 
 			//vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->getPipeline());
-			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
+			cmd::bindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 1, &uboOffset);
 			offscreenBuffer.lightView = viewMatrix;
 			for (auto& obj : GameObjectManager::GetSingleton().gameObjects)
 			{
@@ -383,8 +367,13 @@ namespace jhb {
 					//  must skybox cube model excluded
 					continue;
 				}
+				// instanced model is drawn once, by owner of its batch
+				if (obj.second.model == nullptr || obj.first != obj.second.model->batchOwner)
+				{
+					continue;
+				}
 
-				vkCmdPushConstants(
+				cmd::pushConstants(
 					cmd,
 					pipelineLayout,
 					VK_SHADER_STAGE_VERTEX_BIT,
@@ -392,7 +381,8 @@ namespace jhb {
 					sizeof(OffscreenConstant),
 					&offscreenBuffer);
 				obj.second.model->bind(cmd);
-				obj.second.model->drawNoTexture(cmd, pipeline->getPipeline(), pipelineLayout, frameIndex);
+				const CulledGeometry* culled = culling ? culling->getCulledGeometry(obj.second.model.get(), MeshletCullSystem::SHADOW_VIEW + faceIndex) : nullptr;
+				obj.second.model->drawNoTexture(cmd, pipeline->getPipeline(), pipelineLayout, frameIndex, culled);
 			}
 
 			vkCmdEndRenderPass(cmd);
@@ -406,7 +396,6 @@ namespace jhb {
 		uniformData.view = glm::mat4(1.0f);
 		uniformData.model = glm::translate(glm::mat4(1.0f), glm::vec3(-lightPos.x, -lightPos.y, -lightPos.z));
 		uniformData.lightPos = { lightPos, 1 };
-		memcpy(uboBuffer->getMappedMemory(), &uniformData, sizeof(UniformData));
 	}
 
 	void ShadowRenderSystem::renderGameObjects(FrameInfo& frameInfo)
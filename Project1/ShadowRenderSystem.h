@@ -13,10 +13,13 @@
 #include "GameObject.h"
 #include "Camera.h"
 #include "FrameInfo.h"
+#include "UniformRing.h"
 
 #include <stdint.h>
 
 namespace jhb {
+	class MeshletCullSystem;
+
 	class ShadowRenderSystem : public BaseRenderSystem {
 		struct Texture {
 			VkImage image;
@@ -38,7 +41,7 @@ namespace jhb {
 		} offscreenBuffer;
 
 	public:
-		ShadowRenderSystem(Device& device, const std::string& vert, const std::string& frag);
+		ShadowRenderSystem(Device& device, UniformRing& uniformRing, const std::string& vert, const std::string& frag);
 		~ShadowRenderSystem();
 
 		ShadowRenderSystem(const ShadowRenderSystem&) = delete;
@@ -47,36 +50,47 @@ namespace jhb {
 
 		virtual void renderGameObjects(FrameInfo& frameInfo) override;
 
-		void updateShadowMap(VkCommandBuffer cmd, GameObject::Map& gameObjs, uint32_t frameIndex);
+		// models in culling draw its shadow view output, culling may be null
+		void updateShadowMap(VkCommandBuffer cmd, GameObject::Map& gameObjs, uint32_t frameIndex, const MeshletCullSystem* culling = nullptr);
 		void updateUniformBuffer(glm::vec3 pos);
+		// rotation of cube face, pushed to shader as light view
+		static glm::mat4 getFaceView(int faceIndex);
+		// world to clip of cube face, same as shadowOffscreen.vert without gltf and instance transform
+		glm::mat4 getFaceViewProjection(int faceIndex) const { return uniformData.projection * getFaceView(faceIndex) * uniformData.model; }
+		glm::vec3 getLightPosition() const { return _lightpos; }
+		// depth is transient render graph image, framebuffers are recreated whenever graph is compiled
+		void createOffscreenFrameBuffer(VkImageView depthView);
 
 	private:
 		// render pass only used to create pipeline
 		// render system doest not store render pass, beacuase render system's life cycle is not tie to render pass
 		virtual void createPipeline(VkRenderPass renderPass, const std::string& vert, const std::string& frag) override;
-		void createOffscreenFrameBuffer();
+		void destroyOffscreenFrameBuffer();
 		VkRenderPass createOffscreenRenderPass();
 		void createShadowCubeMap();
 		std::vector<VkDescriptorSetLayout> initializeOffScreenDescriptor();
 	public:
 		Texture& GetShadowMap() { return shadowMap; }
+		VkFormat getDepthFormat() const { return depthFormat; }
+		VkImageAspectFlags getDepthAspect() const;
+		VkExtent2D getExtent() const { return offscreenImageSize; }
 
 	private:
 		Texture shadowMap;
-		Texture offScreenDepth;
-		Texture offScreenImage;
+		VkFormat depthFormat;
 
 		std::array<VkImageView, 6> shadowmapCubeFaces;
-		std::vector<VkFramebuffer> FramebuffersPerCubeFaces{6};
+		std::vector<VkFramebuffer> FramebuffersPerCubeFaces{6, VK_NULL_HANDLE};
 
 		VkRenderPass offScreenRenderPass;
 		const VkExtent2D offscreenImageSize{ 1024, 1024 };
 
-		std::unique_ptr<Buffer> uboBuffer;
+		// light ubo goes into uniform ring every frame
+		UniformRing& uniformRing;
 		VkDescriptorSet descriptorSet;
 
 		std::unique_ptr<DescriptorPool> descriptorPool;
-		std::unique_ptr<DescriptorSetLayout> descriptorSetLayout;
+		std::shared_ptr<DescriptorSetLayout> descriptorSetLayout;
 		glm::vec3 _lightpos;
 	};
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "SkyBoxRenderSystem.h"
+#include "CommandStats.h"
 #include <memory>
 #include <array>
 
@@ -65,7 +66,7 @@ namespace jhb {
 	{
 		pipeline->bind(frameInfo.commandBuffer);
 		BaseRenderSystem::renderGameObjects(frameInfo);
-		vkCmdBindDescriptorSets(
+		cmd::bindDescriptorSets(
 			frameInfo.commandBuffer,
 			VK_PIPELINE_BIND_POINT_GRAPHICS,
 			pipelineLayout,
@@ -78,7 +79,7 @@ namespace jhb {
 		push.ModelMatrix = skyBox.transform.mat4();
 		push.normalMatrix = skyBox.transform.normalMatrix();
 
-		vkCmdPushConstants(frameInfo.commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(SimplePushConstantData), &push);
+		cmd::pushConstants(frameInfo.commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(SimplePushConstantData), &push);
 
 		skyBox.model->bind(frameInfo.commandBuffer);
 		skyBox.model->draw(frameInfo.commandBuffer, pipelineLayout, 0);
@@ -104,7 +104,7 @@ namespace jhb {
 			VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
 	}
 
-	VkResult SwapChain::submitCommandBuffers(const VkCommandBuffer* buffers, uint32_t* imageIndex)
+	VkResult SwapChain::submitCommandBuffers(const VkCommandBuffer* buffers, uint32_t* imageIndex, const TimelineSync* timelineSync)
 	{
 		if (imagesInFlight[*imageIndex] != VK_NULL_HANDLE) {
 			vkWaitForFences(device.getLogicalDevice(), 1, &imagesInFlight[*imageIndex], VK_TRUE, UINT64_MAX);
@@ -114,8 +114,9 @@ namespace jhb {
 		VkSubmitInfo submitInfo = {};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-		VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame], computeSemaphores[currentFrame]};
-		VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT , VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT };
+		VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE };
+		VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT , 0 };
+		uint64_t waitValues[] = { 0, 0 }; // binary semaphore ignores value
 		submitInfo.waitSemaphoreCount = 1;
 		submitInfo.pWaitSemaphores = waitSemaphores;
 		submitInfo.pWaitDstStageMask = waitStages;
@@ -123,10 +124,35 @@ namespace jhb {
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = buffers;
 
-		VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
+		VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame], VK_NULL_HANDLE };
+		uint64_t signalValues[] = { 0, 0 };
 		submitInfo.signalSemaphoreCount = 1;
 		submitInfo.pSignalSemaphores = signalSemaphores;
 
+		VkTimelineSemaphoreSubmitInfo timelineInfo{};
+		if (timelineSync)
+		{
+			if (timelineSync->waitSemaphore != VK_NULL_HANDLE)
+			{
+				waitSemaphores[1] = timelineSync->waitSemaphore;
+				waitStages[1] = timelineSync->waitStage;
+				waitValues[1] = timelineSync->waitValue;
+				submitInfo.waitSemaphoreCount = 2;
+			}
+			if (timelineSync->signalSemaphore != VK_NULL_HANDLE)
+			{
+				signalSemaphores[1] = timelineSync->signalSemaphore;
+				signalValues[1] = timelineSync->signalValue;
+				submitInfo.signalSemaphoreCount = 2;
+			}
+			timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+			timelineInfo.waitSemaphoreValueCount = submitInfo.waitSemaphoreCount;
+			timelineInfo.pWaitSemaphoreValues = waitValues;
+			timelineInfo.signalSemaphoreValueCount = submitInfo.signalSemaphoreCount;
+			timelineInfo.pSignalSemaphoreValues = signalValues;
+			submitInfo.pNext = &timelineInfo;
+		}
+
 		vkResetFences(device.getLogicalDevice(), 1, &inFlightFences[currentFrame]);
 		if (vkQueueSubmit(device.getGraphicsQueue(), 1, &submitInfo, inFlightFences[currentFrame]) !=
 			VK_SUCCESS) {
@@ -137,7 +163,7 @@ namespace jhb {
 		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
 		presentInfo.waitSemaphoreCount = 1;
-		presentInfo.pWaitSemaphores = signalSemaphores;
+		presentInfo.pWaitSemaphores = signalSemaphores; // only render finished semaphore
 
 		VkSwapchainKHR swapChains[] = { swapChain };
 		presentInfo.swapchainCount = 1;
@@ -152,28 +178,6 @@ namespace jhb {
 		return result;
 	}
 
-	VkResult SwapChain::submitComputeCommandBuffers(const VkCommandBuffer* buffers)
-	{
-		vkWaitForFences(device.getLogicalDevice(), 1, &computeFences[currentFrame], VK_TRUE, UINT64_MAX);
-		vkResetFences(device.getLogicalDevice(), 1, &computeFences[currentFrame]);
-
-		VkSubmitInfo submitInfo = {};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = buffers;
-
-		VkSemaphore signalSemaphores[] = { computeSemaphores[currentFrame] };
-		submitInfo.signalSemaphoreCount = 1;
-		submitInfo.pSignalSemaphores = signalSemaphores;
-
-		VkResult ret = vkQueueSubmit(device.getComputeQueue(), 1, &submitInfo, nullptr);
-		if (ret != VK_SUCCESS) {
-			throw std::runtime_error("failed to submit draw command buffer!");
-		}
-		return ret;
-	}
-
 	void SwapChain::createSwapChain()
 	{
 		SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device.getPhysicalDevice(), device.getSurface());
@@ -196,6 +200,11 @@ namespace jhb {
 		createInfo.imageExtent = extent;
 		createInfo.imageArrayLayers = 1; //always 1
 		createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT; // direct render to images, if you want to like a PostProcessing, then use VK_IMAGE_USAGE_TRANSFER_DST_BIT flag.
+		readbackSupported = (swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) != 0;
+		if (readbackSupported)
+		{
+			createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		}
 
 		jhb::Device::QueueFamilyIndexes indices = device.findQueueFamilies(device.getPhysicalDevice());
 		uint32_t queueFamilyIndices[] = { indices.graphicsFamily.value(), indices.presentFamily.value() };
@@ -414,9 +423,6 @@ namespace jhb {
 		imagesInFlight.resize(swapChainImages.size(), VK_NULL_HANDLE);
 
 
-		computeFences.resize(MAX_FRAMES_IN_FLIGHT);
-		computeSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-
 		VkSemaphoreCreateInfo semaphoreInfo = {};
 		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
@@ -430,9 +436,6 @@ namespace jhb {
 				vkCreateSemaphore(device.getLogicalDevice(), &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) !=
 				VK_SUCCESS ||
 				vkCreateFence(device.getLogicalDevice(), &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS
-				|| vkCreateSemaphore(device.getLogicalDevice(), &semaphoreInfo, nullptr, &computeSemaphores[i]) !=
-				VK_SUCCESS
-				|| vkCreateFence(device.getLogicalDevice(), &fenceInfo, nullptr, &computeFences[i]) != VK_SUCCESS
 				) {
 				throw std::runtime_error("failed to create synchronization objects for a frame!");
 			}
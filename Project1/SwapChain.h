@@ -13,6 +13,15 @@ namespace jhb {
 			std::vector<VkPresentModeKHR> presentModes;
 		};
 
+		// extra timeline semaphore wait and signal on graphics submission, async compute handoff
+		struct TimelineSync {
+			VkSemaphore waitSemaphore = VK_NULL_HANDLE;
+			uint64_t waitValue = 0;
+			VkPipelineStageFlags waitStage = 0;
+			VkSemaphore signalSemaphore = VK_NULL_HANDLE;
+			uint64_t signalValue = 0;
+		};
+
 	public:
 		static constexpr int MAX_FRAMES_IN_FLIGHT = 3;
 		SwapChain(Device& device, VkExtent2D extent, const std::vector<VkSubpassDependency>& dependencies, bool shouldSwapChainCreate, VkFormat format, int attachmentCount);
@@ -32,17 +41,22 @@ namespace jhb {
 			return swapChainImageviews[index];
 		}
 
+		VkImage getSwapChainImage(int index) const {
+			return swapChainImages[index];
+		}
+
 		const std::vector<VkImageView>& getSwapChianImageViews() const {
 			return swapChainImageviews;
 		}
 		VkRenderPass getRenderPass() { return renderPass; }
 		size_t getImageCount() { return swapChainImages.size(); }
+		// images can be copied out, anti aliasing quality capture needs it
+		bool supportsReadback() const { return readbackSupported; }
 		VkResult acquireNextImage(uint32_t* imageIndex);
 
 		VkFormat findDepthFormat();
 
-		VkResult submitCommandBuffers(const VkCommandBuffer* buffers, uint32_t* imageIndex);
-		VkResult submitComputeCommandBuffers(const VkCommandBuffer* buffers);
+		VkResult submitCommandBuffers(const VkCommandBuffer* buffers, uint32_t* imageIndex, const TimelineSync* timelineSync = nullptr);
 
 		bool compareSwapChainFormats(const SwapChain& swapChain) const {
 			return swapChain.swapChainDepthFormat == swapChainDepthFormat && swapChain.swapChainImageFormat == swapChainImageFormat;
@@ -66,6 +80,7 @@ namespace jhb {
 	private:
 		Device& device;
 		VkExtent2D swapChainExtent;
+		bool readbackSupported = false;
 
 		VkSwapchainKHR swapChain;
 		VkFormat swapChainDepthFormat;
@@ -89,9 +104,6 @@ namespace jhb {
 		std::vector<VkFence> inFlightFences;
 		std::vector<VkFence> imagesInFlight;
 
-		std::vector<VkSemaphore> computeSemaphores;
-		std::vector<VkFence> computeFences;
-
 		size_t currentFrame = 0;
 	};
 }
@@ -0,0 +1,268 @@
+#include "TAARenderSystem.h"
+#include "CommandStats.h"
+#include <memory>
+#include <array>
+
+namespace jhb {
+	TAARenderSystem::TAARenderSystem(Device& device, const std::vector<VkImageView>& swapchainImageViews, VkFormat swapchainFormat, VkImageView sceneColorView, VkImageView velocityView)
+		: BaseRenderSystem(device), format(swapchainFormat)
+	{
+		createRenderPass();
+		createHistoryImages();
+		createFrameBuffers(swapchainImageViews);
+
+		VkSamplerCreateInfo samplerInfo{};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = VK_FILTER_LINEAR;
+		samplerInfo.minFilter = VK_FILTER_LINEAR;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.maxLod = 1.f;
+		samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+		if (vkCreateSampler(device.getLogicalDevice(), &samplerInfo, nullptr, &sampler) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create taa sampler!");
+		}
+
+		taaDescriptorSetLayout = DescriptorSetLayout::Builder(device)
+			.addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.addBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.addBinding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.build();
+		createDescriptors(sceneColorView, velocityView);
+
+		BaseRenderSystem::createPipeLineLayout({ taaDescriptorSetLayout->getDescriptorSetLayout() }, { VkPushConstantRange{VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(TAAPushConstant)} });
+		createPipeline(taaRenderPass, "shaders/deferedPBR.vert.spv", "shaders/taaResolve.frag.spv");
+	}
+
+	TAARenderSystem::~TAARenderSystem()
+	{
+		removeVkResources();
+		vkDestroySampler(device.getLogicalDevice(), sampler, nullptr);
+		vkDestroyRenderPass(device.getLogicalDevice(), taaRenderPass, nullptr);
+	}
+
+	void TAARenderSystem::createPipeline(VkRenderPass renderPass, const std::string& vert, const std::string& frag)
+	{
+		assert(pipelineLayout != nullptr && "Cannot Create pipeline before pipeline layout!!");
+
+		PipelineConfigInfo pipelineConfig{};
+		Pipeline::defaultPipelineConfigInfo(pipelineConfig);
+		pipelineConfig.depthStencilInfo.depthTestEnable = false;
+		pipelineConfig.depthStencilInfo.depthWriteEnable = false;
+		pipelineConfig.rasterizationInfo.cullMode = VK_CULL_MODE_NONE;
+
+		// fullscreen triangle from gl_VertexIndex, no vertex input
+		pipelineConfig.attributeDescriptions.clear();
+		pipelineConfig.bindingDescriptions.clear();
+
+		std::array<VkPipelineColorBlendAttachmentState, 2> blendAttachmentStates;
+		for (int i = 0; i < blendAttachmentStates.size(); i++)
+		{
+			VkPipelineColorBlendAttachmentState colorblendState{};
+			colorblendState.blendEnable = VK_FALSE;
+			colorblendState.colorWriteMask = 0xf;
+			blendAttachmentStates[i] = colorblendState;
+		}
+		pipelineConfig.colorBlendInfo.attachmentCount = blendAttachmentStates.size();
+		pipelineConfig.colorBlendInfo.pAttachments = blendAttachmentStates.data();
+
+		pipelineConfig.renderPass = renderPass;
+		pipelineConfig.pipelineLayout = pipelineLayout;
+		pipeline = std::make_unique<Pipeline>(device, vert, frag, pipelineConfig);
+	}
+
+	void TAARenderSystem::createRenderPass()
+	{
+		// 0 : swapchain, 1 : history written this frame
+		std::array<VkAttachmentDescription, 2> attachmentDescs = {};
+		for (uint32_t i = 0; i < 2; ++i)
+		{
+			attachmentDescs[i].format = format;
+			attachmentDescs[i].samples = VK_SAMPLE_COUNT_1_BIT;
+			attachmentDescs[i].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE; // every pixel is overwritten
+			attachmentDescs[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			attachmentDescs[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			attachmentDescs[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachmentDescs[i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		}
+		attachmentDescs[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		attachmentDescs[1].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		std::array<VkAttachmentReference, 2> colorReferences = { {
+			{ 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL },
+			{ 1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL },
+		} };
+
+		VkSubpassDescription subpassDescription{};
+		subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpassDescription.colorAttachmentCount = colorReferences.size();
+		subpassDescription.pColorAttachments = colorReferences.data();
+
+		std::array<VkSubpassDependency, 2> dependencies;
+		// scene color and velocity are written by lighting subpass, history by previous frame
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dependencyFlags = 0;
+
+		dependencies[1].srcSubpass = 0;
+		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		dependencies[1].dependencyFlags = 0;
+
+		VkRenderPassCreateInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		renderPassInfo.attachmentCount = attachmentDescs.size();
+		renderPassInfo.pAttachments = attachmentDescs.data();
+		renderPassInfo.subpassCount = 1;
+		renderPassInfo.pSubpasses = &subpassDescription;
+		renderPassInfo.dependencyCount = dependencies.size();
+		renderPassInfo.pDependencies = dependencies.data();
+
+		if (vkCreateRenderPass(device.getLogicalDevice(), &renderPassInfo, nullptr, &taaRenderPass) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create taa RenderPass!");
+		}
+	}
+
+	void TAARenderSystem::createHistoryImages()
+	{
+		historyMemorySize = 0;
+		for (auto& historyImage : history)
+		{
+			VkImageCreateInfo imageCI{};
+			imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			imageCI.imageType = VK_IMAGE_TYPE_2D;
+			imageCI.format = format;
+			imageCI.extent.width = device.getWindow().getExtent().width;
+			imageCI.extent.height = device.getWindow().getExtent().height;
+			imageCI.extent.depth = 1;
+			imageCI.mipLevels = 1;
+			imageCI.arrayLayers = 1;
+			imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+			device.createImageWithInfo(imageCI, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, historyImage.image, historyImage.memory);
+			VkMemoryRequirements memReqs;
+			vkGetImageMemoryRequirements(device.getLogicalDevice(), historyImage.image, &memReqs);
+			historyMemorySize += memReqs.size;
+
+			VkImageViewCreateInfo viewCI{};
+			viewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewCI.format = format;
+			viewCI.subresourceRange = {};
+			viewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			viewCI.subresourceRange.levelCount = 1;
+			viewCI.subresourceRange.layerCount = 1;
+			viewCI.image = historyImage.image;
+			if (vkCreateImageView(device.getLogicalDevice(), &viewCI, nullptr, &historyImage.view))
+			{
+				throw std::runtime_error("failed to create ImageView!");
+			}
+		}
+
+		// history which is read first frame is never written, so move both to read layout once
+		auto cmd = device.beginSingleTimeCommands();
+		for (auto& historyImage : history)
+		{
+			device.transitionImageLayout(cmd, historyImage.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		}
+		device.endSingleTimeCommands(cmd);
+		historyValid = false;
+	}
+
+	void TAARenderSystem::createFrameBuffers(const std::vector<VkImageView>& swapchainImageViews)
+	{
+		frameBuffers.resize(swapchainImageViews.size() * 2);
+		for (int i = 0; i < swapchainImageViews.size(); i++)
+		{
+			for (int h = 0; h < 2; h++)
+			{
+				std::array<VkImageView, 2> attachments = { swapchainImageViews[i], history[h].view };
+				VkFramebufferCreateInfo fbufCreateInfo{};
+				fbufCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+				fbufCreateInfo.renderPass = taaRenderPass;
+				fbufCreateInfo.attachmentCount = attachments.size();
+				fbufCreateInfo.pAttachments = attachments.data();
+				fbufCreateInfo.width = device.getWindow().getExtent().width;
+				fbufCreateInfo.height = device.getWindow().getExtent().height;
+				fbufCreateInfo.layers = 1;
+				if (vkCreateFramebuffer(device.getLogicalDevice(), &fbufCreateInfo, nullptr, &frameBuffers[i * 2 + h]) != VK_SUCCESS)
+				{
+					throw std::runtime_error("failed to create taa frameBuffer!");
+				}
+			}
+		}
+	}
+
+	void TAARenderSystem::createDescriptors(VkImageView sceneColorView, VkImageView velocityView)
+	{
+		taaDescriptorPool = DescriptorPool::Builder(device).setMaxSets(2).addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 6).build();
+
+		VkDescriptorImageInfo colorInfo{ sampler, sceneColorView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		VkDescriptorImageInfo velocityInfo{ sampler, velocityView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		for (int h = 0; h < 2; h++)
+		{
+			// set h is used while writing history[h], so it reads the other one
+			VkDescriptorImageInfo historyInfo{ sampler, history[1 - h].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+			DescriptorWriter(*taaDescriptorSetLayout, *taaDescriptorPool).writeImage(0, &colorInfo).writeImage(1, &historyInfo)
+				.writeImage(2, &velocityInfo).build(taaDescriptorSets[h]);
+		}
+	}
+
+	void TAARenderSystem::recreate(const std::vector<VkImageView>& swapchainImageViews, VkImageView sceneColorView, VkImageView velocityView)
+	{
+		removeVkResources();
+		createHistoryImages();
+		createFrameBuffers(swapchainImageViews);
+		device.getDeletionQueue().retire(std::move(taaDescriptorPool));
+		createDescriptors(sceneColorView, velocityView);
+	}
+
+	void TAARenderSystem::removeVkResources()
+	{
+		// history of last frames may still be read in flight
+		VkDevice logicalDevice = device.getLogicalDevice();
+		device.getDeletionQueue().retire([logicalDevice, oldFrameBuffers = frameBuffers, oldHistory = history]() {
+			for (auto framebuffer : oldFrameBuffers)
+			{
+				vkDestroyFramebuffer(logicalDevice, framebuffer, nullptr);
+			}
+			for (auto& historyImage : oldHistory)
+			{
+				vkDestroyImageView(logicalDevice, historyImage.view, nullptr);
+				vkDestroyImage(logicalDevice, historyImage.image, nullptr);
+				vkFreeMemory(logicalDevice, historyImage.memory, nullptr);
+			}
+		});
+		frameBuffers.clear();
+	}
+
+	void TAARenderSystem::renderGameObjects(FrameInfo& frameInfo)
+	{
+		TAAPushConstant push{};
+		push.texelSize = glm::vec2(1.f / device.getWindow().getExtent().width, 1.f / device.getWindow().getExtent().height);
+		push.feedback = feedback;
+		push.resetHistory = historyValid ? 0 : 1;
+
+		cmd::bindPipeline(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->getPipeline());
+		cmd::bindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &taaDescriptorSets[historyIndex], 0, nullptr);
+		cmd::pushConstants(frameInfo.commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(TAAPushConstant), &push);
+		cmd::draw(frameInfo.commandBuffer, 3, 1, 0, 0);
+
+		// next frame reads what was written now
+		historyIndex = 1 - historyIndex;
+		historyValid = true;
+	}
+}
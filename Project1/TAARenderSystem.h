@@ -0,0 +1,68 @@
+#pragma once
+#include "BaseRenderSystem.h"
+
+#include <array>
+
+namespace jhb {
+	// resolves jittered 1x scene color from DeferedPBRRenderSystem with reprojected history into swapchain
+	class TAARenderSystem : public BaseRenderSystem
+	{
+		struct HistoryImage {
+			VkImage image;
+			VkDeviceMemory memory;
+			VkImageView view;
+		};
+
+		struct TAAPushConstant {
+			glm::vec2 texelSize;
+			float feedback;
+			int resetHistory;
+		};
+
+	public:
+		TAARenderSystem(Device& device, const std::vector<VkImageView>& swapchainImageViews, VkFormat swapchainFormat, VkImageView sceneColorView, VkImageView velocityView);
+		~TAARenderSystem();
+
+		TAARenderSystem(const TAARenderSystem&) = delete;
+		TAARenderSystem(TAARenderSystem&&) = delete;
+		TAARenderSystem& operator=(const TAARenderSystem&) = delete;
+
+		// draw fullscreen resolve and swap history, must be called inside taa render pass
+		virtual void renderGameObjects(FrameInfo& frameInfo) override;
+	public:
+		VkRenderPass getRenderPass() { return taaRenderPass; }
+		VkFramebuffer getFrameBuffer(int idx) { return frameBuffers[idx * 2 + historyIndex]; }
+		void recreate(const std::vector<VkImageView>& swapchainImageViews, VkImageView sceneColorView, VkImageView velocityView);
+		void resetHistory() { historyValid = false; }
+		VkDeviceSize getHistoryMemorySize() { return historyMemorySize; }
+
+	public:
+		float feedback = 0.9f;
+
+	private:
+		virtual void createPipeline(VkRenderPass renderPass, const std::string& vert, const std::string& frag) override;
+		void createRenderPass();
+		void createHistoryImages();
+		void createFrameBuffers(const std::vector<VkImageView>& swapchainImageViews);
+		void createDescriptors(VkImageView sceneColorView, VkImageView velocityView);
+		void removeVkResources();
+
+	private:
+		VkFormat format;
+		VkRenderPass taaRenderPass;
+		VkSampler sampler;
+
+		// ping pong, historyIndex is written this frame and the other one is read
+		std::array<HistoryImage, 2> history;
+		uint32_t historyIndex = 0;
+		bool historyValid = false;
+		VkDeviceSize historyMemorySize = 0;
+
+		// swapchain image count * 2 history images
+		std::vector<VkFramebuffer> frameBuffers;
+
+		std::unique_ptr<DescriptorPool> taaDescriptorPool;
+		std::shared_ptr<DescriptorSetLayout> taaDescriptorSetLayout;
+		std::array<VkDescriptorSet, 2> taaDescriptorSets;
+	};
+}
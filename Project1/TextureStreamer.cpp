@@ -0,0 +1,580 @@
+#include "TextureStreamer.h"
+#include "CommandStats.h"
+#include "DeletionQueue.h"
+#include "Buffer.h"
+#include "Model.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace jhb {
+	TextureStreamer::TextureStreamer(Device& device, uint32_t threadCount) : device{ device }
+	{
+		const uint8_t white[4] = { 255, 255, 255, 255 };
+		const uint8_t flatNormal[4] = { 128, 128, 255, 255 };
+		createPlaceholder(white, placeholderImages[0], placeholderMemory[0], placeholderViews[0]);
+		createPlaceholder(flatNormal, placeholderImages[1], placeholderMemory[1], placeholderViews[1]);
+
+		for (uint32_t i = 0; i < std::max(threadCount, 1u); i++)
+		{
+			workers.emplace_back(&TextureStreamer::workerLoop, this);
+		}
+	}
+
+	TextureStreamer::~TextureStreamer()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wakeCondition.notify_all();
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+
+		// device is idle by now, retired chains are flushed by deletion queue
+		VkDevice logicalDevice = device.getLogicalDevice();
+		for (auto& entry : entries)
+		{
+			if (entry.residentMip < entry.mipCount)
+			{
+				vkDestroyImageView(logicalDevice, entry.image->view, nullptr);
+				vkDestroyImage(logicalDevice, entry.image->image, nullptr);
+				vkFreeMemory(logicalDevice, entry.image->deviceMemory, nullptr);
+			}
+		}
+		for (int i = 0; i < 2; i++)
+		{
+			vkDestroyImageView(logicalDevice, placeholderViews[i], nullptr);
+			vkDestroyImage(logicalDevice, placeholderImages[i], nullptr);
+			vkFreeMemory(logicalDevice, placeholderMemory[i], nullptr);
+		}
+	}
+
+	void TextureStreamer::addModel(const std::shared_ptr<Model>& model)
+	{
+		// normal maps wait on flat normal so lighting doesn't tilt until their tail arrives
+		std::vector<uint8_t> normalMaps(model->images.size(), 0);
+		for (auto& material : model->materials)
+		{
+			if (material.normalTextureIndex < model->textures.size())
+			{
+				int32_t imageIndex = model->textures[material.normalTextureIndex].imageIndex;
+				if (imageIndex >= 0 && imageIndex < static_cast<int32_t>(normalMaps.size()))
+				{
+					normalMaps[imageIndex] = 1;
+				}
+			}
+		}
+
+		bool added = false;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (size_t i = 0; i < model->images.size(); i++)
+			{
+				Image& image = model->images[i];
+				if (image.streamPath.empty() || image.streamEntry >= 0)
+				{
+					continue;
+				}
+
+				Entry entry{};
+				entry.model = model.get();
+				entry.image = &image;
+				entry.path = image.streamPath;
+				entry.width = image.width;
+				entry.height = image.height;
+				entry.mipCount = image.mipLevels;
+				entry.tailMip = 0;
+				while (entry.tailMip + 1 < entry.mipCount && (std::max(entry.width, entry.height) >> entry.tailMip) > TAIL_SIZE)
+				{
+					entry.tailMip++;
+				}
+				entry.residentMip = entry.mipCount;
+				entry.wantedMip = entry.tailMip;
+				entry.normalMap = normalMaps[i] != 0;
+				entry.loading = true;
+				entry.loadingMip = entry.tailMip;
+
+				int placeholder = entry.normalMap ? 1 : 0;
+				image.image = placeholderImages[placeholder];
+				image.deviceMemory = placeholderMemory[placeholder];
+				image.view = placeholderViews[placeholder];
+				image.width = 1;
+				image.height = 1;
+				image.mipLevels = 1;
+				image.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				image.updateDescriptor();
+				image.streamEntry = static_cast<int32_t>(entries.size());
+
+				// tails go first, queue is in order of request
+				jobs.push_back(Job{ static_cast<uint32_t>(entries.size()), entry.path, entry.tailMip });
+				entries.push_back(std::move(entry));
+				added = true;
+			}
+		}
+		if (added)
+		{
+			models.push_back(model);
+			wakeCondition.notify_all();
+		}
+	}
+
+	void TextureStreamer::beginFrame()
+	{
+		frameCounter++;
+		for (auto& entry : entries)
+		{
+			entry.wantedMip = entry.tailMip;
+		}
+	}
+
+	void TextureStreamer::request(Image& image, float uvPixels)
+	{
+		if (image.streamEntry < 0)
+		{
+			return;
+		}
+		Entry& entry = entries[image.streamEntry];
+		// texels of full chain under one screen pixel, every mip halves it
+		float texelsPerPixel = static_cast<float>(std::max(entry.width, entry.height)) / std::max(uvPixels, 1e-6f);
+		uint32_t mip = texelsPerPixel > 1.f ? static_cast<uint32_t>(std::min(std::floor(std::log2(texelsPerPixel)), 31.f)) : 0;
+		entry.wantedMip = std::min({ entry.wantedMip, mip, entry.tailMip });
+		entry.lastUsed = frameCounter;
+	}
+
+	void TextureStreamer::update(VkCommandBuffer commandBuffer)
+	{
+		stats.budgetBytes = queryBudget();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (auto& decoded : finished)
+			{
+				ready.push_back(std::move(decoded));
+			}
+			finished.clear();
+		}
+
+		VkDeviceSize uploaded = 0;
+		while (!ready.empty() && uploaded < UPLOAD_BYTES_PER_FRAME)
+		{
+			Decoded decoded = std::move(ready.front());
+			ready.pop_front();
+			Entry& entry = entries[decoded.entry];
+			entry.loading = false;
+			if (decoded.pixels.empty())
+			{
+				entry.failed = true;
+				std::cout << "[texture streaming] failed to decode " << entry.path << std::endl;
+				continue;
+			}
+			if (decoded.topMip >= entry.residentMip)
+			{
+				continue;
+			}
+			// tails always go in, finer chains only when lru chains make room for them
+			bool tail = entry.residentMip == entry.mipCount;
+			VkDeviceSize bytes = chainBytes(entry, decoded.topMip);
+			if (!tail && !makeRoom(bytes - entry.bytes, decoded.entry, commandBuffer))
+			{
+				continue;
+			}
+			upload(entry, decoded, commandBuffer);
+			uploaded += decoded.pixels.size();
+		}
+
+		// budget may have shrunk since last frame
+		makeRoom(0, UINT32_MAX, commandBuffer);
+
+		// chains not used this frame can give way, loads asking more than that would only bounce between loading and eviction
+		VkDeviceSize evictable = 0;
+		VkDeviceSize committed = stats.residentBytes;
+		for (auto& entry : entries)
+		{
+			if (entry.lastUsed != frameCounter && entry.residentMip < entry.tailMip)
+			{
+				evictable += entry.bytes - chainBytes(entry, entry.tailMip);
+			}
+			if (entry.loading && entry.residentMip < entry.mipCount && entry.loadingMip < entry.residentMip)
+			{
+				committed += chainBytes(entry, entry.loadingMip) - entry.bytes;
+			}
+		}
+
+		bool queued = false;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (uint32_t i = 0; i < entries.size(); i++)
+			{
+				Entry& entry = entries[i];
+				// tail has to be there first, it is the floor eviction falls back to
+				if (entry.loading || entry.failed || entry.residentMip == entry.mipCount || entry.wantedMip >= entry.residentMip)
+				{
+					continue;
+				}
+				VkDeviceSize extra = chainBytes(entry, entry.wantedMip) - entry.bytes;
+				if (committed + extra > stats.budgetBytes + evictable)
+				{
+					continue;
+				}
+				jobs.push_back(Job{ i, entry.path, entry.wantedMip });
+				entry.loading = true;
+				entry.loadingMip = entry.wantedMip;
+				committed += extra;
+				queued = true;
+			}
+		}
+		if (queued)
+		{
+			wakeCondition.notify_all();
+		}
+
+		stats.imageCount = static_cast<uint32_t>(entries.size());
+		stats.satisfiedCount = 0;
+		stats.pendingLoads = 0;
+		for (auto& entry : entries)
+		{
+			stats.satisfiedCount += entry.residentMip <= entry.wantedMip ? 1 : 0;
+			stats.pendingLoads += entry.loading ? 1 : 0;
+		}
+	}
+
+	void TextureStreamer::printReport() const
+	{
+		if (entries.empty())
+		{
+			return;
+		}
+		const double mb = 1024.0 * 1024.0;
+		std::cout << "[texture streaming] " << stats.imageCount << " images, " << stats.satisfiedCount << " at wanted mip, " << stats.residentBytes / mb << " / "
+			<< stats.budgetBytes / mb << " MB resident, " << stats.uploadedBytes / mb << " MB uploaded, " << stats.evictions << " evictions"
+			<< (stats.memoryBudgetExtension ? "" : ", no memory budget extension") << std::endl;
+	}
+
+	void TextureStreamer::workerLoop()
+	{
+		for (;;)
+		{
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wakeCondition.wait(lock, [this]() { return quit || !jobs.empty(); });
+				if (quit)
+				{
+					return;
+				}
+				job = std::move(jobs.front());
+				jobs.pop_front();
+			}
+
+			Decoded decoded;
+			decode(job, decoded);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			finished.push_back(std::move(decoded));
+		}
+	}
+
+	void TextureStreamer::decode(const Job& job, Decoded& decoded)
+	{
+		decoded.entry = job.entry;
+		decoded.topMip = job.topMip;
+
+		int texWidth, texHeight, texChannels;
+		stbi_uc* pixels = stbi_load(job.path.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+		if (!pixels)
+		{
+			return;
+		}
+		uint32_t width = static_cast<uint32_t>(texWidth);
+		uint32_t height = static_cast<uint32_t>(texHeight);
+		std::vector<uint8_t> level(pixels, pixels + static_cast<size_t>(width) * height * 4);
+		stbi_image_free(pixels);
+
+		// same chain length as Model::loadImages, level size is max(1, size >> mip) like vulkan
+		uint32_t mipCount = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+		std::vector<uint8_t> next;
+		for (uint32_t mip = 0; mip < mipCount; mip++)
+		{
+			if (mip >= job.topMip)
+			{
+				decoded.levelOffsets.push_back(decoded.pixels.size());
+				decoded.pixels.insert(decoded.pixels.end(), level.begin(), level.end());
+			}
+			if (mip + 1 == mipCount)
+			{
+				break;
+			}
+
+			// 2x2 box, odd edge repeats its last texel
+			uint32_t nextWidth = std::max(width / 2, 1u);
+			uint32_t nextHeight = std::max(height / 2, 1u);
+			next.resize(static_cast<size_t>(nextWidth) * nextHeight * 4);
+			for (uint32_t y = 0; y < nextHeight; y++)
+			{
+				const uint8_t* row0 = &level[static_cast<size_t>(std::min(y * 2, height - 1)) * width * 4];
+				const uint8_t* row1 = &level[static_cast<size_t>(std::min(y * 2 + 1, height - 1)) * width * 4];
+				uint8_t* out = &next[static_cast<size_t>(y) * nextWidth * 4];
+				for (uint32_t x = 0; x < nextWidth; x++)
+				{
+					uint32_t x0 = std::min(x * 2, width - 1) * 4;
+					uint32_t x1 = std::min(x * 2 + 1, width - 1) * 4;
+					for (uint32_t c = 0; c < 4; c++)
+					{
+						out[x * 4 + c] = static_cast<uint8_t>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+					}
+				}
+			}
+			level.swap(next);
+			width = nextWidth;
+			height = nextHeight;
+		}
+	}
+
+	void TextureStreamer::createPlaceholder(const uint8_t* rgba, VkImage& image, VkDeviceMemory& memory, VkImageView& view)
+	{
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.extent = { 1, 1, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, memory);
+
+		VkBuffer stagingBuffer;
+		VkDeviceMemory stagingBufferMemory;
+		device.createBuffer(4, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+		void* data;
+		vkMapMemory(device.getLogicalDevice(), stagingBufferMemory, 0, 4, 0, &data);
+		memcpy(data, rgba, 4);
+		vkUnmapMemory(device.getLogicalDevice(), stagingBufferMemory);
+
+		VkImageSubresourceRange subresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		VkCommandBuffer commandBuffer = device.beginSingleTimeCommands();
+		device.transitionImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
+		device.copyBufferToImage(commandBuffer, stagingBuffer, image, 1, 1, 1);
+		device.transitionImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
+		device.endSingleTimeCommands(commandBuffer);
+
+		vkDestroyBuffer(device.getLogicalDevice(), stagingBuffer, nullptr);
+		vkFreeMemory(device.getLogicalDevice(), stagingBufferMemory, nullptr);
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+		viewInfo.subresourceRange = subresourceRange;
+		if (vkCreateImageView(device.getLogicalDevice(), &viewInfo, nullptr, &view) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create texture image view!");
+		}
+	}
+
+	VkDeviceSize TextureStreamer::chainBytes(const Entry& entry, uint32_t topMip) const
+	{
+		VkDeviceSize bytes = 0;
+		for (uint32_t mip = topMip; mip < entry.mipCount; mip++)
+		{
+			bytes += static_cast<VkDeviceSize>(std::max(entry.width >> mip, 1u)) * std::max(entry.height >> mip, 1u) * 4;
+		}
+		return bytes;
+	}
+
+	VkDeviceSize TextureStreamer::queryBudget()
+	{
+		VkDeviceSize budget = budgetBytes;
+		VkDeviceSize usage = 0;
+		VkDeviceSize heapBudget = 0;
+		stats.memoryBudgetExtension = device.queryMemoryUsage(usage, heapBudget);
+		if (stats.memoryBudgetExtension)
+		{
+			// everything else on device local heaps keeps its memory, textures get rest of what driver grants this process
+			VkDeviceSize others = usage > stats.residentBytes ? usage - stats.residentBytes : 0;
+			budget = std::min(budget, heapBudget > others ? heapBudget - others : 0);
+		}
+		return budget;
+	}
+
+	bool TextureStreamer::makeRoom(VkDeviceSize extra, uint32_t keep, VkCommandBuffer commandBuffer)
+	{
+		if (stats.residentBytes + extra <= stats.budgetBytes)
+		{
+			return true;
+		}
+
+		// unused chains go back to their tail oldest first, then used ones down to what this frame asks for
+		std::vector<uint32_t> candidates;
+		for (uint32_t i = 0; i < entries.size(); i++)
+		{
+			const Entry& entry = entries[i];
+			uint32_t target = entry.lastUsed == frameCounter ? entry.wantedMip : entry.tailMip;
+			if (i != keep && target > entry.residentMip)
+			{
+				candidates.push_back(i);
+			}
+		}
+		std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b) { return entries[a].lastUsed < entries[b].lastUsed; });
+
+		for (uint32_t i : candidates)
+		{
+			if (stats.residentBytes + extra <= stats.budgetBytes)
+			{
+				break;
+			}
+			Entry& entry = entries[i];
+			shrink(entry, entry.lastUsed == frameCounter ? entry.wantedMip : entry.tailMip, commandBuffer);
+			stats.evictions++;
+		}
+		return stats.residentBytes + extra <= stats.budgetBytes;
+	}
+
+	void TextureStreamer::upload(Entry& entry, Decoded& decoded, VkCommandBuffer commandBuffer)
+	{
+		VkImage image;
+		VkDeviceMemory memory;
+		createChain(entry, decoded.topMip, image, memory);
+
+		auto staging = std::make_unique<Buffer>(device, 1, static_cast<uint32_t>(decoded.pixels.size()), VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		staging->map();
+		staging->writeToBuffer(decoded.pixels.data(), decoded.pixels.size());
+
+		uint32_t levels = entry.mipCount - decoded.topMip;
+		std::vector<VkBufferImageCopy> regions(levels);
+		for (uint32_t level = 0; level < levels; level++)
+		{
+			VkBufferImageCopy& region = regions[level];
+			region = VkBufferImageCopy{};
+			region.bufferOffset = decoded.levelOffsets[level];
+			region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+			region.imageExtent = { std::max(entry.width >> (decoded.topMip + level), 1u), std::max(entry.height >> (decoded.topMip + level), 1u), 1 };
+		}
+
+		VkImageSubresourceRange subresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, levels, 0, 1 };
+		device.transitionImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
+		cmd::copyBufferToImage(commandBuffer, staging->getBuffer(), image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, levels, regions.data());
+		device.transitionImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
+		// copy runs with this frame
+		device.getDeletionQueue().retire(std::move(staging));
+
+		bindChain(entry, decoded.topMip, image, memory);
+		stats.uploadedBytes += decoded.pixels.size();
+	}
+
+	void TextureStreamer::shrink(Entry& entry, uint32_t topMip, VkCommandBuffer commandBuffer)
+	{
+		VkImage image;
+		VkDeviceMemory memory;
+		createChain(entry, topMip, image, memory);
+
+		// coarse levels are already on gpu, copied over instead of decoded again
+		uint32_t levels = entry.mipCount - topMip;
+		uint32_t skipped = topMip - entry.residentMip;
+		std::array<VkImageMemoryBarrier, 2> barriers{};
+		for (auto& barrier : barriers)
+		{
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		}
+		// earlier frames may still sample old chain
+		barriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barriers[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barriers[0].image = entry.image->image;
+		barriers[0].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, skipped, levels, 0, 1 };
+		barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barriers[1].srcAccessMask = 0;
+		barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barriers[1].image = image;
+		barriers[1].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, levels, 0, 1 };
+		cmd::pipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
+			static_cast<uint32_t>(barriers.size()), barriers.data());
+
+		std::vector<VkImageCopy> copies(levels);
+		for (uint32_t level = 0; level < levels; level++)
+		{
+			VkImageCopy& copy = copies[level];
+			copy = VkImageCopy{};
+			copy.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, skipped + level, 0, 1 };
+			copy.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+			copy.extent = { std::max(entry.width >> (topMip + level), 1u), std::max(entry.height >> (topMip + level), 1u), 1 };
+		}
+		cmd::copyImage(commandBuffer, entry.image->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, levels, copies.data());
+		device.transitionImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, barriers[1].subresourceRange);
+
+		bindChain(entry, topMip, image, memory);
+	}
+
+	void TextureStreamer::createChain(const Entry& entry, uint32_t topMip, VkImage& image, VkDeviceMemory& memory)
+	{
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.extent.width = std::max(entry.width >> topMip, 1u);
+		imageInfo.extent.height = std::max(entry.height >> topMip, 1u);
+		imageInfo.extent.depth = 1;
+		imageInfo.mipLevels = entry.mipCount - topMip;
+		imageInfo.arrayLayers = 1;
+		imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, memory);
+	}
+
+	void TextureStreamer::bindChain(Entry& entry, uint32_t topMip, VkImage image, VkDeviceMemory memory)
+	{
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, entry.mipCount - topMip, 0, 1 };
+		VkImageView view;
+		if (vkCreateImageView(device.getLogicalDevice(), &viewInfo, nullptr, &view) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create texture image view!");
+		}
+
+		Image& target = *entry.image;
+		// placeholders are shared, chains are retired since other frame slot's material set still points at them
+		if (entry.residentMip < entry.mipCount)
+		{
+			VkDevice logicalDevice = device.getLogicalDevice();
+			device.getDeletionQueue().retire([logicalDevice, oldImage = target.image, oldMemory = target.deviceMemory, oldView = target.view]() {
+				vkDestroyImageView(logicalDevice, oldView, nullptr);
+				vkDestroyImage(logicalDevice, oldImage, nullptr);
+				vkFreeMemory(logicalDevice, oldMemory, nullptr);
+			});
+		}
+
+		stats.residentBytes -= entry.bytes;
+		entry.bytes = chainBytes(entry, topMip);
+		stats.residentBytes += entry.bytes;
+		entry.residentMip = topMip;
+
+		target.image = image;
+		target.deviceMemory = memory;
+		target.view = view;
+		target.width = std::max(entry.width >> topMip, 1u);
+		target.height = std::max(entry.height >> topMip, 1u);
+		target.mipLevels = entry.mipCount - topMip;
+		target.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		target.updateDescriptor();
+		entry.model->materialTexturesDirty.fill(true);
+	}
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "Device.h"
+
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+namespace jhb {
+	class Model;
+	struct Image;
+
+	// mips of glTF textures are streamed instead of whole chains being loaded at startup. every image starts on a shared 1x1 placeholder,
+	// workers decode files and build mips on cpu, render thread uploads chains down to the mip screen density of materials asks for.
+	// resident chains are shrunk back to their tail in lru order when they don't fit budget, VK_EXT_memory_budget lowers it when available
+	class TextureStreamer
+	{
+	public:
+		// chains from this size down are loaded first and never evicted
+		static constexpr uint32_t TAIL_SIZE = 64;
+		// decoded bytes uploaded in one frame, rest waits for next frames
+		static constexpr VkDeviceSize UPLOAD_BYTES_PER_FRAME = 32ull * 1024 * 1024;
+
+		struct Stats {
+			VkDeviceSize residentBytes = 0;
+			// min of budgetBytes and what memory budget extension leaves for textures
+			VkDeviceSize budgetBytes = 0;
+			uint32_t imageCount = 0;
+			// images with every mip they asked for
+			uint32_t satisfiedCount = 0;
+			uint32_t pendingLoads = 0;
+			// whole run
+			VkDeviceSize uploadedBytes = 0;
+			uint64_t evictions = 0;
+			bool memoryBudgetExtension = false;
+		};
+
+	public:
+		explicit TextureStreamer(Device& device, uint32_t threadCount = 2);
+		~TextureStreamer();
+
+		TextureStreamer(const TextureStreamer&) = delete;
+		TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+		// binds placeholder to every image with Image::streamPath and queues its tail, call before material sets are written
+		void addModel(const std::shared_ptr<Model>& model);
+
+		// every image falls back to its tail until requested again this frame
+		void beginFrame();
+		// image is sampled where one uv unit covers uvPixels on screen
+		void request(Image& image, float uvPixels);
+		// shrinks lru chains over budget, uploads finished decodes and queues new ones.
+		// records copies into frame's command buffer outside render passes, dirty models rewrite material sets after this
+		void update(VkCommandBuffer commandBuffer);
+
+		const Stats& getStats() const { return stats; }
+		void printReport() const;
+
+	public:
+		// configurable part of budget
+		VkDeviceSize budgetBytes = 512ull * 1024 * 1024;
+
+	private:
+		struct Entry {
+			Model* model;
+			Image* image;
+			std::string path;
+			uint32_t width, height;
+			uint32_t mipCount;
+			uint32_t tailMip;
+			// first level of full chain that is resident, mipCount while placeholder is bound
+			uint32_t residentMip;
+			// finest level asked this frame
+			uint32_t wantedMip;
+			uint64_t lastUsed = 0;
+			VkDeviceSize bytes = 0;
+			bool normalMap = false;
+			bool loading = false;
+			uint32_t loadingMip = 0;
+			bool failed = false;
+		};
+
+		struct Job {
+			uint32_t entry;
+			std::string path;
+			uint32_t topMip;
+		};
+
+		struct Decoded {
+			uint32_t entry;
+			uint32_t topMip;
+			// rgba8 levels topMip .. mipCount - 1 back to back, empty when file failed to load
+			std::vector<uint8_t> pixels;
+			std::vector<VkDeviceSize> levelOffsets;
+		};
+
+		void workerLoop();
+		static void decode(const Job& job, Decoded& decoded);
+		void createPlaceholder(const uint8_t* rgba, VkImage& image, VkDeviceMemory& memory, VkImageView& view);
+
+		VkDeviceSize chainBytes(const Entry& entry, uint32_t topMip) const;
+		VkDeviceSize queryBudget();
+		// shrinks least recently used chains until extra more bytes fit, keep is never touched
+		bool makeRoom(VkDeviceSize extra, uint32_t keep, VkCommandBuffer commandBuffer);
+		void upload(Entry& entry, Decoded& decoded, VkCommandBuffer commandBuffer);
+		void shrink(Entry& entry, uint32_t topMip, VkCommandBuffer commandBuffer);
+		// creates chain of levels topMip .. mipCount - 1, left in undefined layout
+		void createChain(const Entry& entry, uint32_t topMip, VkImage& image, VkDeviceMemory& memory);
+		// old chain is retired and material sets of entry's model are marked dirty
+		void bindChain(Entry& entry, uint32_t topMip, VkImage image, VkDeviceMemory memory);
+
+	private:
+		Device& device;
+
+		std::vector<std::shared_ptr<Model>> models;
+		std::vector<Entry> entries;
+		uint64_t frameCounter = 0;
+
+		// white, and flat tangent space normal
+		VkImage placeholderImages[2] = {};
+		VkDeviceMemory placeholderMemory[2] = {};
+		VkImageView placeholderViews[2] = {};
+
+		std::vector<std::thread> workers;
+		std::mutex mutex;
+		std::condition_variable wakeCondition;
+		std::deque<Job> jobs;
+		std::vector<Decoded> finished;
+		bool quit = false;
+		// taken from finished, uploaded over next frames
+		std::deque<Decoded> ready;
+
+		Stats stats;
+	};
+}
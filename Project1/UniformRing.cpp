@@ -0,0 +1,37 @@
+#include "UniformRing.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace jhb {
+	UniformRing::UniformRing(Device& device, VkDeviceSize frameCapacity) : device{ device }
+	{
+		alignment = std::max<VkDeviceSize>(device.properties.limits.minUniformBufferOffsetAlignment, 1);
+		this->frameCapacity = (frameCapacity + alignment - 1) & ~(alignment - 1);
+
+		// coherent, so writes need no flush
+		buffer = std::make_unique<Buffer>(device, this->frameCapacity, SwapChain::MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		buffer->map();
+	}
+
+	void UniformRing::beginFrame(int frameIndex)
+	{
+		peakFrameUsage = std::max(peakFrameUsage, head - frameBegin);
+		frameBegin = frameIndex * frameCapacity;
+		head = frameBegin;
+	}
+
+	uint32_t UniformRing::push(const void* data, VkDeviceSize size)
+	{
+		VkDeviceSize offset = (head + alignment - 1) & ~(alignment - 1);
+		if (offset + size > frameBegin + frameCapacity)
+		{
+			throw std::runtime_error("failed to allocate uniform block, frame capacity exceeded!");
+		}
+
+		memcpy(static_cast<char*>(buffer->getMappedMemory()) + offset, data, size);
+		head = offset + size;
+		return static_cast<uint32_t>(offset);
+	}
+}
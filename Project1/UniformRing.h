@@ -0,0 +1,44 @@
+#pragma once
+#include "Device.h"
+#include "Buffer.h"
+#include "SwapChain.h"
+
+#include <memory>
+
+namespace jhb {
+	// one persistently mapped uniform buffer split into a region per frame in flight.
+	// systems bump allocate aligned blocks from current frame's region and bind them with dynamic offsets,
+	// region of frame N is reused only after its fence is waited in beginFrame, so nothing in flight is overwritten
+	class UniformRing
+	{
+	public:
+		UniformRing(Device& device, VkDeviceSize frameCapacity);
+		~UniformRing() = default;
+
+		UniformRing(const UniformRing&) = delete;
+		UniformRing& operator=(const UniformRing&) = delete;
+
+		// after renderer.beginFrame, rewinds region of this frame
+		void beginFrame(int frameIndex);
+
+		// returns dynamic offset of copied block
+		uint32_t push(const void* data, VkDeviceSize size);
+		template<typename T>
+		uint32_t push(const T& data) { return push(&data, sizeof(T)); }
+
+		// descriptor for UNIFORM_BUFFER_DYNAMIC binding, range is size of struct shader sees
+		VkDescriptorBufferInfo descriptorInfo(VkDeviceSize range) const { return { buffer->getBuffer(), 0, range }; }
+		VkDeviceSize getFrameCapacity() const { return frameCapacity; }
+		VkDeviceSize getPeakFrameUsage() const { return peakFrameUsage; }
+
+	private:
+		Device& device;
+		std::unique_ptr<Buffer> buffer;
+		VkDeviceSize frameCapacity;
+		VkDeviceSize alignment;
+
+		VkDeviceSize frameBegin = 0;
+		VkDeviceSize head = 0;
+		VkDeviceSize peakFrameUsage = 0;
+	};
+}
@@ -4,7 +4,7 @@
 #include "External/Imgui/imgui_impl_glfw.h"
 #include <stdexcept>
 
-jhb::Window::Window(int w, int h, const std::string name) : width{ w }, height{ h }, windowName{ name }
+jhb::Window::Window(int w, int h, const std::string name, bool visible) : width{ w }, height{ h }, visible{ visible }, windowName{ name }
 {
 	initWindow();
 	camera = std::make_unique<jhb::Camera>(0.8f);
@@ -49,7 +49,8 @@ void jhb::Window::initWindow()
 	glfwInit();
 
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+	glfwWindowHint(GLFW_RESIZABLE, visible ? GLFW_TRUE : GLFW_FALSE);
+	glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
 
 	window = glfwCreateWindow(width, height, "Vulkan", nullptr, nullptr);
 	glfwSetWindowUserPointer(window, this);
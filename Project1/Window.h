@@ -20,7 +20,8 @@ namespace jhb {
 
 
 	public:
-		Window(int w, int h, const std::string name);
+		// hidden window still gets a swapchain, for benchmark runs nobody watches
+		Window(int w, int h, const std::string name, bool visible = true);
 		~Window();
 
 		Window(const Window&) = delete;
@@ -61,6 +62,7 @@ namespace jhb {
 
 		bool framebufferResized = false;
 		bool isMousePressed = false;
+		bool visible = true;
 		
 		glm::vec2 prevPos{0.f};
 		std::string windowName;
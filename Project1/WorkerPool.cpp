@@ -0,0 +1,86 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+namespace jhb {
+	WorkerPool::WorkerPool(uint32_t threadCount)
+	{
+		if (threadCount == 0)
+		{
+			threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+		}
+		// calling thread is one of them
+		for (uint32_t i = 1; i < threadCount; i++)
+		{
+			workers.emplace_back(&WorkerPool::workerLoop, this);
+		}
+	}
+
+	WorkerPool::~WorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			quit = true;
+		}
+		wakeCondition.notify_all();
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+	}
+
+	void WorkerPool::parallelFor(uint32_t count, const std::function<void(uint32_t)>& job)
+	{
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			currentJob = &job;
+			jobCount = count;
+			nextJob = 0;
+			busyWorkers = static_cast<uint32_t>(workers.size());
+			generation++;
+		}
+		wakeCondition.notify_all();
+
+		for (uint32_t i = nextJob++; i < count; i = nextJob++)
+		{
+			job(i);
+		}
+
+		// every worker has to see this generation before next one starts
+		std::unique_lock<std::mutex> lock{ mutex };
+		doneCondition.wait(lock, [this]() { return busyWorkers == 0; });
+		currentJob = nullptr;
+	}
+
+	void WorkerPool::workerLoop()
+	{
+		uint64_t seenGeneration = 0;
+		while (true)
+		{
+			const std::function<void(uint32_t)>* job;
+			uint32_t count;
+			{
+				std::unique_lock<std::mutex> lock{ mutex };
+				wakeCondition.wait(lock, [&]() { return quit || generation != seenGeneration; });
+				if (quit)
+				{
+					return;
+				}
+				seenGeneration = generation;
+				job = currentJob;
+				count = jobCount;
+			}
+
+			for (uint32_t i = nextJob++; i < count; i = nextJob++)
+			{
+				(*job)(i);
+			}
+
+			std::lock_guard<std::mutex> lock{ mutex };
+			if (--busyWorkers == 0)
+			{
+				doneCondition.notify_one();
+			}
+		}
+	}
+}
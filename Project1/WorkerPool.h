@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+namespace jhb {
+	// persistent threads for data parallel cpu work of a frame, calling thread takes jobs too.
+	// one parallelFor at a time, jobs must not call back into same pool
+	class WorkerPool
+	{
+	public:
+		// 0 uses every hardware thread
+		explicit WorkerPool(uint32_t threadCount = 0);
+		~WorkerPool();
+
+		WorkerPool(const WorkerPool&) = delete;
+		WorkerPool& operator=(const WorkerPool&) = delete;
+
+		uint32_t getThreadCount() const { return static_cast<uint32_t>(workers.size()) + 1; }
+		// runs job(0 .. jobCount - 1) on workers and calling thread, returns when all are done
+		void parallelFor(uint32_t jobCount, const std::function<void(uint32_t)>& job);
+
+	private:
+		void workerLoop();
+
+	private:
+		std::vector<std::thread> workers;
+		std::mutex mutex;
+		std::condition_variable wakeCondition;
+		std::condition_variable doneCondition;
+		const std::function<void(uint32_t)>* currentJob = nullptr;
+		uint32_t jobCount = 0;
+		std::atomic<uint32_t> nextJob{ 0 };
+		uint32_t busyWorkers = 0;
+		uint64_t generation = 0;
+		bool quit = false;
+	};
+}
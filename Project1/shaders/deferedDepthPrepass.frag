@@ -0,0 +1,17 @@
+#version 450
+
+layout (location = 3) in vec2 fraguv;
+
+layout (set = 2, binding = 0) uniform sampler2D samplerColorMap;
+
+layout (constant_id = 0) const bool ALPHA_MASK = false;
+layout (constant_id = 1) const float ALPHA_MASK_CUTOFF = 0.0f;
+
+// depth only, opaque materials compile to an empty shader and keep early depth test
+void main() {
+	if (ALPHA_MASK) {
+		if (texture(samplerColorMap, fraguv).a < ALPHA_MASK_CUTOFF) {
+			discard;
+		}
+	}
+}
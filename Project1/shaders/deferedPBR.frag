@@ -14,7 +14,7 @@ layout (set = 0, input_attachment_index = 4, binding = 4) uniform subpassInput i
 
 
 layout (set = 2, binding = 0) uniform sampler2D samplerBRDFLUT;
-layout (set = 2, binding = 1) uniform samplerCube samplerIrradiance;
+// binding 1 irradiance cube is only for forward pbr.frag, diffuse here comes from irradianceSH
 layout (set = 2, binding = 2) uniform samplerCube prefilteredMap;
 layout (set = 3, binding = 0) uniform samplerCube shadowMap;
 
@@ -32,9 +32,16 @@ layout(set=1, binding = 0) uniform GlobalUbo{
 	int numLights;
 	float exposure;
 	float gamma;
+	mat4 viewProjection;
+	mat4 prevViewProjection;
+	vec4 irradianceSH[9];
 } ubo;
 
 layout (location = 0) out vec4 outColor;
+#ifdef TAA
+// compiled with -DTAA for the taa render pass, gbuffer is 1x and scene color is resolved in taaResolve.frag
+layout (location = 1) out vec4 outVelocity;
+#endif
 
 #define PI 3.1415926535897932384626433832795
 
@@ -111,6 +118,21 @@ vec3 SpecularAndDiffuseContribution(vec3 L, vec3 V, vec3 N, vec3 F0, float metal
 	return color;
 }
 
+// coefficients are convolved on projection in shirradiance.comp
+vec3 irradianceFromSH(vec3 n)
+{
+	vec3 result = ubo.irradianceSH[0].rgb * 0.282095
+		+ ubo.irradianceSH[1].rgb * 0.488603 * n.y
+		+ ubo.irradianceSH[2].rgb * 0.488603 * n.z
+		+ ubo.irradianceSH[3].rgb * 0.488603 * n.x
+		+ ubo.irradianceSH[4].rgb * 1.092548 * n.x * n.y
+		+ ubo.irradianceSH[5].rgb * 1.092548 * n.y * n.z
+		+ ubo.irradianceSH[6].rgb * 0.315392 * (3.0 * n.z * n.z - 1.0)
+		+ ubo.irradianceSH[7].rgb * 1.092548 * n.x * n.z
+		+ ubo.irradianceSH[8].rgb * 0.546274 * (n.x * n.x - n.y * n.y);
+	return max(result, vec3(0.0));
+}
+
 vec3 getIBLContribution(vec3 V, vec3 N, vec3 R,float roughness, float metallic, vec3 baseColor)
 {
 	vec3 f0 = vec3(0.04);
@@ -124,7 +146,7 @@ vec3 getIBLContribution(vec3 V, vec3 N, vec3 R,float roughness, float metallic,
 	vec2 brdf = texture(samplerBRDFLUT, vec2(max(dot(N, V), 0.0), roughness)).rg;
 
 	vec3 specularLight = textureLod(prefilteredMap, R, lod).rgb; // same as reflection
-	vec3 diffuseLight = texture(samplerIrradiance, N).rgb; // same as irradiance
+	vec3 diffuseLight = irradianceFromSH(N); // same as irradiance
 
 	// Specular reflectance
 	vec3 specular = specularLight * (specularColor * brdf.x + brdf.y);
@@ -154,9 +176,12 @@ void main() {
 
 	vec3 Lo = vec3(0.0);
 
-	// per light
-	vec3 L = normalize(ubo.pointLights[0].position.xyz - fragPosWorld);
-	Lo += SpecularAndDiffuseContribution(L, V, N, F0, metallic, roughness, ubo.pointLights[0].color, albedo);
+	// per light, only light 0 casts shadow
+	for (int i = 0; i < ubo.numLights; i++)
+	{
+		vec3 L = normalize(ubo.pointLights[i].position.xyz - fragPosWorld);
+		Lo += SpecularAndDiffuseContribution(L, V, N, F0, metallic, roughness, ubo.pointLights[i].color, albedo);
+	}
 
 	vec3 iblColor = getIBLContribution(V, N, R, roughness, metallic, albedo.rgb);
 
@@ -197,4 +222,24 @@ void main() {
 
 	outColor = vec4(color, 1.0);
 	outColor *= shadow;
+
+#ifdef TAA
+	outVelocity = vec4(0.0);
+	vec4 currClip, prevClip;
+	if (albedo.a >= 0.0)
+	{
+		currClip = ubo.viewProjection * vec4(fragPosWorld, 1.0);
+		prevClip = ubo.prevViewProjection * vec4(fragPosWorld, 1.0);
+	}
+	else
+	{
+		// sky writes no position. it is at infinity, so view direction with w = 0 only moves with camera rotation
+		vec4 rayPoint = inverse(ubo.viewProjection) * vec4(fraguv * 2.0 - 1.0, 0.5, 1.0);
+		vec3 viewDir = rayPoint.xyz / rayPoint.w - ubo.invView[3].xyz;
+		currClip = ubo.viewProjection * vec4(viewDir, 0.0);
+		prevClip = ubo.prevViewProjection * vec4(viewDir, 0.0);
+	}
+	// ndc to uv space
+	outVelocity.xy = (currClip.xy / currClip.w - prevClip.xy / prevClip.w) * 0.5;
+#endif
 }
@@ -47,6 +47,13 @@ layout (location = 3) out vec4 outAlbedo;
 layout (location = 4) out vec4 outMaterial;
 layout (location = 5) out vec4 outEmmisive;
 
+// g of instance data is lod level + 1 when lod debug view is on
+vec3 lodDebugColor(float level)
+{
+	const vec3 colors[5] = vec3[](vec3(1, 1, 1), vec3(0.2, 1, 0.2), vec3(0.2, 0.6, 1), vec3(1, 1, 0.2), vec3(1, 0.3, 0.2));
+	return colors[clamp(int(level + 0.5) - 1, 0, 4)];
+}
+
 vec3 calculateNormal()
 {
 	vec3 N = normalize(fragNormalWorld);
@@ -54,7 +61,10 @@ vec3 calculateNormal()
 	vec3 B = cross(N, T);
 	mat3 TBN = mat3(T, B, N);
 
-	vec3 normaltext =normalize(texture(samplerNormalMap, fraguv).xyz*2.0 - 1.0);
+	// z is rebuilt so two channel (bc5, eac rg11) normal maps work too
+	vec3 normaltext;
+	normaltext.xy = texture(samplerNormalMap, fraguv).xy*2.0 - 1.0;
+	normaltext.z = sqrt(max(1.0 - dot(normaltext.xy, normaltext.xy), 0.0));
 	return TBN*normaltext;
 }
 
@@ -66,6 +76,11 @@ void main() {
 		}
 	}
 
+	if (fg > 0.5)
+	{
+		outAlbedo.rgb *= lodDebugColor(fg);
+	}
+
 	outPosition = vec4(fragPosWorld, 1.0);
 	outNormal = vec4(normalize(calculateNormal())*0.5+0.5,0);
 
@@ -81,6 +96,16 @@ void main() {
 		outMaterial.g = 1;
 	}
 	
+	// stress scene material variants, 0 keeps model's own
+	if (fragroughness > 0.0)
+	{
+		outMaterial.g = fragroughness;
+	}
+	if (fragmetallic > 0.0)
+	{
+		outMaterial.b = fragmetallic;
+	}
+
 	outMaterial.r=1;
 	if(isOcclusion)
 	{
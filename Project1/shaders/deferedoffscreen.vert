@@ -25,6 +25,9 @@ layout (location = 8) out float fg;
 layout (location = 9) out float fb;
 layout (location = 10) out vec3 outlightpos;
 
+// depth prepass and gbuffer pipelines both use this shader with different fragment stages, gbuffer tests equal against prepass depth
+invariant gl_Position;
+
 struct PointLight{
 	vec4 position; // w is  just for allign
 	vec4 color; // w is intensity
@@ -24,6 +24,8 @@ layout (location = 7) out float fr;
 layout (location = 8) out float fg;
 layout (location = 9) out float fb;
 layout (location = 10) out vec3 outlightpos;
+// batch slot of this instance for picking, flat so it is never interpolated
+layout (location = 11) flat out uint fragInstanceSlot;
 
 struct PointLight{
 	vec4 position; // w is  just for allign
@@ -50,6 +52,8 @@ void main(){
 	fr = r;
 	fg = g;
 	fb = b;
+	// slot is written as float in r, round instead of truncating
+	fragInstanceSlot = uint(r + 0.5);
 	vec4 positionWorld = push.model * vec4(position + instancePos, 1.0);
 	gl_Position =  ubo.projection * ubo.view * positionWorld;
 	fraguv = uv;
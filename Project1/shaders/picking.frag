@@ -10,6 +10,7 @@ layout (location = 6) in float fragmetallic;
 layout (location = 7) in float fr;
 layout (location = 8) in float fg;
 layout (location = 9) in float fb;
+layout (location = 11) flat in uint fragInstanceSlot;
 
 layout (location = 0) out uvec3 outColor;
 
@@ -18,5 +19,5 @@ layout(push_constant) uniform fragmentPushConstants {
 } u_pushConstants;
 
 void main() {
-	outColor = uvec3(u_pushConstants.objId+fr);
+	outColor = uvec3(u_pushConstants.objId + fragInstanceSlot);
 }
@@ -0,0 +1,57 @@
+#version 450
+
+layout (location = 0) in vec2 fraguv;
+
+layout (set = 0, binding = 0) uniform sampler2D currentColor;
+layout (set = 0, binding = 1) uniform sampler2D historyColor;
+layout (set = 0, binding = 2) uniform sampler2D velocityMap;
+
+layout(push_constant) uniform Push{
+	vec2 texelSize;
+	float feedback;
+	int resetHistory;
+} push;
+
+layout (location = 0) out vec4 outColor; // swapchain
+layout (location = 1) out vec4 outHistory; // history for next frame
+
+void main()
+{
+	vec3 current = texture(currentColor, fraguv).rgb;
+
+	if (push.resetHistory != 0)
+	{
+		outColor = vec4(current, 1.0);
+		outHistory = outColor;
+		return;
+	}
+
+	// 3x3 neighborhood box of current frame, history outside of this box is ghosting
+	vec3 minColor = current;
+	vec3 maxColor = current;
+	for (int x = -1; x <= 1; x++)
+	{
+		for (int y = -1; y <= 1; y++)
+		{
+			vec3 neighbor = texture(currentColor, fraguv + vec2(x, y) * push.texelSize).rgb;
+			minColor = min(minColor, neighbor);
+			maxColor = max(maxColor, neighbor);
+		}
+	}
+
+	vec2 velocity = texture(velocityMap, fraguv).xy;
+	vec2 prevUV = fraguv - velocity;
+
+	vec3 history = texture(historyColor, prevUV).rgb;
+	history = clamp(history, minColor, maxColor);
+
+	// disocclusion from outside of screen, use only current frame
+	float feedback = push.feedback;
+	if (any(lessThan(prevUV, vec2(0.0))) || any(greaterThan(prevUV, vec2(1.0))))
+	{
+		feedback = 0.0;
+	}
+
+	outColor = vec4(mix(current, history, feedback), 1.0);
+	outHistory = outColor;
+}